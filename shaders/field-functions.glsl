@@ -0,0 +1,214 @@
+// The numbered vector field functions, the same as in src/FieldFunctions.hpp,
+// keep the two in sync. Included by vector-field.comp, and by particle.comp
+// when it evaluates the field at every particle.
+//
+// FIELD_FUNCTION selects the function and is defined by the program when the
+// shader is compiled, so only that one ends up in the binary.
+#ifndef FIELD_FUNCTION
+#define FIELD_FUNCTION 0
+#endif
+
+const float PI = 3.14159265358979;
+
+///////////////////
+// Helper Functions
+////////////////////
+
+// The same as float(int(x) % 2) in C++, which keeps the sign of x
+float truncMod2(float x){
+	float t = trunc(x);
+	return t - 2.0 * trunc(t * 0.5);
+}
+
+vec2 toClipSpace(vec2 p, float width, float height){
+	return 2.0 * p / vec2(width, height) - 1.0;
+}
+
+// The signed distance to an arc in x and its gradient in yz.
+// sc = sin/cos of aperture
+vec3 sdgArc(vec2 p, vec2 sc, float ra, float rb){
+	vec2 q = p;
+	float s = sign(p.x);
+	p.x = abs(p.x);
+
+	if(sc.y * p.x > sc.x * p.y){
+		vec2 w = p - ra * sc;
+		float d = length(w);
+		return vec3(d - rb, vec2(s * w.x, w.y) / d);
+	} else {
+		float l = length(q);
+		float w = l - ra;
+		return vec3(abs(w) - rb, sign(w) * q / l);
+	}
+}
+
+// The signed distance to a cross in x and its gradient in yz.
+vec3 sdgCross(vec2 p, vec2 b){
+	vec2 s = sign(p);
+	p = abs(p);
+
+	bool swap = p.y > p.x;
+	vec2 q = (swap ? p.yx : p) - b;
+	float h = max(q.x, q.y);
+
+	bool inside = h < 0.0;
+	vec2 o = max(inside ? vec2(b.y - b.x - q.x, -q.y) : q, 0.0);
+	float l = length(o);
+
+	vec3 r = (inside && -q.x < l) ? vec3(-q.x, 1.0, 0.0) : vec3(l, o / l);
+	return vec3(sign(h) * r.x, s * (swap ? r.zy : r.yz));
+}
+
+// Follow the border on the outside and the gradient on the inside.
+vec2 flowAlongSdf(vec3 dg, float a){
+	vec2 grad = dg.yz;
+	return a * (dg.x <= 0.0 ? grad : vec2(-grad.y, grad.x));
+}
+
+#if FIELD_FUNCTION == 25
+float f25(float x, float y){
+	return sin(x) + sin(2.0 * x) * x / 4.0 + sin(3.0 * x) * y / 6.0 + sin(4.0 * x) * x / 8.0 + sin(5.0 * x) * y / 10.0;
+}
+
+float df25(float x, float y){
+	float h = 0.001;
+	return (f25(x + h, y) - f25(x - h, y)) / (2.0 * h);
+}
+#endif
+
+#if FIELD_FUNCTION == 26 || FIELD_FUNCTION == 27
+float f26(float x, float y){
+	return sin(x) + cos(2.0 * x) * y / 4.0 + sin(3.0 * x) * x / 6.0 + cos(4.0 * x) * x / 8.0 + sin(5.0 * x) * y / 10.0;
+}
+
+float df26(float x, float y){
+	float h = 0.001;
+	return (f26(x + h, y) - f26(x - h, y)) / (2.0 * h);
+}
+#endif
+
+///////////////////
+// Field Function
+////////////////////
+
+vec2 field(float x, float y, float width, float height){
+	vec2 clip = toClipSpace(vec2(x, y), width, height);
+	float a = 0.01;
+	float twirl_size = 20.0;
+	float radial_exponent = 1.5;
+	float len = length(clip);
+	float radial_coeff = pow(len, radial_exponent);
+
+#if FIELD_FUNCTION == 0
+	return 0.01 * vec2(sin(x * PI / 9.0), cos(y * PI / 9.0));
+#elif FIELD_FUNCTION == 1
+	return vec2(0.01 * sin(x * PI / 9.0) + 0.01, 0.0);
+#elif FIELD_FUNCTION == 2
+	float max_length = sqrt(width * width + height * height) / 2.0;
+	return 0.01 * (vec2(x, y) - vec2(width, height) / 2.0) / max_length;
+#elif FIELD_FUNCTION == 3
+	return vec2((-1.0 + 2.0 * truncMod2(y)) * 0.01, 0.0);
+#elif FIELD_FUNCTION == 4
+	float x_ = x / width * 0.01;
+	float y_ = y / height * 0.01;
+	return vec2(x_ + y_, y_ - x_);
+#elif FIELD_FUNCTION == 5
+	return 0.01 * vec2(sin(x * PI / 4.0), cos(y * PI / 4.0));
+#elif FIELD_FUNCTION == 6
+	return 0.01 * vec2(atan(x - width), atan(y - height));
+#elif FIELD_FUNCTION == 7 || FIELD_FUNCTION == 8
+	return 0.01 * vec2(-1.0 + 2.0 * truncMod2(x), -1.0 + 2.0 * truncMod2(y));
+#elif FIELD_FUNCTION == 9
+	return 0.01 * vec2(sin(5.0 * y + x), cos(5.0 * x - y));
+#elif FIELD_FUNCTION == 10
+	float w = 2.0 * PI / 5.0;
+	vec2 mid = trunc(vec2(x, y) - vec2(width, height) / 2.0);
+	float d = length(mid) + 0.01;
+	return 2.0 * 0.001 * vec2(cos(w * 100.0 / d), sin(w * 100.0 / d));
+#elif FIELD_FUNCTION == 11
+	vec2 mid = trunc(vec2(x, y) - vec2(width, height) / 2.0);
+	float r2 = dot(mid, mid);
+	return vec2(0.01 * y / r2, -0.01 * x / r2);
+#elif FIELD_FUNCTION == 12 || FIELD_FUNCTION == 13
+	float s = FIELD_FUNCTION == 12 ? 0.01 : 0.001;
+	vec2 mid = trunc(vec2(x, y) - vec2(width, height) / 2.0);
+	float r2 = dot(mid, mid) + s;
+	return vec2(s * mid.y / r2 - s * mid.x, -1.0 * s * mid.x / r2 - s * mid.y);
+#elif FIELD_FUNCTION == 14
+	vec2 mid = trunc(vec2(x, y) - vec2(width, height) / 2.0);
+	return vec2(0.001 * mid.y, -1.0 * 0.001 * mid.x);
+#elif FIELD_FUNCTION == 15
+	return a * vec2(-2.0 * truncMod2(x) + 1.0, -2.0 * truncMod2(y) + 1.0);
+#elif FIELD_FUNCTION == 16
+	vec2 v = vec2(-2.0 * truncMod2(x) + 1.0, -2.0 * truncMod2(y) + 1.0);
+	return a * v * vec2(cos(x * PI * 0.236123), cos(y * PI * 0.872766836123));
+#elif FIELD_FUNCTION == 17
+	vec2 v = vec2(-2.0 * truncMod2(x) + 1.0, -2.0 * truncMod2(y) + 1.0);
+	return a * v * vec2(y / height, x / width);
+#elif FIELD_FUNCTION == 18
+	return a * clip * clip / (0.1 + clip.yx);
+#elif FIELD_FUNCTION == 19
+	return a * (vec2(-clip.y, clip.x) / len + radial_coeff * vec2(sin(twirl_size * y), cos(twirl_size * x)));
+#elif FIELD_FUNCTION == 20
+	return a * (clip / len + radial_coeff * vec2(sin(twirl_size * y), cos(twirl_size * x)));
+#elif FIELD_FUNCTION == 21
+	return a * (clip.yx / (len + 0.01) + radial_coeff * vec2(sin(twirl_size * x), sin(twirl_size * y)));
+#elif FIELD_FUNCTION == 22
+	return a * (vec2(-clip.y, clip.x) / (len + 0.01) + radial_coeff * vec2(atan(twirl_size * x), atan(twirl_size * y)));
+#elif FIELD_FUNCTION == 23
+	return a * (vec2(clip.y, -clip.x) / (len + 0.01) + radial_coeff * sin(2.0 * twirl_size * y));
+#elif FIELD_FUNCTION == 24
+	vec2 f1 = sin(clip);
+	vec2 f2 = sin(2.0 * clip);
+	vec2 f3 = sin(3.0 * clip);
+	vec2 f4 = sin(4.0 * clip);
+	vec2 f5 = sin(5.0 * clip);
+	return a * (f1 + f2 * clip.y / 4.0 + f3 * clip.x / 6.0 + f4 * clip.x / 8.0 + f5 * clip.y / 10.0);
+#elif FIELD_FUNCTION == 25
+	return a * vec2(df25(clip.x, clip.y), df25(clip.y, clip.x));
+#elif FIELD_FUNCTION == 26
+	return a * (vec2(df26(clip.y, clip.x), -df26(clip.x, clip.y)) / (len + 0.01) + radial_coeff * vec2(sin(twirl_size * y), sin(twirl_size * x)));
+#elif FIELD_FUNCTION == 27
+	return a * (-vec2(df26(clip.y, clip.x), df26(clip.x, clip.y)) + radial_coeff * vec2(sin(twirl_size * y), sin(twirl_size * x)));
+#elif FIELD_FUNCTION == 28
+	return a * vec2(cos(clip.x) * sin(clip.y), tanh(clip.y));
+#elif FIELD_FUNCTION == 29
+	return a * vec2(tanh(clip.x) * tanh(clip.y), -tanh(clip.y));
+#elif FIELD_FUNCTION == 30
+	vec2 t = tan(clip * PI / 2.12937678);
+	return a * sin(t) * cos(t.yx);
+#elif FIELD_FUNCTION == 31
+	return a * vec2(sin(tan(clip.y * PI / 3.1976123)) * cos(tan(clip.x * PI / 0.82734)),
+	                sin(tan(clip.y * PI / 4.123871)) * cos(tan(clip.x * PI / 2.7236)));
+#elif FIELD_FUNCTION == 32 || FIELD_FUNCTION == 33
+	vec2 offset = FIELD_FUNCTION == 32 ? vec2(0.5, 0.0) : vec2(0.5, -0.2);
+	vec2 p1 = clip - offset;
+	vec2 p2 = clip + offset;
+	vec2 s = p1 / dot(p1, p1) + p2 / dot(p2, p2);
+	return FIELD_FUNCTION == 32 ? a * vec2(-s.y, s.x) : a * vec2(s.y, -s.x);
+#elif FIELD_FUNCTION == 34
+	return a * clip.yx * clip.yx;
+#elif FIELD_FUNCTION == 35
+	return a * (clip.yx * clip.yx + radial_coeff * vec2(sin(twirl_size * x), sin(twirl_size * y)));
+#elif FIELD_FUNCTION == 36
+	return a * (clip.yx * clip + radial_coeff * vec2(sin(2.0 * twirl_size * x), cos(2.0 * twirl_size * y)));
+#elif FIELD_FUNCTION == 37
+	return flowAlongSdf(sdgArc(clip, vec2(0.3, 0.3), 0.5, 0.5), 0.01);
+#elif FIELD_FUNCTION == 38
+	return flowAlongSdf(sdgCross(clip, vec2(0.3, 0.3)), 0.01);
+#elif FIELD_FUNCTION == 39
+	return flowAlongSdf(sdgCross(clip, vec2(0.8, 0.3)), 0.01);
+#elif FIELD_FUNCTION == 40
+	return flowAlongSdf(sdgArc(clip, vec2(0.7, 0.3), -0.8, 0.3), 0.01);
+#else
+	return 0.01 * vec2(sin(x * PI / 9.0), cos(y * PI / 9.0));
+#endif
+}
+
+// How far the sample points have moved at the given time when the field is
+// animated. They go around a circle with the given radius (in vectors), which
+// passes through the still field at time 0.
+vec2 orbitOffset(float time, float radius, float period){
+	float angle = 2.0 * PI * time / period;
+	return radius * vec2(cos(angle) - 1.0, sin(angle));
+}
@@ -0,0 +1,35 @@
+// The order of the vectors in the field buffer, the same as src/FieldLayout.hpp.
+// FIELD_LAYOUT is defined by the program, it is the FIELD_LAYOUT it was built with.
+
+#define FIELD_LAYOUT_COLUMNS 0
+#define FIELD_LAYOUT_TILED 1
+#define FIELD_LAYOUT_MORTON 2
+
+#ifndef FIELD_LAYOUT
+#define FIELD_LAYOUT FIELD_LAYOUT_COLUMNS
+#endif
+
+#define FIELD_TILE_SIZE 8
+
+// Spread the 3 bits of v out to every other bit
+int fieldMortonSpread(int v){
+	return (v & 1) | ((v & 2) << 1) | ((v & 4) << 2);
+}
+
+// The position of the vector at (x, y) in the buffer of a grid with the given height
+int fieldLayoutIndex(int x, int y, int height){
+#if FIELD_LAYOUT == FIELD_LAYOUT_COLUMNS
+	return x * height + y;
+#else
+	int tilesPerColumn = (height + FIELD_TILE_SIZE - 1) / FIELD_TILE_SIZE;
+	int tile = (x / FIELD_TILE_SIZE) * tilesPerColumn + y / FIELD_TILE_SIZE;
+	int tx = x % FIELD_TILE_SIZE;
+	int ty = y % FIELD_TILE_SIZE;
+#if FIELD_LAYOUT == FIELD_LAYOUT_TILED
+	int inTile = ty * FIELD_TILE_SIZE + tx;
+#else
+	int inTile = fieldMortonSpread(tx) | (fieldMortonSpread(ty) << 1);
+#endif
+	return tile * FIELD_TILE_SIZE * FIELD_TILE_SIZE + inTile;
+#endif
+}
@@ -0,0 +1,48 @@
+// The buffers of the particles, shared by particle.comp and particle-init.comp.
+//
+// The particles are split by how often they are used. The positions are read and
+// written every step, the colors are only written with u_color_mode 1-3 and never
+// read, without those modes nothing is bound to binding 5.
+//
+// PARTICLE_COMPACT is defined by the program with --particle-format compact, see
+// src/CompactParticles.hpp. The positions are then fixed point in the vector grid,
+// the loop is packed into a buffer of its own that is only read when looping, and
+// the colors are RGBA8.
+#ifdef PARTICLE_COMPACT
+const float COMPACT_PARTICLE_ONE = float(1 << COMPACT_PARTICLE_FRACTION_BITS);
+const int COMPACT_PARTICLE_FRACTION_MASK = (1 << COMPACT_PARTICLE_FRACTION_BITS) - 1;
+// Where the particles are parked, far enough outside clip space for any grid and
+// far enough from the smallest int to move them around in
+const int COMPACT_PARTICLE_PARKED = -0x40000000;
+
+layout(std430, binding = 1) buffer particlePositionBuffer
+{
+	// x and y in 1/COMPACT_PARTICLE_ONE of a vector
+	ivec2 particlePositions[];
+};
+
+layout(std430, binding = 6) buffer particleLifetimeBuffer
+{
+	// The number of steps until the particle is alive in the low 16 bits,
+	// how long it has to live in the high
+	uint particleLifetimes[];
+};
+
+layout(std430, binding = 5) writeonly buffer particleColorBuffer
+{
+	uint particleColors[];
+};
+#else
+layout(std430, binding = 1) buffer particlePositionBuffer
+{
+	// x and y are positions
+	// z is number of steps until the particle is alive
+	// w is how long it has to live
+	vec4 particlePositions[];
+};
+
+layout(std430, binding = 5) writeonly buffer particleColorBuffer
+{
+	vec4 particleColors[];
+};
+#endif
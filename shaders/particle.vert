@@ -1,13 +1,28 @@
 #version 430 core
+// PARTICLE_COMPACT is defined by the program with --particle-format compact, the
+// position is then fixed point in the vector grid, see particle.comp
+#ifdef PARTICLE_COMPACT
+layout (location = 0) in ivec2 aPosition;
+#else
 layout (location = 0) in vec2 aPos_loop;
+#endif
 layout (location = 1) in vec4 color;
 
 uniform mat4 model;
+#ifdef PARTICLE_COMPACT
+// The size of the vector grid less the last vector, like in particle.comp
+uniform vec2 u_grid_size;
+#endif
 
 out vec4 particle_color;
 
 void main()
 {
+#ifdef PARTICLE_COMPACT
+    vec2 realPos = vec2(aPosition >> COMPACT_PARTICLE_FRACTION_BITS) + vec2(aPosition & ((1 << COMPACT_PARTICLE_FRACTION_BITS) - 1)) / float(1 << COMPACT_PARTICLE_FRACTION_BITS);
+    gl_Position = model * vec4(realPos / u_grid_size * 2.0 - 1.0, 0.0, 1.0);
+#else
     gl_Position = model * vec4(aPos_loop.xy, 0.0, 1.0);
+#endif
     particle_color = color;
-}
\ No newline at end of file
+}
@@ -0,0 +1,19 @@
+// Philox4x32-10, the counter-based random number generator of Salmon et al.,
+// "Parallel Random Numbers: As Easy as 1, 2, 3". Every counter gives four random
+// uints of its own, so any number of them can be made at once and in any order.
+// The same as philox4x32(..) in src/ParticleSeeder.hpp.
+
+uvec4 philoxRound(uvec4 counter, uvec2 key){
+	uint hi0, lo0, hi1, lo1;
+	umulExtended(0xD2511F53u, counter.x, hi0, lo0);
+	umulExtended(0xCD9E8D57u, counter.z, hi1, lo1);
+	return uvec4(hi1 ^ counter.y ^ key.x, lo1, hi0 ^ counter.w ^ key.y, lo0);
+}
+
+uvec4 philox4x32(uvec4 counter, uvec2 key){
+	for(int r = 0; r < 10; r++){
+		counter = philoxRound(counter, key);
+		key += uvec2(0x9E3779B9u, 0xBB67AE85u);
+	}
+	return counter;
+}
@@ -0,0 +1,343 @@
+#ifndef ADAPTIVE_VECTOR_FIELD_H
+#define ADAPTIVE_VECTOR_FIELD_H
+
+#include "../include/glad/glad.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include "GLHelpers.hpp"
+#include "ThreadPool.hpp"
+#include "VectorField.hpp"
+
+/**
+    CS-11 Asn 2: A vector field that is only built finely where it needs to be.
+    @file AdaptiveVectorField.hpp
+    @author Frank Hampus Weslien
+
+    Most fields are smooth nearly everywhere and only change quickly close to a
+    few points, like the centres of 11-13 or 18-22. The grid is cut into
+    ADAPTIVE_FIELD_ROOT_SIZE x ADAPTIVE_FIELD_ROOT_SIZE cells, and every cell
+    is the root of a quadtree. A cell is stored as the four vectors at its
+    corners, interpolated in between, if that is no more than the tolerance off
+    the function on a 5x5 lattice of points in it. Otherwise it is cut into four
+    and each quarter is tried again. A cell of ADAPTIVE_FIELD_BRICK_SIZE that is
+    still too far off stores every vector in it, a brick of the plain grid, so
+    nothing is ever coarser than the function needs.
+
+    The lines of the lattice inside the cell are moved one vector off the even
+    coordinates, or functions that flip every vector (like 3 and 7) would look
+    the same at every point tested and pass as constant.
+
+    The nodes are one uint each (binding 3). The roots come first, a column of
+    them at a time like the grid. An inner node is the index of its four
+    children, bottom left, bottom right, top left, top right. A leaf has
+    ADAPTIVE_FIELD_LEAF set, and ADAPTIVE_FIELD_BRICK too for a brick, and the
+    rest is where its vectors start in the vector buffer (binding 2): the four
+    corners in the same order as the children, or the brick a column at a time.
+    particle.comp walks down from the root to the leaf the particle is in.
+
+    Neighbouring leaves of different sizes don't agree exactly along the edge
+    they share, by at most about the tolerance.
+
+    NOTE: The object can not be copied since it owns the buffers.
+*/
+
+// The side of the roots of the quadtrees, in vectors
+#define ADAPTIVE_FIELD_ROOT_SIZE 64
+// The side of the smallest cell, stored as a brick of vectors when it is not smooth enough
+#define ADAPTIVE_FIELD_BRICK_SIZE 8
+// The side of the cells whose vectors are all computed at once when they are not smooth enough
+#define ADAPTIVE_FIELD_BLOCK_SIZE 32
+#define ADAPTIVE_FIELD_LEAF 0x80000000u
+#define ADAPTIVE_FIELD_BRICK 0x40000000u
+#define ADAPTIVE_FIELD_OFFSET_MASK 0x3fffffffu
+
+class AdaptiveVectorField : private boost::noncopyable
+{
+    const FieldKernel * kernel;
+    int width;
+    int height;
+    int rootsX;
+    int rootsY;
+    float tolerance;
+
+    GLuint vectorBuffer = 0;
+    GLuint nodeBuffer = 0;
+
+    size_t nbrNodes = 0;
+    size_t nbrVectors = 0;
+    size_t nbrLeaves = 0;
+    size_t nbrBricks = 0;
+
+    // One quadtree, with the root at index 0 and its vectors from 0
+    struct Tree {
+        std::vector<GLuint> nodes;
+        std::vector<float> vectors;
+        size_t nbrLeaves = 0;
+        size_t nbrBricks = 0;
+    };
+
+public:
+
+    /**
+        @param kernel the function to build the field with, must outlive the object
+        @param width the number of vectors along the x-axis of the grid
+        @param height the number of vectors along the y-axis of the grid
+        @param tolerance how far the interpolated vectors may be from the function, in
+                         the unit of the vectors
+    */
+    AdaptiveVectorField(const FieldKernel *kernel, int width, int height, float tolerance)
+        : kernel(kernel)
+        , width(width)
+        , height(height)
+        // Enough roots to cover the squares between the vectors
+        , rootsX(std::max(1, (width + ADAPTIVE_FIELD_ROOT_SIZE - 2) / ADAPTIVE_FIELD_ROOT_SIZE))
+        , rootsY(std::max(1, (height + ADAPTIVE_FIELD_ROOT_SIZE - 2) / ADAPTIVE_FIELD_ROOT_SIZE))
+        , tolerance(tolerance)
+    {}
+
+    ~AdaptiveVectorField()
+    {
+        GLuint buffers[] = { vectorBuffer, nodeBuffer };
+        glDeleteBuffers(2, buffers);
+    }
+
+    /**
+        Build the quadtrees on all threads and upload them.
+        @param pool the threads to build the quadtrees on
+    */
+    void build(ThreadPool &pool){
+        const unsigned int nbrRoots = rootsX * rootsY;
+        std::vector<Tree> trees(nbrRoots);
+        pool.parallelFor(0, nbrRoots, pool.grainSizeFor(nbrRoots), [&](unsigned int begin, unsigned int end){
+            for(unsigned int root = begin; root < end; root++){
+                Tree &tree = trees[root];
+                tree.nodes.push_back(0);
+                refine(tree, 0, (root / rootsY) * ADAPTIVE_FIELD_ROOT_SIZE, (root % rootsY) * ADAPTIVE_FIELD_ROOT_SIZE, ADAPTIVE_FIELD_ROOT_SIZE, NULL);
+            }
+        });
+
+        // Every tree after the roots and the trees before it
+        std::vector<size_t> nodeStart(nbrRoots);
+        std::vector<size_t> vectorStart(nbrRoots);
+        nbrNodes = nbrRoots;
+        nbrVectors = 0;
+        nbrLeaves = 0;
+        nbrBricks = 0;
+        for(unsigned int root = 0; root < nbrRoots; root++){
+            nodeStart[root] = nbrNodes;
+            vectorStart[root] = nbrVectors;
+            nbrNodes += trees[root].nodes.size() - 1;
+            nbrVectors += trees[root].vectors.size() / 2;
+            nbrLeaves += trees[root].nbrLeaves;
+            nbrBricks += trees[root].nbrBricks;
+        }
+
+        if(nbrVectors > ADAPTIVE_FIELD_OFFSET_MASK){
+            std::cout << "ERROR::ADAPTIVE_VECTOR_FIELD::TOO_MANY_VECTORS " << nbrVectors << ", raise '--adaptive-field-tolerance'" << std::endl;
+            return;
+        }
+
+        // The trees are copied straight into graphics memory
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+        glGenBuffers(1, &vectorBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vectorBuffer);
+        glBufferStorage(GL_COPY_WRITE_BUFFER, 2 * nbrVectors * sizeof(float), NULL, GL_MAP_WRITE_BIT);
+        float * vectors = (float *) glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, 2 * nbrVectors * sizeof(float), flags);
+
+        glGenBuffers(1, &nodeBuffer);
+        glBindBuffer(GL_COPY_READ_BUFFER, nodeBuffer);
+        glBufferStorage(GL_COPY_READ_BUFFER, nbrNodes * sizeof(GLuint), NULL, GL_MAP_WRITE_BIT);
+        GLuint * nodes = (GLuint *) glMapBufferRange(GL_COPY_READ_BUFFER, 0, nbrNodes * sizeof(GLuint), flags);
+        glCheckError();
+
+        if(vectors != NULL && nodes != NULL){
+            pool.parallelFor(0, nbrRoots, pool.grainSizeFor(nbrRoots), [&](unsigned int begin, unsigned int end){
+                for(unsigned int root = begin; root < end; root++){
+                    const Tree &tree = trees[root];
+                    for(size_t i = 0; i < tree.nodes.size(); i++){
+                        GLuint node = tree.nodes[i];
+                        node = (node & ADAPTIVE_FIELD_LEAF) != 0
+                             ? node + (GLuint) vectorStart[root]
+                             : node + (GLuint) nodeStart[root] - 1;
+                        nodes[i == 0 ? root : nodeStart[root] + i - 1] = node;
+                    }
+                    std::copy(tree.vectors.begin(), tree.vectors.end(), vectors + 2 * vectorStart[root]);
+                }
+            });
+        }
+
+        // The contents are undefined if the driver lost them while mapped, rare but possible
+        bool unmapped = vectors != NULL && glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_TRUE;
+        unmapped = nodes != NULL && glUnmapBuffer(GL_COPY_READ_BUFFER) == GL_TRUE && unmapped;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glCheckError();
+
+        if(!unmapped){
+            std::cout << "ERROR::ADAPTIVE_VECTOR_FIELD::COULD_NOT_MAP_BUFFERS of size " << bufferBytes() << std::endl;
+            GLuint buffers[] = { vectorBuffer, nodeBuffer };
+            glDeleteBuffers(2, buffers);
+            vectorBuffer = nodeBuffer = 0;
+        }
+    }
+
+    /**
+        @return false if the quadtrees could not be built
+    */
+    bool good() const {
+        return nodeBuffer != 0;
+    }
+
+    /**
+        @return the number of cells stored as their four corners
+    */
+    size_t nbrCornerLeaves() const {
+        return nbrLeaves - nbrBricks;
+    }
+
+    /**
+        @return the number of cells stored as a brick of vectors
+    */
+    size_t nbrBrickLeaves() const {
+        return nbrBricks;
+    }
+
+    /**
+        @return the graphics memory taken by the quadtrees
+    */
+    size_t bufferBytes() const {
+        return nbrNodes * sizeof(GLuint) + 2 * nbrVectors * sizeof(float);
+    }
+
+    /**
+        Bind the vectors and the nodes to the bindings particle.comp reads them from.
+    */
+    void bind() const {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, vectorBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, nodeBuffer);
+    }
+
+    /**
+        The lines particle.comp needs to read an adaptive field.
+    */
+    static std::string shaderDefines(){
+        return "#define FIELD_ADAPTIVE\n"
+               "#define ADAPTIVE_FIELD_ROOT_SIZE " + std::to_string(ADAPTIVE_FIELD_ROOT_SIZE) + "\n"
+               "#define ADAPTIVE_FIELD_LEAF " + std::to_string(ADAPTIVE_FIELD_LEAF) + "u\n"
+               "#define ADAPTIVE_FIELD_BRICK " + std::to_string(ADAPTIVE_FIELD_BRICK) + "u\n"
+               "#define ADAPTIVE_FIELD_OFFSET_MASK " + std::to_string(ADAPTIVE_FIELD_OFFSET_MASK) + "u\n";
+    }
+
+private:
+
+    // Every vector of a cell of ADAPTIVE_FIELD_BLOCK_SIZE, a column at a time
+    struct Block {
+        static const int side = ADAPTIVE_FIELD_BLOCK_SIZE + 1;
+        int x0;
+        int y0;
+        float x[side][side];
+        float y[side][side];
+    };
+
+    /**
+        Decide what the cell at (x0, y0) is and fill in tree.nodes[at] with it.
+        Once a cell is down to ADAPTIVE_FIELD_BLOCK_SIZE and still not smooth, all
+        of its vectors are computed at once and the cells in it are decided from
+        them, so functions with detail everywhere aren't evaluated a few points at
+        a time.
+        @param block the vectors of the cell, or NULL if they are not computed yet
+    */
+    void refine(Tree &tree, size_t at, int x0, int y0, int size, const Block *block) const {
+        // The lattice, at 0, 1/4, 1/2, 3/4, and 1 of the cell with the inner quarters moved by one
+        float latticeX[5][5];
+        float latticeY[5][5];
+        int offsets[5] = { 0, size / 4 + 1, size / 2, 3 * size / 4 + 1, size };
+        for(int i = 0; i < 5; i++){
+            if(block != NULL){
+                for(int j = 0; j < 5; j++){
+                    latticeX[i][j] = block->x[x0 - block->x0 + offsets[i]][y0 - block->y0 + offsets[j]];
+                    latticeY[i][j] = block->y[x0 - block->x0 + offsets[i]][y0 - block->y0 + offsets[j]];
+                }
+                continue;
+            }
+            float vx[3], vy[3];
+            kernel->evaluate(x0 + offsets[i], y0, size / 2, 3, width, height, vx, vy);
+            for(int j = 0; j < 3; j++){
+                latticeX[i][2 * j] = vx[j];
+                latticeY[i][2 * j] = vy[j];
+            }
+            kernel->evaluate(x0 + offsets[i], y0 + offsets[1], size / 2, 2, width, height, vx, vy);
+            for(int j = 0; j < 2; j++){
+                latticeX[i][2 * j + 1] = vx[j];
+                latticeY[i][2 * j + 1] = vy[j];
+            }
+        }
+
+        // NaN, from dividing by 0 at a centre, never counts as close enough
+        bool smooth = true;
+        for(int i = 0; i < 5; i++){
+            for(int j = 0; j < 5; j++){
+                float u = (float) offsets[i] / size;
+                float v = (float) offsets[j] / size;
+                float bottomX = latticeX[0][0] * (1.0f - u) + latticeX[4][0] * u;
+                float topX = latticeX[0][4] * (1.0f - u) + latticeX[4][4] * u;
+                float bottomY = latticeY[0][0] * (1.0f - u) + latticeY[4][0] * u;
+                float topY = latticeY[0][4] * (1.0f - u) + latticeY[4][4] * u;
+                float dx = bottomX * (1.0f - v) + topX * v - latticeX[i][j];
+                float dy = bottomY * (1.0f - v) + topY * v - latticeY[i][j];
+                smooth = smooth && std::abs(dx) <= tolerance && std::abs(dy) <= tolerance;
+            }
+        }
+
+        if(smooth){
+            tree.nodes[at] = ADAPTIVE_FIELD_LEAF | (GLuint) (tree.vectors.size() / 2);
+            float corners[8] = { latticeX[0][0], latticeY[0][0], latticeX[4][0], latticeY[4][0]
+                               , latticeX[0][4], latticeY[0][4], latticeX[4][4], latticeY[4][4] };
+            tree.vectors.insert(tree.vectors.end(), corners, corners + 8);
+            tree.nbrLeaves++;
+            return;
+        }
+
+        if(size <= ADAPTIVE_FIELD_BRICK_SIZE){
+            tree.nodes[at] = ADAPTIVE_FIELD_LEAF | ADAPTIVE_FIELD_BRICK | (GLuint) (tree.vectors.size() / 2);
+            float * out = &*tree.vectors.insert(tree.vectors.end(), 2 * (size + 1) * (size + 1), 0.0f);
+            for(int i = 0; i <= size; i++){
+                const float * columnX = &block->x[x0 - block->x0 + i][y0 - block->y0];
+                const float * columnY = &block->y[x0 - block->x0 + i][y0 - block->y0];
+                for(int j = 0; j <= size; j++){
+                    *out++ = columnX[j];
+                    *out++ = columnY[j];
+                }
+            }
+            tree.nbrLeaves++;
+            tree.nbrBricks++;
+            return;
+        }
+
+        std::unique_ptr<Block> computed;
+        if(block == NULL && size <= ADAPTIVE_FIELD_BLOCK_SIZE){
+            computed.reset(new Block());
+            computed->x0 = x0;
+            computed->y0 = y0;
+            for(int i = 0; i < Block::side; i++)
+                kernel->evaluate(x0 + i, y0, 1.0f, Block::side, width, height, computed->x[i], computed->y[i]);
+            block = computed.get();
+        }
+
+        size_t children = tree.nodes.size();
+        tree.nodes[at] = (GLuint) children;
+        tree.nodes.resize(children + 4);
+        int half = size / 2;
+        refine(tree, children,     x0,        y0,        half, block);
+        refine(tree, children + 1, x0 + half, y0,        half, block);
+        refine(tree, children + 2, x0,        y0 + half, half, block);
+        refine(tree, children + 3, x0 + half, y0 + half, half, block);
+    }
+};
+
+#endif
@@ -5,9 +5,12 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/string_cast.hpp>
+#include <algorithm>
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
 #include <boost/program_options.hpp>
+#include "FieldLayout.hpp"
 
 
 using namespace boost::program_options;
@@ -27,6 +30,20 @@ public:
     bool show_help;
     bool show_version;
     std::string shaderPath = "";
+    unsigned int nbr_threads = 0;
+    std::string field_isa = "auto";
+    std::string field_backend = "cpu";
+    std::string field_format = "ssbo";
+    std::string particle_backend = "gpu";
+    std::string render_backend = "gpu";
+    std::string particle_format = "float";
+    bool check_field_kernels;
+    bool check_particle_backend;
+    bool benchmark_field_layout;
+    std::string field_cache = "";
+    unsigned int field_cache_max_mb;
+    std::string export_field = "";
+    std::string analyze_field = "";
 
     // Simulations
 
@@ -35,9 +52,37 @@ public:
     unsigned int height_ratio;
     unsigned int pixels_per_ratio;
     unsigned int vectors_per_ratio;
-
-    unsigned int nbr_compute_groups;
+    float field_max_vectors_per_pixel;
+    bool full_field_resolution;
+    bool sparse_field;
+    bool adaptive_field;
+    float adaptive_field_tolerance = 0.0002f;
+    std::string field_period = "declared";
+    std::string field_edits = "";
+    bool field_brush;
+    float field_brush_radius = 0.05f;
+    float field_brush_strength = 0.01f;
+    unsigned int sparse_field_gpu_mb;
+    unsigned int sparse_field_cache_mb;
+
+    std::string particle_local_size = "auto";
+    std::string particle_local_size_cache = "";
     unsigned int vector_field_function;
+    std::string field_x = "";
+    std::string field_y = "";
+    std::string field_sdf = "";
+    std::string field_image = "";
+    float field_image_blur = 0.0f;
+    std::string field_image_mode = "gradient";
+    float field_image_strength = 0.01f;
+    float field_orbit_radius;
+    float field_orbit_period;
+    std::string field_sequence = "";
+    unsigned int field_sequence_frames;
+    std::vector<unsigned int> field_morph;
+    unsigned int field_morph_frames;
+    unsigned int field_morph_hold;
+    std::string field_morph_curve = "smooth";
     float probability_to_die;
     float trail_mix_rate = 0.9;
 
@@ -47,6 +92,8 @@ public:
     // Resolution dependent
     float point_size;
     unsigned int nbr_particles;
+    std::string particle_init = "mt19937";
+    unsigned int particle_seed;
 
     // Coloring
     int colorMode;
@@ -121,6 +168,145 @@ public:
 
         if (vm.count("shader-path"))
             shaderPath = vm["shader-path"].as<std::string>();
+
+        if (vm.count("nbr-threads"))
+            nbr_threads = vm["nbr-threads"].as<unsigned int>();
+
+        if (vm.count("field-isa")){
+            std::string tmpIsa = vm["field-isa"].as<std::string>();
+            if( tmpIsa == "auto"
+                || tmpIsa == "scalar"
+                || tmpIsa == "sse4.1"
+                || tmpIsa == "avx2"
+                || tmpIsa == "avx512"
+                ){
+                field_isa = tmpIsa;
+            } else {
+                std::cout
+                    << "WARNING: '--field-isa "
+                    << tmpIsa
+                    << "' must be one of: 'auto', 'scalar', 'sse4.1', 'avx2', or 'avx512'"
+                    << std::endl;
+                failed = true;
+            }
+        }
+
+        if (vm.count("field-backend")){
+            std::string tmpBackend = vm["field-backend"].as<std::string>();
+            if(tmpBackend == "cpu" || tmpBackend == "gpu" || tmpBackend == "analytic"){
+                field_backend = tmpBackend;
+            } else {
+                std::cout
+                    << "WARNING: '--field-backend "
+                    << tmpBackend
+                    << "' only accepts 'cpu', 'gpu', or 'analytic'"
+                    << std::endl;
+                failed = true;
+            }
+        }
+
+        if (vm.count("field-format")){
+            std::string tmpFormat = vm["field-format"].as<std::string>();
+            if(tmpFormat == "ssbo" || tmpFormat == "rg16f" || tmpFormat == "rg32f"){
+                field_format = tmpFormat;
+            } else {
+                std::cout
+                    << "WARNING: '--field-format "
+                    << tmpFormat
+                    << "' only accepts 'ssbo', 'rg16f', or 'rg32f'"
+                    << std::endl;
+                failed = true;
+            }
+        }
+
+        if (vm.count("particle-backend")){
+            std::string tmpBackend = vm["particle-backend"].as<std::string>();
+            if(tmpBackend == "gpu" || tmpBackend == "cpu"){
+                particle_backend = tmpBackend;
+            } else {
+                std::cout
+                    << "WARNING: '--particle-backend "
+                    << tmpBackend
+                    << "' only accepts 'gpu' or 'cpu'"
+                    << std::endl;
+                failed = true;
+            }
+        }
+
+        // The software renderer draws the particles where the CPU moved them
+        if (vm.count("render-backend")){
+            std::string tmpBackend = vm["render-backend"].as<std::string>();
+            if(tmpBackend == "gpu" || tmpBackend == "cpu"){
+                render_backend = tmpBackend;
+                if(render_backend == "cpu")
+                    particle_backend = "cpu";
+            } else {
+                std::cout
+                    << "WARNING: '--render-backend "
+                    << tmpBackend
+                    << "' only accepts 'gpu' or 'cpu'"
+                    << std::endl;
+                failed = true;
+            }
+        }
+
+        if (vm.count("particle-format")){
+            std::string tmpFormat = vm["particle-format"].as<std::string>();
+            if(tmpFormat == "float" || tmpFormat == "compact"){
+                particle_format = tmpFormat;
+            } else {
+                std::cout
+                    << "WARNING: '--particle-format "
+                    << tmpFormat
+                    << "' only accepts 'float' or 'compact'"
+                    << std::endl;
+                failed = true;
+            }
+        }
+
+        if (vm.count("field-period")){
+            std::string tmpPeriod = vm["field-period"].as<std::string>();
+            if(tmpPeriod == "declared" || tmpPeriod == "auto" || tmpPeriod == "off"){
+                field_period = tmpPeriod;
+            } else {
+                std::cout
+                    << "WARNING: '--field-period "
+                    << tmpPeriod
+                    << "' only accepts 'declared', 'auto', or 'off'"
+                    << std::endl;
+                failed = true;
+            }
+        }
+
+        if (vm.count("field-cache"))
+            field_cache = vm["field-cache"].as<std::string>();
+
+        if (vm.count("field-cache-max-mb"))
+            field_cache_max_mb = vm["field-cache-max-mb"].as<unsigned int>();
+
+        if (vm.count("export-field"))
+            export_field = vm["export-field"].as<std::string>();
+
+        if (vm.count("analyze-field"))
+            analyze_field = vm["analyze-field"].as<std::string>();
+
+        if (vm.count("check-field-kernels"))
+            check_field_kernels = true;
+        else
+            check_field_kernels = false;
+
+        // Needs everything '--particle-backend cpu' needs
+        if (vm.count("check-particle-backend")){
+            check_particle_backend = true;
+            particle_backend = "cpu";
+        } else {
+            check_particle_backend = false;
+        }
+
+        if (vm.count("benchmark-field-layout"))
+            benchmark_field_layout = true;
+        else
+            benchmark_field_layout = false;
     
 
         // Resolution
@@ -140,6 +326,65 @@ public:
 
         if (vm.count("vectors-per-ratio"))
             vectors_per_ratio = vm["vectors-per-ratio"].as<unsigned int>();
+
+        if (vm.count("field-max-vectors-per-pixel")){
+            field_max_vectors_per_pixel = vm["field-max-vectors-per-pixel"].as<float>();
+            if(field_max_vectors_per_pixel <= 0.0f){
+                std::cout
+                    << "WARNING: '--field-max-vectors-per-pixel "
+                    << field_max_vectors_per_pixel
+                    << "' must be larger than 0"
+                    << std::endl;
+                failed = true;
+            }
+        }
+
+        if (vm.count("full-field-resolution"))
+            full_field_resolution = true;
+        else
+            full_field_resolution = false;
+
+        if (vm.count("sparse-field"))
+            sparse_field = true;
+        else
+            sparse_field = false;
+
+        if (vm.count("adaptive-field"))
+            adaptive_field = true;
+        else
+            adaptive_field = false;
+
+        if (vm.count("adaptive-field-tolerance")){
+            adaptive_field_tolerance = vm["adaptive-field-tolerance"].as<float>();
+            if(adaptive_field_tolerance < 0.0f){
+                std::cout
+                    << "WARNING: '--adaptive-field-tolerance "
+                    << adaptive_field_tolerance
+                    << "' can't be negative"
+                    << std::endl;
+                failed = true;
+            }
+        }
+
+        if (vm.count("field-edits"))
+            field_edits = vm["field-edits"].as<std::string>();
+
+        if (vm.count("field-brush"))
+            field_brush = true;
+        else
+            field_brush = false;
+
+        if (vm.count("field-brush-radius"))
+            field_brush_radius = vm["field-brush-radius"].as<float>();
+
+        if (vm.count("field-brush-strength"))
+            field_brush_strength = vm["field-brush-strength"].as<float>();
+
+        if (vm.count("sparse-field-gpu-mb"))
+            sparse_field_gpu_mb = vm["sparse-field-gpu-mb"].as<unsigned int>();
+
+        if (vm.count("sparse-field-cache-mb"))
+            sparse_field_cache_mb = vm["sparse-field-cache-mb"].as<unsigned int>();
         
         if (vm.count("point-size"))
             point_size = vm["point-size"].as<float>();
@@ -147,13 +392,162 @@ public:
         if (vm.count("nbr-particles"))
             nbr_particles = vm["nbr-particles"].as<unsigned int>();
 
-        if (vm.count("nbr-compute-groups"))
-            nbr_compute_groups = vm["nbr-compute-groups"].as<unsigned int>();
+        if (vm.count("particle-local-size")){
+            std::string tmpSize = vm["particle-local-size"].as<std::string>();
+            if(tmpSize == "auto" || tmpSize == "64" || tmpSize == "128" || tmpSize == "256" || tmpSize == "512" || tmpSize == "1024"){
+                particle_local_size = tmpSize;
+            } else {
+                std::cout
+                    << "WARNING: '--particle-local-size "
+                    << tmpSize
+                    << "' only accepts 'auto', '64', '128', '256', '512', or '1024'"
+                    << std::endl;
+                failed = true;
+            }
+        }
+
+        if (vm.count("particle-local-size-cache"))
+            particle_local_size_cache = vm["particle-local-size-cache"].as<std::string>();
+
+        if (vm.count("particle-init")){
+            std::string tmpInit = vm["particle-init"].as<std::string>();
+            if(tmpInit == "mt19937" || tmpInit == "philox"){
+                particle_init = tmpInit;
+            } else {
+                std::cout
+                    << "WARNING: '--particle-init "
+                    << tmpInit
+                    << "' only accepts 'mt19937' or 'philox'"
+                    << std::endl;
+                failed = true;
+            }
+        }
+
+        if (vm.count("particle-seed"))
+            particle_seed = vm["particle-seed"].as<unsigned int>();
 
 
         if(vm.count("vector-field-function"))
             vector_field_function = vm["vector-field-function"].as<unsigned int>();
 
+        if(vm.count("field-x"))
+            field_x = vm["field-x"].as<std::string>();
+
+        if(vm.count("field-y"))
+            field_y = vm["field-y"].as<std::string>();
+
+        if(vm.count("field-sdf"))
+            field_sdf = vm["field-sdf"].as<std::string>();
+
+        if(vm.count("field-image"))
+            field_image = vm["field-image"].as<std::string>();
+
+        if(vm.count("field-image-blur"))
+            field_image_blur = vm["field-image-blur"].as<float>();
+
+        if(vm.count("field-image-mode")){
+            std::string tmpMode = vm["field-image-mode"].as<std::string>();
+            if(tmpMode == "gradient" || tmpMode == "along"){
+                field_image_mode = tmpMode;
+            } else {
+                std::cout
+                    << "WARNING: '--field-image-mode "
+                    << tmpMode
+                    << "' only accepts 'gradient' or 'along'"
+                    << std::endl;
+                failed = true;
+            }
+        }
+
+        if(vm.count("field-image-strength"))
+            field_image_strength = vm["field-image-strength"].as<float>();
+
+        if(vm.count("field-orbit-radius"))
+            field_orbit_radius = vm["field-orbit-radius"].as<float>();
+
+        if(vm.count("field-orbit-period")){
+            field_orbit_period = vm["field-orbit-period"].as<float>();
+            if(field_orbit_period <= 0.0f){
+                std::cout
+                    << "WARNING: '--field-orbit-period "
+                    << field_orbit_period
+                    << "' must be larger than 0"
+                    << std::endl;
+                failed = true;
+            }
+        }
+
+        if(vm.count("field-sequence"))
+            field_sequence = vm["field-sequence"].as<std::string>();
+
+        if(vm.count("field-sequence-frames")){
+            field_sequence_frames = vm["field-sequence-frames"].as<unsigned int>();
+            if(field_sequence_frames == 0){
+                std::cout
+                    << "WARNING: '--field-sequence-frames "
+                    << field_sequence_frames
+                    << "' must be at least 1"
+                    << std::endl;
+                failed = true;
+            }
+        }
+
+        if(vm.count("field-morph")){
+            std::string tmpMorph = vm["field-morph"].as<std::string>();
+            std::istringstream numbers(tmpMorph);
+            std::string number;
+            field_morph.clear();
+            while(std::getline(numbers, number, ',')){
+                try {
+                    size_t end;
+                    unsigned long functionNbr = std::stoul(number, &end);
+                    if(number.find_first_not_of(" \t", end) != std::string::npos)
+                        throw std::invalid_argument(number);
+                    field_morph.push_back((unsigned int) functionNbr);
+                } catch(const std::exception &) {
+                    field_morph.clear();
+                    break;
+                }
+            }
+            if(field_morph.size() < 2){
+                std::cout
+                    << "WARNING: '--field-morph "
+                    << tmpMorph
+                    << "' needs at least two vector field functions separated by commas, like '3,11,13'"
+                    << std::endl;
+                failed = true;
+            }
+        }
+
+        if(vm.count("field-morph-frames")){
+            field_morph_frames = vm["field-morph-frames"].as<unsigned int>();
+            if(field_morph_frames == 0){
+                std::cout
+                    << "WARNING: '--field-morph-frames "
+                    << field_morph_frames
+                    << "' must be at least 1"
+                    << std::endl;
+                failed = true;
+            }
+        }
+
+        if(vm.count("field-morph-hold"))
+            field_morph_hold = vm["field-morph-hold"].as<unsigned int>();
+
+        if(vm.count("field-morph-curve")){
+            std::string tmpCurve = vm["field-morph-curve"].as<std::string>();
+            if(tmpCurve == "linear" || tmpCurve == "smooth"){
+                field_morph_curve = tmpCurve;
+            } else {
+                std::cout
+                    << "WARNING: '--field-morph-curve "
+                    << tmpCurve
+                    << "' only accepts 'linear' or 'smooth'"
+                    << std::endl;
+                failed = true;
+            }
+        }
+
         if(vm.count("probability-to-die"))
             probability_to_die = vm["probability-to-die"].as<float>();     
      
@@ -399,16 +793,147 @@ public:
         // WARNINGS
         // ----------------------------------------------------------------------------------------
 
-        if(nbr_particles % nbr_compute_groups != 0){
-            std::cout 
-                << "WARNING: '--nbr-particles "
-                << nbr_particles
-                << "' was specified to a number not divisible by '--nbr-compute-groups" 
-                << nbr_compute_groups 
-                << "'" 
+        if(field_orbit_radius != 0.0f && field_backend == "cpu"){
+            std::cout
+                << "WARNING: '--field-orbit-radius "
+                << field_orbit_radius
+                << "' animates the vector field which needs '--field-backend gpu' or 'analytic'"
                 << std::endl;
             failed = true;
-            }
+        }
+
+        if(field_x.empty() != field_y.empty()){
+            std::cout
+                << "WARNING: '--field-x' and '--field-y' must be given together"
+                << std::endl;
+            failed = true;
+        }
+
+        if(!field_x.empty() && field_backend != "cpu"){
+            std::cout
+                << "WARNING: '--field-x' and '--field-y' are only evaluated by '--field-backend cpu'"
+                << std::endl;
+            failed = true;
+        }
+
+        if(!field_x.empty() && !field_sequence.empty()){
+            std::cout
+                << "WARNING: '--field-x' and '--field-y' can't be used together with '--field-sequence', which plays the vector field from disk"
+                << std::endl;
+            failed = true;
+        }
+
+        if(!field_sdf.empty() && !field_x.empty()){
+            std::cout
+                << "WARNING: '--field-sdf' can't be used together with '--field-x' and '--field-y'"
+                << std::endl;
+            failed = true;
+        }
+
+        if(!field_sdf.empty() && field_backend != "cpu"){
+            std::cout
+                << "WARNING: '--field-sdf' is only evaluated by '--field-backend cpu'"
+                << std::endl;
+            failed = true;
+        }
+
+        if(!field_image.empty() && (!field_x.empty() || !field_sdf.empty())){
+            std::cout
+                << "WARNING: '--field-image' can't be used together with '--field-x' and '--field-y' or '--field-sdf'"
+                << std::endl;
+            failed = true;
+        }
+
+        if(!field_image.empty() && field_backend != "cpu"){
+            std::cout
+                << "WARNING: '--field-image' is only turned into a vector field by '--field-backend cpu'"
+                << std::endl;
+            failed = true;
+        }
+
+        if(field_format != "ssbo" && (field_backend == "analytic" || !field_sequence.empty())){
+            std::cout
+                << "WARNING: '--field-format "
+                << field_format
+                << "' needs a vector field grid that is built once or on the GPU, it can't be used with '--field-backend analytic' or '--field-sequence'"
+                << std::endl;
+            failed = true;
+        }
+
+        // The cpu copies its field into the texture as it is, which needs the layout of a texture
+        if(field_format != "ssbo" && field_backend == "cpu" && FIELD_LAYOUT != FIELD_LAYOUT_COLUMNS){
+            std::cout
+                << "WARNING: '--field-format "
+                << field_format
+                << "' with '--field-backend cpu' needs a build with the 'columns' FIELD_LAYOUT, this one is '"
+                << fieldLayoutName(FIELD_LAYOUT)
+                << "'"
+                << std::endl;
+            failed = true;
+        }
+
+        if(!field_sequence.empty() && field_backend != "cpu"){
+            std::cout
+                << "WARNING: '--field-sequence "
+                << field_sequence
+                << "' plays the vector field from disk and can't be used with '--field-backend "
+                << field_backend
+                << "'"
+                << std::endl;
+            failed = true;
+        }
+
+        if(sparse_field && (field_backend != "cpu" || field_format != "ssbo" || !field_sequence.empty())){
+            std::cout
+                << "WARNING: '--sparse-field' builds the vector field on the CPU into an ssbo, it needs '--field-backend cpu' and '--field-format ssbo' and can't be used with '--field-sequence'"
+                << std::endl;
+            failed = true;
+        }
+
+        if((!field_edits.empty() || field_brush) && (field_backend != "cpu" || sparse_field || !field_sequence.empty() || !field_morph.empty())){
+            std::cout
+                << "WARNING: '--field-edits' and '--field-brush' change the vector field on the CPU, they need '--field-backend cpu' and can't be used with '--sparse-field', '--field-sequence' or '--field-morph'"
+                << std::endl;
+            failed = true;
+        }
+
+        if(adaptive_field && (field_backend != "cpu" || field_format != "ssbo" || sparse_field || !field_sequence.empty()
+                              || !field_morph.empty() || !field_edits.empty() || field_brush)){
+            std::cout
+                << "WARNING: '--adaptive-field' builds the vector field on the CPU into an ssbo, it needs '--field-backend cpu' and '--field-format ssbo' and can't be used with '--sparse-field', '--field-sequence', '--field-morph', '--field-edits' or '--field-brush'"
+                << std::endl;
+            failed = true;
+        }
+
+        if(!field_morph.empty() && (field_backend != "cpu" || field_format != "ssbo" || sparse_field || !field_sequence.empty()
+                                    || !field_x.empty() || !field_sdf.empty() || !field_image.empty())){
+            std::cout
+                << "WARNING: '--field-morph' builds every vector field function on the CPU into an ssbo, it needs '--field-backend cpu' and '--field-format ssbo' and can't be used with '--sparse-field', '--field-sequence', '--field-x', '--field-sdf' or '--field-image'"
+                << std::endl;
+            failed = true;
+        }
+
+        if(particle_backend == "cpu" && (field_backend != "cpu" || field_format != "ssbo" || sparse_field || adaptive_field
+                                         || !field_sequence.empty() || !field_morph.empty() || !field_edits.empty() || field_brush)){
+            std::cout
+                << "WARNING: '--particle-backend cpu' reads the vector field from the CPU's memory, it needs '--field-backend cpu' and '--field-format ssbo' and can't be used with '--sparse-field', '--adaptive-field', '--field-sequence', '--field-morph', '--field-edits' or '--field-brush'"
+                << std::endl;
+            failed = true;
+        }
+
+        if(particle_format == "compact" && particle_backend == "cpu"){
+            std::cout
+                << "WARNING: '--particle-format compact' is only read by particle.comp, it can't be used with '--particle-backend cpu', '--render-backend cpu' or '--check-particle-backend'"
+                << std::endl;
+            failed = true;
+        }
+
+        if(render_backend == "cpu" && !record && !screenshot){
+            std::cout
+                << "WARNING: '--render-backend cpu' doesn't open a window, it needs '--record' or '--screenshot'"
+                << std::endl;
+            failed = true;
+        }
     }
 
     unsigned int width(){
@@ -419,11 +944,60 @@ public:
         return height_ratio * pixels_per_ratio;
     }
 
+    /**
+        @return true if a vector field that repeats itself may be stored one period
+                at a time, the other ways of storing it keep the whole grid
+    */
+    bool fieldPeriodUsable() {
+        return field_period != "off"
+            && field_backend == "cpu"
+            && !sparse_field
+            && !adaptive_field
+            && field_sequence.empty()
+            && field_morph.empty()
+            && field_edits.empty()
+            && !field_brush;
+    }
+
+    /**
+        @return true if the vector field is built at a lower resolution than
+                '--vectors-per-ratio' since the particles can't tell the difference
+    */
+    bool fieldResolutionCapped() {
+        return !full_field_resolution
+            && !sparse_field
+            && !adaptive_field
+            && field_backend == "cpu"
+            && field_sequence.empty()
+            && vectors_per_ratio > pixels_per_ratio * field_max_vectors_per_pixel;
+    }
+
+    /**
+        @return the number of vectors per ratio in the vector field grid
+    */
+    unsigned int fieldVectorsPerRatio() {
+        if(!fieldResolutionCapped())
+            return vectors_per_ratio;
+        return std::max(1u, (unsigned int) (pixels_per_ratio * field_max_vectors_per_pixel));
+    }
+
     unsigned int vectorGridWidth() {
-        return width_ratio * vectors_per_ratio;
+        return width_ratio * fieldVectorsPerRatio();
     }
 
     unsigned int vectorGridHeight() {
+        return height_ratio * fieldVectorsPerRatio();
+    }
+
+    /**
+        The grid the vector field function is sampled on, the same as the vector
+        grid unless the resolution is capped.
+    */
+    unsigned int fieldSampleWidth() {
+        return width_ratio * vectors_per_ratio;
+    }
+
+    unsigned int fieldSampleHeight() {
         return height_ratio * vectors_per_ratio;
     }
 
@@ -440,18 +1014,63 @@ private:
             ("help", "Help screen")
             ("version,v", "Print version string")
             ("config", value<std::vector<std::string>>()->multitoken(), "Files containing command line options")
-            ("shader-path", value<std::string>()->default_value("./shaders"), "The folder where the shaders are located");
+            ("shader-path", value<std::string>()->default_value("./shaders"), "The folder where the shaders are located")
+            ("nbr-threads", value<unsigned int>()->default_value(0), "The number of CPU threads used to build the vector field, and to move the particles with '--particle-backend cpu' (0 uses all cores)")
+            ("field-isa", value<std::string>()->default_value("auto"), "The instruction set used to build the vector field: 'auto', 'scalar', 'sse4.1', 'avx2', or 'avx512'")
+            ("field-backend", value<std::string>()->default_value("cpu"), "Build the vector field on the 'cpu', straight into graphics memory on the 'gpu', or skip the grid and evaluate it at every particle with 'analytic'")
+            ("field-format", value<std::string>()->default_value("ssbo"), "Store the vector field in an 'ssbo' and interpolate it in the shader, or in an 'rg16f' or 'rg32f' texture that the texture unit interpolates")
+            ("particle-backend", value<std::string>()->default_value("gpu"), "Move the particles with particle.comp on the 'gpu', or on every core of the 'cpu' with the vector field in the CPU's memory")
+            ("particle-format", value<std::string>()->default_value("float"), "Store every particle as 'float's (32 bytes), or 'compact' in fixed point and RGBA8 (12 bytes, 16 with color modes 1-3) to fit more particles in the same memory")
+            ("render-backend", value<std::string>()->default_value("gpu"), "Draw the particles and their trails with OpenGL on the 'gpu', or on every core of the 'cpu' without a window or OpenGL for '--record' and '--screenshot' (implies '--particle-backend cpu')")
+            ("field-period", value<std::string>()->default_value("declared"), "Store only one period of vector field functions that repeat themselves, with the periods they 'declared', also the ones found by trying ('auto', for '--field-x' and the like), or never ('off')")
+            ("field-cache", value<std::string>(), "A folder to keep built vector fields in so that later runs can skip building them")
+            ("field-cache-max-mb", value<unsigned int>()->default_value(4096), "The most the vector fields in '--field-cache' may take up, the least recently used ones are removed first")
+            ("sparse-field", "Only build the tiles of the vector field the particles read from, when they first read from them (needs '--field-backend cpu')")
+            ("sparse-field-gpu-mb", value<unsigned int>()->default_value(512), "The most graphics memory the tiles of '--sparse-field' may take up, the ones read the longest ago are replaced first")
+            ("sparse-field-cache-mb", value<unsigned int>()->default_value(1024), "The most memory the tiles of '--sparse-field' are kept in after they are built, so that they don't have to be built again")
+            ("adaptive-field", "Build the vector field as quadtrees that are only cut finer where the function changes too quickly to be interpolated (needs '--field-backend cpu')")
+            ("adaptive-field-tolerance", value<float>()->default_value(0.0002f), "How far the vectors of '--adaptive-field' may be from the function, the vectors of the functions are about 0.01 long")
+            ("field-edits", value<std::string>(), "A script of changes to parts of the vector field and the frames they are made at (see src/FieldEdits.hpp)")
+            ("field-brush", "Drag the vector field along with the mouse while the left button is held")
+            ("field-brush-radius", value<float>()->default_value(0.05f), "The radius of '--field-brush' as a part of the height")
+            ("field-brush-strength", value<float>()->default_value(0.01f), "The length of the vectors '--field-brush' pulls the field towards")
+            ("full-field-resolution", "Build the vector field at '--vectors-per-ratio' even when it has more vectors per pixel than '--field-max-vectors-per-pixel'")
+            ("export-field", value<std::string>(), "Build the vector field, write it to this file and exit, the files can be played with '--field-sequence'")
+            ("analyze-field", value<std::string>(), "Build the vector field on the CPU, follow particles through it for the '--length' of the video, write where they end up, the fixed points, speed, divergence, and curl to this folder as report.json and PNG images, and exit")
+            ("check-field-kernels", "Compare the SIMD vector field functions against the scalar ones and exit, with '--field-backend gpu' the GPU ones against the CPU ones")
+            ("check-particle-backend", "Move the particles one step at a time on the CPU and with particle.comp, compare them and exit")
+            ("benchmark-field-layout", "Move '--nbr-particles' particles through the vector field on the CPU in every memory layout, print how fast it was and how many cache lines were read, and exit");
 
         simulation.add_options()
             ("width-ratio, w", value<unsigned int>()->default_value(16), "Width-Ratio like 16 in 16:9")
             ("height-ratio, h", value<unsigned int>()->default_value(9), "Width-Ratio like 9 in 16:9")
             ("pixels-per-ratio", value<unsigned int>()->default_value(80), "The number of pixels per ratio")
             ("vectors-per-ratio", value<unsigned int>()->default_value(1200), "The number of vectors per ratio")
+            ("field-max-vectors-per-pixel", value<float>()->default_value(2.0f), "With '--field-backend cpu' a vector field with more vectors per pixel than this is built at this resolution instead, every vector the average of the ones it stands for")
             ("speed", value<float>()->default_value(1.0), "modify the speed of the particles")
             ("point-size", value<float>()->default_value(2.0f), "The pixel size of the particles")
             ("nbr-particles", value<unsigned int>()->default_value(1024), "The number of particles in the simulation")
-            ("nbr-compute-groups", value<unsigned int>()->default_value(1024), "The number of compute groups issues to the graphics card")
+            ("nbr-compute-groups", value<unsigned int>()->default_value(1024), "Not used anymore, every particle is moved whatever their number. Kept so that old configs still work")
+            ("particle-local-size", value<std::string>()->default_value("auto"), "The number of particles in a work group of particle.comp: '64', '128', '256', '512', '1024', or 'auto' to time them all once on this GPU and keep the fastest")
+            ("particle-local-size-cache", value<std::string>()->default_value(""), "The file where '--particle-local-size auto' keeps the fastest size for every GPU (empty for ~/.cache/MOTION/particle-local-size.txt, 'none' to time them every run)")
+            ("particle-init", value<std::string>()->default_value("mt19937"), "Where the particles start: 'mt19937' on the CPU one after the other like the NFTs were made, or 'philox' all at once on the graphics card (the same on the CPU with '--particle-backend cpu')")
+            ("particle-seed", value<unsigned int>()->default_value(1000), "The seed of the random start of the particles")
             ("vector-field-function", value<unsigned int>()->default_value(0), "Which function to use when creating the vector field")
+            ("field-x", value<std::string>(), "An expression of x, y, width, and height for the x-component of the vector field, instead of '--vector-field-function' (see src/FieldExpression.hpp)")
+            ("field-y", value<std::string>(), "An expression of x, y, width, and height for the y-component of the vector field")
+            ("field-sdf", value<std::string>(), "A vector field made from signed distance fields, like 'flow(union(circle(0.3), box(0.5, 0.1)), 0.01)', instead of '--vector-field-function' (see src/FieldSdf.hpp)")
+            ("field-image", value<std::string>(), "An image to make the vector field from, instead of '--vector-field-function' (see src/FieldImage.hpp)")
+            ("field-image-blur", value<float>()->default_value(0.0f), "Blur the '--field-image' first, this is the standard deviation in pixels")
+            ("field-image-mode", value<std::string>()->default_value("gradient"), "Point the vectors of the '--field-image' where it gets brighter ('gradient') or along the edges ('along')")
+            ("field-image-strength", value<float>()->default_value(0.01f), "The length of the longest vector of the '--field-image'")
+            ("field-orbit-radius", value<float>()->default_value(0.0f), "Animate the vector field by moving it around a circle with this radius, as a fraction of the height (needs '--field-backend gpu' or 'analytic')")
+            ("field-orbit-period", value<float>()->default_value(10.0f), "The number of seconds it takes the vector field to go around the circle once")
+            ("field-sequence", value<std::string>(), "A folder of vector fields made with '--export-field' to play one after the other, in the order of their names, instead of '--vector-field-function'")
+            ("field-sequence-frames", value<unsigned int>()->default_value(30), "The number of frames it takes to blend from one vector field in '--field-sequence' to the next")
+            ("field-morph", value<std::string>(), "Vector field functions to morph between one after the other, like '3,11,13', instead of '--vector-field-function'. All of them are kept in graphics memory")
+            ("field-morph-frames", value<unsigned int>()->default_value(60), "The number of frames it takes to blend from one function of '--field-morph' to the next")
+            ("field-morph-hold", value<unsigned int>()->default_value(60), "The number of frames every function of '--field-morph' is shown on its own before the blend")
+            ("field-morph-curve", value<std::string>()->default_value("smooth"), "How '--field-morph' blends, at a constant speed ('linear') or easing in and out ('smooth')")
             ("interpolation-mode", value<std::string>()->default_value("smooth"), "Which interpolation mode to use")
             ("probability-to-die", value<float>()->default_value(0.01f), "The probability for a particle to die")
             ("trail-mix-rate", value<float>()->default_value(0.9f), "The rate by which the particle trail is mixed into the background");
@@ -0,0 +1,94 @@
+#ifndef COMPACT_PARTICLES_H
+#define COMPACT_PARTICLES_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+    CS-11 Asn 2: The particles packed into 12-16 bytes each, --particle-format compact.
+    @file CompactParticles.hpp
+    @author Frank Hampus Weslien
+
+    As floats a particle takes 32 bytes, a vec4 for the position and the
+    loop and a vec4 for the color. Packed it is
+      - the position in the vector grid as two ints of fixed point, the vector
+        the particle is past and how far past it in 1/32768ths of a vector
+        (binding 1, 8 bytes). The precision is the same everywhere on the grid,
+        but every step is rounded to 1/32768 of a vector, so the particles
+        don't follow quite the same paths as with floats.
+      - the frame it comes alive at and the number of frames it lives, 16 bits
+        each (binding 6, 4 bytes). Only read by particle.comp when it loops.
+      - the color as RGBA8 (binding 5, 4 bytes), only with color modes 1-3.
+    particle.comp reads and writes them with PARTICLE_COMPACT defined, and
+    particle.vert turns the position into clip space.
+
+    The ints hold grids of up to COMPACT_PARTICLE_MAX_GRID vectors per side,
+    with room for particles to step as far again outside of them before they
+    are put back.
+*/
+
+// The bits below the vector in the fixed point positions
+#define COMPACT_PARTICLE_FRACTION_BITS 15
+// The widest and highest vector grid the fixed point reaches over
+#define COMPACT_PARTICLE_MAX_GRID 32768
+// The longest loop, in frames
+#define COMPACT_PARTICLE_MAX_FRAMES 65535
+
+/**
+ * The particles as the buffers of particle.comp have them.
+ */
+struct CompactParticles {
+    // x and y of every particle
+    std::vector<int32_t> positions;
+    // The first frame in the low 16 bits, the number of frames in the high
+    std::vector<uint32_t> lifetimes;
+    // R, G, B and A as bytes in that order, empty when the colors never change
+    std::vector<uint32_t> colors;
+};
+
+/**
+    @param clip a coordinate of the position in clip space, -1 to 1
+    @param vectors the number of vectors of the grid in that direction
+    @return the coordinate in the fixed point of particle.comp
+*/
+inline int32_t compactParticlePosition(float clip, int vectors){
+    // The last vector is the far edge, like in particle.comp
+    double grid = (clip + 1.0) / 2.0 * (vectors - 1);
+    return (int32_t) std::floor(grid * (1 << COMPACT_PARTICLE_FRACTION_BITS) + 0.5);
+}
+
+/**
+    @param aliveFrom the frame the particle comes alive at
+    @param lifetime the number of frames it lives
+    @return both packed, longer loops are cut at COMPACT_PARTICLE_MAX_FRAMES frames
+*/
+inline uint32_t compactParticleLifetime(float aliveFrom, float lifetime){
+    uint32_t from = (uint32_t) std::min(std::max(aliveFrom, 0.0f), (float) COMPACT_PARTICLE_MAX_FRAMES);
+    uint32_t frames = (uint32_t) std::min(std::max(lifetime, 0.0f), (float) COMPACT_PARTICLE_MAX_FRAMES);
+    return from | frames << 16;
+}
+
+/**
+    @return the color like packUnorm4x8(..) in particle.comp
+*/
+inline uint32_t compactParticleColor(glm::vec4 color){
+    uint32_t packed = 0;
+    for(int c = 0; c < 4; c++){
+        float byte = std::floor(std::min(std::max(color[c], 0.0f), 1.0f) * 255.0f + 0.5f);
+        packed |= (uint32_t) byte << (8 * c);
+    }
+    return packed;
+}
+
+/**
+    @return the lines particle.comp and particle.vert need for the packed particles
+*/
+inline std::string compactParticleShaderDefines(){
+    return "#define PARTICLE_COMPACT\n#define COMPACT_PARTICLE_FRACTION_BITS " + std::to_string(COMPACT_PARTICLE_FRACTION_BITS) + "\n";
+}
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef CPU_PARTICLE_SYSTEM_H
+#define CPU_PARTICLE_SYSTEM_H
+
+#include "../include/glad/glad.h"
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include "FieldKernels.hpp"
+#include "GLHelpers.hpp"
+#include "ParticleStep.hpp"
+#include "ThreadPool.hpp"
+
+/**
+    CS-11 Asn 2: Move the particles on the CPU instead of with particle.comp, --particle-backend cpu.
+    @file CpuParticleSystem.hpp
+    @author Frank Hampus Weslien
+
+    The particles are kept as one array per component, padded to whole SIMD
+    lanes, and stepped on every thread with the widest instruction set the CPU
+    has (see ParticleStep.hpp). The field is read from the host, so nothing
+    but the particles crosses the bus: after every step the positions are
+    interleaved straight into the mapped vertex buffer that particle.vert draws
+    from, and the colors into theirs when the color mode changes them.
+
+    The result is the same as particle.comp's up to the rounding of the GPU's
+    acos and cos, '--check-particle-backend' compares the two.
+
+    NOTE: The object can not be copied since it owns the particles.
+*/
+
+/**
+ * The stepParticles(..) compiled for the instruction set.
+ */
+inline ParticleStepFn particleStepFunction(FieldIsa isa){
+#ifdef FIELD_SIMD_X86
+    switch(isa){
+        case FIELD_ISA_SSE41: return particleStepSSE41();
+        case FIELD_ISA_AVX2: return particleStepAVX2();
+        case FIELD_ISA_AVX512: return particleStepAVX512();
+        default: break;
+    }
+#endif
+    return &stepParticles<float>;
+}
+
+class CpuParticleSystem : private boost::noncopyable
+{
+    unsigned int nbrParticles;
+    // The length of every array, a multiple of PARTICLE_LANE_PADDING
+    size_t stride;
+    std::vector<float> storage;
+    ParticleArrays arrays;
+    ParticleStepParams params;
+
+public:
+
+    /**
+        @param positions the positions as particle.comp has them, 4 floats each
+        @param colors the colors as particle.comp has them, 4 floats each
+        @param params the uniforms of particle.comp and the field, which must outlive the object.
+                      time and loopIteration are set by step(..)
+    */
+    CpuParticleSystem(const std::vector<float> &positions, const std::vector<float> &colors, const ParticleStepParams &params)
+        : nbrParticles(positions.size() / 4)
+        , stride((nbrParticles + PARTICLE_LANE_PADDING - 1) / PARTICLE_LANE_PADDING * PARTICLE_LANE_PADDING)
+        , storage(8 * stride, 0.0f)
+        , params(params)
+    {
+        float * components[8];
+        for(int c = 0; c < 8; c++)
+            components[c] = storage.data() + c * stride;
+        arrays = ParticleArrays { components[0], components[1], components[2], components[3]
+                                , components[4], components[5], components[6], components[7] };
+
+        for(unsigned int i = 0; i < nbrParticles; i++){
+            for(int c = 0; c < 4; c++){
+                components[c][i] = positions[4 * i + c];
+                components[4 + c][i] = colors[4 * i + c];
+            }
+        }
+    }
+
+    /**
+        Move every particle one step, like one dispatch of particle.comp.
+        @param pool the threads to move the particles on
+        @param time u_time, seeds the random deaths
+        @param frameNbr u_loop_iteration
+    */
+    void step(ThreadPool &pool, float time, unsigned int frameNbr){
+        params.time = time;
+        params.loopIteration = (float) frameNbr;
+        const ParticleStepFn stepFn = particleStepFunction(activeFieldIsa());
+        const unsigned int nbrBlocks = stride / PARTICLE_LANE_PADDING;
+        pool.parallelFor(0, nbrBlocks, pool.grainSizeFor(nbrBlocks), [&](unsigned int begin, unsigned int end){
+            stepFn(params, arrays, begin * PARTICLE_LANE_PADDING, end * PARTICLE_LANE_PADDING);
+        });
+    }
+
+    /**
+        Write the particles interleaved, 4 floats each like particle.comp has them.
+        @param pool the threads to do the work on
+        @param positions room for 4 floats per particle
+        @param colors room for 4 floats per particle, or NULL to skip them
+    */
+    void interleave(ThreadPool &pool, float *positions, float *colors) const {
+        const float * positionComponents[4] = { arrays.x, arrays.y, arrays.aliveFrom, arrays.lifetime };
+        const float * colorComponents[4] = { arrays.red, arrays.green, arrays.blue, arrays.alpha };
+        interleave(pool, positionComponents, positions);
+        if(colors != NULL)
+            interleave(pool, colorComponents, colors);
+    }
+
+    /**
+        Replace the contents of the vertex buffers with the particles.
+        @param pool the threads to do the work on
+        @param positionVbo the vertex buffer of the positions, with room for every particle
+        @param colorVbo the vertex buffer of the colors, or 0 when the colors never change
+        @return false if a buffer could not be mapped
+    */
+    bool upload(ThreadPool &pool, GLuint positionVbo, GLuint colorVbo) const {
+        const float * positionComponents[4] = { arrays.x, arrays.y, arrays.aliveFrom, arrays.lifetime };
+        const float * colorComponents[4] = { arrays.red, arrays.green, arrays.blue, arrays.alpha };
+        bool uploaded = upload(pool, positionComponents, positionVbo);
+        if(colorVbo != 0)
+            uploaded = upload(pool, colorComponents, colorVbo) && uploaded;
+        return uploaded;
+    }
+
+    /**
+        @return the number of particles
+    */
+    unsigned int size() const {
+        return nbrParticles;
+    }
+
+    /**
+        @return the length of the arrays, the number of particles padded to whole lanes
+    */
+    unsigned int paddedSize() const {
+        return stride;
+    }
+
+    /**
+        @return the particles, valid until the object is destroyed
+    */
+    const ParticleArrays &particleArrays() const {
+        return arrays;
+    }
+
+private:
+
+    // The four arrays one after the other for every particle
+    void interleave(ThreadPool &pool, const float * const components[4], float *out) const {
+        pool.parallelFor(0, nbrParticles, pool.grainSizeFor(nbrParticles), [&](unsigned int begin, unsigned int end){
+            for(unsigned int i = begin; i < end; i++){
+                for(int c = 0; c < 4; c++)
+                    out[4 * (size_t) i + c] = components[c][i];
+            }
+        });
+    }
+
+    // The four arrays interleaved into the mapped vertex buffer
+    bool upload(ThreadPool &pool, const float * const components[4], GLuint vbo) const {
+        GLsizeiptr nbytes = (GLsizeiptr) nbrParticles * 4 * sizeof(float);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        // Invalidated, so the driver doesn't wait for the frame that still draws the old particles
+        float * mapping = (float *) glMapBufferRange(GL_ARRAY_BUFFER, 0, nbytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if(mapping == NULL){
+            std::cout << "ERROR::CPU_PARTICLE_SYSTEM::COULD_NOT_MAP_BUFFER of size " << nbytes << std::endl;
+            glCheckError();
+            return false;
+        }
+        interleave(pool, components, mapping);
+        bool unmapped = glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
+        glCheckError();
+        if(!unmapped)
+            std::cout << "ERROR::CPU_PARTICLE_SYSTEM::BUFFER_LOST_WHILE_MAPPED" << std::endl;
+        return unmapped;
+    }
+};
+
+#endif
@@ -0,0 +1,625 @@
+#ifndef FIELD_ANALYSIS_H
+#define FIELD_ANALYSIS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <png.h>
+#include <boost/filesystem.hpp>
+#include "ThreadPool.hpp"
+#include "VectorField.hpp"
+
+/**
+    CS-11 Asn 2: Find out what a vector field does to the particles without rendering it.
+    @file FieldAnalysis.hpp
+    @author Frank Hampus Weslien
+
+    Everything runs on the CPU, spread over the thread pool a few columns at a
+    time like buildVectorField(..).
+
+    - The speed, divergence and curl of every vector, the derivatives taken
+      over the neighbouring vectors, in units of the grid. Min, max, mean and a
+      histogram of each, the divergence and curl as their absolute value.
+    - Fixed points, the cells where both components of the field change sign.
+      They are sinks, sources, saddles or centers depending on the derivatives
+      across the cell.
+    - Basins. FIELD_ANALYSIS_SEEDS particles, spread evenly over the field, are
+      moved the way particle.comp moves them with 'smooth' interpolation for the
+      frames of the video. A particle that ends up within
+      FIELD_ANALYSIS_SINK_RADIUS vectors of a sink is in its basin. If a few
+      basins hold most of the particles the video will be a few dots.
+
+    The report is report.json in the output folder, with speed.png,
+    divergence.png, curl.png and basins.png next to it. The images are the field
+    as seen on screen, at most FIELD_ANALYSIS_IMAGE_WIDTH pixels wide.
+*/
+
+#define FIELD_ANALYSIS_BINS 64
+// The most values the percentiles are taken from
+#define FIELD_ANALYSIS_PERCENTILE_SAMPLES (1 << 20)
+#define FIELD_ANALYSIS_SEEDS 65536
+#define FIELD_ANALYSIS_SINK_RADIUS 4.0f
+#define FIELD_ANALYSIS_IMAGE_WIDTH 1920
+// The largest basins listed in the report
+#define FIELD_ANALYSIS_LISTED_BASINS 32
+
+enum FixedPointKind {
+    FIXED_POINT_SINK,
+    FIXED_POINT_SOURCE,
+    FIXED_POINT_SADDLE,
+    FIXED_POINT_CENTER
+};
+
+struct FixedPoint {
+    float x;
+    float y;
+    FixedPointKind kind;
+    float divergence;
+    float curl;
+};
+
+struct FieldStatistics {
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    double sum = 0.0;
+    uint64_t count = 0;
+    uint64_t nonFinite = 0;
+    // Of the absolute value, FIELD_ANALYSIS_BINS bins from 0 to the largest absolute value
+    double binWidth = 0.0;
+    std::vector<uint64_t> histogram;
+    // The absolute value 99% of the values are below, what the images are scaled to
+    double percentile99 = 0.0;
+
+    void add(float value){
+        if(!std::isfinite(value)){
+            nonFinite++;
+            return;
+        }
+        min = std::min(min, (double) value);
+        max = std::max(max, (double) value);
+        sum += value;
+        count++;
+    }
+
+    void merge(const FieldStatistics &other){
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        sum += other.sum;
+        count += other.count;
+        nonFinite += other.nonFinite;
+    }
+
+    double largestAbsolute() const {
+        return count > 0 ? std::max(std::abs(min), std::abs(max)) : 0.0;
+    }
+};
+
+struct FieldAnalysis {
+    int width;
+    int height;
+    // Of every vector, in the columns layout
+    std::vector<float> speed;
+    std::vector<float> divergence;
+    std::vector<float> curl;
+    FieldStatistics speedStatistics;
+    FieldStatistics divergenceStatistics;
+    FieldStatistics curlStatistics;
+
+    std::vector<FixedPoint> fixedPoints;
+    size_t nbrOfKind[4] = { 0, 0, 0, 0 };
+
+    unsigned int frames;
+    int seedsX;
+    int seedsY;
+    // The fixed point every seed ended up in, or one of the values below
+    std::vector<int> seedBasin;
+    // The particles in the basin of every fixed point, only sinks have any
+    std::vector<uint32_t> basinSize;
+    size_t seedsLeft = 0;
+    size_t seedsWandering = 0;
+};
+
+#define FIELD_ANALYSIS_WANDERING -1
+#define FIELD_ANALYSIS_LEFT -2
+
+inline const char * fixedPointKindName(FixedPointKind kind){
+    switch(kind){
+    case FIXED_POINT_SINK: return "sink";
+    case FIXED_POINT_SOURCE: return "source";
+    case FIXED_POINT_SADDLE: return "saddle";
+    default: return "center";
+    }
+}
+
+/**
+    Fill in the speed, divergence and curl of every vector and their statistics.
+*/
+inline void analyzeFieldDerivatives(ThreadPool &pool, const VectorField &field, FieldAnalysis &analysis){
+    int width = field.width;
+    int height = field.height;
+    size_t nbrVectors = (size_t) width * height;
+    analysis.speed.resize(nbrVectors);
+    analysis.divergence.resize(nbrVectors);
+    analysis.curl.resize(nbrVectors);
+
+    std::mutex mutex;
+    auto at = [&field](int x, int y){ return field.data + 2 * vectorFieldIndex(x, y, field.height); };
+
+    pool.parallelFor(0, width, pool.grainSizeFor(width), [&](unsigned int begin, unsigned int end){
+        FieldStatistics speed, divergence, curl;
+        for(int x = begin; x < (int) end; x++){
+            int x0 = std::max(0, x - 1);
+            int x1 = std::min(width - 1, x + 1);
+            for(int y = 0; y < height; y++){
+                int y0 = std::max(0, y - 1);
+                int y1 = std::min(height - 1, y + 1);
+                const float * v = at(x, y);
+                const float * left = at(x0, y);
+                const float * right = at(x1, y);
+                const float * below = at(x, y0);
+                const float * above = at(x, y1);
+                float dx = std::max(1, x1 - x0);
+                float dy = std::max(1, y1 - y0);
+
+                size_t i = (size_t) x * height + y;
+                analysis.speed[i] = std::sqrt(v[0] * v[0] + v[1] * v[1]);
+                analysis.divergence[i] = (right[0] - left[0]) / dx + (above[1] - below[1]) / dy;
+                analysis.curl[i] = (right[1] - left[1]) / dx - (above[0] - below[0]) / dy;
+                speed.add(analysis.speed[i]);
+                divergence.add(analysis.divergence[i]);
+                curl.add(analysis.curl[i]);
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        analysis.speedStatistics.merge(speed);
+        analysis.divergenceStatistics.merge(divergence);
+        analysis.curlStatistics.merge(curl);
+    });
+
+    // The histograms need the largest value first
+    FieldStatistics * statistics[3] = { &analysis.speedStatistics, &analysis.divergenceStatistics, &analysis.curlStatistics };
+    const std::vector<float> * values[3] = { &analysis.speed, &analysis.divergence, &analysis.curl };
+    for(int s = 0; s < 3; s++){
+        FieldStatistics &stats = *statistics[s];
+        const float * data = values[s]->data();
+        size_t nbrValues = values[s]->size();
+        size_t stride = std::max<size_t>(1, nbrValues / FIELD_ANALYSIS_PERCENTILE_SAMPLES);
+        std::vector<float> samples;
+        for(size_t i = 0; i < nbrValues; i += stride){
+            if(std::isfinite(data[i]))
+                samples.push_back(std::abs(data[i]));
+        }
+        if(!samples.empty()){
+            auto nth = samples.begin() + (size_t) (0.99 * (samples.size() - 1));
+            std::nth_element(samples.begin(), nth, samples.end());
+            stats.percentile99 = *nth;
+        }
+
+        stats.histogram.assign(FIELD_ANALYSIS_BINS, 0);
+        stats.binWidth = stats.largestAbsolute() / FIELD_ANALYSIS_BINS;
+        if(stats.binWidth <= 0.0){
+            stats.histogram[0] = stats.count;
+            continue;
+        }
+
+        pool.parallelFor(0, width, pool.grainSizeFor(width), [&, data](unsigned int begin, unsigned int end){
+            std::vector<uint64_t> histogram(FIELD_ANALYSIS_BINS, 0);
+            for(size_t i = (size_t) begin * height; i < (size_t) end * height; i++){
+                if(std::isfinite(data[i]))
+                    histogram[std::min(FIELD_ANALYSIS_BINS - 1, (int) (std::abs(data[i]) / stats.binWidth))]++;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            for(int bin = 0; bin < FIELD_ANALYSIS_BINS; bin++)
+                stats.histogram[bin] += histogram[bin];
+        });
+    }
+}
+
+/**
+    Find the cells where both components of the field are zero somewhere.
+*/
+inline void findFixedPoints(ThreadPool &pool, const VectorField &field, FieldAnalysis &analysis){
+    int width = field.width;
+    int height = field.height;
+    std::mutex mutex;
+
+    pool.parallelFor(0, std::max(0, width - 1), pool.grainSizeFor(width), [&](unsigned int begin, unsigned int end){
+        std::vector<FixedPoint> found;
+        for(int x = begin; x < (int) end; x++){
+            for(int y = 0; y + 1 < height; y++){
+                const float * v00 = field.data + 2 * vectorFieldIndex(x, y, height);
+                const float * v10 = field.data + 2 * vectorFieldIndex(x + 1, y, height);
+                const float * v01 = field.data + 2 * vectorFieldIndex(x, y + 1, height);
+                const float * v11 = field.data + 2 * vectorFieldIndex(x + 1, y + 1, height);
+
+                bool crosses = true;
+                for(int c = 0; c < 2 && crosses; c++){
+                    float low = std::min(std::min(v00[c], v10[c]), std::min(v01[c], v11[c]));
+                    float high = std::max(std::max(v00[c], v10[c]), std::max(v01[c], v11[c]));
+                    // Also false for NaN
+                    crosses = low <= 0.0f && high >= 0.0f && std::isfinite(low) && std::isfinite(high);
+                }
+                if(!crosses)
+                    continue;
+
+                // The derivatives across the cell
+                float dxdx = ((v10[0] + v11[0]) - (v00[0] + v01[0])) / 2;
+                float dxdy = ((v01[0] + v11[0]) - (v00[0] + v10[0])) / 2;
+                float dydx = ((v10[1] + v11[1]) - (v00[1] + v01[1])) / 2;
+                float dydy = ((v01[1] + v11[1]) - (v00[1] + v10[1])) / 2;
+                float trace = dxdx + dydy;
+                float determinant = dxdx * dydy - dxdy * dydx;
+                float scale = std::abs(dxdx) + std::abs(dxdy) + std::abs(dydx) + std::abs(dydy);
+
+                FixedPoint point = { x + 0.5f, y + 0.5f, FIXED_POINT_CENTER, trace, dydx - dxdy };
+                if(determinant < 0.0f)
+                    point.kind = FIXED_POINT_SADDLE;
+                else if(trace < -1e-3f * scale)
+                    point.kind = FIXED_POINT_SINK;
+                else if(trace > 1e-3f * scale)
+                    point.kind = FIXED_POINT_SOURCE;
+                found.push_back(point);
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        analysis.fixedPoints.insert(analysis.fixedPoints.end(), found.begin(), found.end());
+    });
+
+    // The chunks finish in any order
+    std::sort(analysis.fixedPoints.begin(), analysis.fixedPoints.end(), [](const FixedPoint &a, const FixedPoint &b){
+        return a.x < b.x || (a.x == b.x && a.y < b.y);
+    });
+    for(const FixedPoint &point : analysis.fixedPoints)
+        analysis.nbrOfKind[point.kind]++;
+}
+
+/**
+    Move the seeds through the field and find the sink every one of them ends up in.
+    @param speedFactor how far the particles move per frame, like speed_factor in particle.comp
+    @param frames the number of frames to move them
+*/
+inline void findBasins(ThreadPool &pool, const VectorField &field, FieldAnalysis &analysis, float speedFactor, unsigned int frames){
+    int width = field.width;
+    int height = field.height;
+    float fWidth = width - 1.0f;
+    float fHeight = height - 1.0f;
+
+    // About FIELD_ANALYSIS_SEEDS seeds in the proportions of the field
+    double spacing = std::sqrt((double) width * height / FIELD_ANALYSIS_SEEDS);
+    analysis.frames = frames;
+    analysis.seedsX = std::max(1, (int) (width / spacing));
+    analysis.seedsY = std::max(1, (int) (height / spacing));
+    int seedsX = analysis.seedsX;
+    int seedsY = analysis.seedsY;
+    analysis.seedBasin.assign((size_t) seedsX * seedsY, FIELD_ANALYSIS_WANDERING);
+
+    // The sinks sorted by the bucket of FIELD_ANALYSIS_SINK_RADIUS vectors they are in
+    int bucketsY = (int) (height / FIELD_ANALYSIS_SINK_RADIUS) + 1;
+    auto bucketOf = [bucketsY](int bx, int by){ return (int64_t) bx * bucketsY + by; };
+    std::vector<std::pair<int64_t, int>> sinks;
+    for(size_t i = 0; i < analysis.fixedPoints.size(); i++){
+        const FixedPoint &point = analysis.fixedPoints[i];
+        if(point.kind == FIXED_POINT_SINK)
+            sinks.push_back(std::make_pair(bucketOf((int) (point.x / FIELD_ANALYSIS_SINK_RADIUS), (int) (point.y / FIELD_ANALYSIS_SINK_RADIUS)), (int) i));
+    }
+    std::sort(sinks.begin(), sinks.end());
+
+    auto at = [&field](int x, int y){ return field.data + 2 * vectorFieldIndex(x, y, field.height); };
+
+    pool.parallelFor(0, seedsX, pool.grainSizeFor(seedsX), [&](unsigned int begin, unsigned int end){
+        for(int sx = begin; sx < (int) end; sx++){
+            for(int sy = 0; sy < seedsY; sy++){
+                float pos[2] = { (sx + 0.5f) / seedsX * 2.0f - 1.0f, (sy + 0.5f) / seedsY * 2.0f - 1.0f };
+                float x = 0.0f;
+                float y = 0.0f;
+                bool inside = true;
+
+                for(unsigned int frame = 0; frame <= frames && inside; frame++){
+                    x = (pos[0] + 1.0f) / 2.0f * fWidth;
+                    y = (pos[1] + 1.0f) / 2.0f * fHeight;
+                    inside = x >= 0.0f && x < fWidth && y >= 0.0f && y < fHeight;
+                    if(!inside || frame == frames)
+                        break;
+
+                    int xi = (int) x;
+                    int yi = (int) y;
+                    float dx = x - xi;
+                    float dy = y - yi;
+                    const float * v00 = at(xi, yi);
+                    const float * v10 = at(xi + 1, yi);
+                    const float * v01 = at(xi, yi + 1);
+                    const float * v11 = at(xi + 1, yi + 1);
+                    for(int c = 0; c < 2; c++){
+                        float r1 = v00[c] * (1.0f - dx) + v10[c] * dx;
+                        float r2 = v01[c] * (1.0f - dx) + v11[c] * dx;
+                        pos[c] += speedFactor * (r1 * (1.0f - dy) + r2 * dy);
+                    }
+                }
+
+                int &basin = analysis.seedBasin[(size_t) sx * seedsY + sy];
+                if(!inside){
+                    // particle.comp puts it somewhere else at random
+                    basin = FIELD_ANALYSIS_LEFT;
+                    continue;
+                }
+
+                float closest = FIELD_ANALYSIS_SINK_RADIUS * FIELD_ANALYSIS_SINK_RADIUS;
+                int bx = (int) (x / FIELD_ANALYSIS_SINK_RADIUS);
+                int by = (int) (y / FIELD_ANALYSIS_SINK_RADIUS);
+                for(int nx = bx - 1; nx <= bx + 1; nx++){
+                    for(int ny = by - 1; ny <= by + 1; ny++){
+                        auto range = std::equal_range(sinks.begin(), sinks.end(), std::make_pair(bucketOf(nx, ny), 0),
+                                                      [](const std::pair<int64_t, int> &a, const std::pair<int64_t, int> &b){ return a.first < b.first; });
+                        for(auto it = range.first; it != range.second; ++it){
+                            const FixedPoint &sink = analysis.fixedPoints[it->second];
+                            float distance = (sink.x - x) * (sink.x - x) + (sink.y - y) * (sink.y - y);
+                            if(distance <= closest){
+                                closest = distance;
+                                basin = it->second;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    analysis.basinSize.assign(analysis.fixedPoints.size(), 0);
+    for(int basin : analysis.seedBasin){
+        if(basin == FIELD_ANALYSIS_LEFT)
+            analysis.seedsLeft++;
+        else if(basin == FIELD_ANALYSIS_WANDERING)
+            analysis.seedsWandering++;
+        else
+            analysis.basinSize[basin]++;
+    }
+}
+
+/**
+    Write an RGB image, the rows from the top down.
+*/
+inline bool writeFieldAnalysisImage(const std::string &path, int width, int height, const std::vector<png_byte> &rgb){
+    FILE *f = fopen(path.c_str(), "wb");
+    if(f == NULL)
+        return false;
+
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png ? png_create_info_struct(png) : NULL;
+    if(info == NULL || setjmp(png_jmpbuf(png))){
+        png_destroy_write_struct(&png, info ? &info : NULL);
+        fclose(f);
+        return false;
+    }
+
+    std::vector<png_bytep> rows(height);
+    for(int i = 0; i < height; i++)
+        rows[i] = (png_bytep) &rgb[(size_t) i * width * 3];
+
+    png_init_io(png, f);
+    png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+    png_write_image(png, rows.data());
+    png_write_end(png, NULL);
+    png_destroy_write_struct(&png, &info);
+    fclose(f);
+    return true;
+}
+
+/**
+    Draw an image of the field, color(x, y, rgb) colors the vector at (x, y).
+    Up is up, like on screen.
+*/
+template <typename Color>
+bool writeFieldAnalysisImage(ThreadPool &pool, const std::string &path, int width, int height, Color color){
+    int imageWidth = std::min(width, FIELD_ANALYSIS_IMAGE_WIDTH);
+    int imageHeight = std::max(1, (int) ((int64_t) height * imageWidth / width));
+    std::vector<png_byte> rgb((size_t) imageWidth * imageHeight * 3);
+
+    pool.parallelFor(0, imageHeight, pool.grainSizeFor(imageHeight), [&](unsigned int begin, unsigned int end){
+        for(int row = begin; row < (int) end; row++){
+            int y = (int) ((int64_t) (imageHeight - 1 - row) * height / imageHeight);
+            for(int column = 0; column < imageWidth; column++)
+                color((int) ((int64_t) column * width / imageWidth), y, &rgb[((size_t) row * imageWidth + column) * 3]);
+        }
+    });
+
+    return writeFieldAnalysisImage(path, imageWidth, imageHeight, rgb);
+}
+
+// Black through red and yellow to white for t in [0, 1]
+inline void fieldAnalysisHeat(float t, png_byte *rgb){
+    t = std::isfinite(t) ? std::min(1.0f, std::max(0.0f, t)) : 1.0f;
+    rgb[0] = (png_byte) (255 * std::min(1.0f, 3.0f * t));
+    rgb[1] = (png_byte) (255 * std::min(1.0f, std::max(0.0f, 3.0f * t - 1.0f)));
+    rgb[2] = (png_byte) (255 * std::max(0.0f, 3.0f * t - 2.0f));
+}
+
+// Blue for -1, white for 0 and red for 1
+inline void fieldAnalysisDiverging(float t, png_byte *rgb){
+    if(!std::isfinite(t))
+        t = t > 0.0f ? 1.0f : -1.0f;
+    t = std::min(1.0f, std::max(-1.0f, t));
+    float fade = 1.0f - std::abs(t);
+    rgb[0] = (png_byte) (255 * (t > 0.0f ? 1.0f : fade));
+    rgb[1] = (png_byte) (255 * fade);
+    rgb[2] = (png_byte) (255 * (t < 0.0f ? 1.0f : fade));
+}
+
+// The value as a part of scale for the colors above. A scale of 0 means every
+// finite value is 0, which would otherwise be 0 / 0.
+inline float fieldAnalysisScaled(float value, float scale){
+    if(scale == 0.0f && std::isfinite(value))
+        return 0.0f;
+    return value / scale;
+}
+
+inline std::string fieldAnalysisNumber(double value){
+    if(!std::isfinite(value))
+        return "null";
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.6g", value);
+    return buffer;
+}
+
+// The text as a JSON string, with the quotes
+inline std::string fieldAnalysisString(const std::string &text){
+    std::string quoted = "\"";
+    for(unsigned char c : text){
+        if(c == '"' || c == '\\'){
+            quoted += '\\';
+            quoted += c;
+        }
+        else if(c < 0x20){
+            char buffer[8];
+            snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            quoted += buffer;
+        }
+        else
+            quoted += c;
+    }
+    return quoted + "\"";
+}
+
+inline void writeFieldStatistics(std::ostream &out, const char *name, const FieldStatistics &stats){
+    out << "  \"" << name << "\": {\n"
+        << "    \"min\": " << fieldAnalysisNumber(stats.count > 0 ? stats.min : 0.0) << ",\n"
+        << "    \"max\": " << fieldAnalysisNumber(stats.count > 0 ? stats.max : 0.0) << ",\n"
+        << "    \"mean\": " << fieldAnalysisNumber(stats.count > 0 ? stats.sum / stats.count : 0.0) << ",\n"
+        << "    \"99th_percentile_of_absolute\": " << fieldAnalysisNumber(stats.percentile99) << ",\n"
+        << "    \"not_finite\": " << stats.nonFinite << ",\n"
+        << "    \"histogram_bin_width\": " << fieldAnalysisNumber(stats.binWidth) << ",\n"
+        << "    \"histogram\": [";
+    for(size_t bin = 0; bin < stats.histogram.size(); bin++)
+        out << (bin > 0 ? ", " : "") << stats.histogram[bin];
+    out << "]\n  },\n";
+}
+
+/**
+    Analyze the field and write the report and the images to a folder.
+    @param pool the threads to do the work on
+    @param field the vector field, as the particles see it
+    @param name what the field is called in the report
+    @param speedFactor how far the particles move per frame, like speed_factor in particle.comp
+    @param frames the number of frames the particles are followed
+    @param directory the folder to write to, it is created if needed
+    @return false if the report could not be written
+*/
+inline bool analyzeField(ThreadPool &pool, const VectorField &field, const std::string &name, float speedFactor, unsigned int frames, const std::string &directory){
+    FieldAnalysis analysis;
+    analysis.width = field.width;
+    analysis.height = field.height;
+
+    analyzeFieldDerivatives(pool, field, analysis);
+    findFixedPoints(pool, field, analysis);
+    findBasins(pool, field, analysis, speedFactor, frames);
+
+    boost::system::error_code error;
+    boost::filesystem::create_directories(directory, error);
+    boost::filesystem::path folder(directory);
+
+    // The basins by size
+    std::vector<int> basins;
+    for(size_t i = 0; i < analysis.basinSize.size(); i++){
+        if(analysis.basinSize[i] > 0)
+            basins.push_back(i);
+    }
+    std::sort(basins.begin(), basins.end(), [&analysis](int a, int b){ return analysis.basinSize[a] > analysis.basinSize[b]; });
+    double nbrSeeds = analysis.seedBasin.size();
+    uint64_t inLargest = 0;
+    uint64_t inFiveLargest = 0;
+    for(size_t i = 0; i < basins.size() && i < 5; i++){
+        inFiveLargest += analysis.basinSize[basins[i]];
+        if(i == 0)
+            inLargest = analysis.basinSize[basins[i]];
+    }
+
+    std::string reportPath = (folder / "report.json").string();
+    std::ofstream out(reportPath.c_str(), std::ios::trunc);
+    out << "{\n"
+        << "  \"field\": " << fieldAnalysisString(name) << ",\n"
+        << "  \"width\": " << field.width << ",\n"
+        << "  \"height\": " << field.height << ",\n";
+    writeFieldStatistics(out, "speed", analysis.speedStatistics);
+    writeFieldStatistics(out, "divergence", analysis.divergenceStatistics);
+    writeFieldStatistics(out, "curl", analysis.curlStatistics);
+    out << "  \"fixed_points\": {\n";
+    for(int kind = 0; kind < 4; kind++)
+        out << "    \"" << fixedPointKindName((FixedPointKind) kind) << "s\": " << analysis.nbrOfKind[kind] << (kind < 3 ? ",\n" : "\n");
+    out << "  },\n"
+        << "  \"particles\": {\n"
+        << "    \"seeds\": " << analysis.seedBasin.size() << ",\n"
+        << "    \"frames\": " << frames << ",\n"
+        << "    \"left_the_field\": " << fieldAnalysisNumber(analysis.seedsLeft / nbrSeeds) << ",\n"
+        << "    \"not_in_a_sink\": " << fieldAnalysisNumber(analysis.seedsWandering / nbrSeeds) << ",\n"
+        << "    \"in_a_sink\": " << fieldAnalysisNumber((nbrSeeds - analysis.seedsLeft - analysis.seedsWandering) / nbrSeeds) << ",\n"
+        << "    \"in_the_largest_basin\": " << fieldAnalysisNumber(inLargest / nbrSeeds) << ",\n"
+        << "    \"in_the_five_largest_basins\": " << fieldAnalysisNumber(inFiveLargest / nbrSeeds) << "\n"
+        << "  },\n"
+        << "  \"basins\": [";
+    for(size_t i = 0; i < basins.size() && i < FIELD_ANALYSIS_LISTED_BASINS; i++){
+        const FixedPoint &sink = analysis.fixedPoints[basins[i]];
+        out << (i > 0 ? "," : "") << "\n    { \"x\": " << fieldAnalysisNumber(sink.x)
+            << ", \"y\": " << fieldAnalysisNumber(sink.y)
+            << ", \"particles\": " << fieldAnalysisNumber(analysis.basinSize[basins[i]] / nbrSeeds)
+            << ", \"divergence\": " << fieldAnalysisNumber(sink.divergence)
+            << ", \"curl\": " << fieldAnalysisNumber(sink.curl) << " }";
+    }
+    out << (basins.empty() ? "" : "\n  ") << "]\n}\n";
+    out.close();
+
+    if(!out){
+        std::cout << "ERROR::FIELD_ANALYSIS::COULD_NOT_WRITE '" << reportPath << "'" << std::endl;
+        return false;
+    }
+
+    int width = field.width;
+    int height = field.height;
+    float speedScale = analysis.speedStatistics.percentile99;
+    float divergenceScale = analysis.divergenceStatistics.percentile99;
+    float curlScale = analysis.curlStatistics.percentile99;
+    bool written = true;
+
+    written &= writeFieldAnalysisImage(pool, (folder / "speed.png").string(), width, height, [&](int x, int y, png_byte *rgb){
+        fieldAnalysisHeat(fieldAnalysisScaled(analysis.speed[(size_t) x * height + y], speedScale), rgb);
+    });
+    written &= writeFieldAnalysisImage(pool, (folder / "divergence.png").string(), width, height, [&](int x, int y, png_byte *rgb){
+        fieldAnalysisDiverging(fieldAnalysisScaled(analysis.divergence[(size_t) x * height + y], divergenceScale), rgb);
+    });
+    written &= writeFieldAnalysisImage(pool, (folder / "curl.png").string(), width, height, [&](int x, int y, png_byte *rgb){
+        fieldAnalysisDiverging(fieldAnalysisScaled(analysis.curl[(size_t) x * height + y], curlScale), rgb);
+    });
+    // Every seed colored by the basin it ends up in, gray if none and black if it left
+    written &= writeFieldAnalysisImage(pool, (folder / "basins.png").string(), width, height, [&](int x, int y, png_byte *rgb){
+        int sx = std::min(analysis.seedsX - 1, (int) ((int64_t) x * analysis.seedsX / width));
+        int sy = std::min(analysis.seedsY - 1, (int) ((int64_t) y * analysis.seedsY / height));
+        int basin = analysis.seedBasin[(size_t) sx * analysis.seedsY + sy];
+        uint32_t hash = basin * 2654435761u;
+        rgb[0] = basin == FIELD_ANALYSIS_LEFT ? 0 : basin == FIELD_ANALYSIS_WANDERING ? 128 : 64 + (hash >> 8) % 192;
+        rgb[1] = basin == FIELD_ANALYSIS_LEFT ? 0 : basin == FIELD_ANALYSIS_WANDERING ? 128 : 64 + (hash >> 16) % 192;
+        rgb[2] = basin == FIELD_ANALYSIS_LEFT ? 0 : basin == FIELD_ANALYSIS_WANDERING ? 128 : 64 + (hash >> 24) % 192;
+    });
+
+    if(!written)
+        std::cout << "ERROR::FIELD_ANALYSIS::COULD_NOT_WRITE_IMAGES to '" << directory << "'" << std::endl;
+
+    std::cout << "The vector field has " << analysis.nbrOfKind[FIXED_POINT_SINK] << " sinks, "
+              << analysis.nbrOfKind[FIXED_POINT_SOURCE] << " sources, "
+              << analysis.nbrOfKind[FIXED_POINT_SADDLE] << " saddles and "
+              << analysis.nbrOfKind[FIXED_POINT_CENTER] << " centers. After " << frames << " frames "
+              << 100.0 * (nbrSeeds - analysis.seedsLeft - analysis.seedsWandering) / nbrSeeds << "% of the particles are in a sink, "
+              << 100.0 * inFiveLargest / nbrSeeds << "% in the five largest and "
+              << 100.0 * analysis.seedsLeft / nbrSeeds << "% left the field. The report is in '" << reportPath << "'" << std::endl;
+    return written;
+}
+
+#endif
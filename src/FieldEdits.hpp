@@ -0,0 +1,291 @@
+#ifndef FIELD_EDITS_H
+#define FIELD_EDITS_H
+
+#include "../include/glad/glad.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include "GLHelpers.hpp"
+#include "ThreadPool.hpp"
+#include "VectorField.hpp"
+
+/**
+    CS-11 Asn 2: Changes to parts of the vector field while the program runs.
+    @file FieldEdits.hpp
+    @author Frank Hampus Weslien
+
+    An edit moves the vectors inside a circle towards a target, either another
+    field function or a fixed vector, by the most in the middle and not at all at
+    the edge. They come from a script (--field-edits) or from dragging the mouse
+    over the window (--field-brush), which pulls the field along with it.
+
+    Only the rectangle around the circle is computed, on all threads, and only
+    that rectangle is written to the mapped ssbo or sent to the texture with
+    glTexSubImage2D, so an edit costs the same on any grid. The mapped ssbo can
+    only be written to, so FieldEditor keeps its own copy of the vectors, made
+    a FIELD_EDIT_TILE_SIZE x FIELD_EDIT_TILE_SIZE tile at a time the first time
+    an edit touches the tile.
+
+    NOTE: The object can not be copied since it owns the copy of the field.
+*/
+
+// The side of the tiles FieldEditor copies the field in, in vectors
+#define FIELD_EDIT_TILE_SIZE 64
+
+/**
+ * Move the vectors inside a circle towards a target.
+ */
+struct FieldEdit {
+    // The middle of the circle, in vectors
+    float x;
+    float y;
+    // The radius of the circle, in vectors
+    float radius;
+    // How far the vectors in the middle are moved towards the target, from 0 to 1
+    float strength;
+    // The target, or NULL for (targetX, targetY) everywhere
+    const FieldKernel * kernel;
+    float targetX;
+    float targetY;
+};
+
+/**
+ * A rectangle of the grid, [x0, x1) x [y0, y1).
+ */
+struct FieldRect {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+/**
+ * An edit from --field-edits and the frame it is made before.
+ */
+struct ScriptedFieldEdit {
+    unsigned int frame;
+    FieldEdit edit;
+};
+
+/**
+    Read a script of edits. Every line is one edit,
+
+        <frame> <x> <y> <radius> <strength> function <number>
+        <frame> <x> <y> <radius> <strength> vector <x> <y>
+
+    where x and y go from 0 to 1 over the width and height of the grid, the
+    radius is a part of its height, and everything after a # is ignored. For
+    example '30 0.5 0.5 0.2 1 function 13' turns the middle of the field into
+    function 13 before frame 30.
+
+    @param path the script
+    @param width the number of vectors along the x-axis of the grid
+    @param height the number of vectors along the y-axis of the grid
+    @param edits filled with the edits, in the order of their frames
+    @param error set to what is wrong if the script can't be read
+    @return false if the script can't be read
+*/
+inline bool loadFieldEdits(const std::string &path, int width, int height, std::vector<ScriptedFieldEdit> &edits, std::string &error){
+    std::ifstream in(path.c_str());
+    if(!in){
+        error = "can't open '" + path + "'";
+        return false;
+    }
+
+    std::string line;
+    for(int lineNbr = 1; std::getline(in, line); lineNbr++){
+        line = line.substr(0, line.find('#'));
+        if(line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+        std::istringstream words(line);
+
+        ScriptedFieldEdit scripted;
+        FieldEdit &edit = scripted.edit;
+        std::string kind;
+        bool good = bool(words >> scripted.frame >> edit.x >> edit.y >> edit.radius >> edit.strength >> kind);
+        edit.kernel = NULL;
+        edit.targetX = edit.targetY = 0.0f;
+        if(good && kind == "function"){
+            unsigned int functionNbr;
+            good = bool(words >> functionNbr) && functionNbr < NBR_FIELD_FUNCTIONS;
+            if(good)
+                edit.kernel = fieldKernel(functionNbr);
+        } else if(good && kind == "vector"){
+            good = bool(words >> edit.targetX >> edit.targetY);
+        } else {
+            good = false;
+        }
+        std::string rest;
+        if(!good || words >> rest){
+            error = path + ":" + std::to_string(lineNbr) + ": expected '<frame> <x> <y> <radius> <strength> function <number>' or '... vector <x> <y>'";
+            return false;
+        }
+
+        edit.x *= width - 1;
+        edit.y *= height - 1;
+        edit.radius *= height;
+        edits.push_back(scripted);
+    }
+
+    std::stable_sort(edits.begin(), edits.end(), [](const ScriptedFieldEdit &a, const ScriptedFieldEdit &b){
+        return a.frame < b.frame;
+    });
+    return true;
+}
+
+class FieldEditor : private boost::noncopyable
+{
+    const FieldKernel * kernel;
+    VectorField field;
+    GLuint texture;
+    int sampleWidth;
+    int sampleHeight;
+    int tilesX;
+    int tilesY;
+
+    // The copy of the field, NULL for the tiles no edit has touched
+    std::vector<std::unique_ptr<float[]>> tiles;
+    size_t nbrCopied = 0;
+    // The rectangle on its way to the texture
+    std::vector<float> staging;
+
+public:
+
+    /**
+        @param kernel the function the field was built with, must outlive the object
+        @param field the field, data is NULL unless it is the mapped ssbo
+        @param texture the texture the field is in, 0 when it is in the ssbo
+        @param sampleWidth the width of the grid the field was sampled on, see buildVectorField(..)
+        @param sampleHeight the height of the grid the field was sampled on
+    */
+    FieldEditor(const FieldKernel *kernel, VectorField field, GLuint texture, int sampleWidth, int sampleHeight)
+        : kernel(kernel)
+        , field(field)
+        , texture(texture)
+        , sampleWidth(sampleWidth)
+        , sampleHeight(sampleHeight)
+        , tilesX((field.width + FIELD_EDIT_TILE_SIZE - 1) / FIELD_EDIT_TILE_SIZE)
+        , tilesY((field.height + FIELD_EDIT_TILE_SIZE - 1) / FIELD_EDIT_TILE_SIZE)
+        , tiles(tilesX * tilesY)
+    {}
+
+    /**
+        Make the edit, and write the vectors it changed to the field.
+        @param pool the threads to do the work on
+        @param edit the edit
+        @return the rectangle that was written, empty if the circle is outside the grid
+    */
+    FieldRect apply(ThreadPool &pool, const FieldEdit &edit){
+        const int width = field.width;
+        const int height = field.height;
+        FieldRect rect;
+        rect.x0 = std::max(0, (int) std::floor(edit.x - edit.radius));
+        rect.y0 = std::max(0, (int) std::floor(edit.y - edit.radius));
+        rect.x1 = std::min(width, (int) std::ceil(edit.x + edit.radius) + 1);
+        rect.y1 = std::min(height, (int) std::ceil(edit.y + edit.radius) + 1);
+        if(rect.x0 >= rect.x1 || rect.y0 >= rect.y1 || edit.radius <= 0.0f)
+            return FieldRect { 0, 0, 0, 0 };
+
+        copyTiles(pool, rect);
+
+        const int rectHeight = rect.y1 - rect.y0;
+        if(texture != 0)
+            staging.resize(2 * (size_t) (rect.x1 - rect.x0) * rectHeight);
+
+        pool.parallelFor(rect.x0, rect.x1, pool.grainSizeFor(rect.x1 - rect.x0), [&](unsigned int begin, unsigned int end){
+            std::vector<float> target(2 * rectHeight);
+            for(int x = begin; x < (int) end; x++){
+                if(edit.kernel != NULL)
+                    sampleVectorFieldColumn(*edit.kernel, x, rect.y0, rect.y1, width, height, sampleWidth, sampleHeight, target.data());
+
+                for(int y = rect.y0; y < rect.y1; y++){
+                    float * vector = copyOf(x, y);
+                    float distance = std::sqrt((x - edit.x) * (x - edit.x) + (y - edit.y) * (y - edit.y)) / edit.radius;
+                    if(distance < 1.0f){
+                        // smoothstep, so the edit blends into the field around it
+                        float f = 1.0f - distance;
+                        float w = edit.strength * f * f * (3.0f - 2.0f * f);
+                        float targetX = edit.kernel != NULL ? target[2 * (y - rect.y0)] : edit.targetX;
+                        float targetY = edit.kernel != NULL ? target[2 * (y - rect.y0) + 1] : edit.targetY;
+                        vector[0] += w * (targetX - vector[0]);
+                        vector[1] += w * (targetY - vector[1]);
+                    }
+
+                    if(field.data != NULL){
+                        float * out = field.data + 2 * vectorFieldIndex(x, y, height);
+                        out[0] = vector[0];
+                        out[1] = vector[1];
+                    }
+                    if(texture != 0){
+                        float * out = &staging[2 * ((size_t) (x - rect.x0) * rectHeight + y - rect.y0)];
+                        out[0] = vector[0];
+                        out[1] = vector[1];
+                    }
+                }
+            }
+        });
+
+        // The texture is transposed like the ssbo, the column x is its row x
+        if(texture != 0){
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, rect.y0, rect.x0, rectHeight, rect.x1 - rect.x0, GL_RG, GL_FLOAT, staging.data());
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glCheckError();
+        }
+        return rect;
+    }
+
+    /**
+        @return the RAM taken by the copy of the field
+    */
+    size_t copyBytes() const {
+        return nbrCopied * 2 * FIELD_EDIT_TILE_SIZE * FIELD_EDIT_TILE_SIZE * sizeof(float);
+    }
+
+private:
+
+    float * copyOf(int x, int y){
+        int tile = (y / FIELD_EDIT_TILE_SIZE) * tilesX + x / FIELD_EDIT_TILE_SIZE;
+        int local = (x % FIELD_EDIT_TILE_SIZE) * FIELD_EDIT_TILE_SIZE + y % FIELD_EDIT_TILE_SIZE;
+        return tiles[tile].get() + 2 * local;
+    }
+
+    /**
+        Copy the tiles under the rectangle that are not copied yet. The field
+        can't be read back, so they are built again, a column of a tile at a time.
+    */
+    void copyTiles(ThreadPool &pool, const FieldRect &rect){
+        std::vector<int> missing;
+        for(int ty = rect.y0 / FIELD_EDIT_TILE_SIZE; ty <= (rect.y1 - 1) / FIELD_EDIT_TILE_SIZE; ty++){
+            for(int tx = rect.x0 / FIELD_EDIT_TILE_SIZE; tx <= (rect.x1 - 1) / FIELD_EDIT_TILE_SIZE; tx++){
+                int tile = ty * tilesX + tx;
+                if(!tiles[tile]){
+                    tiles[tile].reset(new float[2 * FIELD_EDIT_TILE_SIZE * FIELD_EDIT_TILE_SIZE]);
+                    missing.push_back(tile);
+                }
+            }
+        }
+        nbrCopied += missing.size();
+
+        const int width = field.width;
+        const int height = field.height;
+        unsigned int nbrColumns = missing.size() * FIELD_EDIT_TILE_SIZE;
+        pool.parallelFor(0, nbrColumns, pool.grainSizeFor(nbrColumns), [&](unsigned int begin, unsigned int end){
+            for(unsigned int i = begin; i < end; i++){
+                int tile = missing[i / FIELD_EDIT_TILE_SIZE];
+                int x = (tile % tilesX) * FIELD_EDIT_TILE_SIZE + i % FIELD_EDIT_TILE_SIZE;
+                int y0 = (tile / tilesX) * FIELD_EDIT_TILE_SIZE;
+                int y1 = std::min(y0 + FIELD_EDIT_TILE_SIZE, height);
+                if(x < width)
+                    sampleVectorFieldColumn(*kernel, x, y0, y1, width, height, sampleWidth, sampleHeight, copyOf(x, y0));
+            }
+        });
+    }
+};
+
+#endif
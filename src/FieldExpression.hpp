@@ -0,0 +1,593 @@
+#ifndef FIELD_EXPRESSION_H
+#define FIELD_EXPRESSION_H
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "FieldKernels.hpp"
+#include "FieldProgram.hpp"
+
+/**
+    CS-11 Asn 2: Vector fields written as expressions in the config, --field-x and --field-y.
+    @file FieldExpression.hpp
+    @author Frank Hampus Weslien
+
+    The two expressions are parsed once and compiled to a FieldProgram, which
+    FieldExpressionKernel runs on the same instruction sets and threads as the
+    numbered functions. The language:
+
+        numbers     1, 0.5, 1e-3
+        variables   x, y (the grid point), width, height (of the grid), pi
+        operators   + - * / ^ and < <= > >= which give 1 or 0
+        functions   sin cos tan atan tanh exp log sqrt abs floor sign
+                    min(a, b) max(a, b) pow(a, b) mod(a, b)
+                    select(c, a, b) which is a where c is not 0 and b elsewhere
+
+    For example function 0 is
+
+        field-x = 0.01 * sin(x * pi / 9)
+        field-y = 0.01 * cos(y * pi / 9)
+
+    pow(a, b) and a ^ b are only defined for a >= 0, like in GLSL, except when b
+    is a whole number written out in the expression, which is turned into
+    multiplications. Parts that do not depend on y are computed once per column
+    and parts that are constant once when the expression is compiled. A part
+    that appears more than once, in one or both expressions, is computed once.
+*/
+
+// The largest whole exponent that is turned into multiplications
+#define FIELD_EXPRESSION_MAX_INTEGER_POWER 16
+
+/**
+ * @param isa the instruction set
+ * @return runFieldProgram(..) compiled for isa, NULL for FIELD_ISA_SCALAR
+ */
+inline FieldProgramSpanFn fieldProgramSpan(FieldIsa isa){
+#ifdef FIELD_SIMD_X86
+    switch(isa){
+        case FIELD_ISA_SSE41: return fieldProgramSpanSSE41();
+        case FIELD_ISA_AVX2: return fieldProgramSpanAVX2();
+        case FIELD_ISA_AVX512: return fieldProgramSpanAVX512();
+        default: break;
+    }
+#endif
+    return NULL;
+}
+
+/**
+ * Apply one instruction to plain floats, used to fold constants.
+ */
+inline float evaluateFieldOp(int op, float a, float b, float c){
+    typedef float T;
+    switch(op){
+#define FIELD_OP_CASE(NAME, OPERANDS, RESULT) case FIELD_OP_##NAME: return RESULT;
+        FIELD_OP_LIST(FIELD_OP_CASE)
+#undef FIELD_OP_CASE
+        default: return 0.0f;
+    }
+}
+
+/**
+ * Parses the expressions into a graph and compiles the graph to a FieldProgram.
+ * Only used through FieldExpressionKernel::compile(..), FieldSdf.hpp builds
+ * its graphs out of the same nodes.
+ */
+class FieldExpressionCompiler
+{
+protected:
+
+    enum NodeKind { NODE_NUMBER, NODE_REGISTER, NODE_OP, NODE_POWER };
+
+    enum Target {
+        TARGET_BLOCK,   // a temporary in the part that runs once per block
+        TARGET_SETUP,   // a temporary in the part that runs once per call
+        TARGET_UNIFORM  // written once by the setup part and kept for the blocks
+    };
+
+    struct Node {
+        NodeKind kind;
+        int op;           // NODE_OP
+        float value;      // NODE_NUMBER
+        int reg;          // NODE_REGISTER
+        int power;        // NODE_POWER, the whole exponent
+        int args[3];
+        bool varying;     // depends on y
+    };
+
+    struct Function {
+        const char * name;
+        int op;
+        int nbrArgs;
+    };
+
+    std::vector<Node> nodes;
+    // Every node by its kind and arguments, so that the same one is never made twice
+    std::map<std::tuple<int, int, int, int, int>, int> uniqueNodes;
+    std::string text;
+    size_t pos = 0;
+
+    std::vector<FieldInstruction> setupCode;
+    std::vector<FieldInstruction> blockCode;
+    bool used[FIELD_PROGRAM_MAX_REGISTERS];
+    bool temporary[FIELD_PROGRAM_MAX_REGISTERS];
+    bool writtenByBlock[FIELD_PROGRAM_MAX_REGISTERS];
+    // The number of times the value in a temporary register is still going to be read
+    int readsLeft[FIELD_PROGRAM_MAX_REGISTERS];
+    uint64_t uniformRegisters = 0;
+    int nbrRegisters = FIELD_PROGRAM_FIRST_FREE_REGISTER;
+    std::map<uint32_t, int> constants;
+    // The number of times every node is read, and the register it is in once it is computed
+    std::vector<int> nodeReads;
+    std::vector<int> nodeRegister;
+
+public:
+
+    /**
+        @param fieldX the expression for the x-component
+        @param fieldY the expression for the y-component
+        @param program filled with the compiled expressions
+        @param error set to what is wrong if the expressions can't be compiled
+        @return false if the expressions can't be compiled
+    */
+    bool compile(const std::string &fieldX, const std::string &fieldY, FieldProgram &program, std::string &error){
+        try {
+            int rootX = parse(fieldX, "field-x");
+            int rootY = parse(fieldY, "field-y");
+            emitProgram(rootX, rootY, program);
+        } catch(const std::invalid_argument &e) {
+            error = e.what();
+            return false;
+        }
+
+        return finishProgram(program, error);
+    }
+
+protected:
+
+    /**
+        Emit the code for the two components of the field.
+        @param rootX the node of the x-component
+        @param rootY the node of the y-component
+        @param program gets the output registers, the code is added by finishProgram(..)
+    */
+    void emitProgram(int rootX, int rootY, FieldProgram &program){
+        for(int r = 0; r < FIELD_PROGRAM_MAX_REGISTERS; r++){
+            used[r] = r < FIELD_PROGRAM_FIRST_FREE_REGISTER;
+            temporary[r] = false;
+            writtenByBlock[r] = false;
+            readsLeft[r] = 0;
+        }
+        uniformRegisters = (1ull << FIELD_PROGRAM_REGISTER_X)
+                         | (1ull << FIELD_PROGRAM_REGISTER_WIDTH)
+                         | (1ull << FIELD_PROGRAM_REGISTER_HEIGHT);
+
+        nodeReads.assign(nodes.size(), 0);
+        nodeRegister.assign(nodes.size(), -1);
+        countReads(rootX);
+        countReads(rootY);
+
+        // outX stays allocated while field-y is compiled
+        program.outX = (uint8_t) emit(rootX, TARGET_BLOCK);
+        program.outY = (uint8_t) emit(rootY, TARGET_BLOCK);
+    }
+
+    /**
+        Copy the emitted code into the program.
+        @return false if it does not fit
+    */
+    bool finishProgram(FieldProgram &program, std::string &error){
+        if(setupCode.size() + blockCode.size() > FIELD_PROGRAM_MAX_INSTRUCTIONS){
+            error = "the expressions need more than " + std::to_string(FIELD_PROGRAM_MAX_INSTRUCTIONS) + " instructions";
+            return false;
+        }
+
+        std::copy(setupCode.begin(), setupCode.end(), program.code);
+        std::copy(blockCode.begin(), blockCode.end(), program.code + setupCode.size());
+        program.setupLength = (int) setupCode.size();
+        program.length = (int) (setupCode.size() + blockCode.size());
+        program.nbrRegisters = nbrRegisters;
+        program.uniformRegisters = uniformRegisters;
+        return true;
+    }
+
+    // Parsing
+    // --------------------------------------------------------------------------------------------
+
+    int parse(const std::string &expression, const std::string &name){
+        text = expression;
+        pos = 0;
+        try {
+            int root = parseComparison();
+            skipSpace();
+            if(pos < text.size())
+                fail("unexpected '" + std::string(1, text[pos]) + "'");
+            return root;
+        } catch(const std::invalid_argument &e) {
+            throw std::invalid_argument(name + " = " + expression + "\n" + std::string(name.size() + 3 + pos, ' ') + "^ " + e.what());
+        }
+    }
+
+    void fail(const std::string &message){
+        throw std::invalid_argument(message);
+    }
+
+    void skipSpace(){
+        while(pos < text.size() && std::isspace((unsigned char) text[pos]))
+            pos++;
+    }
+
+    bool accept(const char *token){
+        skipSpace();
+        size_t length = std::strlen(token);
+        if(text.compare(pos, length, token) != 0)
+            return false;
+        pos += length;
+        return true;
+    }
+
+    void expect(const char *token){
+        if(!accept(token))
+            fail(std::string("expected '") + token + "'");
+    }
+
+    int parseComparison(){
+        int left = parseSum();
+        if(accept("<="))
+            return makeOp(FIELD_OP_LESS_EQUAL, left, parseSum());
+        if(accept(">="))
+            return makeOp(FIELD_OP_GREATER_EQUAL, left, parseSum());
+        if(accept("<"))
+            return makeOp(FIELD_OP_LESS, left, parseSum());
+        if(accept(">"))
+            return makeOp(FIELD_OP_GREATER, left, parseSum());
+        return left;
+    }
+
+    int parseSum(){
+        int left = parseProduct();
+        for(;;){
+            if(accept("+"))
+                left = makeOp(FIELD_OP_ADD, left, parseProduct());
+            else if(accept("-"))
+                left = makeOp(FIELD_OP_SUB, left, parseProduct());
+            else
+                return left;
+        }
+    }
+
+    int parseProduct(){
+        int left = parseUnary();
+        for(;;){
+            if(accept("*"))
+                left = makeOp(FIELD_OP_MUL, left, parseUnary());
+            else if(accept("/"))
+                left = makeOp(FIELD_OP_DIV, left, parseUnary());
+            else
+                return left;
+        }
+    }
+
+    // -a ^ b is -(a ^ b) and a ^ -b is allowed, like in most languages
+    int parseUnary(){
+        if(accept("-"))
+            return makeOp(FIELD_OP_NEG, parseUnary());
+        if(accept("+"))
+            return parseUnary();
+        int base = parsePrimary();
+        if(accept("^"))
+            return makePower(base, parseUnary());
+        return base;
+    }
+
+    int parsePrimary(){
+        skipSpace();
+        if(pos >= text.size())
+            fail("unexpected end of the expression");
+
+        if(accept("(")){
+            int inner = parseComparison();
+            expect(")");
+            return inner;
+        }
+
+        char c = text[pos];
+        if(std::isdigit((unsigned char) c) || c == '.'){
+            const char * begin = text.c_str() + pos;
+            char * end;
+            float value = std::strtof(begin, &end);
+            if(end == begin)
+                fail("expected a number");
+            pos += end - begin;
+            return makeNumber(value);
+        }
+
+        if(!std::isalpha((unsigned char) c) && c != '_')
+            fail("unexpected '" + std::string(1, c) + "'");
+
+        size_t start = pos;
+        while(pos < text.size() && (std::isalnum((unsigned char) text[pos]) || text[pos] == '_'))
+            pos++;
+        std::string name = text.substr(start, pos - start);
+
+        if(name == "x") return makeRegister(FIELD_PROGRAM_REGISTER_X, false);
+        if(name == "y") return makeRegister(FIELD_PROGRAM_REGISTER_Y, true);
+        if(name == "width") return makeRegister(FIELD_PROGRAM_REGISTER_WIDTH, false);
+        if(name == "height") return makeRegister(FIELD_PROGRAM_REGISTER_HEIGHT, false);
+        if(name == "pi") return makeNumber(FIELD_PI);
+
+        static const Function functions[] = {
+            { "sin", FIELD_OP_SIN, 1 },     { "cos", FIELD_OP_COS, 1 },     { "tan", FIELD_OP_TAN, 1 },
+            { "atan", FIELD_OP_ATAN, 1 },   { "tanh", FIELD_OP_TANH, 1 },   { "exp", FIELD_OP_EXP, 1 },
+            { "log", FIELD_OP_LOG, 1 },     { "sqrt", FIELD_OP_SQRT, 1 },   { "abs", FIELD_OP_ABS, 1 },
+            { "floor", FIELD_OP_FLOOR, 1 }, { "sign", FIELD_OP_SIGN, 1 },   { "min", FIELD_OP_MIN, 2 },
+            { "max", FIELD_OP_MAX, 2 },     { "pow", FIELD_OP_POW, 2 },     { "mod", FIELD_OP_MOD, 2 },
+            { "select", FIELD_OP_SELECT, 3 }
+        };
+
+        for(const Function &f : functions){
+            if(name != f.name)
+                continue;
+
+            int args[3] = { -1, -1, -1 };
+            expect("(");
+            for(int i = 0; i < f.nbrArgs; i++){
+                if(i > 0)
+                    expect(",");
+                args[i] = parseComparison();
+            }
+            expect(")");
+
+            if(f.op == FIELD_OP_POW)
+                return makePower(args[0], args[1]);
+            return makeOp(f.op, args[0], args[1], args[2]);
+        }
+
+        pos = start;
+        fail("unknown name '" + name + "'");
+        return -1;
+    }
+
+    // Building the tree
+    // --------------------------------------------------------------------------------------------
+
+    int addNode(const Node &node){
+        nodes.push_back(node);
+        return (int) nodes.size() - 1;
+    }
+
+    // Numbers are shared when they are emitted instead
+    int addUniqueNode(const Node &node){
+        int value = node.kind == NODE_OP ? node.op : node.kind == NODE_POWER ? node.power : node.reg;
+        std::tuple<int, int, int, int, int> key(node.kind, value, node.args[0], node.args[1], node.args[2]);
+        std::map<std::tuple<int, int, int, int, int>, int>::iterator it = uniqueNodes.find(key);
+        if(it != uniqueNodes.end())
+            return it->second;
+
+        int index = addNode(node);
+        uniqueNodes[key] = index;
+        return index;
+    }
+
+    int makeNumber(float value){
+        Node node = {};
+        node.kind = NODE_NUMBER;
+        node.value = value;
+        return addNode(node);
+    }
+
+    int makeRegister(int reg, bool varying){
+        Node node = {};
+        node.kind = NODE_REGISTER;
+        node.reg = reg;
+        node.varying = varying;
+        node.args[0] = node.args[1] = node.args[2] = -1;
+        return addUniqueNode(node);
+    }
+
+    // Constants are folded right away
+    int makeOp(int op, int a, int b = -1, int c = -1){
+        int args[3] = { a, b, c };
+        bool constant = true;
+        bool varying = false;
+        for(int arg : args){
+            if(arg < 0)
+                continue;
+            constant = constant && nodes[arg].kind == NODE_NUMBER;
+            varying = varying || nodes[arg].varying;
+        }
+
+        if(constant){
+            float value[3] = { 0.0f, 0.0f, 0.0f };
+            for(int i = 0; i < 3; i++)
+                if(args[i] >= 0)
+                    value[i] = nodes[args[i]].value;
+            return makeNumber(evaluateFieldOp(op, value[0], value[1], value[2]));
+        }
+
+        Node node = {};
+        node.kind = NODE_OP;
+        node.op = op;
+        node.varying = varying;
+        std::copy(args, args + 3, node.args);
+        return addUniqueNode(node);
+    }
+
+    int makePower(int base, int exponent){
+        const Node &e = nodes[exponent];
+        bool whole = e.kind == NODE_NUMBER && e.value == std::floor(e.value)
+                     && std::abs(e.value) <= FIELD_EXPRESSION_MAX_INTEGER_POWER;
+        if(!whole || nodes[base].kind == NODE_NUMBER)
+            return makeOp(FIELD_OP_POW, base, exponent);
+
+        int power = (int) e.value;
+        if(power == 0)
+            return makeNumber(1.0f);
+        if(power < 0)
+            return makeOp(FIELD_OP_DIV, makeNumber(1.0f), makePower(base, makeNumber((float) -power)));
+        if(power == 1)
+            return base;
+
+        Node node = {};
+        node.kind = NODE_POWER;
+        node.power = power;
+        node.varying = nodes[base].varying;
+        node.args[0] = base;
+        node.args[1] = node.args[2] = -1;
+        return addUniqueNode(node);
+    }
+
+    // Code generation
+    // --------------------------------------------------------------------------------------------
+
+    void countReads(int index){
+        if(nodeReads[index]++ > 0)
+            return;
+        for(int arg : nodes[index].args)
+            if(arg >= 0)
+                countReads(arg);
+    }
+
+    /**
+        @param target where the register is written
+        @return a free register
+    */
+    int allocate(Target target){
+        for(int r = FIELD_PROGRAM_FIRST_FREE_REGISTER; r < FIELD_PROGRAM_MAX_REGISTERS; r++){
+            // The setup part runs first, anything the blocks write over is lost
+            if(used[r] || (target == TARGET_UNIFORM && writtenByBlock[r]))
+                continue;
+
+            used[r] = true;
+            temporary[r] = target != TARGET_UNIFORM;
+            writtenByBlock[r] = writtenByBlock[r] || target == TARGET_BLOCK;
+            readsLeft[r] = 1;
+            if(target == TARGET_UNIFORM)
+                uniformRegisters |= 1ull << r;
+            nbrRegisters = std::max(nbrRegisters, r + 1);
+            return r;
+        }
+        fail("the expressions are too complex, they need more than " + std::to_string(FIELD_PROGRAM_MAX_REGISTERS) + " registers");
+        return -1;
+    }
+
+    // Uniform registers are never released, the others once they have been read for the last time
+    void release(int reg){
+        if(temporary[reg] && --readsLeft[reg] <= 0){
+            used[reg] = false;
+            temporary[reg] = false;
+        }
+    }
+
+    void push(Target target, int op, int dst, int a, int b = 0, int c = 0, float value = 0.0f){
+        FieldInstruction ins = { (uint8_t) op, (uint8_t) dst, (uint8_t) a, (uint8_t) b, (uint8_t) c, value };
+        (target == TARGET_BLOCK ? blockCode : setupCode).push_back(ins);
+    }
+
+    /**
+        Emit the instructions for a node.
+        @param target where the result goes, its arguments go to the same part of the program
+        @return the register with the result
+    */
+    int emit(int index, Target target){
+        const Node node = nodes[index];
+
+        if(node.kind == NODE_REGISTER)
+            return node.reg;
+
+        if(node.kind == NODE_NUMBER){
+            uint32_t bits;
+            std::memcpy(&bits, &node.value, sizeof(bits));
+            std::map<uint32_t, int>::iterator it = constants.find(bits);
+            if(it != constants.end())
+                return it->second;
+
+            int reg = allocate(TARGET_UNIFORM);
+            push(TARGET_UNIFORM, FIELD_OP_CONST, reg, 0, 0, 0, node.value);
+            constants[bits] = reg;
+            return reg;
+        }
+
+        if(nodeRegister[index] >= 0)
+            return nodeRegister[index];
+
+        // The largest part of the graph that does not depend on y goes into the setup code,
+        // and so does anything read more than once that does not, the temporaries of the
+        // setup code are gone by the time the blocks run
+        if(!node.varying && (target == TARGET_BLOCK || nodeReads[index] > 1))
+            target = TARGET_UNIFORM;
+
+        Target argTarget = target == TARGET_BLOCK ? TARGET_BLOCK : TARGET_SETUP;
+
+        if(node.kind == NODE_POWER){
+            int base = emit(node.args[0], argTarget);
+            int reg = allocate(target);
+            push(target, FIELD_OP_MUL, reg, base, base);
+            for(int i = 2; i < node.power; i++)
+                push(target, FIELD_OP_MUL, reg, reg, base);
+            release(base);
+            return remember(index, reg);
+        }
+
+        int args[3] = { 0, 0, 0 };
+        for(int i = 0; i < 3; i++)
+            if(node.args[i] >= 0)
+                args[i] = emit(node.args[i], argTarget);
+        for(int i = 0; i < 3; i++)
+            if(node.args[i] >= 0)
+                release(args[i]);
+
+        // The result may go into one of the arguments, every lane is read before it is written
+        int reg = allocate(target);
+        push(target, node.op, reg, args[0], args[1], args[2]);
+        return remember(index, reg);
+    }
+
+    // Keep the node in its register until every node that reads it is emitted
+    int remember(int index, int reg){
+        if(nodeReads[index] > 1){
+            nodeRegister[index] = reg;
+            readsLeft[reg] = nodeReads[index];
+        }
+        return reg;
+    }
+};
+
+/**
+ * A vector field given by two expressions, see the top of this file.
+ */
+class FieldExpressionKernel : public FieldKernel {
+protected:
+    FieldProgram program;
+public:
+
+    /**
+        @param fieldX the expression for the x-component
+        @param fieldY the expression for the y-component
+        @param error set to what is wrong if the expressions can't be compiled
+        @return false if the expressions can't be compiled
+    */
+    bool compile(const std::string &fieldX, const std::string &fieldY, std::string &error){
+        FieldExpressionCompiler compiler;
+        return compiler.compile(fieldX, fieldY, program, error);
+    }
+
+    void evaluate(float x, float y0, float yStep, int count, float width, float height, float * outX, float * outY) const {
+        FieldProgramSpanFn span = fieldProgramSpan(activeFieldIsa());
+        if (span != NULL) {
+            span(program, x, y0, yStep, count, width, height, outX, outY);
+            return;
+        }
+
+        runFieldProgram<float>(program, x, y0, yStep, count, width, height, outX, outY);
+    }
+};
+
+#endif
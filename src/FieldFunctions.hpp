@@ -0,0 +1,653 @@
+#ifndef FIELD_FUNCTIONS_H
+#define FIELD_FUNCTIONS_H
+
+#include "FieldMath.hpp"
+#include "VectorFieldFunctions.hpp"
+
+/**
+    CS-11 Asn 2: The numbered vector field functions.
+    @file FieldFunctions.hpp
+    @author Frank Hampus Weslien
+
+    Every function is written as a struct with a static eval(..) template that
+    computes one vector per lane. T is float for the scalar kernels and one of
+    the lane types in SimdVec.hpp for the SIMD kernels, so the math has to go
+    through fieldmath:: and branches through fieldmath::select(..).
+
+    This file is also compiled for SSE4.1, AVX2 and AVX-512 (FieldKernels*.cpp),
+    so keep anything that is not a template out of it.
+
+    A function that repeats itself declares how often with PERIOD_X and
+    PERIOD_Y, in vectors, 1 if it is the same all along the axis and 0 (or
+    leaving them out) if it does not repeat along it. Only one period of those
+    is built and stored, see FieldKernel::period(..), and --check-field-kernels
+    makes sure the periods hold.
+
+    If you want to create your own vector field add a new FieldFunction struct,
+    add it to FIELD_FUNCTION_LIST and register it in fieldKernel(..) in
+    FieldKernels.hpp. shaders/vector-field.comp has a GLSL copy of every
+    function for --field-backend gpu.
+*/
+
+#define NBR_FIELD_FUNCTIONS 41
+
+// Bump this whenever a function changes what it computes, fields cached with an
+// older version are then rebuilt (see VectorFieldCache.hpp)
+#define FIELD_KERNEL_VERSION 1
+
+/**
+ * Evaluate a field function at the points (x, y0), (x, y0 + yStep), ..., (x, y0 + (count - 1) * yStep).
+ * See FieldKernel::evaluate(..).
+ */
+typedef void (*FieldSpanFn)(float x, float y0, float yStep, int count, float width, float height, float * outX, float * outY);
+
+const float FIELD_PI = 3.14159265358979f;
+
+// Shared by the signed distance fields, follow the border on the outside and
+// the gradient on the inside.
+template <typename T>
+inline void flowAlongSdf(T d, T grad_x, T grad_y, float a, T &vx, T &vy){
+    T turned_x, turned_y;
+    turnNinetyDegrees(grad_x, grad_y, turned_x, turned_y);
+    auto inside = d <= 0.0f;
+    vx = a * fieldmath::select(inside, grad_x, turned_x);
+    vy = a * fieldmath::select(inside, grad_y, turned_y);
+}
+
+struct FieldFunction0 {
+    static const int PERIOD_X = 18;
+    static const int PERIOD_Y = 18;
+
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        vx = 0.01f * fieldmath::sin(x * FIELD_PI / 9.0f);
+        vy = 0.01f * fieldmath::cos(y * FIELD_PI / 9.0f);
+    }
+};
+
+struct FieldFunction1 {
+    static const int PERIOD_X = 18;
+    static const int PERIOD_Y = 1;
+
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        vx = 0.01f * fieldmath::sin(x * FIELD_PI / 9.0f) + 0.01f;
+        vy = 0.0f;
+    }
+};
+
+struct FieldFunction2 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float center_x = width / 2;
+        float center_y = height / 2;
+        float max_length = fieldmath::sqrt(width * width + height * height) / 2.0f;
+        vx = 0.01f * (x - center_x) / max_length;
+        vy = 0.01f * (y - center_y) / max_length;
+    }
+};
+
+struct FieldFunction3 {
+    static const int PERIOD_X = 1;
+    static const int PERIOD_Y = 2;
+
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        T sign = -1.0f + 2.0f * fieldmath::truncMod2(y);
+        vx = sign * 0.01f;
+        vy = 0.0f;
+    }
+};
+
+struct FieldFunction4 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        T x_ = x / width * 0.01f;
+        T y_ = y / height * 0.01f;
+        vx = x_ + y_;
+        vy = y_ - x_;
+    }
+};
+
+struct FieldFunction5 {
+    static const int PERIOD_X = 8;
+    static const int PERIOD_Y = 8;
+
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        vx = fieldmath::sin(x * FIELD_PI / 4) * 0.01f;
+        vy = fieldmath::cos(y * FIELD_PI / 4) * 0.01f;
+    }
+};
+
+struct FieldFunction6 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        vx = fieldmath::atan(x - width) * 0.01f;
+        vy = fieldmath::atan(y - height) * 0.01f;
+    }
+};
+
+// Function 7 and 8 are the same
+struct FieldFunction7 {
+    static const int PERIOD_X = 2;
+    static const int PERIOD_Y = 2;
+
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        T even_x = -1.0f + 2.0f * fieldmath::truncMod2(x);
+        T even_y = -1.0f + 2.0f * fieldmath::truncMod2(y);
+        vx = even_x * 0.01f;
+        vy = even_y * 0.01f;
+    }
+};
+
+struct FieldFunction9 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        vx = fieldmath::sin(5.0f * y + x) * 0.01f;
+        vy = fieldmath::cos(5.0f * x - y) * 0.01f;
+    }
+};
+
+struct FieldFunction10 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float w = 2.0f * FIELD_PI / 5.0f;
+        float A = 2.0f;
+        T mid_x = fieldmath::trunc(x - width / 2);
+        T mid_y = fieldmath::trunc(y - height / 2);
+
+        T d = fieldmath::sqrt(mid_x * mid_x + mid_y * mid_y) + 0.01f;
+        vx = A * fieldmath::cos(w * 100 / d) * 0.001f;
+        vy = A * fieldmath::sin(w * 100 / d) * 0.001f;
+    }
+};
+
+struct FieldFunction11 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        T mid_x = fieldmath::trunc(x - width / 2);
+        T mid_y = fieldmath::trunc(y - height / 2);
+        T r2 = mid_x * mid_x + mid_y * mid_y;
+        //v = vec2(p.y, -x) / r2 - a * p;
+        vx = 0.01f * y / r2;
+        vy = -0.01f * x / r2;
+    }
+};
+
+struct FieldFunction12 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        T mid_x = fieldmath::trunc(x - width / 2);
+        T mid_y = fieldmath::trunc(y - height / 2);
+        T r2 = mid_x * mid_x + mid_y * mid_y + 0.01f;
+        //v = vec2(p.y, -x) / r2 - a * p;
+        vx = a * mid_y / r2 - a * mid_x;
+        vy = -1.0f * a * mid_x / r2 - a * mid_y;
+    }
+};
+
+struct FieldFunction13 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.001f;
+        T mid_x = fieldmath::trunc(x - width / 2);
+        T mid_y = fieldmath::trunc(y - height / 2);
+        T r2 = mid_x * mid_x + mid_y * mid_y + 0.001f;
+        //v = vec2(p.y, -x) / r2 - a * p;
+        vx = a * mid_y / r2 - a * mid_x;
+        vy = -1.0f * a * mid_x / r2 - a * mid_y;
+    }
+};
+
+struct FieldFunction14 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.001f;
+        T mid_x = fieldmath::trunc(x - width / 2);
+        T mid_y = fieldmath::trunc(y - height / 2);
+        vx = a * mid_y;
+        vy = -1.0f * a * mid_x;
+    }
+};
+
+struct FieldFunction15 {
+    static const int PERIOD_X = 2;
+    static const int PERIOD_Y = 2;
+
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        T x_v = -2.0f * fieldmath::truncMod2(x) + 1.0f;
+        T y_v = -2.0f * fieldmath::truncMod2(y) + 1.0f;
+        vx = a * x_v;
+        vy = a * y_v;
+    }
+};
+
+struct FieldFunction16 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        T x_v = -2.0f * fieldmath::truncMod2(x) + 1.0f;
+        T y_v = -2.0f * fieldmath::truncMod2(y) + 1.0f;
+        vx = a * x_v * fieldmath::cos(x * FIELD_PI * 0.236123f);
+        vy = a * y_v * fieldmath::cos(y * FIELD_PI * 0.872766836123f);
+    }
+};
+
+struct FieldFunction17 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        T x_v = -2.0f * fieldmath::truncMod2(x) + 1.0f;
+        T y_v = -2.0f * fieldmath::truncMod2(y) + 1.0f;
+        vx = a * x_v * y / height;
+        vy = a * y_v * x / width;
+    }
+};
+
+struct FieldFunction18 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        T clip_x, clip_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        vx = a * clip_x * clip_x / (0.1f + clip_y);
+        vy = a * clip_y * clip_y / (0.1f + clip_x);
+    }
+};
+
+struct FieldFunction19 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        float twirl_size = 20.0f;
+        T clip_x, clip_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        float radial_exponent = 1.5f;
+        T length = fieldmath::sqrt(clip_x * clip_x + clip_y * clip_y);
+        T radial_coeff = fieldmath::pow(length, radial_exponent);
+        T new_x = -clip_y / length + radial_coeff * fieldmath::sin(twirl_size * y);
+        T new_y =  clip_x / length + radial_coeff * fieldmath::cos(twirl_size * x);
+        vx = a * new_x;
+        vy = a * new_y;
+    }
+};
+
+struct FieldFunction20 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        float twirl_size = 20.0f;
+        T clip_x, clip_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        float radial_exponent = 1.5f;
+        T length = fieldmath::sqrt(clip_x * clip_x + clip_y * clip_y);
+        T radial_coeff = fieldmath::pow(length, radial_exponent);
+        T new_x = clip_x / length + radial_coeff * fieldmath::sin(twirl_size * y);
+        T new_y = clip_y / length + radial_coeff * fieldmath::cos(twirl_size * x);
+        vx = a * new_x;
+        vy = a * new_y;
+    }
+};
+
+struct FieldFunction21 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        float twirl_size = 20.0f;
+        T clip_x, clip_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        float radial_exponent = 1.5f;
+        T length = fieldmath::sqrt(clip_x * clip_x + clip_y * clip_y);
+        T radial_coeff = fieldmath::pow(length, radial_exponent);
+        T new_x = clip_y / (length + 0.01f) + radial_coeff * fieldmath::sin(twirl_size * x);
+        T new_y = clip_x / (length + 0.01f) + radial_coeff * fieldmath::sin(twirl_size * y);
+        vx = a * new_x;
+        vy = a * new_y;
+    }
+};
+
+struct FieldFunction22 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        float twirl_size = 20.0f;
+        T clip_x, clip_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        float radial_exponent = 1.5f;
+        T length = fieldmath::sqrt(clip_x * clip_x + clip_y * clip_y);
+        T radial_coeff = fieldmath::pow(length, radial_exponent);
+        T new_x = -clip_y / (length + 0.01f) + radial_coeff * fieldmath::atan(twirl_size * x);
+        T new_y =  clip_x / (length + 0.01f) + radial_coeff * fieldmath::atan(twirl_size * y);
+        vx = a * new_x;
+        vy = a * new_y;
+    }
+};
+
+struct FieldFunction23 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        float twirl_size = 40.0f;
+        T clip_x, clip_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        float radial_exponent = 1.5f;
+        T length = fieldmath::sqrt(clip_x * clip_x + clip_y * clip_y);
+        T radial_coeff = fieldmath::pow(length, radial_exponent);
+        T new_x =  clip_y / (length + 0.01f) + radial_coeff * fieldmath::sin(twirl_size * y);
+        T new_y = -clip_x / (length + 0.01f) + radial_coeff * fieldmath::sin(twirl_size * y);
+        vx = a * new_x;
+        vy = a * new_y;
+    }
+};
+
+struct FieldFunction24 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        T clip_x, clip_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        T f1 = fieldmath::sin(clip_x);
+        T f2 = fieldmath::sin(2.0f * clip_x);
+        T f3 = fieldmath::sin(3.0f * clip_x);
+        T f4 = fieldmath::sin(4.0f * clip_x);
+        T f5 = fieldmath::sin(5.0f * clip_x);
+        vx = a * (f1 +
+            f2 * clip_y / 4.0f +
+            f3 * clip_x / 6.0f +
+            f4 * clip_x / 8.0f +
+            f5 * clip_y / 10.0f);
+        f1 = fieldmath::sin(clip_y);
+        f2 = fieldmath::sin(2.0f * clip_y);
+        f3 = fieldmath::sin(3.0f * clip_y);
+        f4 = fieldmath::sin(4.0f * clip_y);
+        f5 = fieldmath::sin(5.0f * clip_y);
+        vy = a * (f1 +
+            f2 * clip_y / 4.0f +
+            f3 * clip_x / 6.0f +
+            f4 * clip_x / 8.0f +
+            f5 * clip_y / 10.0f);
+    }
+};
+
+struct FieldFunction25 {
+    template <typename T>
+    static inline T f(T x, T y){
+        T f1 = fieldmath::sin(x);
+        T f2 = fieldmath::sin(2.0f * x);
+        T f3 = fieldmath::sin(3.0f * x);
+        T f4 = fieldmath::sin(4.0f * x);
+        T f5 = fieldmath::sin(5.0f * x);
+        return (f1 +
+            f2 * x / 4.0f +
+            f3 * y / 6.0f +
+            f4 * x / 8.0f +
+            f5 * y / 10.0f);
+    }
+
+    template <typename T>
+    static inline T df(T x, T y){
+        float h = 0.001f;
+        return (f(x + h, y) - f(x - h, y)) / (2.0f * h);
+    }
+
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        T clip_x, clip_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        vx = a * df(clip_x, clip_y);
+        vy = a * df(clip_y, clip_x);
+    }
+};
+
+// Shared by function 26 and 27
+struct FieldFunction26Base {
+    template <typename T>
+    static inline T f(T x, T y){
+        T f1 = fieldmath::sin(x);
+        T f2 = fieldmath::cos(2.0f * x);
+        T f3 = fieldmath::sin(3.0f * x);
+        T f4 = fieldmath::cos(4.0f * x);
+        T f5 = fieldmath::sin(5.0f * x);
+        return (f1 +
+            f2 * y / 4.0f +
+            f3 * x / 6.0f +
+            f4 * x / 8.0f +
+            f5 * y / 10.0f);
+    }
+
+    template <typename T>
+    static inline T df(T x, T y){
+        float h = 0.001f;
+        return (f(x + h, y) - f(x - h, y)) / (2.0f * h);
+    }
+};
+
+struct FieldFunction26 : FieldFunction26Base {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        T clip_x, clip_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        float twirl_size = 20.0f;
+        float radial_exponent = 1.5f;
+        T length = fieldmath::sqrt(clip_x * clip_x + clip_y * clip_y);
+        T radial_coeff = fieldmath::pow(length, radial_exponent);
+        T new_x =  df(clip_y, clip_x) / (length + 0.01f) + radial_coeff * fieldmath::sin(twirl_size * y);
+        T new_y = -df(clip_x, clip_y) / (length + 0.01f) + radial_coeff * fieldmath::sin(twirl_size * x);
+        vx = a * new_x;
+        vy = a * new_y;
+    }
+};
+
+struct FieldFunction27 : FieldFunction26Base {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        T clip_x, clip_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        float twirl_size = 20.0f;
+        float radial_exponent = 1.5f;
+        T length = fieldmath::sqrt(clip_x * clip_x + clip_y * clip_y);
+        T radial_coeff = fieldmath::pow(length, radial_exponent);
+        T new_x = -df(clip_y, clip_x) + radial_coeff * fieldmath::sin(twirl_size * y);
+        T new_y = -df(clip_x, clip_y) + radial_coeff * fieldmath::sin(twirl_size * x);
+        vx = a * new_x;
+        vy = a * new_y;
+    }
+};
+
+struct FieldFunction28 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        T clip_x, clip_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        vx = a * fieldmath::cos(clip_x) * fieldmath::sin(clip_y);
+        vy = a * fieldmath::tanh(clip_y);
+    }
+};
+
+struct FieldFunction29 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        T clip_x, clip_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        vx = a * fieldmath::tanh(clip_x) * fieldmath::tanh(clip_y);
+        vy = a * -fieldmath::tanh(clip_y);
+    }
+};
+
+struct FieldFunction30 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        T clip_x, clip_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        T tan_x = fieldmath::tan(clip_x * FIELD_PI / 2.12937678f);
+        T tan_y = fieldmath::tan(clip_y * FIELD_PI / 2.12937678f);
+        vx = a * fieldmath::sin(tan_x) * fieldmath::cos(tan_y);
+        vy = a * fieldmath::sin(tan_y) * fieldmath::cos(tan_x);
+    }
+};
+
+struct FieldFunction31 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        T clip_x, clip_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        vx = a * fieldmath::sin(fieldmath::tan(clip_y * FIELD_PI / 3.1976123f)) * fieldmath::cos(fieldmath::tan(clip_x * FIELD_PI / 0.82734f));
+        vy = a * fieldmath::sin(fieldmath::tan(clip_y * FIELD_PI / 4.123871f)) * fieldmath::cos(fieldmath::tan(clip_x * FIELD_PI / 2.7236f));
+    }
+};
+
+struct FieldFunction32 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        T clip_x, clip_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        T p1_x = clip_x - 0.5f;
+        T p1_y = clip_y;
+
+        T p2_x = clip_x + 0.5f;
+        T p2_y = clip_y;
+
+        T p1_length = p1_x * p1_x + p1_y * p1_y;
+        T p2_length = p2_x * p2_x + p2_y * p2_y;
+
+        vx = a * -1.0f * (p1_y / p1_length + p2_y / p2_length);
+        vy = a * (p1_x / p1_length + p2_x / p2_length);
+    }
+};
+
+struct FieldFunction33 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        T clip_x, clip_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        T p1_x = clip_x - 0.5f;
+        T p1_y = clip_y + 0.2f;
+
+        T p2_x = clip_x + 0.5f;
+        T p2_y = clip_y - 0.2f;
+
+        T p1_length = p1_x * p1_x + p1_y * p1_y;
+        T p2_length = p2_x * p2_x + p2_y * p2_y;
+
+        vx = a * (p1_y / p1_length + p2_y / p2_length);
+        vy = a * -1.0f * (p1_x / p1_length + p2_x / p2_length);
+    }
+};
+
+struct FieldFunction34 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float a = 0.01f;
+        T clip_x, clip_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        vx = a * clip_y * clip_y;
+        vy = a * clip_x * clip_x;
+    }
+};
+
+struct FieldFunction35 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float twirl_size = 20.0f;
+        float radial_exponent = 1.5f;
+        float a = 0.01f;
+        T clip_x, clip_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+
+        T length = fieldmath::sqrt(clip_x * clip_x + clip_y * clip_y);
+        T radial_coeff = fieldmath::pow(length, radial_exponent);
+        vx = a * (clip_y * clip_y + radial_coeff * fieldmath::sin(twirl_size * x));
+        vy = a * (clip_x * clip_x + radial_coeff * fieldmath::sin(twirl_size * y));
+    }
+};
+
+struct FieldFunction36 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        float twirl_size = 20.0f;
+        float radial_exponent = 1.5f;
+        float a = 0.01f;
+        T clip_x, clip_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+
+        T length = fieldmath::sqrt(clip_x * clip_x + clip_y * clip_y);
+        T radial_coeff = fieldmath::pow(length, radial_exponent);
+        vx = a * (clip_y * clip_x + radial_coeff * fieldmath::sin(2.0f * twirl_size * x));
+        vy = a * (clip_x * clip_y + radial_coeff * fieldmath::cos(2.0f * twirl_size * y));
+    }
+};
+
+struct FieldFunction37 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        T clip_x, clip_y, d, grad_x, grad_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        sdgArc(clip_x, clip_y, 0.3f, 0.3f, 0.5f, 0.5f, d, grad_x, grad_y);
+        flowAlongSdf(d, grad_x, grad_y, 0.01f, vx, vy);
+    }
+};
+
+struct FieldFunction38 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        T clip_x, clip_y, d, grad_x, grad_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        sdgCross(clip_x, clip_y, 0.3f, 0.3f, d, grad_x, grad_y);
+        flowAlongSdf(d, grad_x, grad_y, 0.01f, vx, vy);
+    }
+};
+
+struct FieldFunction39 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        T clip_x, clip_y, d, grad_x, grad_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        sdgCross(clip_x, clip_y, 0.8f, 0.3f, d, grad_x, grad_y);
+        flowAlongSdf(d, grad_x, grad_y, 0.01f, vx, vy);
+    }
+};
+
+struct FieldFunction40 {
+    template <typename T>
+    static inline void eval(T x, T y, float width, float height, T &vx, T &vy){
+        T clip_x, clip_y, d, grad_x, grad_y;
+        toClipSpace(x, y, width, height, clip_x, clip_y);
+        sdgArc(clip_x, clip_y, 0.7f, 0.3f, -0.8f, 0.3f, d, grad_x, grad_y);
+        flowAlongSdf(d, grad_x, grad_y, 0.01f, vx, vy);
+    }
+};
+
+// Every function in the order of --vector-field-function, 8 is the same as 7
+#define FIELD_FUNCTION_LIST(X) \
+    X(FieldFunction0)  X(FieldFunction1)  X(FieldFunction2)  X(FieldFunction3)  X(FieldFunction4)  \
+    X(FieldFunction5)  X(FieldFunction6)  X(FieldFunction7)  X(FieldFunction7)  X(FieldFunction9)  \
+    X(FieldFunction10) X(FieldFunction11) X(FieldFunction12) X(FieldFunction13) X(FieldFunction14) \
+    X(FieldFunction15) X(FieldFunction16) X(FieldFunction17) X(FieldFunction18) X(FieldFunction19) \
+    X(FieldFunction20) X(FieldFunction21) X(FieldFunction22) X(FieldFunction23) X(FieldFunction24) \
+    X(FieldFunction25) X(FieldFunction26) X(FieldFunction27) X(FieldFunction28) X(FieldFunction29) \
+    X(FieldFunction30) X(FieldFunction31) X(FieldFunction32) X(FieldFunction33) X(FieldFunction34) \
+    X(FieldFunction35) X(FieldFunction36) X(FieldFunction37) X(FieldFunction38) X(FieldFunction39) \
+    X(FieldFunction40)
+
+#ifdef FIELD_SIMD_X86
+// One table of NBR_FIELD_FUNCTIONS spans per instruction set, see FieldKernelsSSE41.cpp etc.
+const FieldSpanFn * fieldSpanFunctionsSSE41();
+const FieldSpanFn * fieldSpanFunctionsAVX2();
+const FieldSpanFn * fieldSpanFunctionsAVX512();
+#endif
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef FIELD_IMAGE_H
+#define FIELD_IMAGE_H
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stb_image.h>
+#include "FieldKernels.hpp"
+#include "FieldImageFilter.hpp"
+#include "ThreadPool.hpp"
+
+/**
+    CS-11 Asn 2: Vector fields made from an image, --field-image.
+    @file FieldImage.hpp
+    @author Frank Hampus Weslien
+
+    The image is loaded as grey values, blurred if --field-image-blur is given,
+    and the Sobel operator gives the direction the image gets brighter in at
+    every pixel. The field is that direction (--field-image-mode gradient), or
+    the direction turned 90 degrees so the particles follow the edges instead
+    of crossing them (along). The longest vector gets --field-image-strength.
+
+    All of it is done once when the image is loaded, a column at a time on every
+    thread with the filters in FieldImageFilter.hpp. ImageFieldKernel then only
+    has to look the vectors up, so the field is built like any other function,
+    straight into the buffer or texture, at whatever grid size is asked for.
+*/
+
+/**
+ * @param isa the instruction set
+ * @return the image filters compiled for isa, the float versions for FIELD_ISA_SCALAR
+ */
+inline FieldImageFilters fieldImageFilters(FieldIsa isa){
+#ifdef FIELD_SIMD_X86
+    switch(isa){
+        case FIELD_ISA_SSE41: return fieldImageFiltersSSE41();
+        case FIELD_ISA_AVX2: return fieldImageFiltersAVX2();
+        case FIELD_ISA_AVX512: return fieldImageFiltersAVX512();
+        default: break;
+    }
+#endif
+    return FieldImageFilters { &blurFieldImage<float>, &sobelFieldImage<float> };
+}
+
+/**
+ * A vector field that follows the edges of an image, see the top of this file.
+ */
+class ImageFieldKernel : public FieldKernel {
+    int imageWidth = 0;
+    int imageHeight = 0;
+    // The Sobel operator of the image, a column at a time from the bottom up
+    std::unique_ptr<float[]> gradX;
+    std::unique_ptr<float[]> gradY;
+    bool along = false;
+    // Turns the Sobel operator into the vectors of the field
+    float scale = 0.0f;
+
+public:
+
+    /**
+        Load the image and compute the field, on every thread of the pool.
+        @param path the image, any format stb_image reads
+        @param pool the threads to use
+        @param blur the standard deviation of the Gaussian blur in pixels, 0 for none
+        @param along true to follow the edges, false to cross them
+        @param strength the length of the longest vector
+        @param error set to what is wrong if the image can't be loaded
+        @return false if the image can't be loaded
+    */
+    bool load(const std::string &path, ThreadPool &pool, float blur, bool along, float strength, std::string &error){
+        int channels;
+        stbi_uc * pixels = stbi_load(path.c_str(), &imageWidth, &imageHeight, &channels, 1);
+        if(pixels == NULL){
+            error = "can't load '" + path + "': " + stbi_failure_reason();
+            return false;
+        }
+
+        const int width = imageWidth;
+        const int height = imageHeight;
+        const FieldImageFilters filters = fieldImageFilters(activeFieldIsa());
+
+        // The columns are padded by repeating the first and last value, enough
+        // for the blur and the Sobel operator to read past the ends. The buffers
+        // are hundreds of megabytes for large photos, so they are not zeroed first.
+        const int radius = blur > 0.0f ? (int) std::ceil(3.0f * blur) : 0;
+        const int pad = std::max(radius, 1);
+        const size_t stride = height + 2 * pad;
+        std::unique_ptr<float[]> grey(new float[width * stride]);
+        auto column = [&](std::unique_ptr<float[]> &image, int x){ return image.get() + x * stride + pad; };
+        auto padColumns = [&](std::unique_ptr<float[]> &image){
+            pool.parallelFor(0, width, pool.grainSizeFor(width), [&](unsigned int begin, unsigned int end){
+                for(unsigned int x = begin; x < end; x++){
+                    float * values = column(image, x);
+                    for(int i = 1; i <= pad; i++){
+                        values[-i] = values[0];
+                        values[height - 1 + i] = values[height - 1];
+                    }
+                }
+            });
+        };
+
+        // The rows of the image go from the top down, the columns of the field from
+        // the bottom up. A band of rows at a time keeps the writes to every column short.
+        const int rowsPerTask = 64;
+        pool.parallelFor(0, (height + rowsPerTask - 1) / rowsPerTask, 1, [&](unsigned int begin, unsigned int end){
+            int y0 = begin * rowsPerTask;
+            int y1 = std::min((int) end * rowsPerTask, height);
+            for(int x = 0; x < width; x++){
+                float * values = column(grey, x);
+                for(int y = y0; y < y1; y++)
+                    values[y] = pixels[(size_t) (height - 1 - y) * width + x] * (1.0f / 255.0f);
+            }
+        });
+        stbi_image_free(pixels);
+        padColumns(grey);
+
+        const unsigned int grain = pool.grainSizeFor(width);
+
+        if(radius > 0){
+            int taps = 2 * radius + 1;
+            std::vector<float> weights(taps);
+            float total = 0.0f;
+            for(int k = 0; k < taps; k++){
+                weights[k] = std::exp(-0.5f * (k - radius) * (k - radius) / (blur * blur));
+                total += weights[k];
+            }
+            for(float &w : weights)
+                w /= total;
+
+            // Down the columns into blurred, then across them back into grey
+            std::unique_ptr<float[]> blurred(new float[width * stride]);
+            pool.parallelFor(0, width, grain, [&](unsigned int begin, unsigned int end){
+                std::vector<const float *> rows(taps);
+                for(unsigned int x = begin; x < end; x++){
+                    for(int k = 0; k < taps; k++)
+                        rows[k] = column(grey, x) + k - radius;
+                    filters.blur(rows.data(), weights.data(), taps, height, column(blurred, x));
+                }
+            });
+            pool.parallelFor(0, width, grain, [&](unsigned int begin, unsigned int end){
+                std::vector<const float *> rows(taps);
+                for(unsigned int x = begin; x < end; x++){
+                    for(int k = 0; k < taps; k++)
+                        rows[k] = column(blurred, std::min(std::max((int) x + k - radius, 0), width - 1));
+                    filters.blur(rows.data(), weights.data(), taps, height, column(grey, x));
+                }
+            });
+            padColumns(grey);
+        }
+
+        gradX.reset(new float[(size_t) width * height]);
+        gradY.reset(new float[(size_t) width * height]);
+        std::vector<float> largest(width, 0.0f);
+        pool.parallelFor(0, width, grain, [&](unsigned int begin, unsigned int end){
+            for(unsigned int x = begin; x < end; x++){
+                const float * left = column(grey, std::max((int) x - 1, 0));
+                const float * right = column(grey, std::min((int) x + 1, width - 1));
+                largest[x] = filters.sobel(left, column(grey, x), right, height, &gradX[(size_t) x * height], &gradY[(size_t) x * height]);
+            }
+        });
+
+        float longest = std::sqrt(*std::max_element(largest.begin(), largest.end()));
+        this->along = along;
+        this->scale = longest > 0.0f ? strength / longest : 0.0f;
+        return true;
+    }
+
+    /**
+        The image is stretched over the grid, every point gets the vector of the
+        pixels under it, interpolated between the four closest.
+    */
+    void evaluate(float x, float y0, float yStep, int count, float width, float height, float * outX, float * outY) const {
+        float u = std::min(std::max((x + 0.5f) * imageWidth / width - 0.5f, 0.0f), imageWidth - 1.0f);
+        int x0 = (int) u;
+        int x1 = std::min(x0 + 1, imageWidth - 1);
+        float fx = u - x0;
+        const float * leftX = &gradX[(size_t) x0 * imageHeight];
+        const float * leftY = &gradY[(size_t) x0 * imageHeight];
+        const float * rightX = &gradX[(size_t) x1 * imageHeight];
+        const float * rightY = &gradY[(size_t) x1 * imageHeight];
+
+        float yScale = imageHeight / height;
+        for(int i = 0; i < count; i++){
+            float v = std::min(std::max((y0 + i * yStep + 0.5f) * yScale - 0.5f, 0.0f), imageHeight - 1.0f);
+            int j0 = (int) v;
+            int j1 = std::min(j0 + 1, imageHeight - 1);
+            float fy = v - j0;
+
+            float bottomX = leftX[j0] + fx * (rightX[j0] - leftX[j0]);
+            float topX = leftX[j1] + fx * (rightX[j1] - leftX[j1]);
+            float bottomY = leftY[j0] + fx * (rightY[j0] - leftY[j0]);
+            float topY = leftY[j1] + fx * (rightY[j1] - leftY[j1]);
+            float gx = scale * (bottomX + fy * (topX - bottomX));
+            float gy = scale * (bottomY + fy * (topY - bottomY));
+
+            // Like turnNinetyDegrees(..)
+            outX[i] = along ? -gy : gx;
+            outY[i] = along ? gx : gy;
+        }
+    }
+
+    int width() const {
+        return imageWidth;
+    }
+
+    int height() const {
+        return imageHeight;
+    }
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef FIELD_IMAGE_FILTER_H
+#define FIELD_IMAGE_FILTER_H
+
+#include "FieldProgram.hpp"
+
+/**
+    CS-11 Asn 2: The filters that turn an image into a vector field, see FieldImage.hpp.
+    @file FieldImageFilter.hpp
+    @author Frank Hampus Weslien
+
+    The image is stored a column at a time, like the vector field, so both
+    filters run down a column on full SIMD lanes and a whole column is one
+    task for the ThreadPool. Like FieldProgram.hpp this file is compiled for
+    SSE4.1, AVX2 and AVX-512 (FieldKernels*.cpp) and the filters are templates
+    on the lane type, float when there is no SIMD.
+*/
+
+/**
+ * out[i] = weights[0] * rows[0][i] + ... + weights[taps - 1] * rows[taps - 1][i]
+ * The Gaussian blur is this down the columns (the rows are the same column moved
+ * up and down) and then across them (the rows are the neighbouring columns).
+ */
+template <typename V>
+void blurFieldImage(const float * const * rows, const float * weights, int taps, int count, float * out){
+    typedef FieldLanes<V> L;
+    int i = 0;
+    for (; i + L::size <= count; i += L::size) {
+        V sum = V(weights[0]) * L::load(rows[0] + i);
+        for (int k = 1; k < taps; k++)
+            sum = sum + V(weights[k]) * L::load(rows[k] + i);
+        L::store(sum, out + i);
+    }
+
+    for (; i < count; i++) {
+        float sum = weights[0] * rows[0][i];
+        for (int k = 1; k < taps; k++)
+            sum += weights[k] * rows[k][i];
+        out[i] = sum;
+    }
+}
+
+/**
+ * The Sobel operator on one column. The columns are read from index -1 to count,
+ * so they need one value of padding at both ends.
+ * @param left the column to the left, mid itself at the left edge
+ * @param mid the column
+ * @param right the column to the right, mid itself at the right edge
+ * @param count the number of values in the column
+ * @param outX filled with the change along x
+ * @param outY filled with the change along y
+ * @return the largest outX[i]^2 + outY[i]^2
+ */
+template <typename V>
+float sobelFieldImage(const float * left, const float * mid, const float * right, int count, float * outX, float * outY){
+    typedef FieldLanes<V> L;
+    V largest(0.0f);
+    int i = 0;
+    for (; i + L::size <= count; i += L::size) {
+        V leftAbove = L::load(left + i + 1);
+        V leftBelow = L::load(left + i - 1);
+        V rightAbove = L::load(right + i + 1);
+        V rightBelow = L::load(right + i - 1);
+        V gx = (rightAbove + V(2.0f) * L::load(right + i) + rightBelow)
+             - (leftAbove + V(2.0f) * L::load(left + i) + leftBelow);
+        V gy = (leftAbove + V(2.0f) * L::load(mid + i + 1) + rightAbove)
+             - (leftBelow + V(2.0f) * L::load(mid + i - 1) + rightBelow);
+        L::store(gx, outX + i);
+        L::store(gy, outY + i);
+        largest = fieldmath::max(largest, gx * gx + gy * gy);
+    }
+
+    float lanes[L::size];
+    L::store(largest, lanes);
+    float result = 0.0f;
+    for (int j = 0; j < L::size; j++)
+        result = lanes[j] > result ? lanes[j] : result;
+
+    for (; i < count; i++) {
+        float gx = (right[i + 1] + 2.0f * right[i] + right[i - 1]) - (left[i + 1] + 2.0f * left[i] + left[i - 1]);
+        float gy = (left[i + 1] + 2.0f * mid[i + 1] + right[i + 1]) - (left[i - 1] + 2.0f * mid[i - 1] + right[i - 1]);
+        outX[i] = gx;
+        outY[i] = gy;
+        result = gx * gx + gy * gy > result ? gx * gx + gy * gy : result;
+    }
+    return result;
+}
+
+typedef void (*FieldImageBlurFn)(const float * const * rows, const float * weights, int taps, int count, float * out);
+typedef float (*FieldImageSobelFn)(const float * left, const float * mid, const float * right, int count, float * outX, float * outY);
+
+/**
+ * The filters compiled for one instruction set.
+ */
+struct FieldImageFilters {
+    FieldImageBlurFn blur;
+    FieldImageSobelFn sobel;
+};
+
+#ifdef FIELD_SIMD_X86
+// blurFieldImage(..) and sobelFieldImage(..) for every instruction set, see FieldKernelsSSE41.cpp etc.
+FieldImageFilters fieldImageFiltersSSE41();
+FieldImageFilters fieldImageFiltersAVX2();
+FieldImageFilters fieldImageFiltersAVX512();
+#endif
+
+#endif
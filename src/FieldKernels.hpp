@@ -0,0 +1,457 @@
+#ifndef FIELD_KERNELS_H
+#define FIELD_KERNELS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+#include "FieldFunctions.hpp"
+
+/**
+    CS-11 Asn 2: The vector field functions, evaluated a whole column at a time.
+    @file FieldKernels.hpp
+    @author Frank Hampus Weslien
+
+    The functions themselves live in FieldFunctions.hpp. BatchFieldKernel runs
+    them on the widest SIMD instruction set the CPU supports, or one point at a
+    time in float when there is none (or --field-isa scalar is given).
+
+    If you want to create your own vector field add a new FieldFunction struct
+    to FieldFunctions.hpp and register it in fieldKernel(..) at the bottom of
+    this file.
+*/
+
+/**
+ * The instruction sets the field functions are compiled for, from slowest to fastest.
+ */
+enum FieldIsa {
+    FIELD_ISA_SCALAR = 0,
+    FIELD_ISA_SSE41,
+    FIELD_ISA_AVX2,
+    FIELD_ISA_AVX512
+};
+
+inline const char * fieldIsaName(FieldIsa isa){
+    switch(isa){
+        case FIELD_ISA_SSE41: return "sse4.1";
+        case FIELD_ISA_AVX2: return "avx2";
+        case FIELD_ISA_AVX512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+/**
+ * Ask the CPU which instruction sets it has.
+ * @return the fastest one that the field functions are compiled for
+ */
+inline FieldIsa bestFieldIsa(){
+#ifdef FIELD_SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+        return FIELD_ISA_AVX512;
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return FIELD_ISA_AVX2;
+    if(__builtin_cpu_supports("sse4.1"))
+        return FIELD_ISA_SSE41;
+#endif
+    return FIELD_ISA_SCALAR;
+}
+
+/**
+ * The instruction set used by every BatchFieldKernel, starts out as bestFieldIsa().
+ */
+inline FieldIsa &activeFieldIsa(){
+    static FieldIsa isa = bestFieldIsa();
+    return isa;
+}
+
+/**
+ * Pick the instruction set to evaluate the field functions with.
+ * @param isa the instruction set
+ * @return false if the CPU does not support it, the active one is then left alone
+ */
+inline bool setFieldIsa(FieldIsa isa){
+    if(isa > bestFieldIsa())
+        return false;
+    activeFieldIsa() = isa;
+    return true;
+}
+
+/**
+ * @param isa the instruction set
+ * @return NBR_FIELD_FUNCTIONS spans compiled for isa, NULL for FIELD_ISA_SCALAR
+ */
+inline const FieldSpanFn * fieldSpanFunctions(FieldIsa isa){
+#ifdef FIELD_SIMD_X86
+    switch(isa){
+        case FIELD_ISA_SSE41: return fieldSpanFunctionsSSE41();
+        case FIELD_ISA_AVX2: return fieldSpanFunctionsAVX2();
+        case FIELD_ISA_AVX512: return fieldSpanFunctionsAVX512();
+        default: break;
+    }
+#endif
+    return NULL;
+}
+
+// The tolerance --check-field-kernels holds the SIMD kernels to. It is not a
+// bound per point: several of the functions subtract nearly equal values, which
+// turns the couple of ULP that the SIMD math differs by into a lot of ULP of a
+// tiny result. It is an absolute bound instead, in ULP of the largest vector in
+// the field, since that is what decides how far a particle moves.
+#define FIELD_CHECK_MAX_PEAK_ULP 16
+
+inline float fieldUlp(float magnitude){
+    return std::nextafter(magnitude, INFINITY) - magnitude;
+}
+
+// Functions 25 to 27 take a finite difference with h = 0.001, which scales
+// every difference in f by 1 / (2 * h) = 500 on the way to the result.
+// Function 31 takes sin(..) and cos(..) of tan(..), which is huge next to its
+// poles, where those are only as precise as FieldMath.hpp says for |x| < 1e6.
+inline float fieldCheckTolerance(unsigned int functionNbr){
+    if(functionNbr >= 25 && functionNbr <= 27)
+        return FIELD_CHECK_MAX_PEAK_ULP * 500.0f;
+    if(functionNbr == 31)
+        return FIELD_CHECK_MAX_PEAK_ULP * 4.0f;
+    return FIELD_CHECK_MAX_PEAK_ULP;
+}
+
+/**
+ * A vector field function that is evaluated for many points per call.
+ */
+class FieldKernel {
+public:
+    virtual ~FieldKernel() {}
+
+    /**
+     * Evaluate the field at the points (x, y0), (x, y0 + yStep), ..., (x, y0 + (count - 1) * yStep).
+     * @param x the x coordinate of the column in the grid
+     * @param y0 the y coordinate of the first point in the grid
+     * @param yStep the distance between the points, 1 for neighbouring grid points
+     * @param count the number of points to evaluate
+     * @param width the number of vectors along the x-axis of the grid
+     * @param height the number of vectors along the y-axis of the grid
+     * @param outX will be filled with count x-components
+     * @param outY will be filled with count y-components
+     */
+    virtual void evaluate(float x, float y0, float yStep, int count, float width, float height, float * outX, float * outY) const = 0;
+
+    /**
+     * How often the field repeats itself, if it is known without looking, see detectFieldPeriod(..).
+     * @param periodX set to the period along the x-axis in vectors, 0 if it does not repeat along it
+     * @param periodY set to the period along the y-axis in vectors, 0 if it does not repeat along it
+     * @return false if the period is not known
+     */
+    virtual bool period(int &periodX, int &periodY) const {
+        return false;
+    }
+
+    /**
+     * How far the SIMD kernels may be from the scalar one, see fieldCheckTolerance(..).
+     * @return the largest difference allowed, in ULP of the largest vector in the field
+     */
+    virtual float checkTolerance() const {
+        return FIELD_CHECK_MAX_PEAK_ULP;
+    }
+};
+
+// The period a FieldFunction declares with PERIOD_X and PERIOD_Y
+template <typename F>
+inline bool declaredFieldPeriod(int &periodX, int &periodY, decltype(F::PERIOD_X) *){
+    periodX = F::PERIOD_X;
+    periodY = F::PERIOD_Y;
+    return true;
+}
+
+// For the functions that declare none
+template <typename F>
+inline bool declaredFieldPeriod(int &periodX, int &periodY, ...){
+    periodX = 0;
+    periodY = 0;
+    return true;
+}
+
+/**
+ * Turns a FieldFunction into a FieldKernel that runs on the active instruction set.
+ */
+template <typename F>
+class BatchFieldKernel : public FieldKernel {
+    unsigned int functionNbr;
+public:
+    /**
+     * @param functionNbr where F is in FIELD_FUNCTION_LIST
+     */
+    BatchFieldKernel(unsigned int functionNbr): functionNbr(functionNbr) {}
+
+    void evaluate(float x, float y0, float yStep, int count, float width, float height, float * outX, float * outY) const {
+        const FieldSpanFn * spans = fieldSpanFunctions(activeFieldIsa());
+        if (spans != NULL) {
+            spans[functionNbr](x, y0, yStep, count, width, height, outX, outY);
+            return;
+        }
+
+        for (int i = 0; i < count; i++) {
+            F::eval(x, y0 + i * yStep, width, height, outX[i], outY[i]);
+        }
+    }
+
+    bool period(int &periodX, int &periodY) const {
+        return declaredFieldPeriod<F>(periodX, periodY, 0);
+    }
+
+    float checkTolerance() const {
+        return fieldCheckTolerance(functionNbr);
+    }
+};
+
+/**
+ * Look up the kernel for one of the numbered vector field functions.
+ * @param functionNbr the number given by --vector-field-function
+ * @return the kernel, function 0 if the number is unknown
+ */
+inline const FieldKernel * fieldKernel(unsigned int functionNbr){
+    static const BatchFieldKernel<FieldFunction0> f0(0);
+    static const BatchFieldKernel<FieldFunction1> f1(1);
+    static const BatchFieldKernel<FieldFunction2> f2(2);
+    static const BatchFieldKernel<FieldFunction3> f3(3);
+    static const BatchFieldKernel<FieldFunction4> f4(4);
+    static const BatchFieldKernel<FieldFunction5> f5(5);
+    static const BatchFieldKernel<FieldFunction6> f6(6);
+    static const BatchFieldKernel<FieldFunction7> f7(7);
+    static const BatchFieldKernel<FieldFunction9> f9(9);
+    static const BatchFieldKernel<FieldFunction10> f10(10);
+    static const BatchFieldKernel<FieldFunction11> f11(11);
+    static const BatchFieldKernel<FieldFunction12> f12(12);
+    static const BatchFieldKernel<FieldFunction13> f13(13);
+    static const BatchFieldKernel<FieldFunction14> f14(14);
+    static const BatchFieldKernel<FieldFunction15> f15(15);
+    static const BatchFieldKernel<FieldFunction16> f16(16);
+    static const BatchFieldKernel<FieldFunction17> f17(17);
+    static const BatchFieldKernel<FieldFunction18> f18(18);
+    static const BatchFieldKernel<FieldFunction19> f19(19);
+    static const BatchFieldKernel<FieldFunction20> f20(20);
+    static const BatchFieldKernel<FieldFunction21> f21(21);
+    static const BatchFieldKernel<FieldFunction22> f22(22);
+    static const BatchFieldKernel<FieldFunction23> f23(23);
+    static const BatchFieldKernel<FieldFunction24> f24(24);
+    static const BatchFieldKernel<FieldFunction25> f25(25);
+    static const BatchFieldKernel<FieldFunction26> f26(26);
+    static const BatchFieldKernel<FieldFunction27> f27(27);
+    static const BatchFieldKernel<FieldFunction28> f28(28);
+    static const BatchFieldKernel<FieldFunction29> f29(29);
+    static const BatchFieldKernel<FieldFunction30> f30(30);
+    static const BatchFieldKernel<FieldFunction31> f31(31);
+    static const BatchFieldKernel<FieldFunction32> f32(32);
+    static const BatchFieldKernel<FieldFunction33> f33(33);
+    static const BatchFieldKernel<FieldFunction34> f34(34);
+    static const BatchFieldKernel<FieldFunction35> f35(35);
+    static const BatchFieldKernel<FieldFunction36> f36(36);
+    static const BatchFieldKernel<FieldFunction37> f37(37);
+    static const BatchFieldKernel<FieldFunction38> f38(38);
+    static const BatchFieldKernel<FieldFunction39> f39(39);
+    static const BatchFieldKernel<FieldFunction40> f40(40);
+
+    static const FieldKernel * const kernels[NBR_FIELD_FUNCTIONS] =
+        { &f0,  &f1,  &f2,  &f3,  &f4,  &f5,  &f6,  &f7,  &f7,  &f9
+        , &f10, &f11, &f12, &f13, &f14, &f15, &f16, &f17, &f18, &f19
+        , &f20, &f21, &f22, &f23, &f24, &f25, &f26, &f27, &f28, &f29
+        , &f30, &f31, &f32, &f33, &f34, &f35, &f36, &f37, &f38, &f39
+        , &f40
+        };
+
+    if(functionNbr >= NBR_FIELD_FUNCTIONS)
+        return kernels[0];
+
+    return kernels[functionNbr];
+}
+
+// The columns of the grid the checks below look at
+inline std::vector<int> fieldCheckColumns(int width){
+    std::vector<int> columns;
+    for(int x = 0; x < width; x += std::max(1, width / 64))
+        columns.push_back(x);
+    columns.push_back(width - 1);
+    return columns;
+}
+
+/**
+ * Evaluate a kernel with an instruction set and with the scalar code, and
+ * compare the two on a sample of the columns in the grid.
+ * @param kernel the kernel to check
+ * @param isa the instruction set, the active one is left alone
+ * @param width the number of vectors along the x-axis of the grid
+ * @param height the number of vectors along the y-axis of the grid
+ * @param sameNonFinite set to false if a value is finite in one and not the other
+ * @return the largest difference, in ULP of the largest vector
+ */
+inline float fieldKernelError(const FieldKernel &kernel, FieldIsa isa, int width, int height, bool &sameNonFinite){
+    FieldIsa active = activeFieldIsa();
+    std::vector<float> refX(height), refY(height), simdX(height), simdY(height);
+    float peak = 0.0f;
+    float maxDiff = 0.0f;
+    sameNonFinite = true;
+
+    for(int x : fieldCheckColumns(width)){
+        activeFieldIsa() = FIELD_ISA_SCALAR;
+        kernel.evaluate(x, 0, 1, height, width, height, refX.data(), refY.data());
+        activeFieldIsa() = isa;
+        kernel.evaluate(x, 0, 1, height, width, height, simdX.data(), simdY.data());
+
+        for(int y = 0; y < 2 * height; y++){
+            float ref = y < height ? refX[y] : refY[y - height];
+            float simd = y < height ? simdX[y] : simdY[y - height];
+            if(!std::isfinite(ref) || !std::isfinite(simd)){
+                sameNonFinite = sameNonFinite && std::isfinite(ref) == std::isfinite(simd);
+                continue;
+            }
+            peak = std::max(peak, std::abs(ref));
+            maxDiff = std::max(maxDiff, std::abs(simd - ref));
+        }
+    }
+
+    activeFieldIsa() = active;
+    return peak > 0.0f ? maxDiff / fieldUlp(peak) : maxDiff;
+}
+
+// How far a field may be from repeating itself and still count as periodic, as a
+// part of its largest vector. sin(..) of a large x is only that precise in float,
+// which is what decides how far apart the periods of functions 0, 1, and 5 are.
+#define FIELD_PERIOD_TOLERANCE 1e-3f
+
+// The longest period detectFieldPeriod(..) looks for, in vectors
+#define FIELD_MAX_PERIOD 64
+
+/**
+ * Compare the field with one period of itself repeated, on a sample of the
+ * columns in the bottom left checkWidth x checkHeight part of the grid.
+ * @param kernel the kernel to check
+ * @param periodX the period along the x-axis, 0 to not repeat along it
+ * @param periodY the period along the y-axis, 0 to not repeat along it
+ * @param width the number of vectors along the x-axis of the grid
+ * @param height the number of vectors along the y-axis of the grid
+ * @param checkWidth the number of columns to compare, at most width
+ * @param checkHeight the number of rows to compare, at most height
+ * @return the largest difference as a part of the largest vector, INFINITY if a value is finite in one and not the other
+ */
+inline float fieldPeriodError(const FieldKernel &kernel, int periodX, int periodY, int width, int height, int checkWidth, int checkHeight){
+    std::vector<float> columnX(checkHeight), columnY(checkHeight), firstX(checkHeight), firstY(checkHeight);
+    float peak = 0.0f;
+    float maxDiff = 0.0f;
+
+    for(int x : fieldCheckColumns(checkWidth)){
+        kernel.evaluate(x, 0, 1, checkHeight, width, height, columnX.data(), columnY.data());
+        kernel.evaluate(periodX > 0 ? x % periodX : x, 0, 1, checkHeight, width, height, firstX.data(), firstY.data());
+
+        for(int y = 0; y < checkHeight; y++){
+            int first = periodY > 0 ? y % periodY : y;
+            float values[4] = { columnX[y], columnY[y], firstX[first], firstY[first] };
+            for(int i = 0; i < 2; i++){
+                if(!std::isfinite(values[i]) || !std::isfinite(values[i + 2])){
+                    if(std::isfinite(values[i]) != std::isfinite(values[i + 2]))
+                        return INFINITY;
+                    continue;
+                }
+                peak = std::max(peak, std::abs(values[i]));
+                maxDiff = std::max(maxDiff, std::abs(values[i] - values[i + 2]));
+            }
+        }
+    }
+
+    return peak > 0.0f ? maxDiff / peak : maxDiff;
+}
+
+/**
+ * Find out if a field repeats itself by trying every period up to
+ * FIELD_MAX_PERIOD, for kernels that don't know their own (see FieldKernel::period(..)).
+ * A period is first tried on the bottom left corner of the grid, which rules out
+ * nearly all of them, and then on a sample of the columns of the whole grid.
+ * @param kernel the kernel to look at
+ * @param width the number of vectors along the x-axis of the grid
+ * @param height the number of vectors along the y-axis of the grid
+ * @param periodX set to the shortest period along the x-axis, 0 if there is none
+ * @param periodY set to the shortest period along the y-axis, 0 if there is none
+ * @return true if the field repeats itself along either axis
+ */
+inline bool detectFieldPeriod(const FieldKernel &kernel, int width, int height, int &periodX, int &periodY){
+    int cornerWidth = std::min(width, 4 * FIELD_MAX_PERIOD);
+    int cornerHeight = std::min(height, 4 * FIELD_MAX_PERIOD);
+
+    for(int axis = 0; axis < 2; axis++){
+        int &period = axis == 0 ? periodX : periodY;
+        int size = axis == 0 ? width : height;
+        period = 0;
+        for(int p = 1; p <= FIELD_MAX_PERIOD && 2 * p <= size && period == 0; p++){
+            int px = axis == 0 ? p : 0;
+            int py = axis == 0 ? 0 : p;
+            if(fieldPeriodError(kernel, px, py, width, height, cornerWidth, cornerHeight) <= FIELD_PERIOD_TOLERANCE
+               && fieldPeriodError(kernel, px, py, width, height, width, height) <= FIELD_PERIOD_TOLERANCE)
+                period = p;
+        }
+    }
+
+    return periodX > 0 || periodY > 0;
+}
+
+/**
+ * Evaluate every field function with every instruction set the CPU supports and
+ * compare it against the scalar version, on a sample of the columns in the grid.
+ * @param width the number of vectors along the x-axis of the grid
+ * @param height the number of vectors along the y-axis of the grid
+ * @return true if all kernels are within FieldKernel::checkTolerance()
+ */
+inline bool checkFieldKernels(int width, int height){
+    bool passed = true;
+
+    for(int isa = FIELD_ISA_SSE41; isa <= bestFieldIsa(); isa++){
+        std::cout << "Checking the " << fieldIsaName((FieldIsa) isa) << " kernels against the scalar ones on a "
+                  << width << "x" << height << " grid" << std::endl;
+
+        for(unsigned int f = 0; f < NBR_FIELD_FUNCTIONS; f++){
+            bool sameNonFinite;
+            float error = fieldKernelError(*fieldKernel(f), (FieldIsa) isa, width, height, sameNonFinite);
+            bool ok = sameNonFinite && error <= fieldKernel(f)->checkTolerance();
+            passed = passed && ok;
+            std::cout << "    function " << f << ": " << error << " ULP of the largest vector" << (ok ? "" : "  FAILED") << std::endl;
+        }
+    }
+
+    std::cout << "Checking the periods the functions declare on a " << width << "x" << height << " grid" << std::endl;
+    for(unsigned int f = 0; f < NBR_FIELD_FUNCTIONS; f++){
+        int periodX, periodY;
+        if(!fieldKernel(f)->period(periodX, periodY) || (periodX == 0 && periodY == 0))
+            continue;
+        float error = fieldPeriodError(*fieldKernel(f), periodX, periodY, width, height, width, height);
+        bool ok = error <= FIELD_PERIOD_TOLERANCE;
+        passed = passed && ok;
+        std::cout << "    function " << f << ": every " << periodX << "x" << periodY << " vectors, off by "
+                  << error << " of the largest vector" << (ok ? "" : "  FAILED") << std::endl;
+    }
+
+    return passed;
+}
+
+/**
+ * The same as checkFieldKernels(..) for a single kernel, like the one given by
+ * --field-x and --field-y.
+ * @param kernel the kernel to check
+ * @param width the number of vectors along the x-axis of the grid
+ * @param height the number of vectors along the y-axis of the grid
+ * @return true if the kernel is within FieldKernel::checkTolerance() on every instruction set
+ */
+inline bool checkFieldKernel(const FieldKernel &kernel, int width, int height){
+    bool passed = true;
+
+    for(int isa = FIELD_ISA_SSE41; isa <= bestFieldIsa(); isa++){
+        bool sameNonFinite;
+        float error = fieldKernelError(kernel, (FieldIsa) isa, width, height, sameNonFinite);
+        bool ok = sameNonFinite && error <= kernel.checkTolerance();
+        passed = passed && ok;
+        std::cout << "Checking the " << fieldIsaName((FieldIsa) isa) << " kernel against the scalar one on a "
+                  << width << "x" << height << " grid: " << error << " ULP of the largest vector" << (ok ? "" : "  FAILED") << std::endl;
+    }
+
+    return passed;
+}
+
+#endif
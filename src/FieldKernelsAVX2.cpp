@@ -0,0 +1,25 @@
+#define FIELD_SIMD_AVX2
+#include "FieldSimd.hpp"
+#include "FieldProgram.hpp"
+#include "FieldImageFilter.hpp"
+#include "ParticleRaster.hpp"
+
+const FieldSpanFn * fieldSpanFunctionsAVX2(){
+    return fieldSpanTable<simd_avx2::Vec>();
+}
+
+FieldProgramSpanFn fieldProgramSpanAVX2(){
+    return &runFieldProgram<simd_avx2::Vec>;
+}
+
+FieldImageFilters fieldImageFiltersAVX2(){
+    return FieldImageFilters { &blurFieldImage<simd_avx2::Vec>, &sobelFieldImage<simd_avx2::Vec> };
+}
+
+ParticleStepFn particleStepAVX2(){
+    return &stepParticles<simd_avx2::Vec>;
+}
+
+ParticleRasterFn particleRasterAVX2(){
+    return &rasterParticles<simd_avx2::Vec>;
+}
@@ -0,0 +1,25 @@
+#define FIELD_SIMD_AVX512
+#include "FieldSimd.hpp"
+#include "FieldProgram.hpp"
+#include "FieldImageFilter.hpp"
+#include "ParticleRaster.hpp"
+
+const FieldSpanFn * fieldSpanFunctionsAVX512(){
+    return fieldSpanTable<simd_avx512::Vec>();
+}
+
+FieldProgramSpanFn fieldProgramSpanAVX512(){
+    return &runFieldProgram<simd_avx512::Vec>;
+}
+
+FieldImageFilters fieldImageFiltersAVX512(){
+    return FieldImageFilters { &blurFieldImage<simd_avx512::Vec>, &sobelFieldImage<simd_avx512::Vec> };
+}
+
+ParticleStepFn particleStepAVX512(){
+    return &stepParticles<simd_avx512::Vec>;
+}
+
+ParticleRasterFn particleRasterAVX512(){
+    return &rasterParticles<simd_avx512::Vec>;
+}
@@ -0,0 +1,25 @@
+#define FIELD_SIMD_SSE41
+#include "FieldSimd.hpp"
+#include "FieldProgram.hpp"
+#include "FieldImageFilter.hpp"
+#include "ParticleRaster.hpp"
+
+const FieldSpanFn * fieldSpanFunctionsSSE41(){
+    return fieldSpanTable<simd_sse41::Vec>();
+}
+
+FieldProgramSpanFn fieldProgramSpanSSE41(){
+    return &runFieldProgram<simd_sse41::Vec>;
+}
+
+FieldImageFilters fieldImageFiltersSSE41(){
+    return FieldImageFilters { &blurFieldImage<simd_sse41::Vec>, &sobelFieldImage<simd_sse41::Vec> };
+}
+
+ParticleStepFn particleStepSSE41(){
+    return &stepParticles<simd_sse41::Vec>;
+}
+
+ParticleRasterFn particleRasterSSE41(){
+    return &rasterParticles<simd_sse41::Vec>;
+}
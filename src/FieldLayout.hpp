@@ -0,0 +1,106 @@
+#ifndef FIELD_LAYOUT_H
+#define FIELD_LAYOUT_H
+
+#include <cstddef>
+#include <string>
+
+/**
+    CS-11 Asn 2: The order the vectors of a field are stored in memory.
+    @file FieldLayout.hpp
+    @author Frank Hampus Weslien
+
+    The layout is picked at build time with the FIELD_LAYOUT option in
+    CMakeLists.txt, shaders/field-layout.glsl has the same index function for
+    the shaders.
+
+    - columns: the vector at (x, y) is vector x * height + y. A particle that
+      moves along the x-axis jumps a whole column every step.
+    - tiled: the grid is cut into FIELD_TILE_SIZE x FIELD_TILE_SIZE tiles,
+      stored as rows inside the tile. A row of a tile is one 64 byte cache line.
+    - morton: the same tiles, but in Z-order inside the tile, so the four
+      vectors a particle interpolates between are usually in the same line.
+
+    In both tiled layouts the tiles are stored in columns, so FIELD_TILE_SIZE
+    columns of the grid still are one contiguous range of memory. The grid is
+    padded up to whole tiles.
+*/
+
+#define FIELD_LAYOUT_COLUMNS 0
+#define FIELD_LAYOUT_TILED 1
+#define FIELD_LAYOUT_MORTON 2
+#define NBR_FIELD_LAYOUTS 3
+
+#ifndef FIELD_LAYOUT
+#define FIELD_LAYOUT FIELD_LAYOUT_COLUMNS
+#endif
+
+// The side of a tile in vectors, a power of two
+#define FIELD_TILE_SIZE 8
+
+// The number of columns of the grid that share one contiguous range of memory
+#define FIELD_LAYOUT_STRIPE(layout) ((layout) == FIELD_LAYOUT_COLUMNS ? 1 : FIELD_TILE_SIZE)
+
+/**
+ * Spread the 3 bits of v out to every other bit, 0b111 becomes 0b10101.
+ * This and the two below are static since FieldKernels*.cpp compile them with
+ * the wider instruction sets, the scalar code must never call those copies.
+ */
+static inline unsigned int fieldMortonSpread(unsigned int v){
+    return (v & 1) | ((v & 2) << 1) | ((v & 4) << 2);
+}
+
+/**
+ * The position of the vector at (x, y) in a field, in vectors.
+ * @param x the column of the vector
+ * @param y the row of the vector
+ * @param height the number of vectors along the y-axis of the grid
+ */
+template <int Layout>
+static inline size_t fieldLayoutIndex(int x, int y, int height){
+    if(Layout == FIELD_LAYOUT_COLUMNS)
+        return (size_t) x * height + y;
+
+    // Unsigned, so that the divisions are shifts
+    unsigned int ux = x;
+    unsigned int uy = y;
+    size_t tilesPerColumn = ((unsigned int) height + FIELD_TILE_SIZE - 1) / FIELD_TILE_SIZE;
+    size_t tile = (ux / FIELD_TILE_SIZE) * tilesPerColumn + uy / FIELD_TILE_SIZE;
+    unsigned int tx = ux % FIELD_TILE_SIZE;
+    unsigned int ty = uy % FIELD_TILE_SIZE;
+    unsigned int inTile = Layout == FIELD_LAYOUT_TILED
+                        ? ty * FIELD_TILE_SIZE + tx
+                        : fieldMortonSpread(tx) | fieldMortonSpread(ty) << 1;
+    return tile * FIELD_TILE_SIZE * FIELD_TILE_SIZE + inTile;
+}
+
+/**
+ * The number of floats needed to store a field, including the padding of the tiles.
+ * @param width the number of vectors along the x-axis
+ * @param height the number of vectors along the y-axis
+ */
+template <int Layout>
+static inline size_t fieldLayoutSize(int width, int height){
+    if(Layout == FIELD_LAYOUT_COLUMNS)
+        return 2 * (size_t) width * (size_t) height;
+
+    size_t tilesX = (width + FIELD_TILE_SIZE - 1) / FIELD_TILE_SIZE;
+    size_t tilesY = (height + FIELD_TILE_SIZE - 1) / FIELD_TILE_SIZE;
+    return 2 * tilesX * tilesY * FIELD_TILE_SIZE * FIELD_TILE_SIZE;
+}
+
+inline const char * fieldLayoutName(int layout){
+    switch(layout){
+    case FIELD_LAYOUT_TILED: return "tiled";
+    case FIELD_LAYOUT_MORTON: return "morton";
+    default: return "columns";
+    }
+}
+
+/**
+ * The line that tells shaders/field-layout.glsl which layout this program was built with.
+ */
+inline std::string fieldLayoutDefine(){
+    return "#define FIELD_LAYOUT " + std::to_string(FIELD_LAYOUT) + "\n";
+}
+
+#endif
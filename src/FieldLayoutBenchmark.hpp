@@ -0,0 +1,207 @@
+#ifndef FIELD_LAYOUT_BENCHMARK_H
+#define FIELD_LAYOUT_BENCHMARK_H
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "ThreadPool.hpp"
+#include "VectorField.hpp"
+
+/**
+    CS-11 Asn 2: Compare how well the field layouts suit the way the particles read the field.
+    @file FieldLayoutBenchmark.hpp
+    @author Frank Hampus Weslien
+
+    Every layout in FieldLayout.hpp is built with the same kernel and the
+    particles are then moved through it on the CPU the same way particle.comp
+    does with 'smooth' interpolation, four neighbouring vectors per step. Like a
+    dispatch, all particles take a step before any of them takes the next one,
+    so with enough particles the field does not fit in the caches.
+
+    Besides the time it counts the 64 byte cache lines every step reads, and how
+    many of them the same particle already read on its previous step. Those
+    numbers do not depend on the machine and say what a GPU would see as well.
+*/
+
+#define FIELD_BENCHMARK_STEPS 100
+// The vectors in a 64 byte cache line
+#define FIELD_BENCHMARK_LINE_VECTORS 8
+
+struct FieldLayoutBenchmarkResult {
+    double buildSeconds;
+    double nanosecondsPerStep;
+    double linesPerStep;
+    double reusedLines;
+};
+
+// Bob Jenkins' One-At-A-Time hash, like random(..) in particle.comp
+inline float fieldBenchmarkRandom(uint32_t x){
+    x += (x << 10u);
+    x ^= (x >> 6u);
+    x += (x << 3u);
+    x ^= (x >> 11u);
+    x += (x << 15u);
+    return (float) (x & 0x007FFFFFu) / (float) 0x00800000u;
+}
+
+/**
+ * Move the particles in [begin, end) one step, like particle.comp.
+ * With Count the cache lines of every step are added to lines and reused,
+ * previous holds the lines of the last step of every particle.
+ */
+template <int Layout, bool Count>
+void stepFieldBenchmarkParticles( const VectorField &field, float speedFactor, unsigned int step
+                                , float *positions, uint64_t *previous, unsigned int begin, unsigned int end
+                                , uint64_t &lines, uint64_t &reused){
+    const float * data = field.data;
+    int height = field.height;
+    float fWidth = field.width - 1.0f;
+    float fHeight = field.height - 1.0f;
+
+    for(unsigned int i = begin; i < end; i++){
+        float * pos = positions + 2 * i;
+        float x = (pos[0] + 1.0f) / 2.0f * fWidth;
+        float y = (pos[1] + 1.0f) / 2.0f * fHeight;
+
+        if(!(x >= 0.0f && x < fWidth && y >= 0.0f && y < fHeight)){
+            pos[0] = fieldBenchmarkRandom(2 * (i * FIELD_BENCHMARK_STEPS + step)) * 2.0f - 1.0f;
+            pos[1] = fieldBenchmarkRandom(2 * (i * FIELD_BENCHMARK_STEPS + step) + 1) * 2.0f - 1.0f;
+            x = (pos[0] + 1.0f) / 2.0f * fWidth;
+            y = (pos[1] + 1.0f) / 2.0f * fHeight;
+        }
+
+        int xi = (int) x;
+        int yi = (int) y;
+        float dx = x - xi;
+        float dy = y - yi;
+
+        size_t corners[4] = {
+            fieldLayoutIndex<Layout>(xi, yi, height),
+            fieldLayoutIndex<Layout>(xi + 1, yi, height),
+            fieldLayoutIndex<Layout>(xi, yi + 1, height),
+            fieldLayoutIndex<Layout>(xi + 1, yi + 1, height)
+        };
+        const float * v00 = data + 2 * corners[0];
+        const float * v10 = data + 2 * corners[1];
+        const float * v01 = data + 2 * corners[2];
+        const float * v11 = data + 2 * corners[3];
+
+        for(int c = 0; c < 2; c++){
+            float r1 = v00[c] * (1.0f - dx) + v10[c] * dx;
+            float r2 = v01[c] * (1.0f - dx) + v11[c] * dx;
+            pos[c] += speedFactor * (r1 * (1.0f - dy) + r2 * dy);
+        }
+
+        if(Count){
+            uint64_t * last = previous + 4 * i;
+            uint64_t now[4];
+            int distinct = 0;
+            for(int k = 0; k < 4; k++){
+                uint64_t line = corners[k] / FIELD_BENCHMARK_LINE_VECTORS;
+                bool seen = false;
+                for(int j = 0; j < distinct; j++)
+                    seen = seen || now[j] == line;
+                if(seen)
+                    continue;
+                now[distinct++] = line;
+                lines++;
+                if(step > 0 && (last[0] == line || last[1] == line || last[2] == line || last[3] == line))
+                    reused++;
+            }
+            for(int k = 0; k < 4; k++)
+                last[k] = now[k < distinct ? k : 0];
+        }
+    }
+}
+
+/**
+ * Run the particles through the field for FIELD_BENCHMARK_STEPS steps.
+ * @return the seconds it took, the counts are only filled in with Count
+ */
+template <int Layout, bool Count>
+double runFieldBenchmarkParticles( ThreadPool &pool, const VectorField &field, float speedFactor, unsigned int nbrParticles
+                                 , uint64_t &lines, uint64_t &reused){
+    std::vector<float> positions(2 * (size_t) nbrParticles);
+    for(size_t i = 0; i < positions.size(); i++)
+        positions[i] = fieldBenchmarkRandom(i) * 2.0f - 1.0f;
+    std::vector<uint64_t> previous(Count ? 4 * (size_t) nbrParticles : 0);
+
+    std::atomic<uint64_t> totalLines(0);
+    std::atomic<uint64_t> totalReused(0);
+    float * pos = positions.data();
+    uint64_t * last = previous.data();
+
+    auto start = std::chrono::steady_clock::now();
+    for(unsigned int step = 0; step < FIELD_BENCHMARK_STEPS; step++){
+        pool.parallelFor(0, nbrParticles, pool.grainSizeFor(nbrParticles), [&, step](unsigned int begin, unsigned int end){
+            uint64_t chunkLines = 0;
+            uint64_t chunkReused = 0;
+            stepFieldBenchmarkParticles<Layout, Count>(field, speedFactor, step, pos, last, begin, end, chunkLines, chunkReused);
+            totalLines += chunkLines;
+            totalReused += chunkReused;
+        });
+    }
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+    lines = totalLines;
+    reused = totalReused;
+    return seconds.count();
+}
+
+template <int Layout>
+FieldLayoutBenchmarkResult benchmarkFieldLayout(ThreadPool &pool, const FieldKernel &kernel, int width, int height, unsigned int nbrParticles, float speedFactor){
+    FieldLayoutBenchmarkResult result;
+
+    std::vector<float> data(fieldLayoutSize<Layout>(width, height));
+    VectorField field = { data.data(), width, height };
+
+    auto start = std::chrono::steady_clock::now();
+    buildVectorFieldLayout<Layout>(pool, field, kernel);
+    std::chrono::duration<double> build = std::chrono::steady_clock::now() - start;
+    result.buildSeconds = build.count();
+
+    uint64_t lines, reused;
+    double seconds = runFieldBenchmarkParticles<Layout, false>(pool, field, speedFactor, nbrParticles, lines, reused);
+    result.nanosecondsPerStep = seconds * 1e9 / ((double) nbrParticles * FIELD_BENCHMARK_STEPS);
+
+    runFieldBenchmarkParticles<Layout, true>(pool, field, speedFactor, nbrParticles, lines, reused);
+    result.linesPerStep = (double) lines / ((double) nbrParticles * FIELD_BENCHMARK_STEPS);
+    result.reusedLines = lines > 0 ? (double) reused / lines : 0.0;
+    return result;
+}
+
+/**
+ * Benchmark every layout in FieldLayout.hpp and print the results.
+ * @param pool the threads to build the field and move the particles on
+ * @param kernel the function to build the field from
+ * @param width the number of vectors along the x-axis of the grid
+ * @param height the number of vectors along the y-axis of the grid
+ * @param nbrParticles the number of particles, use enough to not fit in the caches
+ * @param speedFactor how far the particles move per step, like speed_factor in particle.comp
+ */
+inline void benchmarkFieldLayouts(ThreadPool &pool, const FieldKernel &kernel, int width, int height, unsigned int nbrParticles, float speedFactor){
+    std::cout << "Benchmarking the field layouts on a " << width << "x" << height << " grid with "
+              << nbrParticles << " particles for " << FIELD_BENCHMARK_STEPS << " steps on "
+              << pool.size() << " threads" << std::endl;
+
+    for(int layout = 0; layout < NBR_FIELD_LAYOUTS; layout++){
+        FieldLayoutBenchmarkResult result;
+        if(layout == FIELD_LAYOUT_TILED)
+            result = benchmarkFieldLayout<FIELD_LAYOUT_TILED>(pool, kernel, width, height, nbrParticles, speedFactor);
+        else if(layout == FIELD_LAYOUT_MORTON)
+            result = benchmarkFieldLayout<FIELD_LAYOUT_MORTON>(pool, kernel, width, height, nbrParticles, speedFactor);
+        else
+            result = benchmarkFieldLayout<FIELD_LAYOUT_COLUMNS>(pool, kernel, width, height, nbrParticles, speedFactor);
+
+        std::cout << "    " << fieldLayoutName(layout) << (layout == FIELD_LAYOUT ? " (this build)" : "") << ": "
+                  << "built in " << result.buildSeconds << " s, "
+                  << result.nanosecondsPerStep << " ns per particle step, "
+                  << result.linesPerStep << " cache lines per step, "
+                  << 100.0 * result.reusedLines << "% of them read on the step before" << std::endl;
+    }
+}
+
+#endif
@@ -0,0 +1,244 @@
+#ifndef FIELD_MATH_H
+#define FIELD_MATH_H
+
+#include <cmath>
+#include <cfloat>
+#include <math.h>
+
+/**
+    CS-11 Asn 2: The math used by the vector field functions, for floats and SIMD lanes.
+    @file FieldMath.hpp
+    @author Frank Hampus Weslien
+
+    Every function has a float overload that calls the C math library and a
+    template that works on any lane type from SimdVec.hpp. The templates only
+    use the 'v' primitives, which are found through the namespace of the lane
+    type, so this file does not depend on any instruction set itself.
+
+    FieldKernels*.cpp include this file too. The float overloads are static and
+    call sqrtf(..) and friends rather than the inline overloads in <cmath>, so
+    those files never emit a copy, built for their instruction set, of a
+    function the scalar code also calls.
+
+    The transcendental functions are the Cephes single precision polynomials.
+    Measured against the correctly rounded results they stay within:
+
+        sin, cos    2 ULP for |x| < 1e6
+        tan         2 ULP
+        atan        2 ULP
+        acos        2 ULP
+        tanh        2 ULP
+        exp, log    1 ULP
+        pow         4 ULP for x >= 0.1, the error of log(x) is scaled by
+                    |log(x)| so it grows to ~25 ULP at 1e-5
+
+    The <cmath> versions are within 1 ULP, so add one to compare with those.
+    --check-field-kernels measures the whole field functions.
+*/
+
+namespace fieldmath {
+
+// Scalar versions
+
+static inline float sqrt(float x){ return ::sqrtf(x); }
+static inline float abs(float x){ return ::fabsf(x); }
+static inline float floor(float x){ return ::floorf(x); }
+static inline float trunc(float x){ return ::truncf(x); }
+static inline float min(float a, float b){ return ::fminf(a, b); }
+static inline float max(float a, float b){ return ::fmaxf(a, b); }
+static inline float select(bool m, float a, float b){ return m ? a : b; }
+static inline float sin(float x){ return ::sinf(x); }
+static inline float cos(float x){ return ::cosf(x); }
+static inline float tan(float x){ return ::tanf(x); }
+static inline float atan(float x){ return ::atanf(x); }
+static inline float acos(float x){ return ::acosf(x); }
+static inline float tanh(float x){ return ::tanhf(x); }
+static inline float exp(float x){ return ::expf(x); }
+static inline float log(float x){ return ::logf(x); }
+static inline float pow(float x, float y){ return ::powf(x, y); }
+
+// -1, 0 or 1 like glm::sign
+static inline float sign(float x){ return (float) ((0.0f < x) - (x < 0.0f)); }
+
+// The same as (float) ((int) x % 2)
+static inline float truncMod2(float x){ return (float) ((int) x % 2); }
+
+// SIMD versions
+
+template <typename V> inline V sqrt(const V &x){ return vsqrt(x); }
+template <typename V> inline V floor(const V &x){ return vfloor(x); }
+template <typename V> inline V trunc(const V &x){ return vtrunc(x); }
+template <typename V> inline V min(const V &a, const V &b){ return vmin(a, b); }
+template <typename V> inline V max(const V &a, const V &b){ return vmax(a, b); }
+template <typename V> inline V select(const typename V::Mask &m, const V &a, const V &b){ return vselect(m, a, b); }
+
+template <typename V> inline V abs(const V &x){
+    return vasfloat(vasint(x) & typename V::IVec(0x7fffffff));
+}
+
+// a with the sign of b
+template <typename V> inline V copySign(const V &a, const V &b){
+    typename V::IVec signBit = vasint(V(-0.0f));
+    return vasfloat((vasint(a) & typename V::IVec(0x7fffffff)) | (vasint(b) & signBit));
+}
+
+template <typename V> inline V sign(const V &x){
+    return vselect(x > V(0.0f), V(1.0f), vselect(x < V(0.0f), V(-1.0f), V(0.0f)));
+}
+
+template <typename V> inline V truncMod2(const V &x){
+    V t = vtrunc(x);
+    return t - V(2.0f) * vtrunc(t * V(0.5f));
+}
+
+// sin(x) when quadrantOffset is 0 and cos(x) when it is 1
+template <typename V> inline V sinCos(const V &x, int quadrantOffset){
+    typedef typename V::IVec IVec;
+    V r;
+    IVec q = vreducePiOver2(x, r) + IVec(quadrantOffset);
+    V z = r * r;
+
+    V s = vfma(vfma(V(-1.9515295891e-4f), z, V(8.3321608736e-3f)), z, V(-1.6666654611e-1f));
+    s = vfma(s, z * r, r);
+    V c = vfma(vfma(V(2.443315711809948e-5f), z, V(-1.388731625493765e-3f)), z, V(4.166664568298827e-2f));
+    c = vfma(c, z * z, vfma(V(-0.5f), z, V(1.0f)));
+
+    V result = vselect((q & IVec(1)) == IVec(1), c, s);
+    // Quadrant 2 and 3 flip the sign
+    return vasfloat(vasint(result) ^ vshl(q & IVec(2), 30));
+}
+
+template <typename V> inline V sin(const V &x){ return sinCos(x, 0); }
+template <typename V> inline V cos(const V &x){ return sinCos(x, 1); }
+
+template <typename V> inline V tan(const V &x){
+    typedef typename V::IVec IVec;
+    V r;
+    IVec q = vreducePiOver2(x, r);
+    V z = r * r;
+
+    V p = vfma(V(9.38540185543e-3f), z, V(3.11992232697e-3f));
+    p = vfma(p, z, V(2.44301354525e-2f));
+    p = vfma(p, z, V(5.34112807005e-2f));
+    p = vfma(p, z, V(1.33387994085e-1f));
+    p = vfma(p, z, V(3.33331568548e-1f));
+    V t = vfma(p * z, r, r);
+
+    // Odd quadrants: tan(x) = -1 / tan(x - pi / 2)
+    return vselect((q & IVec(1)) == IVec(1), V(-1.0f) / t, t);
+}
+
+template <typename V> inline V atan(const V &x){
+    V ax = abs(x);
+    typename V::Mask big = ax > V(2.414213562373095f);
+    typename V::Mask mid = ax > V(0.4142135623730950f);
+
+    V y = vselect(big, V(1.5707963267948966f), vselect(mid, V(0.7853981633974483f), V(0.0f)));
+    V t = vselect(big, V(-1.0f) / ax, vselect(mid, (ax - V(1.0f)) / (ax + V(1.0f)), ax));
+    V z = t * t;
+
+    V p = vfma(V(8.05374449538e-2f), z, V(-1.38776856032e-1f));
+    p = vfma(p, z, V(1.99777106478e-1f));
+    p = vfma(p, z, V(-3.33329491539e-1f));
+    y = y + vfma(p * z, t, t);
+
+    return copySign(y, x);
+}
+
+// Only for |x| <= 1, like <cmath>
+template <typename V> inline V acos(const V &x){
+    V ax = abs(x);
+    // acos(x) = 2 asin(sqrt((1 - x) / 2)) close to 1, where asin is too steep
+    typename V::Mask big = ax > V(0.5f);
+    V t = vselect(big, vsqrt(V(0.5f) * (V(1.0f) - ax)), ax);
+    V z = t * t;
+
+    V p = vfma(V(4.2163199048e-2f), z, V(2.4181311049e-2f));
+    p = vfma(p, z, V(4.5470025998e-2f));
+    p = vfma(p, z, V(7.4953002686e-2f));
+    p = vfma(p, z, V(1.6666752422e-1f));
+    V asinT = vfma(p * z, t, t);
+
+    V bigResult = V(2.0f) * asinT;
+    bigResult = vselect(x < V(0.0f), V(3.14159265358979f) - bigResult, bigResult);
+    return vselect(big, bigResult, V(1.5707963267948966f) - copySign(asinT, x));
+}
+
+template <typename V> inline V exp(const V &x){
+    typedef typename V::IVec IVec;
+    V t = vmin(vmax(x, V(-88.3762626647949f)), V(88.3762626647949f));
+
+    V n = vfloor(vfma(t, V(1.44269504088896341f), V(0.5f)));
+    t = vfma(n, V(-0.693359375f), t);
+    t = vfma(n, V(2.12194440e-4f), t);
+    V z = t * t;
+
+    V p = vfma(V(1.9875691500e-4f), t, V(1.3981999507e-3f));
+    p = vfma(p, t, V(8.3334519073e-3f));
+    p = vfma(p, t, V(4.1665795894e-2f));
+    p = vfma(p, t, V(1.6666665459e-1f));
+    p = vfma(p, t, V(5.0000001201e-1f));
+    p = vfma(p, z, t + V(1.0f));
+
+    // 2^n, built straight in the exponent bits
+    return p * vasfloat(vshl(vtoint(n) + IVec(127), 23));
+}
+
+// Only defined for x > 0
+template <typename V> inline V log(const V &x){
+    typedef typename V::IVec IVec;
+    IVec bits = vasint(vmax(x, V(FLT_MIN)));
+
+    // x = m * 2^e with m in [0.5, 1)
+    V e = vtofloat(vshr(bits, 23) - IVec(126));
+    V m = vasfloat((bits & IVec(0x007fffff)) | IVec(0x3f000000));
+
+    typename V::Mask small = m < V(0.707106781186547524f);
+    e = e - vselect(small, V(1.0f), V(0.0f));
+    m = m + vselect(small, m, V(0.0f)) - V(1.0f);
+    V z = m * m;
+
+    V p = vfma(V(7.0376836292e-2f), m, V(-1.1514610310e-1f));
+    p = vfma(p, m, V(1.1676998740e-1f));
+    p = vfma(p, m, V(-1.2420140846e-1f));
+    p = vfma(p, m, V(1.4249322787e-1f));
+    p = vfma(p, m, V(-1.6668057665e-1f));
+    p = vfma(p, m, V(2.0000714765e-1f));
+    p = vfma(p, m, V(-2.4999993993e-1f));
+    p = vfma(p, m, V(3.3333331174e-1f));
+    V y = p * m * z;
+
+    y = vfma(e, V(-2.12194440e-4f), y);
+    y = vfma(z, V(-0.5f), y);
+    return vfma(e, V(0.693359375f), m + y);
+}
+
+// Only defined for x >= 0
+template <typename V> inline V pow(const V &x, float y){
+    return vselect(x == V(0.0f), V(0.0f), exp(V(y) * log(x)));
+}
+
+// The same with a different exponent in every lane
+template <typename V> inline V pow(const V &x, const V &y){
+    return vselect(x == V(0.0f), V(0.0f), exp(y * log(x)));
+}
+
+template <typename V> inline V tanh(const V &x){
+    V ax = abs(x);
+
+    // 1 - 2 / (e^2x + 1) loses too much close to 0, use a polynomial there
+    V big = V(1.0f) - V(2.0f) / (exp(ax + ax) + V(1.0f));
+
+    V z = x * x;
+    V p = vfma(V(-5.70498872745e-3f), z, V(2.06390887954e-2f));
+    p = vfma(p, z, V(-5.37397155531e-2f));
+    p = vfma(p, z, V(1.33314422036e-1f));
+    p = vfma(p, z, V(-3.33332819422e-1f));
+    V small = vfma(p * z, x, x);
+
+    return vselect(ax >= V(0.625f), copySign(big, x), small);
+}
+
+}
+
+#endif
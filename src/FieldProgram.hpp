@@ -0,0 +1,211 @@
+#ifndef FIELD_PROGRAM_H
+#define FIELD_PROGRAM_H
+
+#include <stdint.h>
+#include "FieldMath.hpp"
+
+/**
+    CS-11 Asn 2: The bytecode that --field-x and --field-y are compiled to, and the interpreter that runs it.
+    @file FieldProgram.hpp
+    @author Frank Hampus Weslien
+
+    A program is a list of three address instructions on a small file of
+    registers. Every register holds a block of FIELD_PROGRAM_BLOCK points, so
+    one instruction does the same thing to a whole block of the column before
+    the next one is looked at. The dispatch is paid once per block while the
+    inner loops run on full SIMD lanes.
+
+    The program comes in two parts. The setup part only depends on x, the width,
+    the height and constants, which are the same for the whole column, and is
+    run once per call. The rest runs once per block.
+
+    Like FieldFunctions.hpp this file is compiled for SSE4.1, AVX2 and AVX-512
+    (FieldKernels*.cpp), so the interpreter is a template on the lane type and
+    the program a plain struct. The parser lives in FieldExpression.hpp.
+*/
+
+#define FIELD_PROGRAM_MAX_REGISTERS 64
+#define FIELD_PROGRAM_MAX_INSTRUCTIONS 512
+// The number of points every register holds, a multiple of the widest lane type
+#define FIELD_PROGRAM_BLOCK 256
+
+// The registers that are filled in before the program runs
+#define FIELD_PROGRAM_REGISTER_X 0
+#define FIELD_PROGRAM_REGISTER_Y 1
+#define FIELD_PROGRAM_REGISTER_WIDTH 2
+#define FIELD_PROGRAM_REGISTER_HEIGHT 3
+#define FIELD_PROGRAM_FIRST_FREE_REGISTER 4
+
+/**
+ * Every instruction as X(NAME, NUMBER OF OPERANDS, RESULT), where the result is
+ * an expression of the operands a, b and c of type T. Comparisons give 1 or 0.
+ */
+#define FIELD_OP_LIST(X) \
+    X(ADD,           2, a + b) \
+    X(SUB,           2, a - b) \
+    X(MUL,           2, a * b) \
+    X(DIV,           2, a / b) \
+    X(NEG,           1, -a) \
+    X(LESS,          2, fieldmath::select(a < b, T(1.0f), T(0.0f))) \
+    X(LESS_EQUAL,    2, fieldmath::select(a <= b, T(1.0f), T(0.0f))) \
+    X(GREATER,       2, fieldmath::select(a > b, T(1.0f), T(0.0f))) \
+    X(GREATER_EQUAL, 2, fieldmath::select(a >= b, T(1.0f), T(0.0f))) \
+    X(SELECT,        3, fieldmath::select(a == T(0.0f), c, b)) \
+    X(SIN,           1, fieldmath::sin(a)) \
+    X(COS,           1, fieldmath::cos(a)) \
+    X(TAN,           1, fieldmath::tan(a)) \
+    X(ATAN,          1, fieldmath::atan(a)) \
+    X(TANH,          1, fieldmath::tanh(a)) \
+    X(EXP,           1, fieldmath::exp(a)) \
+    X(LOG,           1, fieldmath::log(a)) \
+    X(SQRT,          1, fieldmath::sqrt(a)) \
+    X(ABS,           1, fieldmath::abs(a)) \
+    X(FLOOR,         1, fieldmath::floor(a)) \
+    X(SIGN,          1, fieldmath::sign(a)) \
+    X(MIN,           2, fieldmath::min(a, b)) \
+    X(MAX,           2, fieldmath::max(a, b)) \
+    X(POW,           2, fieldmath::pow(a, b)) \
+    X(MOD,           2, a - b * fieldmath::floor(a / b))
+
+#define FIELD_OP_ENUM(NAME, OPERANDS, RESULT) FIELD_OP_##NAME,
+enum FieldOp {
+    FIELD_OP_CONST, // dst = value
+    FIELD_OP_LIST(FIELD_OP_ENUM)
+    NBR_FIELD_OPS
+};
+#undef FIELD_OP_ENUM
+
+struct FieldInstruction {
+    uint8_t op;
+    uint8_t dst;
+    uint8_t a;
+    uint8_t b;
+    uint8_t c;
+    float value;
+};
+
+struct FieldProgram {
+    FieldInstruction code[FIELD_PROGRAM_MAX_INSTRUCTIONS];
+    // code[0, setupLength) runs once per call, code[setupLength, length) once per block
+    int setupLength;
+    int length;
+    int nbrRegisters;
+    // The registers written by the setup part, they are the same for every point
+    uint64_t uniformRegisters;
+    uint8_t outX;
+    uint8_t outY;
+};
+
+/**
+ * Loads and stores for a lane type from SimdVec.hpp, or for plain floats when
+ * there is no SIMD.
+ */
+template <typename V>
+struct FieldLanes {
+    static const int size = V::size;
+    static V load(const float *p){ return V::load(p); }
+    static void store(const V &v, float *p){ v.store(p); }
+};
+
+template <>
+struct FieldLanes<float> {
+    static const int size = 1;
+    static float load(const float *p){ return *p; }
+    static void store(float v, float *p){ *p = v; }
+};
+
+/**
+ * Run the instructions in [begin, end) on the first n points of every register.
+ */
+template <typename V>
+inline void runFieldInstructions(const FieldProgram &program, int begin, int end, float (*regs)[FIELD_PROGRAM_BLOCK], int n){
+    typedef V T;
+    typedef FieldLanes<V> L;
+
+    for (int pc = begin; pc < end; pc++) {
+        const FieldInstruction &ins = program.code[pc];
+        float * dst = regs[ins.dst];
+        const float * pa = regs[ins.a];
+        const float * pb = regs[ins.b];
+        const float * pc3 = regs[ins.c];
+
+        switch (ins.op) {
+        case FIELD_OP_CONST:
+            for (int i = 0; i < n; i++)
+                dst[i] = ins.value;
+            break;
+
+#define FIELD_OP_LOAD_1 T a = L::load(pa + i);
+#define FIELD_OP_LOAD_2 FIELD_OP_LOAD_1 T b = L::load(pb + i);
+#define FIELD_OP_LOAD_3 FIELD_OP_LOAD_2 T c = L::load(pc3 + i);
+#define FIELD_OP_CASE(NAME, OPERANDS, RESULT) \
+        case FIELD_OP_##NAME: \
+            for (int i = 0; i < n; i += L::size) { \
+                FIELD_OP_LOAD_##OPERANDS \
+                L::store(RESULT, dst + i); \
+            } \
+            break;
+
+        FIELD_OP_LIST(FIELD_OP_CASE)
+
+#undef FIELD_OP_CASE
+#undef FIELD_OP_LOAD_3
+#undef FIELD_OP_LOAD_2
+#undef FIELD_OP_LOAD_1
+
+        default:
+            break;
+        }
+    }
+}
+
+/**
+ * Evaluate the program at the points (x, y0), (x, y0 + yStep), ..., (x, y0 + (count - 1) * yStep).
+ * See FieldKernel::evaluate(..).
+ */
+template <typename V>
+void runFieldProgram(const FieldProgram &program, float x, float y0, float yStep, int count, float width, float height, float * outX, float * outY){
+    typedef FieldLanes<V> L;
+    alignas(64) float regs[FIELD_PROGRAM_MAX_REGISTERS][FIELD_PROGRAM_BLOCK];
+
+    // The setup part only needs one lane, its results are then copied to the whole block
+    for (int i = 0; i < L::size; i++) {
+        regs[FIELD_PROGRAM_REGISTER_X][i] = x;
+        regs[FIELD_PROGRAM_REGISTER_WIDTH][i] = width;
+        regs[FIELD_PROGRAM_REGISTER_HEIGHT][i] = height;
+    }
+    runFieldInstructions<V>(program, 0, program.setupLength, regs, L::size);
+
+    for (int r = 0; r < program.nbrRegisters; r++) {
+        if (program.uniformRegisters & (1ull << r)) {
+            for (int i = L::size; i < FIELD_PROGRAM_BLOCK; i++)
+                regs[r][i] = regs[r][0];
+        }
+    }
+
+    for (int begin = 0; begin < count; begin += FIELD_PROGRAM_BLOCK) {
+        int n = count - begin < FIELD_PROGRAM_BLOCK ? count - begin : FIELD_PROGRAM_BLOCK;
+        // The last points of the block are computed on a full vector, like evaluateSpan(..)
+        int padded = (n + L::size - 1) / L::size * L::size;
+
+        for (int i = 0; i < padded; i++)
+            regs[FIELD_PROGRAM_REGISTER_Y][i] = y0 + (begin + i) * yStep;
+        runFieldInstructions<V>(program, program.setupLength, program.length, regs, padded);
+
+        for (int i = 0; i < n; i++) {
+            outX[begin + i] = regs[program.outX][i];
+            outY[begin + i] = regs[program.outY][i];
+        }
+    }
+}
+
+typedef void (*FieldProgramSpanFn)(const FieldProgram &program, float x, float y0, float yStep, int count, float width, float height, float * outX, float * outY);
+
+#ifdef FIELD_SIMD_X86
+// runFieldProgram(..) for every instruction set, see FieldKernelsSSE41.cpp etc.
+FieldProgramSpanFn fieldProgramSpanSSE41();
+FieldProgramSpanFn fieldProgramSpanAVX2();
+FieldProgramSpanFn fieldProgramSpanAVX512();
+#endif
+
+#endif
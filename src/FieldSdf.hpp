@@ -0,0 +1,509 @@
+#ifndef FIELD_SDF_H
+#define FIELD_SDF_H
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "FieldExpression.hpp"
+
+/**
+    CS-11 Asn 2: Vector fields built from signed distance fields in the config, --field-sdf.
+    @file FieldSdf.hpp
+    @author Frank Hampus Weslien
+
+    Functions 37-40 each follow the border of one shape. --field-sdf does the
+    same for any combination of shapes, written as a small graph:
+
+        field-sdf = ring = arc(0.3, 0.3, 0.5, 0.5); flow(union(ring, rotate(cross(0.8, 0.3), pi / 4)), 0.01)
+
+    The lines are separated by ';', every one but the last gives a node a name
+    that the lines after it can use. The last one is the field. The nodes:
+
+        shapes      circle(r) box(half width, half height) cross(b x, b y)
+                    arc(sin aperture, cos aperture, radius, thickness)
+        transforms  translate(shape, x, y) rotate(shape, angle) scale(shape, s)
+                    round(shape, r) which grows the shape by r
+        booleans    union(a, b) intersect(a, b) subtract(a, b) and
+                    blend(a, b, k) which is a union rounded off over a distance k
+        fields      flow(shape, a) around the shape outside and along the
+                    gradient inside, like functions 37-40
+                    gradient(shape, a) along(shape, a) (the gradient turned 90 degrees)
+                    normalize(field, a) which makes every vector a long
+                    add(field, field)
+
+    The numbers may be expressions of constants, like pi / 4. Shapes live in
+    [-1, 1] x [-1, 1] over the grid, like toClipSpace(..).
+
+    The graph is turned into the nodes of FieldExpressionCompiler and compiled
+    to one FieldProgram, so the whole field is computed in one pass over the
+    grid, a block of FIELD_PROGRAM_BLOCK points of a column at a time. A shape
+    that is used twice, by name or written out twice, is computed once per block.
+*/
+
+/**
+ * Parses a graph, see the top of this file, and compiles it to a FieldProgram.
+ * Only used through FieldSdfKernel::compile(..).
+ */
+class FieldSdfCompiler : public FieldExpressionCompiler
+{
+    enum SdfKind {
+        SDF_CIRCLE, SDF_BOX, SDF_CROSS, SDF_ARC,
+        SDF_TRANSLATE, SDF_ROTATE, SDF_SCALE, SDF_ROUND,
+        SDF_UNION, SDF_INTERSECT, SDF_SUBTRACT, SDF_BLEND,
+        SDF_FLOW, SDF_GRADIENT, SDF_ALONG, SDF_NORMALIZE, SDF_ADD
+    };
+
+    enum ArgKind { ARG_NUMBER, ARG_SHAPE, ARG_FIELD };
+
+    struct SdfFunction {
+        const char * name;
+        SdfKind kind;
+        int nbrArgs;
+        ArgKind args[4];
+        bool field; // gives a field instead of a shape
+    };
+
+    struct SdfNode {
+        SdfKind kind;
+        bool field;
+        int children[2];
+        float numbers[4];
+    };
+
+    // The distance and its gradient, as nodes of the compiler
+    struct Distance {
+        int d;
+        int gradX;
+        int gradY;
+    };
+
+    std::vector<SdfNode> sdfNodes;
+    std::map<std::string, int> names;
+    // Every shape by the point it was computed at
+    std::map<std::tuple<int, int, int>, Distance> distances;
+
+public:
+
+    /**
+        @param graph the graph, see the top of this file
+        @param program filled with the compiled graph
+        @param error set to what is wrong if the graph can't be compiled
+        @return false if the graph can't be compiled
+    */
+    bool compile(const std::string &graph, FieldProgram &program, std::string &error){
+        text = graph;
+        pos = 0;
+
+        try {
+            int root = parseGraph();
+            int clipX, clipY;
+            clipPosition(clipX, clipY);
+            int vx, vy;
+            fieldAt(root, clipX, clipY, vx, vy);
+            emitProgram(vx, vy, program);
+        } catch(const std::invalid_argument &e) {
+            error = "field-sdf = " + graph + "\n" + std::string(12 + pos, ' ') + "^ " + e.what();
+            return false;
+        }
+
+        return finishProgram(program, error);
+    }
+
+private:
+
+    // Parsing
+    // --------------------------------------------------------------------------------------------
+
+    int parseGraph(){
+        for(;;){
+            skipSpace();
+            size_t start = pos;
+            std::string name = parseName();
+            std::string definition;
+            if(!name.empty() && accept("="))
+                definition = name;
+            else
+                pos = start;
+
+            int node = parseNode();
+            if(!accept(";")){
+                skipSpace();
+                if(pos < text.size())
+                    fail("expected ';'");
+                if(!definition.empty() || !sdfNodes[node].field)
+                    fail("the last line must be a field, like flow(shape, 0.01)");
+                return node;
+            }
+
+            if(definition.empty())
+                fail("only the last line can be without a name");
+            if(names.count(definition) > 0){
+                pos = start;
+                fail("'" + definition + "' is already defined");
+            }
+            names[definition] = node;
+
+            // A ';' after the last line
+            skipSpace();
+            if(pos == text.size())
+                fail("the last line must be a field, like flow(shape, 0.01)");
+        }
+    }
+
+    std::string parseName(){
+        skipSpace();
+        size_t start = pos;
+        while(pos < text.size() && (std::isalnum((unsigned char) text[pos]) || text[pos] == '_'))
+            pos++;
+        if(start < pos && std::isdigit((unsigned char) text[start]))
+            pos = start;
+        return text.substr(start, pos - start);
+    }
+
+    int parseNode(){
+        skipSpace();
+        size_t start = pos;
+        std::string name = parseName();
+        if(name.empty())
+            fail("expected a shape or a field");
+
+        std::map<std::string, int>::iterator named = names.find(name);
+        if(named != names.end())
+            return named->second;
+
+        static const SdfFunction functions[] = {
+            { "circle",    SDF_CIRCLE,    1, { ARG_NUMBER },                                   false },
+            { "box",       SDF_BOX,       2, { ARG_NUMBER, ARG_NUMBER },                       false },
+            { "cross",     SDF_CROSS,     2, { ARG_NUMBER, ARG_NUMBER },                       false },
+            { "arc",       SDF_ARC,       4, { ARG_NUMBER, ARG_NUMBER, ARG_NUMBER, ARG_NUMBER }, false },
+            { "translate", SDF_TRANSLATE, 3, { ARG_SHAPE, ARG_NUMBER, ARG_NUMBER },            false },
+            { "rotate",    SDF_ROTATE,    2, { ARG_SHAPE, ARG_NUMBER },                        false },
+            { "scale",     SDF_SCALE,     2, { ARG_SHAPE, ARG_NUMBER },                        false },
+            { "round",     SDF_ROUND,     2, { ARG_SHAPE, ARG_NUMBER },                        false },
+            { "union",     SDF_UNION,     2, { ARG_SHAPE, ARG_SHAPE },                         false },
+            { "intersect", SDF_INTERSECT, 2, { ARG_SHAPE, ARG_SHAPE },                         false },
+            { "subtract",  SDF_SUBTRACT,  2, { ARG_SHAPE, ARG_SHAPE },                         false },
+            { "blend",     SDF_BLEND,     3, { ARG_SHAPE, ARG_SHAPE, ARG_NUMBER },             false },
+            { "flow",      SDF_FLOW,      2, { ARG_SHAPE, ARG_NUMBER },                        true },
+            { "gradient",  SDF_GRADIENT,  2, { ARG_SHAPE, ARG_NUMBER },                        true },
+            { "along",     SDF_ALONG,     2, { ARG_SHAPE, ARG_NUMBER },                        true },
+            { "normalize", SDF_NORMALIZE, 2, { ARG_FIELD, ARG_NUMBER },                        true },
+            { "add",       SDF_ADD,       2, { ARG_FIELD, ARG_FIELD },                         true }
+        };
+
+        for(const SdfFunction &f : functions){
+            if(name != f.name)
+                continue;
+
+            SdfNode node = {};
+            node.kind = f.kind;
+            node.field = f.field;
+            node.children[0] = node.children[1] = -1;
+            int nbrChildren = 0;
+            int nbrNumbers = 0;
+
+            expect("(");
+            for(int i = 0; i < f.nbrArgs; i++){
+                if(i > 0)
+                    expect(",");
+                skipSpace();
+                size_t argStart = pos;
+                if(f.args[i] == ARG_NUMBER){
+                    node.numbers[nbrNumbers++] = parseNumber();
+                    continue;
+                }
+
+                int child = parseNode();
+                if(sdfNodes[child].field != (f.args[i] == ARG_FIELD)){
+                    pos = argStart;
+                    fail(f.args[i] == ARG_FIELD ? "expected a field" : "expected a shape");
+                }
+                node.children[nbrChildren++] = child;
+            }
+            expect(")");
+
+            sdfNodes.push_back(node);
+            return (int) sdfNodes.size() - 1;
+        }
+
+        pos = start;
+        fail("unknown name '" + name + "'");
+        return -1;
+    }
+
+    float parseNumber(){
+        int node = parseComparison();
+        if(nodes[node].kind != NODE_NUMBER)
+            fail("expected a number");
+        return nodes[node].value;
+    }
+
+    // Building the graph
+    // --------------------------------------------------------------------------------------------
+
+    int number(float value){
+        return makeNumber(value);
+    }
+
+    int op(int op, int a, int b = -1, int c = -1){
+        return makeOp(op, a, b, c);
+    }
+
+    // a where condition is not 0, b elsewhere
+    int select(int condition, int a, int b){
+        return op(FIELD_OP_SELECT, condition, a, b);
+    }
+
+    int length(int x, int y){
+        return op(FIELD_OP_SQRT, op(FIELD_OP_ADD, op(FIELD_OP_MUL, x, x), op(FIELD_OP_MUL, y, y)));
+    }
+
+    // Like toClipSpace(..)
+    void clipPosition(int &clipX, int &clipY){
+        int x = makeRegister(FIELD_PROGRAM_REGISTER_X, false);
+        int y = makeRegister(FIELD_PROGRAM_REGISTER_Y, true);
+        int width = makeRegister(FIELD_PROGRAM_REGISTER_WIDTH, false);
+        int height = makeRegister(FIELD_PROGRAM_REGISTER_HEIGHT, false);
+        clipX = op(FIELD_OP_SUB, op(FIELD_OP_DIV, op(FIELD_OP_MUL, number(2.0f), x), width), number(1.0f));
+        clipY = op(FIELD_OP_SUB, op(FIELD_OP_DIV, op(FIELD_OP_MUL, number(2.0f), y), height), number(1.0f));
+    }
+
+    /**
+        The distance to a shape and its gradient at the point (px, py).
+    */
+    Distance distanceAt(int index, int px, int py){
+        std::tuple<int, int, int> key(index, px, py);
+        std::map<std::tuple<int, int, int>, Distance>::iterator it = distances.find(key);
+        if(it != distances.end())
+            return it->second;
+
+        const SdfNode &node = sdfNodes[index];
+        const float * n = node.numbers;
+        Distance result;
+
+        switch(node.kind){
+        case SDF_CIRCLE: {
+            int l = length(px, py);
+            result.d = op(FIELD_OP_SUB, l, number(n[0]));
+            result.gradX = op(FIELD_OP_DIV, px, l);
+            result.gradY = op(FIELD_OP_DIV, py, l);
+            break;
+        }
+
+        case SDF_BOX: {
+            // Like sdgBox(..) by Inigo Quilez
+            int wx = op(FIELD_OP_SUB, op(FIELD_OP_ABS, px), number(n[0]));
+            int wy = op(FIELD_OP_SUB, op(FIELD_OP_ABS, py), number(n[1]));
+            int g = op(FIELD_OP_MAX, wx, wy);
+            int qx = op(FIELD_OP_MAX, wx, number(0.0f));
+            int qy = op(FIELD_OP_MAX, wy, number(0.0f));
+            int l = length(qx, qy);
+            int outside = op(FIELD_OP_GREATER, g, number(0.0f));
+            int alongX = op(FIELD_OP_GREATER, wx, wy);
+            result.d = select(outside, l, g);
+            result.gradX = op(FIELD_OP_MUL, op(FIELD_OP_SIGN, px), select(outside, op(FIELD_OP_DIV, qx, l), alongX));
+            result.gradY = op(FIELD_OP_MUL, op(FIELD_OP_SIGN, py), select(outside, op(FIELD_OP_DIV, qy, l), op(FIELD_OP_SUB, number(1.0f), alongX)));
+            break;
+        }
+
+        case SDF_CROSS: {
+            // The same steps as sdgCross(..)
+            float bx = n[0];
+            float by = n[1];
+            int sx = op(FIELD_OP_SIGN, px);
+            int sy = op(FIELD_OP_SIGN, py);
+            int ax = op(FIELD_OP_ABS, px);
+            int ay = op(FIELD_OP_ABS, py);
+
+            int swap = op(FIELD_OP_GREATER, ay, ax);
+            int qx = op(FIELD_OP_SUB, select(swap, ay, ax), number(bx));
+            int qy = op(FIELD_OP_SUB, select(swap, ax, ay), number(by));
+            int h = op(FIELD_OP_MAX, qx, qy);
+
+            int inside = op(FIELD_OP_LESS, h, number(0.0f));
+            int ox = op(FIELD_OP_MAX, select(inside, op(FIELD_OP_SUB, number(by - bx), qx), qx), number(0.0f));
+            int oy = op(FIELD_OP_MAX, select(inside, op(FIELD_OP_NEG, qy), qy), number(0.0f));
+            int l = length(ox, oy);
+
+            int onArm = op(FIELD_OP_MUL, inside, op(FIELD_OP_LESS, op(FIELD_OP_NEG, qx), l));
+            int rx = select(onArm, op(FIELD_OP_NEG, qx), l);
+            int ry = select(onArm, number(1.0f), op(FIELD_OP_DIV, ox, l));
+            int rz = select(onArm, number(0.0f), op(FIELD_OP_DIV, oy, l));
+
+            result.d = op(FIELD_OP_MUL, op(FIELD_OP_SIGN, h), rx);
+            result.gradX = op(FIELD_OP_MUL, sx, select(swap, rz, ry));
+            result.gradY = op(FIELD_OP_MUL, sy, select(swap, ry, rz));
+            break;
+        }
+
+        case SDF_ARC: {
+            // The same steps as sdgArc(..)
+            float scX = n[0];
+            float scY = n[1];
+            float ra = n[2];
+            float rb = n[3];
+            int s = op(FIELD_OP_SIGN, px);
+            int ax = op(FIELD_OP_ABS, px);
+
+            int wx = op(FIELD_OP_SUB, ax, number(ra * scX));
+            int wy = op(FIELD_OP_SUB, py, number(ra * scY));
+            int dw = length(wx, wy);
+
+            int l = length(px, py);
+            int w = op(FIELD_OP_SUB, l, number(ra));
+            int sw = op(FIELD_OP_SIGN, w);
+
+            int onCap = op(FIELD_OP_GREATER, op(FIELD_OP_MUL, number(scY), ax), op(FIELD_OP_MUL, number(scX), py));
+            result.d = select(onCap, op(FIELD_OP_SUB, dw, number(rb)), op(FIELD_OP_SUB, op(FIELD_OP_ABS, w), number(rb)));
+            result.gradX = select(onCap, op(FIELD_OP_DIV, op(FIELD_OP_MUL, s, wx), dw), op(FIELD_OP_DIV, op(FIELD_OP_MUL, sw, px), l));
+            result.gradY = select(onCap, op(FIELD_OP_DIV, wy, dw), op(FIELD_OP_DIV, op(FIELD_OP_MUL, sw, py), l));
+            break;
+        }
+
+        case SDF_TRANSLATE:
+            result = distanceAt(node.children[0], op(FIELD_OP_SUB, px, number(n[0])), op(FIELD_OP_SUB, py, number(n[1])));
+            break;
+
+        case SDF_ROTATE: {
+            // The point is turned back, the gradient turned with the shape
+            float c = std::cos(n[0]);
+            float s = std::sin(n[0]);
+            int qx = op(FIELD_OP_ADD, op(FIELD_OP_MUL, number(c), px), op(FIELD_OP_MUL, number(s), py));
+            int qy = op(FIELD_OP_SUB, op(FIELD_OP_MUL, number(c), py), op(FIELD_OP_MUL, number(s), px));
+            Distance inner = distanceAt(node.children[0], qx, qy);
+            result.d = inner.d;
+            result.gradX = op(FIELD_OP_SUB, op(FIELD_OP_MUL, number(c), inner.gradX), op(FIELD_OP_MUL, number(s), inner.gradY));
+            result.gradY = op(FIELD_OP_ADD, op(FIELD_OP_MUL, number(s), inner.gradX), op(FIELD_OP_MUL, number(c), inner.gradY));
+            break;
+        }
+
+        case SDF_SCALE: {
+            int k = number(n[0]);
+            Distance inner = distanceAt(node.children[0], op(FIELD_OP_DIV, px, k), op(FIELD_OP_DIV, py, k));
+            result = inner;
+            result.d = op(FIELD_OP_MUL, inner.d, k);
+            break;
+        }
+
+        case SDF_ROUND:
+            result = distanceAt(node.children[0], px, py);
+            result.d = op(FIELD_OP_SUB, result.d, number(n[0]));
+            break;
+
+        case SDF_UNION:
+        case SDF_INTERSECT:
+        case SDF_SUBTRACT: {
+            Distance a = distanceAt(node.children[0], px, py);
+            Distance b = distanceAt(node.children[1], px, py);
+            // a - b is a and not b, the inside of b turned out
+            if(node.kind == SDF_SUBTRACT)
+                b = Distance { op(FIELD_OP_NEG, b.d), op(FIELD_OP_NEG, b.gradX), op(FIELD_OP_NEG, b.gradY) };
+            int takeA = node.kind == SDF_UNION ? op(FIELD_OP_LESS, a.d, b.d) : op(FIELD_OP_GREATER, a.d, b.d);
+            result.d = select(takeA, a.d, b.d);
+            result.gradX = select(takeA, a.gradX, b.gradX);
+            result.gradY = select(takeA, a.gradY, b.gradY);
+            break;
+        }
+
+        case SDF_BLEND: {
+            // The polynomial smooth minimum, the gradients are mixed the same way
+            Distance a = distanceAt(node.children[0], px, py);
+            Distance b = distanceAt(node.children[1], px, py);
+            float k = std::max(n[0], 1e-6f);
+            int h = op(FIELD_OP_ADD, number(0.5f), op(FIELD_OP_MUL, number(0.5f / k), op(FIELD_OP_SUB, b.d, a.d)));
+            h = op(FIELD_OP_MIN, op(FIELD_OP_MAX, h, number(0.0f)), number(1.0f));
+            int rest = op(FIELD_OP_SUB, number(1.0f), h);
+            auto mix = [this, h, rest](int fromB, int toA){
+                return op(FIELD_OP_ADD, op(FIELD_OP_MUL, fromB, rest), op(FIELD_OP_MUL, toA, h));
+            };
+            result.d = op(FIELD_OP_SUB, mix(b.d, a.d), op(FIELD_OP_MUL, number(k), op(FIELD_OP_MUL, h, rest)));
+            result.gradX = mix(b.gradX, a.gradX);
+            result.gradY = mix(b.gradY, a.gradY);
+            break;
+        }
+
+        default:
+            fail("expected a shape");
+        }
+
+        distances[key] = result;
+        return result;
+    }
+
+    /**
+        The vector of a field node at the point (px, py).
+    */
+    void fieldAt(int index, int px, int py, int &vx, int &vy){
+        const SdfNode &node = sdfNodes[index];
+        const float * n = node.numbers;
+
+        switch(node.kind){
+        case SDF_FLOW: {
+            // Like flowAlongSdf(..)
+            Distance shape = distanceAt(node.children[0], px, py);
+            int inside = op(FIELD_OP_LESS_EQUAL, shape.d, number(0.0f));
+            vx = op(FIELD_OP_MUL, number(n[0]), select(inside, shape.gradX, op(FIELD_OP_NEG, shape.gradY)));
+            vy = op(FIELD_OP_MUL, number(n[0]), select(inside, shape.gradY, shape.gradX));
+            break;
+        }
+
+        case SDF_GRADIENT: {
+            Distance shape = distanceAt(node.children[0], px, py);
+            vx = op(FIELD_OP_MUL, number(n[0]), shape.gradX);
+            vy = op(FIELD_OP_MUL, number(n[0]), shape.gradY);
+            break;
+        }
+
+        case SDF_ALONG: {
+            Distance shape = distanceAt(node.children[0], px, py);
+            vx = op(FIELD_OP_MUL, number(n[0]), op(FIELD_OP_NEG, shape.gradY));
+            vy = op(FIELD_OP_MUL, number(n[0]), shape.gradX);
+            break;
+        }
+
+        case SDF_NORMALIZE: {
+            int x, y;
+            fieldAt(node.children[0], px, py, x, y);
+            int scale = op(FIELD_OP_DIV, number(n[0]), length(x, y));
+            vx = op(FIELD_OP_MUL, x, scale);
+            vy = op(FIELD_OP_MUL, y, scale);
+            break;
+        }
+
+        case SDF_ADD: {
+            int ax, ay, bx, by;
+            fieldAt(node.children[0], px, py, ax, ay);
+            fieldAt(node.children[1], px, py, bx, by);
+            vx = op(FIELD_OP_ADD, ax, bx);
+            vy = op(FIELD_OP_ADD, ay, by);
+            break;
+        }
+
+        default:
+            fail("expected a field");
+        }
+    }
+};
+
+/**
+ * A vector field given by a graph of signed distance fields, see the top of this file.
+ */
+class FieldSdfKernel : public FieldExpressionKernel {
+public:
+
+    /**
+        @param graph the graph, see the top of this file
+        @param error set to what is wrong if the graph can't be compiled
+        @return false if the graph can't be compiled
+    */
+    bool compile(const std::string &graph, std::string &error){
+        FieldSdfCompiler compiler;
+        return compiler.compile(graph, program, error);
+    }
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef FIELD_SIMD_H
+#define FIELD_SIMD_H
+
+#include "SimdVec.hpp"
+#include "FieldFunctions.hpp"
+
+/**
+    CS-11 Asn 2: Runs the field functions on SIMD lanes.
+    @file FieldSimd.hpp
+    @author Frank Hampus Weslien
+
+    Only included by FieldKernelsSSE41.cpp, FieldKernelsAVX2.cpp and
+    FieldKernelsAVX512.cpp, which are the only files compiled with those
+    instruction sets enabled. V is the lane type of that instruction set, every
+    template below is instantiated with it and never with float, so nothing in
+    here can be shared with code that runs on other machines.
+*/
+
+/**
+ * Evaluate F for V::size points at a time. The last few points of the span are
+ * computed on a full vector and only the ones asked for are copied out.
+ */
+template <typename F, typename V>
+void evaluateSpan(float x, float y0, float yStep, int count, float width, float height, float * outX, float * outY){
+    V vx, vy;
+    int i = 0;
+    for (; i + V::size <= count; i += V::size) {
+        F::eval(V(x), V(y0) + V::iota(i) * V(yStep), width, height, vx, vy);
+        vx.store(outX + i);
+        vy.store(outY + i);
+    }
+
+    if (i < count) {
+        float tailX[V::size];
+        float tailY[V::size];
+        F::eval(V(x), V(y0) + V::iota(i) * V(yStep), width, height, vx, vy);
+        vx.store(tailX);
+        vy.store(tailY);
+        for (int j = 0; i + j < count; j++) {
+            outX[i + j] = tailX[j];
+            outY[i + j] = tailY[j];
+        }
+    }
+}
+
+/**
+ * All the field functions for one lane type.
+ * @return NBR_FIELD_FUNCTIONS spans indexed by --vector-field-function
+ */
+template <typename V>
+const FieldSpanFn * fieldSpanTable(){
+#define FIELD_SPAN_ENTRY(F) &evaluateSpan<F, V>,
+    static const FieldSpanFn table[NBR_FIELD_FUNCTIONS] = {
+        FIELD_FUNCTION_LIST(FIELD_SPAN_ENTRY)
+    };
+#undef FIELD_SPAN_ENTRY
+    return table;
+}
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef GPU_FIELD_BUILDER_H
+#define GPU_FIELD_BUILDER_H
+
+#include "../include/glad/glad.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include "Shader.hpp"
+#include "GLHelpers.hpp"
+#include "VectorField.hpp"
+
+/**
+    CS-11 Asn 2: Build the vector field on the GPU with shaders/vector-field.comp.
+    @file GPUFieldBuilder.hpp
+    @author Frank Hampus Weslien
+
+    The compute shader writes the field straight into the ssbo that
+    particle.comp reads from, so it never crosses the bus. That makes it cheap
+    enough to rebuild every frame, which is how the field is animated: the
+    sample point of every vector moves around a circle, see u_orbit_radius.
+
+    The shader holds a copy of every function in FieldFunctions.hpp, only the
+    selected one is compiled in through FIELD_FUNCTION. With a texture format
+    it writes into a texture instead, see --field-format.
+*/
+
+// The largest difference from the CPU field allowed by checkGPUField(..),
+// relative to the longest vector. GLSL makes no promises about the precision
+// of sin(..) and friends so this is far looser than FIELD_CHECK_MAX_PEAK_ULP.
+#define FIELD_GPU_CHECK_MAX_ERROR 1e-3f
+
+class GPUFieldBuilder : private boost::noncopyable
+{
+    Shader shader;
+    float orbitRadius;
+    float orbitPeriod;
+    GLenum textureFormat;
+
+public:
+
+    /**
+        @param shaderPath the folder where the shaders are located
+        @param functionNbr the number given by --vector-field-function
+        @param orbitRadius the radius, in vectors, of the circle the sample points move around
+        @param orbitPeriod the number of seconds it takes to go around the circle once
+        @param textureFormat GL_RG16F or GL_RG32F to build into a texture, 0 for an ssbo
+    */
+    GPUFieldBuilder(const std::string &shaderPath, unsigned int functionNbr, float orbitRadius, float orbitPeriod, GLenum textureFormat = 0)
+        : shader((shaderPath + "/vector-field.comp").c_str(), "#define FIELD_FUNCTION " + std::to_string(functionNbr) + "\n" + fieldLayoutDefine() + imageFormatDefine(textureFormat))
+        , orbitRadius(orbitRadius)
+        , orbitPeriod(orbitPeriod)
+        , textureFormat(textureFormat)
+    {
+    }
+
+    /**
+        @return true if the field changes over time and has to be rebuilt every frame
+    */
+    bool animated() const {
+        return orbitRadius != 0.0f;
+    }
+
+    /**
+        Fill the ssbo or texture with the field at the given time. Commands that
+        read it afterwards see the new field, there is no need to wait for it.
+        @param field a buffer with room for vectorFieldSize(width, height) floats,
+                     or a height x width texture of the format given to the constructor
+        @param width the number of vectors along the x-axis
+        @param height the number of vectors along the y-axis
+        @param time the number of seconds since the start of the animation
+    */
+    void build(GLuint field, int width, int height, float time){
+        shader.use();
+        shader.setInt("u_width", width);
+        shader.setInt("u_height", height);
+        shader.setFloat("u_time", time);
+        shader.setFloat("u_orbit_radius", orbitRadius);
+        shader.setFloat("u_orbit_period", orbitPeriod);
+
+        if(textureFormat != 0)
+            glBindImageTexture(0, field, 0, GL_FALSE, 0, GL_WRITE_ONLY, textureFormat);
+        else
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, field);
+        // Matches the local size in vector-field.comp
+        glDispatchCompute((height + 63) / 64, (width + 3) / 4, 1);
+        glMemoryBarrier(textureFormat != 0 ? GL_TEXTURE_FETCH_BARRIER_BIT : GL_SHADER_STORAGE_BARRIER_BIT);
+        glCheckError();
+    }
+
+private:
+
+    static std::string imageFormatDefine(GLenum textureFormat){
+        if(textureFormat == GL_RG16F)
+            return "#define FIELD_IMAGE_FORMAT rg16f\n";
+        if(textureFormat == GL_RG32F)
+            return "#define FIELD_IMAGE_FORMAT rg32f\n";
+        return "";
+    }
+};
+
+/**
+ * Build every field function with vector-field.comp and compare it against the
+ * CPU kernels, on a sample of the columns in the grid.
+ * @param shaderPath the folder where the shaders are located
+ * @param width the number of vectors along the x-axis of the grid
+ * @param height the number of vectors along the y-axis of the grid
+ * @return true if all functions are within FIELD_GPU_CHECK_MAX_ERROR
+ */
+inline bool checkGPUField(const std::string &shaderPath, int width, int height){
+    std::cout << "Checking the GPU field functions on " << glGetString(GL_RENDERER)
+              << " against the CPU ones on a " << width << "x" << height << " grid" << std::endl;
+
+    std::vector<int> columns = fieldCheckColumns(width);
+
+    GLuint ssbo;
+    glGenBuffers(1, &ssbo);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, vectorFieldSize(width, height) * sizeof(float), NULL, 0);
+    glCheckError();
+
+    // A column is read together with the rest of its stripe, see FieldLayout.hpp
+    int stripe = FIELD_LAYOUT_STRIPE(FIELD_LAYOUT);
+    std::vector<float> refX(height), refY(height), gpu(vectorFieldSize(stripe, height));
+    bool passed = true;
+
+    for(unsigned int f = 0; f < NBR_FIELD_FUNCTIONS; f++){
+        GPUFieldBuilder builder(shaderPath, f, 0.0f, 1.0f);
+        builder.build(ssbo, width, height, 0.0f);
+        const FieldKernel * kernel = fieldKernel(f);
+
+        float peak = 0.0f;
+        float maxDiff = 0.0f;
+        unsigned int nonFinite = 0;
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+        for(int x : columns){
+            kernel->evaluate(x, 0, 1, height, width, height, refX.data(), refY.data());
+            size_t first = vectorFieldIndex(x - x % stripe, 0, height);
+            glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 2 * first * sizeof(float), gpu.size() * sizeof(float), gpu.data());
+
+            for(int y = 0; y < height; y++){
+                for(int c = 0; c < 2; c++){
+                    float ref = c == 0 ? refX[y] : refY[y];
+                    float value = gpu[2 * (vectorFieldIndex(x, y, height) - first) + c];
+                    // Division by zero is up to the driver, only count it
+                    if(!std::isfinite(ref) || !std::isfinite(value)){
+                        nonFinite += std::isfinite(ref) != std::isfinite(value);
+                        continue;
+                    }
+                    peak = std::max(peak, std::abs(ref));
+                    maxDiff = std::max(maxDiff, std::abs(value - ref));
+                }
+            }
+        }
+
+        float error = peak > 0.0f ? maxDiff / peak : maxDiff;
+        bool ok = error <= FIELD_GPU_CHECK_MAX_ERROR;
+        passed = passed && ok;
+        std::cout << "    function " << f << ": " << error;
+        if(nonFinite > 0)
+            std::cout << " (" << nonFinite << " non-finite values differ)";
+        std::cout << (ok ? "" : "  FAILED") << std::endl;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glDeleteBuffers(1, &ssbo);
+    return passed;
+}
+
+#endif
@@ -0,0 +1,299 @@
+#ifndef PARTICLE_DISPATCH_H
+#define PARTICLE_DISPATCH_H
+
+#include "../include/glad/glad.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
+#include "GLHelpers.hpp"
+#include "Shader.hpp"
+
+/**
+    CS-11 Asn 2: How particle.comp is dispatched, and finding the fastest local size for it.
+    @file ParticleDispatch.hpp
+    @author Frank Hampus Weslien
+
+    particle.comp is compiled with PARTICLE_LOCAL_SIZE invocations per work
+    group and dispatched with enough groups for every particle, the ones past
+    the last particle return straight away. Which local size is fastest
+    depends on the GPU, the driver and how the field is stored, so with
+    '--particle-local-size auto' tuneParticleLocalSize(..) compiles
+    particle.comp with every size, times a few steps of each and keeps the
+    fastest. They are timed on the wall clock between glFinish()es, timer
+    queries read 0 on some drivers. The winner is written to a small text file,
+    one line per device, field and number of particles, so it is only timed
+    once on every machine.
+*/
+
+// The local size particle.comp always had, used until one is picked
+#define PARTICLE_DEFAULT_LOCAL_SIZE 1024
+// The number of steps run before and while timing a local size
+#define PARTICLE_TUNING_WARMUP_STEPS 3
+#define PARTICLE_TUNING_TIMED_STEPS 8
+// GL only promises this many work groups along each axis
+#define PARTICLE_MAX_GROUPS 65535
+
+/**
+    @return the line particle.comp needs to be compiled with the local size
+*/
+inline std::string particleLocalSizeDefine(unsigned int localSize){
+    return "#define PARTICLE_LOCAL_SIZE " + std::to_string(localSize) + "\n";
+}
+
+/**
+    Dispatch particle.comp over the particles. The last group is only partly used,
+    and groups past what GL promises along x continue along y.
+    @param localSize the PARTICLE_LOCAL_SIZE particle.comp was compiled with
+    @param nbrParticles the number of particles, u_nbr_particles
+*/
+inline void dispatchParticles(unsigned int localSize, unsigned int nbrParticles){
+    unsigned int nbrGroups = (nbrParticles + localSize - 1) / localSize;
+    if(nbrGroups == 0)
+        return;
+    unsigned int groupsX = std::min(nbrGroups, (unsigned int) PARTICLE_MAX_GROUPS);
+    glDispatchCompute(groupsX, (nbrGroups + groupsX - 1) / groupsX, 1);
+}
+
+/**
+    @return the local sizes this GPU can run, smallest first
+*/
+inline std::vector<unsigned int> particleLocalSizes(){
+    GLint maxSize = 0, maxInvocations = 0;
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 0, &maxSize);
+    glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxInvocations);
+    std::vector<unsigned int> sizes;
+    for(unsigned int size = 64; size <= PARTICLE_DEFAULT_LOCAL_SIZE; size *= 2){
+        if(size <= (unsigned int) maxSize && size <= (unsigned int) maxInvocations)
+            sizes.push_back(size);
+    }
+    return sizes;
+}
+
+/**
+ * The local sizes picked before, one line per key in a text file.
+ */
+class ParticleLocalSizeCache : private boost::noncopyable
+{
+    std::string path;
+
+public:
+
+    /**
+        @param path the file, it and its folder are created on the first store(..).
+                    Empty for a cache that forgets everything
+    */
+    ParticleLocalSizeCache(const std::string &path) : path(path) {}
+
+    /**
+        @return $XDG_CACHE_HOME/MOTION/particle-local-size.txt, or ~/.cache/.. without it,
+                empty if neither is set
+    */
+    static std::string defaultPath(){
+        const char * cacheHome = std::getenv("XDG_CACHE_HOME");
+        if(cacheHome != NULL && cacheHome[0] != '\0')
+            return std::string(cacheHome) + "/MOTION/particle-local-size.txt";
+        const char * home = std::getenv("HOME");
+        if(home != NULL && home[0] != '\0')
+            return std::string(home) + "/.cache/MOTION/particle-local-size.txt";
+        return "";
+    }
+
+    /**
+        @param key what the local size was picked for, see particleTuningKey(..)
+        @return the local size picked before, 0 if there is none
+    */
+    unsigned int lookup(const std::string &key) const {
+        if(path.empty())
+            return 0;
+        std::ifstream in(path.c_str());
+        std::string line;
+        while(std::getline(in, line)){
+            size_t tab = line.find('\t');
+            if(tab != std::string::npos && line.compare(tab + 1, std::string::npos, key) == 0)
+                return (unsigned int) std::strtoul(line.c_str(), NULL, 10);
+        }
+        return 0;
+    }
+
+    /**
+        Remember the local size for the key, replacing what was picked before.
+        @return false if the file could not be written
+    */
+    bool store(const std::string &key, unsigned int localSize) const {
+        if(path.empty())
+            return false;
+        std::vector<std::string> lines;
+        {
+            std::ifstream in(path.c_str());
+            std::string line;
+            while(std::getline(in, line)){
+                size_t tab = line.find('\t');
+                if(tab != std::string::npos && line.compare(tab + 1, std::string::npos, key) != 0)
+                    lines.push_back(line);
+            }
+        }
+        lines.push_back(std::to_string(localSize) + "\t" + key);
+
+        boost::system::error_code error;
+        boost::filesystem::path file(path);
+        if(file.has_parent_path())
+            boost::filesystem::create_directories(file.parent_path(), error);
+        // Written next to it and renamed, two runs at once never leave half a file
+        std::string tmpPath = path + boost::filesystem::unique_path(".%%%%-%%%%-%%%%-%%%%.tmp").string();
+        {
+            std::ofstream out(tmpPath.c_str(), std::ios::trunc);
+            for(const std::string &line : lines)
+                out << line << "\n";
+            if(!out.good()){
+                std::cout << "ERROR::PARTICLE_LOCAL_SIZE_CACHE::COULD_NOT_WRITE " << tmpPath << std::endl;
+                boost::filesystem::remove(tmpPath, error);
+                return false;
+            }
+        }
+        boost::filesystem::rename(tmpPath, path, error);
+        if(error){
+            std::cout << "ERROR::PARTICLE_LOCAL_SIZE_CACHE::COULD_NOT_WRITE " << path << std::endl;
+            boost::filesystem::remove(tmpPath, error);
+            return false;
+        }
+        return true;
+    }
+};
+
+/**
+    @param defines the defines particle.comp is compiled with, they pick how the field is read
+    @param nbrParticles the number of particles, rounded up to a power of two
+    @return the key of the local size, the GPU, its driver, the defines and the particles
+*/
+inline std::string particleTuningKey(const std::string &defines, unsigned int nbrParticles){
+    std::string key = std::string((const char *) glGetString(GL_VENDOR))
+                    + " | " + (const char *) glGetString(GL_RENDERER)
+                    + " | " + (const char *) glGetString(GL_VERSION)
+                    + " |";
+    for(char c : defines)
+        key += c == '\n' ? ';' : c;
+    unsigned int rounded = 1;
+    while(rounded < nbrParticles && rounded < 0x80000000u)
+        rounded *= 2;
+    return key + " | " + std::to_string(rounded) + " particles";
+}
+
+/**
+    Find the fastest local size for particle.comp and give it to the shader. Every
+    size is compiled, given the uniforms of the shader and timed on the particles;
+    they are put back afterwards, so the video is the same whatever was picked.
+    @param shaderPath the folder where the shaders are located
+    @param defines the defines particleComputeShader was compiled with
+    @param particleComputeShader particle.comp compiled with PARTICLE_DEFAULT_LOCAL_SIZE and
+                                 all its uniforms and buffers set, replaced by the fastest one
+    @param nbrParticles the number of particles
+    @param particleBuffers the buffers particle.comp writes to, 0 for none
+    @param cache where the local size picked before is looked up and the new one stored
+    @return the local size of particleComputeShader
+*/
+inline unsigned int tuneParticleLocalSize( const std::string &shaderPath
+                                         , const std::string &defines
+                                         , Shader *particleComputeShader
+                                         , unsigned int nbrParticles
+                                         , const std::vector<GLuint> &particleBuffers
+                                         , const ParticleLocalSizeCache &cache
+                                         ){
+    const std::string key = particleTuningKey(defines, nbrParticles);
+    const std::vector<unsigned int> sizes = particleLocalSizes();
+    const std::string computePath = shaderPath + "/particle.comp";
+
+    unsigned int cached = cache.lookup(key);
+    if(std::find(sizes.begin(), sizes.end(), cached) != sizes.end()){
+        std::cout << "particle.comp runs with a local size of " << cached << ", picked before on this GPU" << std::endl;
+        if(cached != PARTICLE_DEFAULT_LOCAL_SIZE){
+            Shader tuned(computePath.c_str(), defines + particleLocalSizeDefine(cached));
+            tuned.copyUniforms(*particleComputeShader);
+            particleComputeShader->swap(tuned);
+            tuned.deleteProgram();
+        }
+        return cached;
+    }
+
+    // The steps move the particles, they are copied away and put back afterwards
+    std::vector<GLuint> copies(particleBuffers.size(), 0);
+    for(size_t b = 0; b < particleBuffers.size(); b++){
+        if(particleBuffers[b] == 0)
+            continue;
+        GLint64 size = 0;
+        glBindBuffer(GL_COPY_READ_BUFFER, particleBuffers[b]);
+        glGetBufferParameteri64v(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+        glGenBuffers(1, &copies[b]);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, copies[b]);
+        glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_COPY);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+    }
+    glCheckError();
+
+    unsigned int best = PARTICLE_DEFAULT_LOCAL_SIZE;
+    double bestTime = 0;
+    // The fastest so far unless it is particleComputeShader itself, which is left alone until the end
+    std::unique_ptr<Shader> bestVariant;
+    std::cout << "Timing particle.comp with local sizes of";
+    for(unsigned int size : sizes){
+        std::unique_ptr<Shader> variant;
+        if(size != PARTICLE_DEFAULT_LOCAL_SIZE){
+            variant.reset(new Shader(computePath.c_str(), defines + particleLocalSizeDefine(size)));
+            variant->copyUniforms(*particleComputeShader);
+        }
+        (variant != NULL ? variant.get() : particleComputeShader)->use();
+
+        for(int step = 0; step < PARTICLE_TUNING_WARMUP_STEPS; step++){
+            dispatchParticles(size, nbrParticles);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+        glFinish();
+        auto start = std::chrono::steady_clock::now();
+        for(int step = 0; step < PARTICLE_TUNING_TIMED_STEPS; step++){
+            dispatchParticles(size, nbrParticles);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+        glFinish();
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << " " << size << " (" << elapsed.count() / PARTICLE_TUNING_TIMED_STEPS << " us)";
+
+        if(bestTime == 0 || elapsed.count() < bestTime){
+            best = size;
+            bestTime = elapsed.count();
+            if(bestVariant != NULL)
+                bestVariant->deleteProgram();
+            bestVariant = std::move(variant);
+        } else if(variant != NULL) {
+            variant->deleteProgram();
+        }
+    }
+    if(bestVariant != NULL){
+        particleComputeShader->swap(*bestVariant);
+        bestVariant->deleteProgram();
+    }
+    std::cout << ", " << best << " is the fastest" << std::endl;
+
+    for(size_t b = 0; b < particleBuffers.size(); b++){
+        if(copies[b] == 0)
+            continue;
+        GLint64 size = 0;
+        glBindBuffer(GL_COPY_READ_BUFFER, copies[b]);
+        glGetBufferParameteri64v(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, particleBuffers[b]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+        glDeleteBuffers(1, &copies[b]);
+    }
+    glCheckError();
+
+    cache.store(key, best);
+    return best;
+}
+
+#endif
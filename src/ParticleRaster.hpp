@@ -0,0 +1,111 @@
+#ifndef PARTICLE_RASTER_H
+#define PARTICLE_RASTER_H
+
+#include <cstdint>
+#include "ParticleStep.hpp"
+
+/**
+    CS-11 Asn 2: Where the particles land on the screen, for SoftwareRenderer.hpp.
+    @file ParticleRaster.hpp
+    @author Frank Hampus Weslien
+
+    rasterParticles(..) turns the particles of a CpuParticleSystem into the
+    squares of pixels GL_POINTS covers and the RGBA8 color it writes there: a
+    pixel is covered when its center is inside the square of the point size
+    around the particle, and the color is rounded to the nearest of 256 steps.
+    Like the GPU the particle is first snapped to PARTICLE_RASTER_SUBPIXELS
+    steps per pixel, or a particle right between two pixels lands on the other
+    one now and then.
+    Like ParticleStep.hpp it is compiled for every instruction set
+    (FieldKernels*.cpp) and as float when there is no SIMD.
+*/
+
+// The precision of the positions on the screen, 8 bits below the pixel like most GPUs
+#define PARTICLE_RASTER_SUBPIXELS 256.0f
+
+/**
+ * The screen the particles are drawn on.
+ */
+struct ParticleRasterParams {
+    int width;
+    int height;
+    float pointSize;
+};
+
+/**
+ * The pixels [x0, x1) x [y0, y1) of every particle, y going up like in OpenGL,
+ * and its color as the bytes R, G, B, A in memory.
+ */
+struct ParticlePixels {
+    int32_t * x0;
+    int32_t * y0;
+    int32_t * x1;
+    int32_t * y1;
+    uint32_t * color;
+};
+
+typedef void (*ParticleRasterFn)(const ParticleRasterParams &params, const ParticleArrays &particles, const ParticlePixels &pixels, unsigned int begin, unsigned int end);
+
+// vtoint(..) and storing the integer lanes for a single float, static like the
+// primitives in ParticleStep.hpp
+static inline int32_t vtoint(float a){ return (int32_t) a; }
+static inline void particleStoreInt(int32_t v, int32_t *p){ *p = v; }
+static inline void particleStoreInt(uint32_t v, uint32_t *p){ *p = v; }
+
+// SimdVec.hpp can only store floats, the integer lanes are stored as their bits
+template <typename I, typename T>
+inline void particleStoreInt(const I &v, T *p){
+    vasfloat(v).store(reinterpret_cast<float *>(p));
+}
+
+// One channel of a color as a byte, like a write to an RGBA8 texture
+template <typename V>
+inline typename ParticleLanes<V>::IVec particleColorByte(V c){
+    c = fieldmath::min(fieldmath::max(c, V(0.0f)), V(1.0f));
+    return vtoint(fieldmath::floor(c * V(255.0f) + V(0.5f)));
+}
+
+/**
+ * Find the pixels and colors of the particles in [begin, end), multiples of the lane size.
+ */
+template <typename V>
+void rasterParticles(const ParticleRasterParams &params, const ParticleArrays &particles, const ParticlePixels &pixels, unsigned int begin, unsigned int end){
+    typedef ParticleLanes<V> L;
+    typedef typename L::IVec I;
+
+    const V halfWidth(0.5f * params.width);
+    const V halfHeight(0.5f * params.height);
+    const V subpixels(PARTICLE_RASTER_SUBPIXELS);
+    // The pixel centers are at + 0.5
+    const V halfSize(0.5f * params.pointSize + 0.5f);
+    const V halfSizeEnd(0.5f * params.pointSize - 0.5f);
+
+    for(unsigned int i = begin; i < end; i += L::size){
+        // The viewport transform of the vertex shader
+        V x = (L::load(particles.x + i) + V(1.0f)) * halfWidth;
+        V y = (L::load(particles.y + i) + V(1.0f)) * halfHeight;
+        x = fieldmath::floor(x * subpixels + V(0.5f)) / subpixels;
+        y = fieldmath::floor(y * subpixels + V(0.5f)) / subpixels;
+
+        // ceil(a) is -floor(-a)
+        particleStoreInt(vtoint(-fieldmath::floor(halfSize - x)), pixels.x0 + i);
+        particleStoreInt(vtoint(-fieldmath::floor(halfSize - y)), pixels.y0 + i);
+        particleStoreInt(vtoint(-fieldmath::floor(-halfSizeEnd - x)), pixels.x1 + i);
+        particleStoreInt(vtoint(-fieldmath::floor(-halfSizeEnd - y)), pixels.y1 + i);
+
+        I color = particleColorByte(L::load(particles.red + i))
+                | vshl(particleColorByte(L::load(particles.green + i)), 8)
+                | vshl(particleColorByte(L::load(particles.blue + i)), 16)
+                | vshl(particleColorByte(L::load(particles.alpha + i)), 24);
+        particleStoreInt(color, pixels.color + i);
+    }
+}
+
+#ifdef FIELD_SIMD_X86
+// rasterParticles(..) for every instruction set, see FieldKernelsSSE41.cpp etc.
+ParticleRasterFn particleRasterSSE41();
+ParticleRasterFn particleRasterAVX2();
+ParticleRasterFn particleRasterAVX512();
+#endif
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef PARTICLE_SEEDER_H
+#define PARTICLE_SEEDER_H
+
+#include "../include/glad/glad.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <boost/noncopyable.hpp>
+#include <glm/glm.hpp>
+#include "CompactParticles.hpp"
+#include "GLHelpers.hpp"
+#include "Shader.hpp"
+
+/**
+    CS-11 Asn 2: Put the particles where they start on the GPU, --particle-init philox.
+    @file ParticleSeeder.hpp
+    @author Frank Hampus Weslien
+
+    createParticles(..) in main.cpp draws the start of every particle from one
+    mt19937, which can only be done one particle after the other on the CPU
+    and has to be sent to the graphics card afterwards. Philox is a counter
+    based random number generator instead: the numbers of a particle only
+    depend on the seed and the number of the particle, so
+    shaders/particle-init.comp makes all of them at once, straight into the
+    buffers of particle.comp. particlePhiloxPosition(..) makes the same ones on
+    the CPU for '--particle-backend cpu', the positions are exact so they are
+    the same bits on every GPU and CPU.
+
+    NOTE: The object can not be copied since it owns the shader.
+*/
+
+// The local size of particle-init.comp
+#define PARTICLE_SEEDER_LOCAL_SIZE 256
+// The most work groups dispatched at once, GL only promises 65535
+#define PARTICLE_SEEDER_MAX_GROUPS 65535
+
+/**
+ * One round of Philox4x32.
+ */
+inline void philoxRound(uint32_t counter[4], const uint32_t key[2]){
+    uint64_t product0 = (uint64_t) 0xD2511F53u * counter[0];
+    uint64_t product1 = (uint64_t) 0xCD9E8D57u * counter[2];
+    uint32_t hi0 = (uint32_t) (product0 >> 32), lo0 = (uint32_t) product0;
+    uint32_t hi1 = (uint32_t) (product1 >> 32), lo1 = (uint32_t) product1;
+    counter[0] = hi1 ^ counter[1] ^ key[0];
+    counter[1] = lo1;
+    counter[2] = hi0 ^ counter[3] ^ key[1];
+    counter[3] = lo0;
+}
+
+/**
+    Philox4x32-10, the same as philox4x32(..) in shaders/philox.glsl.
+    @param counter the counter, replaced by the four random numbers
+    @param seed the key
+*/
+inline void philox4x32(uint32_t counter[4], uint32_t seed){
+    uint32_t key[2] = { seed, 0u };
+    for(int round = 0; round < 10; round++){
+        philoxRound(counter, key);
+        key[0] += 0x9E3779B9u;
+        key[1] += 0xBB67AE85u;
+    }
+}
+
+/**
+    @param seed the '--particle-seed'
+    @param particle the number of the particle
+    @param x set to where the particle starts along the x-axis, -1 to 1
+    @param y set to where the particle starts along the y-axis, -1 to 1
+*/
+inline void particlePhiloxPosition(uint32_t seed, uint32_t particle, float *x, float *y){
+    uint32_t random[4] = { particle, 0u, 0u, 0u };
+    philox4x32(random, seed);
+    // The highest 24 bits fit a float exactly, like seedPosition(..) in particle-init.comp
+    *x = (float) (random[0] >> 8) / 16777216.0f * 2.0f - 1.0f;
+    *y = (float) (random[1] >> 8) / 16777216.0f * 2.0f - 1.0f;
+}
+
+class GPUParticleSeeder : private boost::noncopyable
+{
+    Shader shader;
+
+public:
+
+    /**
+        @param shaderPath the folder where the shaders are located
+        @param compact true to write the particles as in CompactParticles.hpp
+    */
+    GPUParticleSeeder(const std::string &shaderPath, bool compact)
+        : shader((shaderPath + "/particle-init.comp").c_str(), compact ? compactParticleShaderDefines() : std::string())
+    {
+    }
+
+    /**
+        Fill the buffers of particle.comp with the particles. Commands that read them
+        afterwards see the particles, there is no need to wait for them.
+        @param positionBuffer binding 1 of particle.comp, with room for every particle
+        @param colorBuffer binding 5, or 0 when the colors never change
+        @param lifetimeBuffer binding 6 of the compact particles, 0 for floats
+        @param nbrParticles the number of particles
+        @param seed the key of every particle's random numbers
+        @param timeToLive the number of frames every particle lives
+        @param color the color of every particle
+        @param vectorWidthGrid the number of vectors along the x-axis, for the compact positions
+        @param vectorHeightGrid the number of vectors along the y-axis, for the compact positions
+    */
+    void seed( GLuint positionBuffer
+             , GLuint colorBuffer
+             , GLuint lifetimeBuffer
+             , unsigned int nbrParticles
+             , uint32_t seed
+             , float timeToLive
+             , glm::vec4 color
+             , int vectorWidthGrid
+             , int vectorHeightGrid
+             ){
+        shader.use();
+        shader.setUint("u_seed", seed);
+        shader.setUint("u_nbr_particles", nbrParticles);
+        shader.setInt("u_width", vectorWidthGrid);
+        shader.setInt("u_height", vectorHeightGrid);
+        shader.setFloat("u_time_to_live", timeToLive);
+        shader.setBool("u_write_colors", colorBuffer != 0);
+        shader.setVec4f("u_particle_color", color.x, color.y, color.z, color.w);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, positionBuffer);
+        if(colorBuffer != 0)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, colorBuffer);
+        if(lifetimeBuffer != 0)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, lifetimeBuffer);
+
+        // The last group only partly, particle-init.comp skips the rest
+        const unsigned int perDispatch = PARTICLE_SEEDER_MAX_GROUPS * PARTICLE_SEEDER_LOCAL_SIZE;
+        for(unsigned int first = 0; first < nbrParticles; first += perDispatch){
+            unsigned int count = std::min(nbrParticles - first, perDispatch);
+            shader.setUint("u_first", first);
+            glDispatchCompute((count + PARTICLE_SEEDER_LOCAL_SIZE - 1) / PARTICLE_SEEDER_LOCAL_SIZE, 1, 1);
+        }
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+        glCheckError();
+    }
+};
+
+#endif
@@ -0,0 +1,266 @@
+#ifndef PARTICLE_STEP_H
+#define PARTICLE_STEP_H
+
+#include <cstdint>
+#include <cstring>
+#include "FieldLayout.hpp"
+#include "FieldMath.hpp"
+#include "FieldProgram.hpp"
+
+/**
+    CS-11 Asn 2: shaders/particle.comp on the CPU, see CpuParticleSystem.hpp.
+    @file ParticleStep.hpp
+    @author Frank Hampus Weslien
+
+    stepParticles(..) does for a range of particles what one dispatch of
+    particle.comp does: respawn the particles that left the grid or drew
+    u_probability_to_die with the same hash, move them by the interpolated
+    field, and color them. The particles are stored as one array per component,
+    so every step works on full SIMD lanes and only the reads from the field
+    are done a lane at a time.
+
+    Like FieldImageFilter.hpp this file is compiled for SSE4.1, AVX2 and
+    AVX-512 (FieldKernels*.cpp) and the step is a template on the lane type,
+    float when there is no SIMD. The float version uses the primitives below,
+    the SIMD ones those in SimdVec.hpp.
+*/
+
+// The arrays of CpuParticleSystem are padded to a multiple of this, so that the
+// widest lanes never need a scalar tail
+#define PARTICLE_LANE_PADDING 16
+
+/**
+ * The particles, one array per component of the positions and colors in particle.comp.
+ */
+struct ParticleArrays {
+    float * x;
+    float * y;
+    // z and w of the positions
+    float * aliveFrom;
+    float * lifetime;
+    float * red;
+    float * green;
+    float * blue;
+    float * alpha;
+};
+
+/**
+ * The uniforms of particle.comp, and the field it reads from.
+ */
+struct ParticleStepParams {
+    // One period of the field when fieldWidth or fieldHeight is less than the grid, see fieldPeriod(..) in main.cpp
+    const float * field;
+    int fieldWidth;
+    int fieldHeight;
+    // u_width and u_height
+    int gridWidth;
+    int gridHeight;
+
+    // u_speed * 30 / u_fps
+    float speedFactor;
+    float time;
+    float probabilityToDie;
+    bool loop;
+    float loopIteration;
+    int interpolationMode;
+    int colorMode;
+    float aa[3];
+    float bb[3];
+    float cc[3];
+    float dd[3];
+    float angleVector[2];
+};
+
+typedef void (*ParticleStepFn)(const ParticleStepParams &params, const ParticleArrays &particles, unsigned int begin, unsigned int end);
+
+// The primitives of SimdVec.hpp that the particles need, for a single float.
+// They are static since FieldKernels*.cpp compile them too, with the wider
+// instruction sets, and those copies must never be the ones the scalar code calls.
+static inline uint32_t vshl(uint32_t a, int n){ return a << n; }
+static inline uint32_t vshr(uint32_t a, int n){ return a >> n; }
+static inline uint32_t vasint(float a){
+    uint32_t i;
+    std::memcpy(&i, &a, sizeof(i));
+    return i;
+}
+static inline float vasfloat(uint32_t a){
+    float f;
+    std::memcpy(&f, &a, sizeof(f));
+    return f;
+}
+
+template <typename V>
+struct ParticleLanes : FieldLanes<V> {
+    typedef typename V::IVec IVec;
+    typedef typename V::Mask Mask;
+};
+
+template <>
+struct ParticleLanes<float> : FieldLanes<float> {
+    typedef uint32_t IVec;
+    typedef bool Mask;
+};
+
+// Bob Jenkins' One-At-A-Time hash, hash(..) in particle.comp
+template <typename I>
+inline I particleHash(I x){
+    x = x + vshl(x, 10);
+    x = x ^ vshr(x, 6);
+    x = x + vshl(x, 3);
+    x = x ^ vshr(x, 11);
+    x = x + vshl(x, 15);
+    return x;
+}
+
+// floatConstruct(..) in particle.comp, the low 23 bits as a float in [0, 1)
+template <typename V, typename I>
+inline V particleFloat(I m){
+    return vasfloat((m & I(0x007FFFFF)) | I(0x3F800000)) - V(1.0f);
+}
+
+// random(float) in particle.comp
+template <typename V>
+inline V particleRandom(V x){
+    return particleFloat<V>(particleHash(vasint(x)));
+}
+
+// random(vec3) in particle.comp
+template <typename V>
+inline V particleRandom(float a, V b, V c){
+    typedef typename ParticleLanes<V>::IVec I;
+    return particleFloat<V>(particleHash(I((int32_t) vasint(a)) ^ particleHash(vasint(b)) ^ particleHash(vasint(c))));
+}
+
+// cos_color(..) in particle.comp for one channel
+template <typename V>
+inline V particleCosColor(V f, const ParticleStepParams &params, int channel){
+    return V(params.aa[channel]) + V(params.bb[channel]) * fieldmath::cos(f * V(params.cc[channel]) + V(params.dd[channel]));
+}
+
+// The angle between two vectors, acos(dot(normalize(a), normalize(b))) in particle.comp
+template <typename V>
+inline V particleAngle(V ax, V ay, V bx, V by){
+    V cosine = (ax * bx + ay * by) / (fieldmath::sqrt(ax * ax + ay * ay) * fieldmath::sqrt(bx * bx + by * by));
+    // Rounding can take it just past 1
+    return fieldmath::acos(fieldmath::max(V(-1.0f), fieldmath::min(cosine, V(1.0f))));
+}
+
+/**
+ * Move the particles in [begin, end) one step, like one dispatch of particle.comp
+ * with the field in the buffer. begin and end are multiples of the lane size.
+ */
+template <typename V>
+void stepParticles(const ParticleStepParams &params, const ParticleArrays &particles, unsigned int begin, unsigned int end){
+    typedef ParticleLanes<V> L;
+    typedef typename L::Mask Mask;
+    const int lanes = L::size;
+
+    const V fWidth((float) params.gridWidth - 1.0f);
+    const V fHeight((float) params.gridHeight - 1.0f);
+    const V iteration(params.loopIteration);
+    const bool periodic = params.fieldWidth < params.gridWidth || params.fieldHeight < params.gridHeight;
+
+    // The vectors around every lane, read a lane at a time
+    float floorX[lanes], floorY[lanes];
+    float corners[8][lanes];
+    auto vectorAt = [&](int x, int y) -> const float * {
+        // Not std::min(..), for the same reason as vshl(..)
+        x = x < params.gridWidth - 1 ? x : params.gridWidth - 1;
+        y = y < params.gridHeight - 1 ? y : params.gridHeight - 1;
+        if(periodic){
+            x %= params.fieldWidth;
+            y %= params.fieldHeight;
+        }
+        return params.field + 2 * fieldLayoutIndex<FIELD_LAYOUT>(x, y, params.fieldHeight);
+    };
+
+    for(unsigned int i = begin; i < end; i += lanes){
+        V px = L::load(particles.x + i);
+        V py = L::load(particles.y + i);
+        V aliveFrom = L::load(particles.aliveFrom + i);
+        V deadAfter = L::load(particles.lifetime + i) + aliveFrom;
+
+        Mask alive = params.loop ? (aliveFrom < iteration) & (iteration <= deadAfter) : (V(0.0f) == V(0.0f));
+
+        // Parked outside clip space, for the lanes that are not alive
+        V parkedX = particleRandom(px) * V(2.0f) + V(8.0f);
+        V parkedY = particleRandom(py) * V(2.0f) + V(8.0f);
+
+        V x = (px + V(1.0f)) / V(2.0f) * fWidth;
+        V y = (py + V(1.0f)) / V(2.0f) * fHeight;
+        Mask inside = (x >= V(0.0f)) & (x < fWidth) & (y >= V(0.0f)) & (y < fHeight);
+        Mask survives = particleRandom(params.time, px, py) > V(params.probabilityToDie);
+
+        // Respawn somewhere viewable
+        Mask keep = inside & survives;
+        px = fieldmath::select(keep, px, particleRandom(px) * V(2.0f) - V(1.0f));
+        py = fieldmath::select(keep, py, particleRandom(py) * V(2.0f) - V(1.0f));
+        x = (px + V(1.0f)) / V(2.0f) * fWidth;
+        y = (py + V(1.0f)) / V(2.0f) * fHeight;
+
+        V x0 = fieldmath::floor(x);
+        V y0 = fieldmath::floor(y);
+        V dx = x - x0;
+        V dy = y - y0;
+        L::store(x0, floorX);
+        L::store(y0, floorY);
+        for(int j = 0; j < lanes; j++){
+            int xi = (int) floorX[j];
+            int yi = (int) floorY[j];
+            const float * around[4] = { vectorAt(xi, yi), vectorAt(xi, yi + 1), vectorAt(xi + 1, yi), vectorAt(xi + 1, yi + 1) };
+            for(int k = 0; k < 4; k++){
+                corners[2 * k][j] = around[k][0];
+                corners[2 * k + 1][j] = around[k][1];
+            }
+        }
+        V v00x = L::load(corners[0]), v00y = L::load(corners[1]);
+        V v01x = L::load(corners[2]), v01y = L::load(corners[3]);
+        V v10x = L::load(corners[4]), v10y = L::load(corners[5]);
+        V v11x = L::load(corners[6]), v11y = L::load(corners[7]);
+
+        V vx, vy;
+        if(params.interpolationMode == 0){
+            V r1x = v00x * (V(1.0f) - dx) + v10x * dx;
+            V r1y = v00y * (V(1.0f) - dx) + v10y * dx;
+            V r2x = v01x * (V(1.0f) - dx) + v11x * dx;
+            V r2y = v01y * (V(1.0f) - dx) + v11y * dx;
+            vx = r1x * (V(1.0f) - dy) + r2x * dy;
+            vy = r1y * (V(1.0f) - dy) + r2y * dy;
+        } else {
+            // The same four cases in the same order as particle.comp
+            Mask first = (dx <= V(0.5f)) & (dy <= V(0.5f));
+            Mask second = (dx <= V(0.5f)) & (dy >= V(0.5f));
+            Mask third = (dx >= V(0.5f)) & (dy >= V(0.5f));
+            vx = fieldmath::select(first, v00x, fieldmath::select(second, v01x, fieldmath::select(third, v10x, v11x)));
+            vy = fieldmath::select(first, v00y, fieldmath::select(second, v01y, fieldmath::select(third, v10y, v11y)));
+        }
+
+        L::store(fieldmath::select(alive, px + V(params.speedFactor) * vx, parkedX), particles.x + i);
+        L::store(fieldmath::select(alive, py + V(params.speedFactor) * vy, parkedY), particles.y + i);
+
+        if(params.colorMode < 1 || params.colorMode > 3)
+            continue;
+
+        V f;
+        if(params.colorMode == 1)
+            f = particleAngle(vx, vy, V(params.angleVector[0]), V(params.angleVector[1]));
+        else if(params.colorMode == 2)
+            f = particleAngle(vx, vy, px + V(params.angleVector[0]), py + V(params.angleVector[1]));
+        else
+            f = V(100.0f) * fieldmath::sqrt(vx * vx + vy * vy);
+
+        L::store(fieldmath::select(alive, particleCosColor(f, params, 0), L::load(particles.red + i)), particles.red + i);
+        L::store(fieldmath::select(alive, particleCosColor(f, params, 1), L::load(particles.green + i)), particles.green + i);
+        L::store(fieldmath::select(alive, particleCosColor(f, params, 2), L::load(particles.blue + i)), particles.blue + i);
+        L::store(fieldmath::select(alive, V(1.0f), L::load(particles.alpha + i)), particles.alpha + i);
+    }
+}
+
+#ifdef FIELD_SIMD_X86
+// stepParticles(..) for every instruction set, see FieldKernelsSSE41.cpp etc.
+ParticleStepFn particleStepSSE41();
+ParticleStepFn particleStepAVX2();
+ParticleStepFn particleStepAVX512();
+#endif
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "../include/glad/glad.h" 
 #include <string>
+#include <cstdint>
 #include <iostream>
 #include <png.h>
 #include <stb_image.h>
@@ -36,21 +37,35 @@ public:
      * @return
      */
     void screenshot(const char *filename, unsigned int width, unsigned int height) {
-        size_t i, nvals;
         const size_t format_nchannels = 4;
-        FILE *f = fopen(filename, "wb");
-        nvals = format_nchannels * width * height;
-        pixels = (GLubyte *) realloc(pixels, nvals * sizeof(GLubyte));
-        png_bytes = (png_byte *) realloc(png_bytes, nvals * sizeof(png_byte));
-        png_rows = (png_byte **) realloc(png_rows, height * sizeof(png_byte*));
+        pixels = (GLubyte *) realloc(pixels, format_nchannels * width * height * sizeof(GLubyte));
 
         glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 
         if(!pixels){
             std::cout << "Could not map pixels to client memory!\n";
         }
+        screenshot(filename, width, height, pixels);
+    }
+
+    /**
+     * Save pixels from memory, like the picture of a SoftwareRenderer.
+     * 
+     * @param filename were to store the file
+     * @param width the width of the image
+     * @param height the height of the image
+     * @param rgba 4 bytes RGBA per pixel with the bottom row first, like glReadPixels(..) gives them
+     */
+    void screenshot(const char *filename, unsigned int width, unsigned int height, const uint8_t *rgba) {
+        size_t i, nvals;
+        const size_t format_nchannels = 4;
+        FILE *f = fopen(filename, "wb");
+        nvals = format_nchannels * width * height;
+        png_bytes = (png_byte *) realloc(png_bytes, nvals * sizeof(png_byte));
+        png_rows = (png_byte **) realloc(png_rows, height * sizeof(png_byte*));
+
         for (i = 0; i < nvals; i++)
-            png_bytes[i] = pixels[i];
+            png_bytes[i] = rgba[i];
         for (i = 0; i < height; i++)
             png_rows[height - i - 1] = &png_bytes[i * width * format_nchannels];
         png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
@@ -6,6 +6,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "GLHelpers.hpp"
+#include <algorithm>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -19,7 +20,13 @@
 
     NOTE: The object can not be copied since at destruction it will remove the
     destroy the OpenGL program it manages.
+
+    A line like #include "file.glsl" in the source code is replaced by the
+    contents of that file, which is looked up next to the shader.
 */
+
+// Deep enough for any sane shader, stops an #include that includes itself
+#define SHADER_MAX_INCLUDE_DEPTH 16
 class Shader : private boost::noncopyable
 {
     unsigned int ID;
@@ -29,11 +36,13 @@ public:
         Constructs a basic OpenGL shader program.
         @param vertexPath the path to the vertex shader source code.
         @param fragmentPath the path to the fragment shader source code.
+        @param defines extra lines such as "#define PARTICLE_COMPACT\n" that are
+        put right after the #version line of the vertex shader.
     */
-    Shader(const char* vertexPath, const char* fragmentPath)
+    Shader(const char* vertexPath, const char* fragmentPath, const std::string &defines = "")
     {
         // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode = loadSourceCode(vertexPath);
+        std::string vertexCode = injectDefines(loadSourceCode(vertexPath), defines);
         unsigned int vertex = compileShaderCode("VERTEX", vertexCode);
         
         std::string fragmentCode = loadSourceCode(fragmentPath);
@@ -55,10 +64,12 @@ public:
     /**
         Constructs a OpenGL compute shader program.
         @param computePath the path to the compute shader source code.
+        @param defines extra lines such as "#define FIELD_FUNCTION 3\n" that are
+        put right after the #version line of the source code.
     */
-    Shader(const char* computePath)
+    Shader(const char* computePath, const std::string &defines = "")
     {
-        std::string computeCode = loadSourceCode(computePath);
+        std::string computeCode = injectDefines(loadSourceCode(computePath), defines);
         glCheckError(); 
         unsigned int compute; compute = compileShaderCode("COMPUTE", computeCode);
         glCheckError(); 
@@ -77,6 +88,41 @@ public:
             glDeleteProgram(ID);
     }
 
+    /**
+        Trade programs with another shader, the objects that point at this one then use its program.
+    */
+    void swap(Shader &other){
+        std::swap(ID, other.ID);
+    }
+
+    /**
+        Give the uniforms of this program the values they have in another one, for
+        programs built from the same source code with different defines. Uniforms
+        that only one of them has are left alone.
+    */
+    void copyUniforms(const Shader &from) const {
+        GLint nbrUniforms = 0;
+        glGetProgramiv(from.ID, GL_ACTIVE_UNIFORMS, &nbrUniforms);
+        for(GLint u = 0; u < nbrUniforms; u++){
+            GLchar name[256];
+            GLint size;
+            GLenum type;
+            glGetActiveUniform(from.ID, u, sizeof(name), NULL, &size, &type, name);
+            // Arrays are named after their first element, every element has a location of its own
+            std::string base(name);
+            if(size > 1 && base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0)
+                base.erase(base.size() - 3);
+            for(GLint element = 0; element < size; element++){
+                std::string elementName = size > 1 ? base + "[" + std::to_string(element) + "]" : base;
+                GLint source = glGetUniformLocation(from.ID, elementName.c_str());
+                GLint target = glGetUniformLocation(ID, elementName.c_str());
+                if(source >= 0 && target >= 0)
+                    copyUniform(from.ID, source, target, type);
+            }
+        }
+        glCheckError();
+    }
+
     /**
         Set this shader to the current active program in OpenGL.
     */
@@ -96,6 +142,11 @@ public:
         glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
     }
     // ------------------------------------------------------------------------
+    void setUint(const std::string &name, unsigned int value) const
+    { 
+        glUniform1ui(glGetUniformLocation(ID, name.c_str()), value); 
+    }
+    // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     { 
         glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
@@ -110,6 +161,11 @@ public:
         glUniform2f(glGetUniformLocation(ID, name.c_str()), value.x, value.y); 
     }
     // ------------------------------------------------------------------------
+    void setVec2i(const std::string &name, int value1, int value2) const
+    { 
+        glUniform2i(glGetUniformLocation(ID, name.c_str()), value1, value2); 
+    }
+    // ------------------------------------------------------------------------
     void setVec3f(const std::string &name, float value1, float value2, float value3) const
     { 
         glUniform3f(glGetUniformLocation(ID, name.c_str()), value1, value2, value3); 
@@ -131,6 +187,35 @@ public:
 
 private:
 
+    void copyUniform(GLuint fromProgram, GLint source, GLint target, GLenum type) const {
+        GLfloat floats[16];
+        GLint ints[4];
+        GLuint uints[4];
+        switch(type){
+            case GL_FLOAT:             glGetUniformfv(fromProgram, source, floats); glProgramUniform1fv(ID, target, 1, floats); break;
+            case GL_FLOAT_VEC2:        glGetUniformfv(fromProgram, source, floats); glProgramUniform2fv(ID, target, 1, floats); break;
+            case GL_FLOAT_VEC3:        glGetUniformfv(fromProgram, source, floats); glProgramUniform3fv(ID, target, 1, floats); break;
+            case GL_FLOAT_VEC4:        glGetUniformfv(fromProgram, source, floats); glProgramUniform4fv(ID, target, 1, floats); break;
+            case GL_FLOAT_MAT4:        glGetUniformfv(fromProgram, source, floats); glProgramUniformMatrix4fv(ID, target, 1, GL_FALSE, floats); break;
+            case GL_INT:
+            case GL_BOOL:
+            case GL_SAMPLER_2D:        glGetUniformiv(fromProgram, source, ints); glProgramUniform1iv(ID, target, 1, ints); break;
+            case GL_INT_VEC2:
+            case GL_BOOL_VEC2:         glGetUniformiv(fromProgram, source, ints); glProgramUniform2iv(ID, target, 1, ints); break;
+            case GL_INT_VEC3:
+            case GL_BOOL_VEC3:         glGetUniformiv(fromProgram, source, ints); glProgramUniform3iv(ID, target, 1, ints); break;
+            case GL_INT_VEC4:
+            case GL_BOOL_VEC4:         glGetUniformiv(fromProgram, source, ints); glProgramUniform4iv(ID, target, 1, ints); break;
+            case GL_UNSIGNED_INT:      glGetUniformuiv(fromProgram, source, uints); glProgramUniform1uiv(ID, target, 1, uints); break;
+            case GL_UNSIGNED_INT_VEC2: glGetUniformuiv(fromProgram, source, uints); glProgramUniform2uiv(ID, target, 1, uints); break;
+            case GL_UNSIGNED_INT_VEC3: glGetUniformuiv(fromProgram, source, uints); glProgramUniform3uiv(ID, target, 1, uints); break;
+            case GL_UNSIGNED_INT_VEC4: glGetUniformuiv(fromProgram, source, uints); glProgramUniform4uiv(ID, target, 1, uints); break;
+            default:
+                std::cout << "ERROR::SHADER::CAN_NOT_COPY_UNIFORM of type 0x" << std::hex << type << std::dec << std::endl;
+                break;
+        }
+    }
+
     unsigned int compileShaderCode(std::string type, std::string sourceCode){
         const char* shaderCode = sourceCode.c_str();
         unsigned int shader;
@@ -150,7 +235,24 @@ private:
         return shader;
     }
 
-    std::string loadSourceCode(const char* shaderPath) {
+    // The #version line has to come first so the defines go after it
+    std::string injectDefines(const std::string &sourceCode, const std::string &defines){
+        if(defines.empty())
+            return sourceCode;
+
+        size_t version = sourceCode.find("#version");
+        if(version == std::string::npos)
+            return defines + "#line 1\n" + sourceCode;
+
+        size_t start = sourceCode.find('\n', version);
+        start = start == std::string::npos ? sourceCode.size() : start + 1;
+        int nextLine = 1 + std::count(sourceCode.begin(), sourceCode.begin() + start, '\n');
+
+        // Keep the line numbers in the compile errors pointing at the file
+        return sourceCode.substr(0, start) + defines + "#line " + std::to_string(nextLine) + "\n" + sourceCode.substr(start);
+    }
+
+    std::string loadSourceCode(const char* shaderPath, int depth = 0) {
         std::string shaderCode;
         std::ifstream shaderFile;
         // ensure ifstream objects can throw exceptions:
@@ -165,7 +267,7 @@ private:
             // close file handlers
             shaderFile.close();
             // convert stream into string
-            return shaderStream.str();
+            return expandIncludes(shaderStream.str(), shaderPath, depth);
         }
         catch (std::ifstream::failure& e)
         {
@@ -174,6 +276,38 @@ private:
         }
     }
 
+    std::string expandIncludes(const std::string &sourceCode, const std::string &shaderPath, int depth){
+        std::string directory = shaderPath.substr(0, shaderPath.find_last_of('/') + 1);
+        std::istringstream lines(sourceCode);
+        std::ostringstream expanded;
+        std::string line;
+        int lineNbr = 0;
+
+        while(std::getline(lines, line)){
+            lineNbr++;
+            size_t start = line.find_first_not_of(" \t");
+            if(start == std::string::npos || line.compare(start, 8, "#include") != 0){
+                expanded << line << '\n';
+                continue;
+            }
+
+            size_t open = line.find('"', start);
+            size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if(close == std::string::npos || depth >= SHADER_MAX_INCLUDE_DEPTH){
+                std::cout << "ERROR::SHADER::BAD_INCLUDE '" << line << "' in '" << shaderPath << "'" << std::endl;
+                continue;
+            }
+
+            std::string includePath = directory + line.substr(open + 1, close - open - 1);
+            // Number the lines of the included file from 1 and then go back to ours
+            expanded << "#line 1\n"
+                     << loadSourceCode(includePath.c_str(), depth + 1)
+                     << "\n#line " << lineNbr + 1 << '\n';
+        }
+
+        return expanded.str();
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(unsigned int shader, std::string type)
@@ -0,0 +1,303 @@
+#ifndef SIMD_VEC_H
+#define SIMD_VEC_H
+
+#include <immintrin.h>
+#include <stdint.h>
+
+/**
+    CS-11 Asn 2: Thin wrappers around the SSE4.1, AVX2 and AVX-512 registers.
+    @file SimdVec.hpp
+    @author Frank Hampus Weslien
+
+    Exactly one of FIELD_SIMD_SSE41, FIELD_SIMD_AVX2 or FIELD_SIMD_AVX512 must be
+    defined before including this file, and the translation unit must be compiled
+    with the matching instruction set (see CMakeLists.txt). Every instruction set
+    lives in its own namespace so that nothing compiled for AVX-512 can end up
+    being called on a machine that only has SSE.
+
+    Vec holds float lanes, IVec int32 lanes and Mask the result of comparisons.
+    The functions are prefixed with 'v' so that they never clash with <cmath>.
+*/
+
+#if defined(FIELD_SIMD_AVX512)
+
+namespace simd_avx512 {
+
+struct Mask {
+    __mmask16 m;
+};
+
+struct IVec {
+    __m512i v;
+    IVec(){}
+    IVec(__m512i v): v(v) {}
+    IVec(int32_t s): v(_mm512_set1_epi32(s)) {}
+};
+
+struct Vec {
+    typedef simd_avx512::IVec IVec;
+    typedef simd_avx512::Mask Mask;
+    static const int size = 16;
+
+    __m512 v;
+    Vec(){}
+    Vec(__m512 v): v(v) {}
+    Vec(float s): v(_mm512_set1_ps(s)) {}
+
+    // start, start + 1, ..., start + size - 1
+    static Vec iota(float start){
+        return _mm512_add_ps(_mm512_set1_ps(start), _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+    }
+    static Vec load(const float *p){ return _mm512_loadu_ps(p); }
+    void store(float *p) const { _mm512_storeu_ps(p, v); }
+};
+
+inline Vec operator+(Vec a, Vec b){ return _mm512_add_ps(a.v, b.v); }
+inline Vec operator-(Vec a, Vec b){ return _mm512_sub_ps(a.v, b.v); }
+inline Vec operator*(Vec a, Vec b){ return _mm512_mul_ps(a.v, b.v); }
+inline Vec operator/(Vec a, Vec b){ return _mm512_div_ps(a.v, b.v); }
+inline Vec operator-(Vec a){ return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a.v), _mm512_set1_epi32(0x80000000))); }
+
+inline Mask operator<(Vec a, Vec b){ return Mask{ _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) }; }
+inline Mask operator<=(Vec a, Vec b){ return Mask{ _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ) }; }
+inline Mask operator>(Vec a, Vec b){ return Mask{ _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ) }; }
+inline Mask operator>=(Vec a, Vec b){ return Mask{ _mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ) }; }
+inline Mask operator==(Vec a, Vec b){ return Mask{ _mm512_cmp_ps_mask(a.v, b.v, _CMP_EQ_OQ) }; }
+
+inline Mask operator&(Mask a, Mask b){ return Mask{ (__mmask16) (a.m & b.m) }; }
+inline Mask operator|(Mask a, Mask b){ return Mask{ (__mmask16) (a.m | b.m) }; }
+inline Mask operator~(Mask a){ return Mask{ (__mmask16) ~a.m }; }
+
+inline IVec operator+(IVec a, IVec b){ return _mm512_add_epi32(a.v, b.v); }
+inline IVec operator-(IVec a, IVec b){ return _mm512_sub_epi32(a.v, b.v); }
+inline IVec operator&(IVec a, IVec b){ return _mm512_and_si512(a.v, b.v); }
+inline IVec operator|(IVec a, IVec b){ return _mm512_or_si512(a.v, b.v); }
+inline IVec operator^(IVec a, IVec b){ return _mm512_xor_si512(a.v, b.v); }
+inline Mask operator==(IVec a, IVec b){ return Mask{ _mm512_cmpeq_epi32_mask(a.v, b.v) }; }
+inline IVec vshl(IVec a, int n){ return _mm512_sll_epi32(a.v, _mm_cvtsi32_si128(n)); }
+inline IVec vshr(IVec a, int n){ return _mm512_srl_epi32(a.v, _mm_cvtsi32_si128(n)); }
+
+// Pick a where the mask is set and b elsewhere
+inline Vec vselect(Mask m, Vec a, Vec b){ return _mm512_mask_blend_ps(m.m, b.v, a.v); }
+inline IVec vselect(Mask m, IVec a, IVec b){ return _mm512_mask_blend_epi32(m.m, b.v, a.v); }
+
+inline Vec vfma(Vec a, Vec b, Vec c){ return _mm512_fmadd_ps(a.v, b.v, c.v); }
+inline Vec vsqrt(Vec a){ return _mm512_sqrt_ps(a.v); }
+inline Vec vmin(Vec a, Vec b){ return _mm512_min_ps(a.v, b.v); }
+inline Vec vmax(Vec a, Vec b){ return _mm512_max_ps(a.v, b.v); }
+inline Vec vfloor(Vec a){ return _mm512_roundscale_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+inline Vec vtrunc(Vec a){ return _mm512_roundscale_ps(a.v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+inline Vec vround(Vec a){ return _mm512_roundscale_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+inline IVec vtoint(Vec a){ return _mm512_cvttps_epi32(a.v); }
+inline Vec vtofloat(IVec a){ return _mm512_cvtepi32_ps(a.v); }
+inline IVec vasint(Vec a){ return _mm512_castps_si512(a.v); }
+inline Vec vasfloat(IVec a){ return _mm512_castsi512_ps(a.v); }
+
+/**
+    Reduce x to r = x - k * pi / 2 with |r| <= pi / 4. The three part constant
+    together with the fused multiply adds keeps r accurate for |x| up to ~1e6,
+    which covers the twirl functions that call sin(40 * x) on large grids.
+    @return k as an int
+*/
+inline IVec vreducePiOver2(Vec x, Vec &r){
+    Vec k = vround(x * Vec(0.636619772367581343f));
+    r = vfma(k, Vec(-1.57079637050628662109375f), x);
+    r = vfma(k, Vec(4.37113900018624283e-8f), r);
+    r = vfma(k, Vec(1.71512451000591e-15f), r);
+    return _mm512_cvtps_epi32(k.v);
+}
+
+}
+
+#elif defined(FIELD_SIMD_AVX2)
+
+namespace simd_avx2 {
+
+struct Mask {
+    __m256 m;
+};
+
+struct IVec {
+    __m256i v;
+    IVec(){}
+    IVec(__m256i v): v(v) {}
+    IVec(int32_t s): v(_mm256_set1_epi32(s)) {}
+};
+
+struct Vec {
+    typedef simd_avx2::IVec IVec;
+    typedef simd_avx2::Mask Mask;
+    static const int size = 8;
+
+    __m256 v;
+    Vec(){}
+    Vec(__m256 v): v(v) {}
+    Vec(float s): v(_mm256_set1_ps(s)) {}
+
+    // start, start + 1, ..., start + size - 1
+    static Vec iota(float start){
+        return _mm256_add_ps(_mm256_set1_ps(start), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+    }
+    static Vec load(const float *p){ return _mm256_loadu_ps(p); }
+    void store(float *p) const { _mm256_storeu_ps(p, v); }
+};
+
+inline Vec operator+(Vec a, Vec b){ return _mm256_add_ps(a.v, b.v); }
+inline Vec operator-(Vec a, Vec b){ return _mm256_sub_ps(a.v, b.v); }
+inline Vec operator*(Vec a, Vec b){ return _mm256_mul_ps(a.v, b.v); }
+inline Vec operator/(Vec a, Vec b){ return _mm256_div_ps(a.v, b.v); }
+inline Vec operator-(Vec a){ return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+
+inline Mask operator<(Vec a, Vec b){ return Mask{ _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+inline Mask operator<=(Vec a, Vec b){ return Mask{ _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+inline Mask operator>(Vec a, Vec b){ return Mask{ _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+inline Mask operator>=(Vec a, Vec b){ return Mask{ _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+inline Mask operator==(Vec a, Vec b){ return Mask{ _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ) }; }
+
+inline Mask operator&(Mask a, Mask b){ return Mask{ _mm256_and_ps(a.m, b.m) }; }
+inline Mask operator|(Mask a, Mask b){ return Mask{ _mm256_or_ps(a.m, b.m) }; }
+inline Mask operator~(Mask a){ return Mask{ _mm256_xor_ps(a.m, _mm256_castsi256_ps(_mm256_set1_epi32(-1))) }; }
+
+inline IVec operator+(IVec a, IVec b){ return _mm256_add_epi32(a.v, b.v); }
+inline IVec operator-(IVec a, IVec b){ return _mm256_sub_epi32(a.v, b.v); }
+inline IVec operator&(IVec a, IVec b){ return _mm256_and_si256(a.v, b.v); }
+inline IVec operator|(IVec a, IVec b){ return _mm256_or_si256(a.v, b.v); }
+inline IVec operator^(IVec a, IVec b){ return _mm256_xor_si256(a.v, b.v); }
+inline Mask operator==(IVec a, IVec b){ return Mask{ _mm256_castsi256_ps(_mm256_cmpeq_epi32(a.v, b.v)) }; }
+inline IVec vshl(IVec a, int n){ return _mm256_sll_epi32(a.v, _mm_cvtsi32_si128(n)); }
+inline IVec vshr(IVec a, int n){ return _mm256_srl_epi32(a.v, _mm_cvtsi32_si128(n)); }
+
+// Pick a where the mask is set and b elsewhere
+inline Vec vselect(Mask m, Vec a, Vec b){ return _mm256_blendv_ps(b.v, a.v, m.m); }
+inline IVec vselect(Mask m, IVec a, IVec b){ return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b.v), _mm256_castsi256_ps(a.v), m.m)); }
+
+inline Vec vfma(Vec a, Vec b, Vec c){ return _mm256_fmadd_ps(a.v, b.v, c.v); }
+inline Vec vsqrt(Vec a){ return _mm256_sqrt_ps(a.v); }
+inline Vec vmin(Vec a, Vec b){ return _mm256_min_ps(a.v, b.v); }
+inline Vec vmax(Vec a, Vec b){ return _mm256_max_ps(a.v, b.v); }
+inline Vec vfloor(Vec a){ return _mm256_floor_ps(a.v); }
+inline Vec vtrunc(Vec a){ return _mm256_round_ps(a.v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+inline Vec vround(Vec a){ return _mm256_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+inline IVec vtoint(Vec a){ return _mm256_cvttps_epi32(a.v); }
+inline Vec vtofloat(IVec a){ return _mm256_cvtepi32_ps(a.v); }
+inline IVec vasint(Vec a){ return _mm256_castps_si256(a.v); }
+inline Vec vasfloat(IVec a){ return _mm256_castsi256_ps(a.v); }
+
+// See the AVX-512 version
+inline IVec vreducePiOver2(Vec x, Vec &r){
+    Vec k = vround(x * Vec(0.636619772367581343f));
+    r = vfma(k, Vec(-1.57079637050628662109375f), x);
+    r = vfma(k, Vec(4.37113900018624283e-8f), r);
+    r = vfma(k, Vec(1.71512451000591e-15f), r);
+    return _mm256_cvtps_epi32(k.v);
+}
+
+}
+
+#elif defined(FIELD_SIMD_SSE41)
+
+namespace simd_sse41 {
+
+struct Mask {
+    __m128 m;
+};
+
+struct IVec {
+    __m128i v;
+    IVec(){}
+    IVec(__m128i v): v(v) {}
+    IVec(int32_t s): v(_mm_set1_epi32(s)) {}
+};
+
+struct Vec {
+    typedef simd_sse41::IVec IVec;
+    typedef simd_sse41::Mask Mask;
+    static const int size = 4;
+
+    __m128 v;
+    Vec(){}
+    Vec(__m128 v): v(v) {}
+    Vec(float s): v(_mm_set1_ps(s)) {}
+
+    // start, start + 1, ..., start + size - 1
+    static Vec iota(float start){
+        return _mm_add_ps(_mm_set1_ps(start), _mm_setr_ps(0, 1, 2, 3));
+    }
+    static Vec load(const float *p){ return _mm_loadu_ps(p); }
+    void store(float *p) const { _mm_storeu_ps(p, v); }
+};
+
+inline Vec operator+(Vec a, Vec b){ return _mm_add_ps(a.v, b.v); }
+inline Vec operator-(Vec a, Vec b){ return _mm_sub_ps(a.v, b.v); }
+inline Vec operator*(Vec a, Vec b){ return _mm_mul_ps(a.v, b.v); }
+inline Vec operator/(Vec a, Vec b){ return _mm_div_ps(a.v, b.v); }
+inline Vec operator-(Vec a){ return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+
+inline Mask operator<(Vec a, Vec b){ return Mask{ _mm_cmplt_ps(a.v, b.v) }; }
+inline Mask operator<=(Vec a, Vec b){ return Mask{ _mm_cmple_ps(a.v, b.v) }; }
+inline Mask operator>(Vec a, Vec b){ return Mask{ _mm_cmpgt_ps(a.v, b.v) }; }
+inline Mask operator>=(Vec a, Vec b){ return Mask{ _mm_cmpge_ps(a.v, b.v) }; }
+inline Mask operator==(Vec a, Vec b){ return Mask{ _mm_cmpeq_ps(a.v, b.v) }; }
+
+inline Mask operator&(Mask a, Mask b){ return Mask{ _mm_and_ps(a.m, b.m) }; }
+inline Mask operator|(Mask a, Mask b){ return Mask{ _mm_or_ps(a.m, b.m) }; }
+inline Mask operator~(Mask a){ return Mask{ _mm_xor_ps(a.m, _mm_castsi128_ps(_mm_set1_epi32(-1))) }; }
+
+inline IVec operator+(IVec a, IVec b){ return _mm_add_epi32(a.v, b.v); }
+inline IVec operator-(IVec a, IVec b){ return _mm_sub_epi32(a.v, b.v); }
+inline IVec operator&(IVec a, IVec b){ return _mm_and_si128(a.v, b.v); }
+inline IVec operator|(IVec a, IVec b){ return _mm_or_si128(a.v, b.v); }
+inline IVec operator^(IVec a, IVec b){ return _mm_xor_si128(a.v, b.v); }
+inline Mask operator==(IVec a, IVec b){ return Mask{ _mm_castsi128_ps(_mm_cmpeq_epi32(a.v, b.v)) }; }
+inline IVec vshl(IVec a, int n){ return _mm_sll_epi32(a.v, _mm_cvtsi32_si128(n)); }
+inline IVec vshr(IVec a, int n){ return _mm_srl_epi32(a.v, _mm_cvtsi32_si128(n)); }
+
+// Pick a where the mask is set and b elsewhere
+inline Vec vselect(Mask m, Vec a, Vec b){ return _mm_blendv_ps(b.v, a.v, m.m); }
+inline IVec vselect(Mask m, IVec a, IVec b){ return _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(b.v), _mm_castsi128_ps(a.v), m.m)); }
+
+// No FMA before AVX2, this rounds twice
+inline Vec vfma(Vec a, Vec b, Vec c){ return _mm_add_ps(_mm_mul_ps(a.v, b.v), c.v); }
+inline Vec vsqrt(Vec a){ return _mm_sqrt_ps(a.v); }
+inline Vec vmin(Vec a, Vec b){ return _mm_min_ps(a.v, b.v); }
+inline Vec vmax(Vec a, Vec b){ return _mm_max_ps(a.v, b.v); }
+inline Vec vfloor(Vec a){ return _mm_floor_ps(a.v); }
+inline Vec vtrunc(Vec a){ return _mm_round_ps(a.v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+inline Vec vround(Vec a){ return _mm_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+inline IVec vtoint(Vec a){ return _mm_cvttps_epi32(a.v); }
+inline Vec vtofloat(IVec a){ return _mm_cvtepi32_ps(a.v); }
+inline IVec vasint(Vec a){ return _mm_castps_si128(a.v); }
+inline Vec vasfloat(IVec a){ return _mm_castsi128_ps(a.v); }
+
+/**
+    Without FMA the float version loses too many bits for large x, so the
+    reduction is done in double precision two lanes at a time instead. The
+    first part of pi / 2 only has 33 bits so that k times it is exact.
+    @return k as an int
+*/
+inline IVec vreducePiOver2(Vec x, Vec &r){
+    const __m128d twoOverPi = _mm_set1_pd(0.636619772367581343076);
+    const __m128d piOver2Hi = _mm_set1_pd(1.57079632673412561417e+00);
+    const __m128d piOver2Lo = _mm_set1_pd(6.07710050650619224932e-11);
+
+    __m128d lo = _mm_cvtps_pd(x.v);
+    __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(x.v, x.v));
+    __m128d klo = _mm_round_pd(_mm_mul_pd(lo, twoOverPi), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m128d khi = _mm_round_pd(_mm_mul_pd(hi, twoOverPi), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    lo = _mm_sub_pd(_mm_sub_pd(lo, _mm_mul_pd(klo, piOver2Hi)), _mm_mul_pd(klo, piOver2Lo));
+    hi = _mm_sub_pd(_mm_sub_pd(hi, _mm_mul_pd(khi, piOver2Hi)), _mm_mul_pd(khi, piOver2Lo));
+
+    r = _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+    return _mm_unpacklo_epi64(_mm_cvtpd_epi32(klo), _mm_cvtpd_epi32(khi));
+}
+
+}
+
+#else
+#error "Define FIELD_SIMD_SSE41, FIELD_SIMD_AVX2 or FIELD_SIMD_AVX512 before including SimdVec.hpp"
+#endif
+
+#endif
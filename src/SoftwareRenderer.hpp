@@ -0,0 +1,192 @@
+#ifndef SOFTWARE_RENDERER_H
+#define SOFTWARE_RENDERER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <glm/glm.hpp>
+#include "CpuParticleSystem.hpp"
+#include "ParticleRaster.hpp"
+#include "ThreadPool.hpp"
+
+/**
+    CS-11 Asn 2: Draw the particles and their trails on the CPU, --render-backend cpu.
+    @file SoftwareRenderer.hpp
+    @author Frank Hampus Weslien
+
+    Does what renderFrame(..) in main.cpp does with OpenGL, without it: the
+    particles are drawn as squares of '--point-size' pixels over the
+    background, in the order they are in, and every pixel without a particle
+    fades towards the background like safe_mix(..) in
+    shaders/post-processing-trail.frag. The picture is RGBA8 with the bottom
+    row first, like glReadPixels(..).
+
+    The screen is cut into bands of SOFTWARE_RENDERER_BAND_ROWS rows that are
+    drawn on all threads. First every thread finds the pixels of a range of
+    the particles (see ParticleRaster.hpp) and sorts them into the bands they
+    touch, then every band draws its particles in the order of the ranges, so
+    that a particle covers the ones before it like on the GPU. A band fits in
+    the cache while it is drawn and faded. The fading only depends on the byte
+    it starts from, so it is a table of 256 bytes per channel.
+
+    NOTE: The object can not be copied since it owns the picture.
+*/
+
+// The height of a band in pixels
+#define SOFTWARE_RENDERER_BAND_ROWS 16
+
+/**
+ * The rasterParticles(..) compiled for the instruction set.
+ */
+inline ParticleRasterFn particleRasterFunction(FieldIsa isa){
+#ifdef FIELD_SIMD_X86
+    switch(isa){
+        case FIELD_ISA_SSE41: return particleRasterSSE41();
+        case FIELD_ISA_AVX2: return particleRasterAVX2();
+        case FIELD_ISA_AVX512: return particleRasterAVX512();
+        default: break;
+    }
+#endif
+    return &rasterParticles<float>;
+}
+
+class SoftwareRenderer : private boost::noncopyable
+{
+    ParticleRasterParams params;
+    int nbrBands;
+    uint32_t background;
+    // particle == u_clearColor in post-processing-trail.frag compares the RGBA8 texel
+    // with the floats, so it is only ever true if the background is whole bytes
+    bool backgroundIsBytes;
+    uint8_t fade[4][256];
+
+    std::vector<uint32_t> picture;
+    std::vector<int32_t> x0, y0, x1, y1;
+    std::vector<uint32_t> colors;
+    // The particles that touch every band, for every range of particles
+    std::vector<std::vector<uint32_t>> bins;
+
+public:
+
+    /**
+        @param width the width of the picture in pixels
+        @param height the height of the picture in pixels
+        @param pointSize the side of the square a particle covers, in pixels
+        @param backgroundColor the color without particles
+        @param trailMix how much of the trail is left after a frame, u_trail_mix
+    */
+    SoftwareRenderer(int width, int height, float pointSize, glm::vec4 backgroundColor, float trailMix)
+        : params(ParticleRasterParams { width, height, pointSize })
+        , nbrBands((height + SOFTWARE_RENDERER_BAND_ROWS - 1) / SOFTWARE_RENDERER_BAND_ROWS)
+        , picture((size_t) width * height)
+    {
+        background = 0;
+        backgroundIsBytes = true;
+        for(int c = 0; c < 4; c++){
+            float clear = backgroundColor[c];
+            float byte = std::floor(std::min(std::max(clear, 0.0f), 1.0f) * 255.0f + 0.5f);
+            background |= (uint32_t) byte << (8 * c);
+            backgroundIsBytes = backgroundIsBytes && byte / 255.0f == clear;
+
+            for(int t = 0; t < 256; t++){
+                // safe_mix(..), moves at least one step towards the background. GPUs fuse
+                // the multiply and add, without that the background itself would drift
+                float trail = t / 255.0f;
+                float mixed = std::fma(trail, trailMix, (1.0f - trailMix) * clear);
+                float diff = mixed - trail;
+                float step = std::max(std::abs(diff), 1.0f / 255.0f);
+                float faded = trail + (float) ((0.0f < diff) - (diff < 0.0f)) * step;
+                fade[c][t] = (uint8_t) std::floor(std::min(std::max(faded, 0.0f), 1.0f) * 255.0f + 0.5f);
+            }
+        }
+    }
+
+    /**
+        Draw the particles over the faded trails of the frames before.
+        @param pool the threads to draw on
+        @param particles the particles to draw
+        @param frameNbr the frame, the trails start at the first one
+    */
+    void render(ThreadPool &pool, const CpuParticleSystem &particles, unsigned int frameNbr){
+        const size_t padded = particles.paddedSize();
+        x0.resize(padded);
+        y0.resize(padded);
+        x1.resize(padded);
+        y1.resize(padded);
+        colors.resize(padded);
+        const ParticlePixels pixels = { x0.data(), y0.data(), x1.data(), y1.data(), colors.data() };
+        const ParticleRasterFn rasterFn = particleRasterFunction(activeFieldIsa());
+
+        // Whole lanes, in the order of the particles
+        const unsigned int nbrRanges = pool.size() + 1;
+        const unsigned int nbrBlocks = padded / PARTICLE_LANE_PADDING;
+        bins.resize((size_t) nbrRanges * nbrBands);
+        pool.parallelFor(0, nbrRanges, 1, [&](unsigned int begin, unsigned int end){
+            for(unsigned int range = begin; range < end; range++){
+                unsigned int first = (uint64_t) nbrBlocks * range / nbrRanges * PARTICLE_LANE_PADDING;
+                unsigned int last = (uint64_t) nbrBlocks * (range + 1) / nbrRanges * PARTICLE_LANE_PADDING;
+                rasterFn(params, particles.particleArrays(), pixels, first, last);
+
+                std::vector<uint32_t> * rangeBins = &bins[(size_t) range * nbrBands];
+                for(int band = 0; band < nbrBands; band++)
+                    rangeBins[band].clear();
+                last = std::min(last, particles.size());
+                for(unsigned int i = first; i < last; i++){
+                    if(x1[i] <= 0 || x0[i] >= params.width || y1[i] <= 0 || y0[i] >= params.height || x0[i] >= x1[i])
+                        continue;
+                    int firstBand = std::max(y0[i], 0) / SOFTWARE_RENDERER_BAND_ROWS;
+                    int lastBand = (std::min(y1[i], params.height) - 1) / SOFTWARE_RENDERER_BAND_ROWS;
+                    for(int band = firstBand; band <= lastBand; band++)
+                        rangeBins[band].push_back(i);
+                }
+            }
+        });
+
+        const int width = params.width;
+        pool.parallelFor(0, nbrBands, 1, [&](unsigned int begin, unsigned int end){
+            std::vector<uint32_t> layer((size_t) width * SOFTWARE_RENDERER_BAND_ROWS);
+            for(unsigned int band = begin; band < end; band++){
+                const int row0 = band * SOFTWARE_RENDERER_BAND_ROWS;
+                const int row1 = std::min(row0 + SOFTWARE_RENDERER_BAND_ROWS, params.height);
+
+                // The particles of this frame, over a cleared screen
+                std::fill(layer.begin(), layer.end(), background);
+                for(unsigned int range = 0; range < nbrRanges; range++){
+                    for(uint32_t i : bins[(size_t) range * nbrBands + band]){
+                        int px0 = std::max(x0[i], 0);
+                        int px1 = std::min(x1[i], width);
+                        int py0 = std::max(y0[i], row0);
+                        int py1 = std::min(y1[i], row1);
+                        for(int y = py0; y < py1; y++)
+                            std::fill(layer.begin() + (size_t) (y - row0) * width + px0, layer.begin() + (size_t) (y - row0) * width + px1, colors[i]);
+                    }
+                }
+
+                // The trails, where there is no particle
+                for(size_t p = 0; p < (size_t) (row1 - row0) * width; p++){
+                    uint32_t &out = picture[(size_t) row0 * width + p];
+                    if(!backgroundIsBytes || layer[p] != background)
+                        out = layer[p];
+                    else if(frameNbr == 0)
+                        out = background;
+                    else
+                        out = (uint32_t) fade[0][out & 0xFF]
+                            | (uint32_t) fade[1][(out >> 8) & 0xFF] << 8
+                            | (uint32_t) fade[2][(out >> 16) & 0xFF] << 16
+                            | (uint32_t) fade[3][out >> 24] << 24;
+                }
+            }
+        });
+    }
+
+    /**
+        @return the picture, 4 bytes RGBA per pixel with the bottom row first
+    */
+    const uint8_t * pixels() const {
+        return reinterpret_cast<const uint8_t *>(picture.data());
+    }
+};
+
+#endif
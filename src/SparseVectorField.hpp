@@ -0,0 +1,354 @@
+#ifndef SPARSE_VECTOR_FIELD_H
+#define SPARSE_VECTOR_FIELD_H
+
+#include "../include/glad/glad.h"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include "GLHelpers.hpp"
+#include "ThreadPool.hpp"
+#include "VectorField.hpp"
+
+/**
+    CS-11 Asn 2: A vector field that is only built where the particles go.
+    @file SparseVectorField.hpp
+    @author Frank Hampus Weslien
+
+    The grid is cut into SPARSE_FIELD_TILE_SIZE x SPARSE_FIELD_TILE_SIZE tiles
+    and a tile is built the first time a particle reads from it. Fields that
+    pull the particles into a few sinks (like 11-13) then never pay for the
+    parts of the grid nobody visits.
+
+    Graphics memory holds a fixed number of tiles, the slots of the tile
+    buffer (binding 2). The page table (binding 3) has one entry per tile of the
+    grid, the slot it is in plus one, or 0 if it is not there. particle.comp
+    marks every tile it reads in the feedback buffer (binding 4), and reads a
+    tile that is not there as no movement at all, so the particles wait for it.
+
+    Before every frame update(..) copies the marks of the last frame to a
+    mapped buffer, and reads the ones copied the frame before that once their
+    fence has passed. Nothing waits on the GPU: while the copy is not done the
+    frame goes on without it and the marks add up until the next one. The
+    missing tiles are built on all threads, at most
+    SPARSE_FIELD_TILES_PER_FRAME per frame, and replace the tiles that were
+    read the longest ago. Built tiles are also kept in an LRU cache in RAM, so
+    a tile that had to leave graphics memory is not built again when the
+    particles come back.
+
+    Inside a tile the vectors are in the FIELD_LAYOUT of the build, as if the
+    tile was a grid of its own.
+
+    NOTE: The object can not be copied since it owns the buffers.
+*/
+
+// The side of a tile in vectors, a multiple of FIELD_TILE_SIZE
+#define SPARSE_FIELD_TILE_SIZE 256
+// The most tiles built and uploaded before a frame
+#define SPARSE_FIELD_TILES_PER_FRAME 64
+
+class SparseVectorField : private boost::noncopyable
+{
+    const FieldKernel * kernel;
+    int width;
+    int height;
+    int tilesX;
+    int tilesY;
+
+    GLuint tileBuffer = 0;
+    GLuint pageTableBuffer = 0;
+    GLuint feedbackBuffer = 0;
+    GLuint readbackBuffer = 0;
+    const GLuint * readback = NULL;
+    // Set after the marks are copied to the readback buffer
+    GLsync readbackFence = NULL;
+
+    // The slot every tile is in plus one, a copy of the page table
+    std::vector<GLuint> pageTable;
+    // The tile in every slot, -1 if it is free
+    std::vector<int> slotTile;
+    // The last frame a particle read the tile in the slot
+    std::vector<unsigned int> slotLastUsed;
+    bool warnedFull = false;
+
+    // Built tiles, the most recently used first
+    std::list<int> cacheOrder;
+    std::unordered_map<int, std::pair<std::list<int>::iterator, std::vector<float>>> cache;
+    size_t cacheCapacity;
+    size_t tilesBuilt = 0;
+
+public:
+
+    /**
+        Create the buffers, no tile is built until it is read.
+        @param kernel the function to build the tiles with, must outlive the object
+        @param width the number of vectors along the x-axis of the grid
+        @param height the number of vectors along the y-axis of the grid
+        @param gpuBytes the most graphics memory the tiles may take up
+        @param cacheBytes the most RAM the cache of built tiles may take up
+    */
+    SparseVectorField(const FieldKernel *kernel, int width, int height, uint64_t gpuBytes, uint64_t cacheBytes)
+        : kernel(kernel)
+        , width(width)
+        , height(height)
+        , tilesX((width + SPARSE_FIELD_TILE_SIZE - 1) / SPARSE_FIELD_TILE_SIZE)
+        , tilesY((height + SPARSE_FIELD_TILE_SIZE - 1) / SPARSE_FIELD_TILE_SIZE)
+    {
+        int nbrTiles = tilesX * tilesY;
+        // More slots than tiles would never be used
+        size_t nbrSlots = std::min<uint64_t>(nbrTiles, std::max<uint64_t>(1, gpuBytes / tileBytes()));
+        cacheCapacity = cacheBytes / tileBytes();
+
+        pageTable.assign(nbrTiles, 0);
+        slotTile.assign(nbrSlots, -1);
+        slotLastUsed.assign(nbrSlots, 0);
+
+        glGenBuffers(1, &tileBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileBuffer);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, nbrSlots * tileBytes(), NULL, GL_DYNAMIC_STORAGE_BIT);
+
+        glGenBuffers(1, &pageTableBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, pageTableBuffer);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, nbrTiles * sizeof(GLuint), pageTable.data(), GL_DYNAMIC_STORAGE_BIT);
+
+        glGenBuffers(1, &feedbackBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, feedbackBuffer);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, nbrTiles * sizeof(GLuint), pageTable.data(), 0);
+
+        GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &readbackBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffer);
+        glBufferStorage(GL_COPY_WRITE_BUFFER, nbrTiles * sizeof(GLuint), pageTable.data(), flags);
+        readback = (const GLuint *) glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, nbrTiles * sizeof(GLuint), flags);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glCheckError();
+
+        if(readback == NULL)
+            std::cout << "ERROR::SPARSE_VECTOR_FIELD::COULD_NOT_MAP_BUFFER of size " << nbrTiles * sizeof(GLuint) << std::endl;
+    }
+
+    ~SparseVectorField()
+    {
+        if(readbackFence != NULL)
+            glDeleteSync(readbackFence);
+
+        if(readbackBuffer != 0){
+            glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffer);
+            if(readback != NULL)
+                glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+
+        GLuint buffers[] = { tileBuffer, pageTableBuffer, feedbackBuffer, readbackBuffer };
+        glDeleteBuffers(4, buffers);
+    }
+
+    /**
+        @return false if the buffer with the marks could not be mapped
+    */
+    bool good() const {
+        return readback != NULL;
+    }
+
+    /**
+        @return the number of tiles that fit in graphics memory
+    */
+    size_t nbrSlots() const {
+        return slotTile.size();
+    }
+
+    /**
+        @return the number of tiles in the grid
+    */
+    size_t nbrTiles() const {
+        return pageTable.size();
+    }
+
+    /**
+        @return the number of times a tile has been built so far
+    */
+    size_t nbrTilesBuilt() const {
+        return tilesBuilt;
+    }
+
+    /**
+        Bind the tiles, the page table, and the feedback buffer to the bindings
+        particle.comp reads them from.
+    */
+    void bind() const {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, tileBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, pageTableBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, feedbackBuffer);
+    }
+
+    /**
+        Bring the tiles the particles asked for into graphics memory. Call it
+        before the commands of the frame are issued.
+        @param pool the threads to build the tiles on
+        @param frameNbr the frame about to be rendered, one more than the last time
+    */
+    void update(ThreadPool &pool, unsigned int frameNbr){
+        std::vector<int> missing;
+
+        // The marks copied before the last frame, of the frame before that
+        if(readbackFence != NULL){
+            // Not copied yet, the feedback buffer is left as it is until it is
+            if(glClientWaitSync(readbackFence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+                return;
+            glDeleteSync(readbackFence);
+            readbackFence = NULL;
+
+            for(size_t tile = 0; tile < pageTable.size(); tile++){
+                if(readback[tile] == 0)
+                    continue;
+                if(pageTable[tile] != 0)
+                    slotLastUsed[pageTable[tile] - 1] = frameNbr;
+                else if(missing.size() < SPARSE_FIELD_TILES_PER_FRAME)
+                    missing.push_back(tile);
+            }
+        }
+
+        // Copy the marks of the last frame, they are read next time. particle.comp
+        // wrote them as an SSBO, the copy and the clear must see those writes
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        glBindBuffer(GL_COPY_READ_BUFFER, feedbackBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, pageTable.size() * sizeof(GLuint));
+        GLuint zero = 0;
+        glClearBufferData(GL_COPY_READ_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        if(missing.empty())
+            return;
+
+        std::vector<const float *> tiles = cachedTiles(pool, missing);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileBuffer);
+        bool uploaded = false;
+        for(size_t i = 0; i < missing.size(); i++){
+            int slot = leastRecentlyUsedSlot();
+            // Every slot was read in the last frame, replacing one would only move the wait
+            if(slotTile[slot] != -1 && slotLastUsed[slot] == frameNbr){
+                if(!warnedFull){
+                    std::cout << "WARNING: the particles read more than the " << nbrSlots()
+                              << " tiles of the vector field that fit in '--sparse-field-gpu-mb', some of them wait for their tile" << std::endl;
+                    warnedFull = true;
+                }
+                break;
+            }
+
+            if(slotTile[slot] != -1)
+                pageTable[slotTile[slot]] = 0;
+            slotTile[slot] = missing[i];
+            slotLastUsed[slot] = frameNbr;
+            pageTable[missing[i]] = slot + 1;
+
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, slot * tileBytes(), tileBytes(), tiles[i]);
+            uploaded = true;
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        if(uploaded){
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, pageTableBuffer);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, pageTable.size() * sizeof(GLuint), pageTable.data());
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        }
+        glCheckError();
+    }
+
+    /**
+        The lines particle.comp needs to read a sparse field.
+    */
+    static std::string shaderDefines(){
+        return "#define FIELD_SPARSE\n#define SPARSE_FIELD_TILE_SIZE " + std::to_string(SPARSE_FIELD_TILE_SIZE) + "\n";
+    }
+
+private:
+
+    // In floats
+    static size_t tileSize(){
+        return fieldLayoutSize<FIELD_LAYOUT>(SPARSE_FIELD_TILE_SIZE, SPARSE_FIELD_TILE_SIZE);
+    }
+
+    static size_t tileBytes(){
+        return tileSize() * sizeof(float);
+    }
+
+    int leastRecentlyUsedSlot() const {
+        int best = 0;
+        for(size_t slot = 0; slot < slotTile.size(); slot++){
+            if(slotTile[slot] == -1)
+                return slot;
+            if(slotLastUsed[slot] < slotLastUsed[best])
+                best = slot;
+        }
+        return best;
+    }
+
+    /**
+        Find the tiles in the cache and build the ones that are not there.
+        The pointers stay valid until the next call.
+    */
+    std::vector<const float *> cachedTiles(ThreadPool &pool, const std::vector<int> &tiles){
+        std::vector<int> toBuild;
+        for(int tile : tiles){
+            if(cache.count(tile) == 0)
+                toBuild.push_back(tile);
+        }
+
+        std::vector<std::vector<float>> built(toBuild.size(), std::vector<float>(tileSize(), 0.0f));
+        pool.parallelFor(0, toBuild.size(), 1, [this, &toBuild, &built](unsigned int begin, unsigned int end){
+            for(unsigned int i = begin; i < end; i++)
+                buildTile(toBuild[i], built[i].data());
+        });
+        tilesBuilt += toBuild.size();
+
+        for(size_t i = 0; i < toBuild.size(); i++){
+            cacheOrder.push_front(toBuild[i]);
+            cache[toBuild[i]] = std::make_pair(cacheOrder.begin(), std::move(built[i]));
+        }
+
+        std::vector<const float *> result;
+        for(int tile : tiles){
+            auto &entry = cache[tile];
+            cacheOrder.splice(cacheOrder.begin(), cacheOrder, entry.first);
+            result.push_back(entry.second.data());
+        }
+
+        // Only after the pointers are taken, the tiles of this frame are at the front
+        while(cacheOrder.size() > std::max(cacheCapacity, tiles.size())){
+            cache.erase(cacheOrder.back());
+            cacheOrder.pop_back();
+        }
+        return result;
+    }
+
+    // The tile is tx * tilesY + ty, like the columns of a grid
+    void buildTile(int tile, float *data) const {
+        float xs[SPARSE_FIELD_TILE_SIZE];
+        float ys[SPARSE_FIELD_TILE_SIZE];
+        int x0 = (tile / tilesY) * SPARSE_FIELD_TILE_SIZE;
+        int y0 = (tile % tilesY) * SPARSE_FIELD_TILE_SIZE;
+        int columns = std::min(SPARSE_FIELD_TILE_SIZE, width - x0);
+        int rows = std::min(SPARSE_FIELD_TILE_SIZE, height - y0);
+
+        for(int i = 0; i < columns; i++){
+            kernel->evaluate(x0 + i, y0, 1, rows, width, height, xs, ys);
+            for(int j = 0; j < rows; j++){
+                float * vector = data + 2 * fieldLayoutIndex<FIELD_LAYOUT>(i, j, SPARSE_FIELD_TILE_SIZE);
+                vector[0] = xs[j];
+                vector[1] = ys[j];
+            }
+        }
+    }
+};
+
+#endif
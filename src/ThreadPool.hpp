@@ -0,0 +1,174 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+/**
+    CS-11 Asn 2: A fixed set of worker threads to spread CPU work over all cores.
+    @file ThreadPool.hpp
+    @author Frank Hampus Weslien
+
+    NOTE: The object can not be copied since it owns the worker threads, they
+    are joined when the pool is destroyed.
+*/
+class ThreadPool : private boost::noncopyable
+{
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+
+    // Shared between the caller of parallelFor and the workers helping it. It
+    // is reference counted since a worker can pick up its task after the
+    // caller already finished all the chunks on its own.
+    struct ParallelForState {
+        std::function<void(unsigned int, unsigned int)> body;
+        unsigned int begin;
+        unsigned int end;
+        unsigned int grainSize;
+        unsigned int nbrChunks;
+        std::atomic<unsigned int> nextChunk;
+        std::atomic<unsigned int> finishedChunks;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+
+public:
+
+    /**
+        Starts the worker threads.
+        @param nbrThreads the number of workers, 0 means one per hardware thread.
+    */
+    ThreadPool(unsigned int nbrThreads = 0)
+    {
+        if(nbrThreads == 0)
+            nbrThreads = std::max(1u, std::thread::hardware_concurrency());
+
+        for(unsigned int i = 0; i < nbrThreads; i++)
+            workers.emplace_back([this]{ workerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        for(std::thread &worker : workers)
+            worker.join();
+    }
+
+    /**
+        Get the number of worker threads.
+        @return the number of worker threads.
+    */
+    unsigned int size() const {
+        return workers.size();
+    }
+
+    /**
+        Run a task on one of the workers at some later point.
+        @param task the function to execute.
+    */
+    void submit(std::function<void()> task)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        condition.notify_one();
+    }
+
+    /**
+        Split the range [begin, end) into chunks of at most grainSize and run
+        body(chunkBegin, chunkEnd) for every chunk spread over all workers.
+        The calling thread takes part in the work and the call returns once
+        every chunk has been processed.
+        @param begin the first index
+        @param end one past the last index
+        @param grainSize the largest number of indices handed out at once
+        @param body the function to call for every chunk
+    */
+    void parallelFor( unsigned int begin
+                    , unsigned int end
+                    , unsigned int grainSize
+                    , std::function<void(unsigned int, unsigned int)> body
+                    ){
+        if(end <= begin)
+            return;
+
+        grainSize = std::max(1u, grainSize);
+
+        std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+        state->body = std::move(body);
+        state->begin = begin;
+        state->end = end;
+        state->grainSize = grainSize;
+        state->nbrChunks = (end - begin + grainSize - 1) / grainSize;
+        state->nextChunk = 0;
+        state->finishedChunks = 0;
+
+        unsigned int nbrHelpers = std::min<unsigned int>(size(), state->nbrChunks - 1);
+        for(unsigned int i = 0; i < nbrHelpers; i++)
+            submit([state]{ runChunks(*state); });
+
+        runChunks(*state);
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->finished.wait(lock, [&state]{ return state->finishedChunks == state->nbrChunks; });
+    }
+
+    /**
+        Pick a reasonable grain size so that every worker gets a few chunks,
+        which evens out chunks that are more expensive than others.
+        @param count the number of indices to split
+        @return the grain size to give to parallelFor
+    */
+    unsigned int grainSizeFor(unsigned int count) const {
+        return std::max(1u, count / (4 * (size() + 1)));
+    }
+
+private:
+
+    void workerLoop(){
+        while(true){
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]{ return stopping || !tasks.empty(); });
+                if(stopping && tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    static void runChunks(ParallelForState &state){
+        unsigned int chunk;
+        while((chunk = state.nextChunk++) < state.nbrChunks){
+            unsigned int chunkBegin = state.begin + chunk * state.grainSize;
+            unsigned int chunkEnd = std::min(state.end, chunkBegin + state.grainSize);
+            state.body(chunkBegin, chunkEnd);
+
+            if(++state.finishedChunks == state.nbrChunks){
+                std::unique_lock<std::mutex> lock(state.mutex);
+                state.finished.notify_all();
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef VECTOR_FIELD_H
+#define VECTOR_FIELD_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "ThreadPool.hpp"
+#include "FieldKernels.hpp"
+#include "FieldLayout.hpp"
+
+// The number of points handed to a FieldKernel at once
+#define FIELD_BATCH_SIZE 256
+
+/**
+ * A grid of 2D vectors in the FIELD_LAYOUT the program was built with, i.e. the
+ * vector at (x, y) is stored at data[2 * vectorFieldIndex(x, y, height)]. With
+ * the default layout that is data[2 * (x * height + y)].
+ *
+ * The struct does not own the memory, data usually points straight into the
+ * mapped SSBO that particle.comp reads from.
+ */
+struct VectorField {
+    float * data;
+    int width;
+    int height;
+};
+
+/**
+ * The number of floats needed to store a vector field.
+ * @param width the number of vectors along the x-axis
+ * @param height the number of vectors along the y-axis
+ * @return the number of floats
+ */
+inline size_t vectorFieldSize(int width, int height){
+    return fieldLayoutSize<FIELD_LAYOUT>(width, height);
+}
+
+/**
+ * The position of the vector at (x, y), in vectors, see FieldLayout.hpp.
+ * @param height the number of vectors along the y-axis
+ */
+inline size_t vectorFieldIndex(int x, int y, int height){
+    return fieldLayoutIndex<FIELD_LAYOUT>(x, y, height);
+}
+
+/**
+ * Evaluate the kernel over the whole grid and write the result into vectorField.data,
+ * in the given layout. vectorFieldSize(..) must be the size of that layout.
+ *
+ * The columns are split over all threads in the pool, a stripe of
+ * FIELD_LAYOUT_STRIPE(Layout) columns at a time. Every stripe is a contiguous
+ * range of memory so no two threads ever write to the same cache line
+ * except at the edges of a chunk.
+ *
+ * @param pool the threads to do the work on
+ * @param vectorField the grid to fill, data must have room for fieldLayoutSize<Layout>(width, height) floats
+ * @param kernel the function to evaluate at every grid point
+ */
+template <int Layout>
+void buildVectorFieldLayout(ThreadPool &pool, VectorField &vectorField, const FieldKernel &kernel){
+    float * data = vectorField.data;
+    int width = vectorField.width;
+    int height = vectorField.height;
+    int stripe = FIELD_LAYOUT_STRIPE(Layout);
+    int nbrStripes = (width + stripe - 1) / stripe;
+
+    pool.parallelFor(0, nbrStripes, pool.grainSizeFor(nbrStripes), [data, width, height, stripe, &kernel](unsigned int begin, unsigned int end){
+        float xs[FIELD_BATCH_SIZE];
+        float ys[FIELD_BATCH_SIZE];
+
+        int last = std::min((int) end * stripe, width);
+        for (int i = begin * stripe; i < last; i++) {
+            for (int j = 0; j < height; j += FIELD_BATCH_SIZE) {
+                int count = std::min(FIELD_BATCH_SIZE, height - j);
+                kernel.evaluate(i, j, 1, count, width, height, xs, ys);
+                for (int k = 0; k < count; k++) {
+                    float * vector = data + 2 * fieldLayoutIndex<Layout>(i, j + k, height);
+                    vector[0] = xs[k];
+                    vector[1] = ys[k];
+                }
+            }
+        }
+    });
+}
+
+/**
+ * Evaluate the kernel over the whole grid and write the result into vectorField.data.
+ * @param pool the threads to do the work on
+ * @param vectorField the grid to fill, data must have room for vectorFieldSize(width, height) floats
+ * @param kernel the function to evaluate at every grid point
+ */
+inline void buildVectorField(ThreadPool &pool, VectorField &vectorField, const FieldKernel &kernel){
+    buildVectorFieldLayout<FIELD_LAYOUT>(pool, vectorField, kernel);
+}
+
+/**
+ * Evaluate one period of a field that repeats itself, the bottom left
+ * vectorField.width x vectorField.height vectors of a gridWidth x gridHeight
+ * grid. The kernel is told the size of the whole grid, so the vectors are the
+ * same as those buildVectorField(..) gives for it.
+ * @param pool the threads to do the work on
+ * @param vectorField the period to fill, data must have room for vectorFieldSize(width, height) floats
+ * @param kernel the function to evaluate, see FieldKernel::period(..)
+ * @param gridWidth the number of vectors along the x-axis of the whole grid
+ * @param gridHeight the number of vectors along the y-axis of the whole grid
+ */
+inline void buildPeriodicVectorField(ThreadPool &pool, VectorField &vectorField, const FieldKernel &kernel, int gridWidth, int gridHeight){
+    float * data = vectorField.data;
+    int width = vectorField.width;
+    int height = vectorField.height;
+
+    pool.parallelFor(0, width, pool.grainSizeFor(width), [=, &kernel](unsigned int begin, unsigned int end){
+        float xs[FIELD_BATCH_SIZE];
+        float ys[FIELD_BATCH_SIZE];
+
+        for (int i = begin; i < (int) end; i++) {
+            for (int j = 0; j < height; j += FIELD_BATCH_SIZE) {
+                int count = std::min(FIELD_BATCH_SIZE, height - j);
+                kernel.evaluate(i, j, 1, count, gridWidth, gridHeight, xs, ys);
+                for (int k = 0; k < count; k++) {
+                    float * vector = data + 2 * vectorFieldIndex(i, j + k, height);
+                    vector[0] = xs[k];
+                    vector[1] = ys[k];
+                }
+            }
+        }
+    });
+}
+
+/**
+ * Compute the vectors of part of one column, the way buildVectorField(..) does.
+ * @param kernel the function to evaluate
+ * @param i the column
+ * @param y0 the first vector of the column
+ * @param y1 one past the last vector of the column
+ * @param width the number of vectors along the x-axis
+ * @param height the number of vectors along the y-axis
+ * @param sampleWidth the width of the grid the kernel is sampled on, see buildVectorField(..)
+ * @param sampleHeight the height of the grid the kernel is sampled on
+ * @param out filled with the 2 * (y1 - y0) components of the vectors
+ */
+inline void sampleVectorFieldColumn(const FieldKernel &kernel, int i, int y0, int y1, int width, int height, int sampleWidth, int sampleHeight, float * out){
+    float xs[FIELD_BATCH_SIZE];
+    float ys[FIELD_BATCH_SIZE];
+
+    if(sampleWidth == width && sampleHeight == height){
+        for (int j = y0; j < y1; j += FIELD_BATCH_SIZE) {
+            int count = std::min(FIELD_BATCH_SIZE, y1 - j);
+            kernel.evaluate(i, j, 1, count, width, height, xs, ys);
+            for (int k = 0; k < count; k++) {
+                out[2 * (j - y0 + k)] = xs[k];
+                out[2 * (j - y0 + k) + 1] = ys[k];
+            }
+        }
+        return;
+    }
+
+    float rx = width > 1 ? (sampleWidth - 1.0f) / (width - 1) : 1.0f;
+    float ry = height > 1 ? (sampleHeight - 1.0f) / (height - 1) : 1.0f;
+    int sx = std::max(1, (int) std::ceil(rx));
+    int sy = std::max(1, (int) std::ceil(ry));
+    float stepX = rx / sx;
+    float stepY = ry / sy;
+
+    std::fill(out, out + 2 * (y1 - y0), 0.0f);
+    int firstSample = y0 * sy;
+    int lastSample = y1 * sy;
+    for (int a = 0; a < sx; a++) {
+        float x = i * rx - rx / 2 + (a + 0.5f) * stepX;
+        for (int j = firstSample; j < lastSample; j += FIELD_BATCH_SIZE) {
+            int count = std::min(FIELD_BATCH_SIZE, lastSample - j);
+            kernel.evaluate(x, (j + 0.5f) * stepY - ry / 2, stepY, count, sampleWidth, sampleHeight, xs, ys);
+            for (int k = 0; k < count; k++) {
+                int y = (j + k) / sy - y0;
+                out[2 * y] += xs[k];
+                out[2 * y + 1] += ys[k];
+            }
+        }
+    }
+
+    float scale = 1.0f / (sx * sy);
+    for (int y = 0; y < 2 * (y1 - y0); y++)
+        out[y] *= scale;
+}
+
+/**
+ * Build vectorField as a smaller version of the field the kernel gives on a
+ * sampleWidth x sampleHeight grid.
+ *
+ * The vector at (x, y) stands for the point (x * rx, y * ry) of the sample grid,
+ * with rx = (sampleWidth - 1) / (width - 1), which is where particle.comp puts
+ * it. It is the average of ceil(rx) x ceil(ry) samples spread evenly over the
+ * rx x ry cell around that point, a box filter, so the detail that is lost is
+ * averaged out instead of aliased. That is at least one sample per point of
+ * the sample grid and less than four, so building the field takes a little
+ * longer than it would at full resolution. The samples of a column are evenly spaced, so the kernel
+ * still gets a whole column at a time.
+ *
+ * @param pool the threads to do the work on
+ * @param vectorField the grid to fill, data must have room for vectorFieldSize(width, height) floats
+ * @param kernel the function to evaluate
+ * @param sampleWidth the width of the grid the kernel is sampled on, at least vectorField.width
+ * @param sampleHeight the height of the grid the kernel is sampled on, at least vectorField.height
+ */
+inline void buildVectorField(ThreadPool &pool, VectorField &vectorField, const FieldKernel &kernel, int sampleWidth, int sampleHeight){
+    if(sampleWidth == vectorField.width && sampleHeight == vectorField.height){
+        buildVectorField(pool, vectorField, kernel);
+        return;
+    }
+
+    float * data = vectorField.data;
+    int width = vectorField.width;
+    int height = vectorField.height;
+    int stripe = FIELD_LAYOUT_STRIPE(FIELD_LAYOUT);
+    int nbrStripes = (width + stripe - 1) / stripe;
+
+    pool.parallelFor(0, nbrStripes, pool.grainSizeFor(nbrStripes), [=, &kernel](unsigned int begin, unsigned int end){
+        std::vector<float> column(2 * height);
+
+        int last = std::min((int) end * stripe, width);
+        for (int i = begin * stripe; i < last; i++) {
+            sampleVectorFieldColumn(kernel, i, 0, height, width, height, sampleWidth, sampleHeight, column.data());
+            for (int y = 0; y < height; y++) {
+                float * vector = data + 2 * vectorFieldIndex(i, y, height);
+                vector[0] = column[2 * y];
+                vector[1] = column[2 * y + 1];
+            }
+        }
+    });
+}
+
+#endif
@@ -0,0 +1,407 @@
+#ifndef VECTOR_FIELD_CACHE_H
+#define VECTOR_FIELD_CACHE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/noncopyable.hpp>
+#include "ThreadPool.hpp"
+#include "VectorField.hpp"
+
+/**
+    CS-11 Asn 2: A directory of prebuilt vector fields that can be shared between runs and machines.
+    @file VectorFieldCache.hpp
+    @author Frank Hampus Weslien
+
+    Every field is stored in its own file, named after a hash of the key, as a
+    VectorFieldCacheHeader followed by the floats in the same layout as
+    VectorField. --export-field and --field-sequence use the same format. A
+    hit memory maps the file and copies it straight into the vector field,
+    which usually is the mapped SSBO.
+
+    Files are written to a temporary name and renamed into place, so readers on
+    other machines never see half a field. When the directory grows past its
+    limit the least recently used fields are removed, a hit counts as a use.
+*/
+
+#define VECTOR_FIELD_CACHE_MAGIC 0x4346564d // "MVFC"
+// The low byte is the version of the file, the next the FIELD_LAYOUT of the floats.
+// Files written by a build with another layout are never read.
+#define VECTOR_FIELD_CACHE_FORMAT (FIELD_LAYOUT << 8 | 3)
+#define VECTOR_FIELD_CACHE_EXTENSION ".field"
+
+// Temporary files older than this were left behind by a crashed writer
+#define VECTOR_FIELD_CACHE_STALE_SECONDS 3600
+
+struct VectorFieldCacheKey {
+    uint32_t functionNbr;
+    uint32_t width;
+    uint32_t height;
+    uint32_t kernelVersion;
+    // The grid the function was sampled on, larger than width x height if the
+    // field was built at a lower resolution, see buildVectorField(..)
+    uint32_t sampleWidth;
+    uint32_t sampleHeight;
+    // For fields given by text, see vectorFieldCacheKey(fieldX, fieldY, ..), a
+    // second hash of it and its length, 0 for the field functions
+    uint64_t sourceHash;
+    uint64_t sourceLength;
+};
+
+struct VectorFieldCacheHeader {
+    uint32_t magic;
+    uint32_t format;
+    VectorFieldCacheKey key;
+    uint64_t payloadSize; // in bytes
+};
+
+/**
+ * The key of a field built with the current field functions.
+ * @param functionNbr the number given by --vector-field-function
+ * @param width the number of vectors along the x-axis
+ * @param height the number of vectors along the y-axis
+ */
+inline VectorFieldCacheKey vectorFieldCacheKey(unsigned int functionNbr, int width, int height){
+    VectorFieldCacheKey key;
+    key.functionNbr = functionNbr < NBR_FIELD_FUNCTIONS ? functionNbr : 0;
+    key.width = width;
+    key.height = height;
+    key.kernelVersion = FIELD_KERNEL_VERSION;
+    key.sampleWidth = width;
+    key.sampleHeight = height;
+    key.sourceHash = 0;
+    key.sourceLength = 0;
+    return key;
+}
+
+// Set in the function number of fields given by --field-x and --field-y
+#define VECTOR_FIELD_CACHE_EXPRESSION_BIT 0x80000000u
+
+/**
+ * The key of a field given by expressions, see FieldExpression.hpp. The
+ * function number is a hash of the expressions, and the key also holds a
+ * 64 bit hash and the length of them so that two expressions whose 32 bit
+ * hashes collide are still told apart.
+ * @param fieldX the expression for the x-component
+ * @param fieldY the expression for the y-component
+ * @param width the number of vectors along the x-axis
+ * @param height the number of vectors along the y-axis
+ */
+inline VectorFieldCacheKey vectorFieldCacheKey(const std::string &fieldX, const std::string &fieldY, int width, int height){
+    std::string expressions = fieldX + '\n' + fieldY;
+    uint32_t hash = 2166136261u;
+    uint64_t longHash = 14695981039346656037ull;
+    for(unsigned char c : expressions){
+        hash ^= c;
+        hash *= 16777619u;
+        longHash ^= c;
+        longHash *= 1099511628211ull;
+    }
+
+    VectorFieldCacheKey key = vectorFieldCacheKey(0, width, height);
+    key.functionNbr = VECTOR_FIELD_CACHE_EXPRESSION_BIT | hash;
+    key.sourceHash = longHash;
+    key.sourceLength = expressions.size();
+    return key;
+}
+
+/**
+ * Read the header of a field file and check that it is one.
+ * @param path the file to read
+ * @param header filled with the header of the file
+ * @return false if the file can not be read or is not a complete field file
+ */
+inline bool readVectorFieldHeader(const std::string &path, VectorFieldCacheHeader &header){
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if(!in.read(reinterpret_cast<char *>(&header), sizeof(header)))
+        return false;
+
+    boost::system::error_code error;
+    uint64_t fileSize = boost::filesystem::file_size(path, error);
+    return !error
+        && header.magic == VECTOR_FIELD_CACHE_MAGIC
+        && header.format == VECTOR_FIELD_CACHE_FORMAT
+        && header.payloadSize == vectorFieldSize(header.key.width, header.key.height) * sizeof(float)
+        && fileSize == sizeof(header) + header.payloadSize;
+}
+
+/**
+ * Read the vectors of a field file.
+ * @param path the file to read
+ * @param width the number of vectors along the x-axis the file must have
+ * @param height the number of vectors along the y-axis the file must have
+ * @param data room for vectorFieldSize(width, height) floats
+ * @return false if the file can not be read or has another size
+ */
+inline bool readVectorFieldFile(const std::string &path, int width, int height, float * data){
+    VectorFieldCacheHeader header;
+    if(!readVectorFieldHeader(path, header) || (int) header.key.width != width || (int) header.key.height != height)
+        return false;
+
+    std::ifstream in(path.c_str(), std::ios::binary);
+    in.seekg(sizeof(header));
+    return (bool) in.read(reinterpret_cast<char *>(data), header.payloadSize);
+}
+
+/**
+ * Write a field in the same format as the cache, for --export-field.
+ * @param path the file to write
+ * @param key what the field was built from
+ * @param data vectorFieldSize(key.width, key.height) floats
+ * @return false if the file could not be written
+ */
+inline bool writeVectorFieldFile(const std::string &path, const VectorFieldCacheKey &key, const float * data){
+    VectorFieldCacheHeader header;
+    header.magic = VECTOR_FIELD_CACHE_MAGIC;
+    header.format = VECTOR_FIELD_CACHE_FORMAT;
+    header.key = key;
+    header.payloadSize = vectorFieldSize(key.width, key.height) * sizeof(float);
+
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(data), header.payloadSize);
+    return (bool) out;
+}
+
+class VectorFieldCache : private boost::noncopyable
+{
+    boost::filesystem::path directory;
+    uint64_t maxBytes;
+
+public:
+
+    /**
+        @param directory where the fields are stored, an empty string turns the cache off
+        @param maxBytes the most the fields in the directory may add up to
+    */
+    VectorFieldCache(const std::string &directory, uint64_t maxBytes)
+        : directory(directory)
+        , maxBytes(maxBytes)
+    {
+        if(enabled()){
+            boost::system::error_code error;
+            boost::filesystem::create_directories(this->directory, error);
+            if(error){
+                std::cout << "ERROR::VECTOR_FIELD_CACHE::COULD_NOT_CREATE_DIRECTORY '" << directory << "': " << error.message() << std::endl;
+                this->directory.clear();
+            }
+        }
+    }
+
+    bool enabled() const {
+        return !directory.empty();
+    }
+
+    /**
+        Copy a cached field into vectorField.
+        @param key the field to look for
+        @param pool the threads to copy with
+        @param vectorField the grid to fill, its size must match the key
+        @return false if the field is not in the cache
+    */
+    bool load(const VectorFieldCacheKey &key, ThreadPool &pool, VectorField &vectorField){
+        if(!enabled())
+            return false;
+
+        boost::filesystem::path path = pathFor(key);
+        uint64_t payloadSize = vectorFieldSize(key.width, key.height) * sizeof(float);
+
+        try {
+            if(!boost::filesystem::exists(path))
+                return false;
+
+            if(boost::filesystem::file_size(path) != sizeof(VectorFieldCacheHeader) + payloadSize){
+                std::cout << "WARNING: removing the damaged vector field " << path << std::endl;
+                boost::filesystem::remove(path);
+                return false;
+            }
+
+            boost::interprocess::file_mapping file(path.string().c_str(), boost::interprocess::read_only);
+            boost::interprocess::mapped_region region(file, boost::interprocess::read_only);
+            const char * bytes = static_cast<const char *>(region.get_address());
+
+            VectorFieldCacheHeader header;
+            std::memcpy(&header, bytes, sizeof(header));
+            if(!matches(header, key, payloadSize)){
+                // A hash collision or a file from another version, leave it be
+                return false;
+            }
+
+            region.advise(boost::interprocess::mapped_region::advice_sequential);
+            copyInParallel(pool, vectorField.data, reinterpret_cast<const float *>(bytes + sizeof(header)), vectorFieldSize(key.width, key.height));
+
+            // Mark it as recently used for the eviction
+            boost::system::error_code error;
+            boost::filesystem::last_write_time(path, std::time(nullptr), error);
+        } catch(const std::exception &e) {
+            std::cout << "ERROR::VECTOR_FIELD_CACHE::COULD_NOT_READ " << path << ": " << e.what() << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+        Build the field into a new cache file and copy it into vectorField from
+        there. Building into the file rather than reading back vectorField
+        matters since that usually is write-only GPU memory.
+        @param key the field to build
+        @param pool the threads to build with
+        @param kernel the function to evaluate at every grid point
+        @param vectorField the grid to fill, its size must match the key
+        @return false if the cache is off or the file could not be created, vectorField is then left untouched
+    */
+    bool buildAndStore(const VectorFieldCacheKey &key, ThreadPool &pool, const FieldKernel &kernel, VectorField &vectorField){
+        if(!enabled())
+            return false;
+
+        size_t count = vectorFieldSize(key.width, key.height);
+        uint64_t fileSize = sizeof(VectorFieldCacheHeader) + count * sizeof(float);
+        if(fileSize > maxBytes)
+            return false;
+
+        boost::filesystem::path path = pathFor(key);
+        boost::filesystem::path tmpPath = directory / boost::filesystem::unique_path("%%%%-%%%%-%%%%-%%%%.tmp");
+
+        try {
+            {
+                std::ofstream out(tmpPath.string().c_str(), std::ios::binary | std::ios::trunc);
+                if(!out)
+                    throw std::runtime_error("could not create " + tmpPath.string());
+            }
+            boost::filesystem::resize_file(tmpPath, fileSize);
+
+            {
+                boost::interprocess::file_mapping file(tmpPath.string().c_str(), boost::interprocess::read_write);
+                boost::interprocess::mapped_region region(file, boost::interprocess::read_write);
+                char * bytes = static_cast<char *>(region.get_address());
+
+                VectorFieldCacheHeader header;
+                header.magic = VECTOR_FIELD_CACHE_MAGIC;
+                header.format = VECTOR_FIELD_CACHE_FORMAT;
+                header.key = key;
+                header.payloadSize = count * sizeof(float);
+                std::memcpy(bytes, &header, sizeof(header));
+
+                VectorField cached = { reinterpret_cast<float *>(bytes + sizeof(header)), (int) key.width, (int) key.height };
+                buildVectorField(pool, cached, kernel, key.sampleWidth, key.sampleHeight);
+                copyInParallel(pool, vectorField.data, cached.data, count);
+
+                region.flush();
+            }
+        } catch(const std::exception &e) {
+            std::cout << "ERROR::VECTOR_FIELD_CACHE::COULD_NOT_WRITE " << tmpPath << ": " << e.what() << std::endl;
+            boost::system::error_code error;
+            boost::filesystem::remove(tmpPath, error);
+            return false;
+        }
+
+        // From here on vectorField is filled, failing only means it is not cached
+        boost::system::error_code error;
+        boost::filesystem::rename(tmpPath, path, error);
+        if(error){
+            std::cout << "ERROR::VECTOR_FIELD_CACHE::COULD_NOT_WRITE " << path << ": " << error.message() << std::endl;
+            boost::filesystem::remove(tmpPath, error);
+            return true;
+        }
+
+        evict();
+        return true;
+    }
+
+private:
+
+    boost::filesystem::path pathFor(const VectorFieldCacheKey &key) const {
+        // FNV-1a over the key, the header holds the key itself to tell collisions apart
+        uint64_t hash = 14695981039346656037ull;
+        const unsigned char * bytes = reinterpret_cast<const unsigned char *>(&key);
+        for(size_t i = 0; i < sizeof(key); i++){
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+
+        char name[17];
+        snprintf(name, sizeof(name), "%016llx", (unsigned long long) hash);
+        return directory / (std::string(name) + VECTOR_FIELD_CACHE_EXTENSION);
+    }
+
+    static bool matches(const VectorFieldCacheHeader &header, const VectorFieldCacheKey &key, uint64_t payloadSize){
+        return header.magic == VECTOR_FIELD_CACHE_MAGIC
+            && header.format == VECTOR_FIELD_CACHE_FORMAT
+            && header.key.functionNbr == key.functionNbr
+            && header.key.width == key.width
+            && header.key.height == key.height
+            && header.key.kernelVersion == key.kernelVersion
+            && header.key.sampleWidth == key.sampleWidth
+            && header.key.sampleHeight == key.sampleHeight
+            && header.key.sourceHash == key.sourceHash
+            && header.key.sourceLength == key.sourceLength
+            && header.payloadSize == payloadSize;
+    }
+
+    static void copyInParallel(ThreadPool &pool, float * dst, const float * src, size_t count){
+        const size_t chunk = 1 << 20;
+        unsigned int nbrChunks = (count + chunk - 1) / chunk;
+        pool.parallelFor(0, nbrChunks, 1, [dst, src, count, chunk](unsigned int begin, unsigned int end){
+            size_t first = begin * chunk;
+            size_t last = std::min(count, end * chunk);
+            std::memcpy(dst + first, src + first, (last - first) * sizeof(float));
+        });
+    }
+
+    /**
+        Remove the least recently used fields until the directory fits in
+        maxBytes. Other machines may be doing the same thing at the same time,
+        so a file that is already gone is not an error.
+    */
+    void evict(){
+        std::vector<std::pair<std::time_t, boost::filesystem::path>> fields;
+        uint64_t totalBytes = 0;
+        std::time_t now = std::time(nullptr);
+
+        boost::system::error_code error;
+        for(boost::filesystem::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)){
+            const boost::filesystem::path &path = it->path();
+            boost::system::error_code statError;
+            std::time_t modified = boost::filesystem::last_write_time(path, statError);
+            if(statError)
+                continue;
+
+            if(path.extension() == ".tmp"){
+                if(now - modified > VECTOR_FIELD_CACHE_STALE_SECONDS)
+                    boost::filesystem::remove(path, statError);
+                continue;
+            }
+
+            if(path.extension() != VECTOR_FIELD_CACHE_EXTENSION)
+                continue;
+
+            uint64_t size = boost::filesystem::file_size(path, statError);
+            if(statError)
+                continue;
+
+            totalBytes += size;
+            fields.push_back(std::make_pair(modified, path));
+        }
+
+        std::sort(fields.begin(), fields.end());
+        for(size_t i = 0; i < fields.size() && totalBytes > maxBytes; i++){
+            boost::system::error_code removeError;
+            uint64_t size = boost::filesystem::file_size(fields[i].second, removeError);
+            if(!removeError && boost::filesystem::remove(fields[i].second, removeError))
+                totalBytes -= size;
+        }
+    }
+};
+
+#endif
@@ -1,68 +1,103 @@
-#include <cmath>
-#include <functional>
-#include <tuple>
-#include <glm/glm.hpp>
+#ifndef VECTOR_FIELD_FUNCTIONS_H
+#define VECTOR_FIELD_FUNCTIONS_H
+
+#include "FieldMath.hpp"
+
+/*
+ * Everything in here is templated on T, which is either float or one of the
+ * SIMD lane types in SimdVec.hpp, so that the same code is used for both.
+ * Branches are written as fieldmath::select(..) since every lane can take a
+ * different path.
+ */
 
 /**
  * Typesafe way of computing of getting the sign of a value.
  * @param val the value to take the sign of
  * @return the sign (-1, 0, or 1) as an int
  */
-template <typename T> int sgn(T val) {
+template <typename T> inline int sgn(T val) {
     return (T(0) < val) - (val < T(0));
 }
 
 /**
  * Turn a vector 90 degrees counter clockwise
- * @param v the vector to rotate
- * @return the vector now rotated 90 degrees counter clockwise
+ * @param x the x-component of the vector to rotate
+ * @param y the y-component of the vector to rotate
+ * @param out_x the x-component of the vector now rotated 90 degrees counter clockwise
+ * @param out_y the y-component of the vector now rotated 90 degrees counter clockwise
  */
-glm::vec2 turnNinetyDegrees(glm::vec2 v){
-    return glm::vec2(-v.y, v.x);
+template <typename T>
+inline void turnNinetyDegrees(T x, T y, T &out_x, T &out_y){
+    out_x = -y;
+    out_y = x;
 }
 
 /**
- * 
+ * Map a point in the grid to [-1, 1] x [-1, 1]
  */
-glm::vec2 toClipSpace(float x, float y, float width, float height){
-    float clip_x = 2.0 * x / width - 1.0;
-    float clip_y = 2.0 * y / height - 1.0;
-    return glm::vec2(clip_x, clip_y);
-}
-
-glm::vec2 toClipSpace(glm::vec2 p, float width, float height){
-    return toClipSpace(p.x, p.y, width, height);
+template <typename T>
+inline void toClipSpace(T x, T y, float width, float height, T &clip_x, T &clip_y){
+    clip_x = 2.0f * x / width - 1.0f;
+    clip_y = 2.0f * y / height - 1.0f;
 }
 
-// sc = sin/cos of aperture
-glm::vec3 sdgArc( glm::vec2 p, glm::vec2 sc, float ra, float rb )
+/**
+ * The signed distance to an arc and its gradient.
+ * sc = sin/cos of aperture
+ */
+template <typename T>
+inline void sdgArc(T p_x, T p_y, float sc_x, float sc_y, float ra, float rb, T &d, T &grad_x, T &grad_y)
 {
-    glm::vec2 q = p;
-    float s = sgn(p.x); p.x = abs(p.x);
-    if( sc.y*p.x > sc.x*p.y )
-    {
-        glm::vec2  w = p - ra*sc;
-        float d = length(w);
-        return glm::vec3( d-rb, glm::vec2(s*w.x,w.y)/d );
-    }
-    else
-    {
-        float l = length(q);
-        float w = l - ra;
-        return glm::vec3( abs(w)-rb, float(sgn(w))*q/l );
-    }
+    T q_x = p_x;
+    T q_y = p_y;
+    T s = fieldmath::sign(p_x);
+    p_x = fieldmath::abs(p_x);
+
+    // sc.y * p.x > sc.x * p.y
+    T w_x = p_x - ra * sc_x;
+    T w_y = p_y - ra * sc_y;
+    T dw = fieldmath::sqrt(w_x * w_x + w_y * w_y);
+
+    // otherwise
+    T l = fieldmath::sqrt(q_x * q_x + q_y * q_y);
+    T w = l - ra;
+    T sw = fieldmath::sign(w);
+
+    auto onCap = sc_y * p_x > sc_x * p_y;
+    d      = fieldmath::select(onCap, dw - rb, fieldmath::abs(w) - rb);
+    grad_x = fieldmath::select(onCap, s * w_x / dw, sw * q_x / l);
+    grad_y = fieldmath::select(onCap, w_y / dw, sw * q_y / l);
 }
 
-glm::vec3 sdgCross( glm::vec2 p, glm::vec2 b ) 
+/**
+ * The signed distance to a cross and its gradient.
+ */
+template <typename T>
+inline void sdgCross(T p_x, T p_y, float b_x, float b_y, T &d, T &grad_x, T &grad_y)
 {
-    glm::vec2 s = glm::sign(p);
-    p = glm::abs(p); 
-    glm::vec2  q = ((p.y>p.x)? glm::vec2(p.y, p.x) : p ) - b;
-    float h = fmax( q.x, q.y );
-    glm::vec2  o = glm::max( ((h<0.0) ? glm::vec2(b.y-b.x,0.0)-q : q), glm::vec2(0.0, 0.0) );
-    float l = length(o);
-    glm::vec3  r = (h<0.0 && -q.x<l) ? glm::vec3(-q.x,1.0,0.0) : glm::vec3(l,o/l);
+    T s_x = fieldmath::sign(p_x);
+    T s_y = fieldmath::sign(p_y);
+    p_x = fieldmath::abs(p_x);
+    p_y = fieldmath::abs(p_y);
+
+    auto swap = p_y > p_x;
+    T q_x = fieldmath::select(swap, p_y, p_x) - b_x;
+    T q_y = fieldmath::select(swap, p_x, p_y) - b_y;
+    T h = fieldmath::max(q_x, q_y);
+
+    auto inside = h < 0.0f;
+    T o_x = fieldmath::max(fieldmath::select(inside, T(b_y - b_x) - q_x, q_x), T(0.0f));
+    T o_y = fieldmath::max(fieldmath::select(inside, -q_y, q_y), T(0.0f));
+    T l = fieldmath::sqrt(o_x * o_x + o_y * o_y);
+
+    auto onArm = inside & (-q_x < l);
+    T r_x = fieldmath::select(onArm, -q_x, l);
+    T r_y = fieldmath::select(onArm, T(1.0f), o_x / l);
+    T r_z = fieldmath::select(onArm, T(0.0f), o_y / l);
 
-    return(p.y>p.x) ? glm::vec3( sgn(h)*r.x,  s.x*r.z, s.y*r.y) : glm::vec3( sgn(h)*r.x,  s.x*r.y, s.y*r.z );
+    d      = fieldmath::sign(h) * r_x;
+    grad_x = s_x * fieldmath::select(swap, r_z, r_y);
+    grad_y = s_y * fieldmath::select(swap, r_y, r_z);
 }
 
+#endif
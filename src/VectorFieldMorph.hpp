@@ -0,0 +1,157 @@
+#ifndef VECTOR_FIELD_MORPH_H
+#define VECTOR_FIELD_MORPH_H
+
+#include "../include/glad/glad.h"
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include "FieldKernels.hpp"
+#include "GLHelpers.hpp"
+#include "Shader.hpp"
+#include "ThreadPool.hpp"
+#include "VectorField.hpp"
+#include "VectorFieldCache.hpp"
+
+/**
+    CS-11 Asn 2: Morph between several vector field functions, --field-morph.
+    @file VectorFieldMorph.hpp
+    @author Frank Hampus Weslien
+
+    Every function is built once on the CPU, into a slot of its own in one
+    ssbo, and stays in graphics memory for as long as the program runs. Each
+    one is shown on its own for a number of frames and then blended into the
+    next, after the last one back into the first. particle.comp does the
+    blending with the same uniforms as for a --field-sequence, so moving from
+    one field to the next costs a few uniforms a frame and nothing on the bus.
+
+    The ssbo is only mapped while the fields are built, afterwards only the GPU
+    can get to it, so the driver is free to keep it where the GPU reads it fastest.
+
+    NOTE: The object can not be copied since it owns the ssbo.
+*/
+
+class VectorFieldMorph : private boost::noncopyable
+{
+    std::vector<unsigned int> functions;
+    int width;
+    int height;
+    unsigned int holdFrames;
+    unsigned int morphFrames;
+    bool smooth;
+
+    GLuint ssbo = 0;
+
+public:
+
+    /**
+        @param functions the numbers of the vector field functions, in the order they are shown
+        @param width the number of vectors along the x-axis of every field
+        @param height the number of vectors along the y-axis of every field
+        @param holdFrames the number of frames every field is shown on its own
+        @param morphFrames the number of frames it takes to blend into the next field
+        @param smooth true to ease in and out of the blend, false for a constant speed
+    */
+    VectorFieldMorph(const std::vector<unsigned int> &functions, int width, int height, unsigned int holdFrames, unsigned int morphFrames, bool smooth)
+        : functions(functions)
+        , width(width)
+        , height(height)
+        , holdFrames(holdFrames)
+        , morphFrames(std::max(1u, morphFrames))
+        , smooth(smooth)
+    {}
+
+    ~VectorFieldMorph()
+    {
+        if(ssbo != 0)
+            glDeleteBuffers(1, &ssbo);
+    }
+
+    /**
+        Build every field into its slot, or load it from the cache.
+        @param pool the threads to build the fields on
+        @param cache where the fields are kept between runs
+        @param sampleWidth the width of the grid the functions are sampled on, see buildVectorField(..)
+        @param sampleHeight the height of the grid the functions are sampled on
+        @return false if the ssbo could not be made
+    */
+    bool build(ThreadPool &pool, VectorFieldCache &cache, int sampleWidth, int sampleHeight){
+        GLsizeiptr nbytes = functions.size() * slotSize() * sizeof(float);
+
+        glGenBuffers(1, &ssbo);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, nbytes, NULL, GL_MAP_WRITE_BIT);
+        float * mapping = (float *) glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, nbytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        glCheckError();
+
+        if(mapping == NULL){
+            std::cout << "ERROR::VECTOR_FIELD_MORPH::COULD_NOT_MAP_BUFFER of size " << nbytes << std::endl;
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            return false;
+        }
+
+        for(size_t slot = 0; slot < functions.size(); slot++){
+            VectorField field = { mapping + slot * slotSize(), width, height };
+            VectorFieldCacheKey key = vectorFieldCacheKey(functions[slot], width, height);
+            key.sampleWidth = sampleWidth;
+            key.sampleHeight = sampleHeight;
+            if(!cache.load(key, pool, field) && !cache.buildAndStore(key, pool, *fieldKernel(functions[slot]), field))
+                buildVectorField(pool, field, *fieldKernel(functions[slot]), sampleWidth, sampleHeight);
+        }
+
+        // The contents are undefined if the driver lost them while mapped, rare but possible
+        bool unmapped = glUnmapBuffer(GL_SHADER_STORAGE_BUFFER) == GL_TRUE;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glCheckError();
+        if(!unmapped){
+            std::cout << "ERROR::VECTOR_FIELD_MORPH::BUFFER_LOST_WHILE_MAPPED" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+        @return the ssbo with the fields, to be bound to binding 2
+    */
+    GLuint buffer() const {
+        return ssbo;
+    }
+
+    /**
+        @return the graphics memory taken by the fields
+    */
+    size_t bufferBytes() const {
+        return functions.size() * slotSize() * sizeof(float);
+    }
+
+    /**
+        Tell the shader which two fields to mix, and how much, at the given frame.
+        @param shader particle.comp compiled with FIELD_SEQUENCE
+        @param frameNbr the frame about to be rendered
+    */
+    void update(Shader *shader, unsigned int frameNbr) const {
+        unsigned int framesPerField = holdFrames + morphFrames;
+        unsigned int current = (frameNbr / framesPerField) % functions.size();
+        unsigned int next = (current + 1) % functions.size();
+        unsigned int frame = frameNbr % framesPerField;
+
+        float t = frame < holdFrames ? 0.0f : (float) (frame - holdFrames) / morphFrames;
+        if(smooth)
+            t = t * t * (3.0f - 2.0f * t);
+
+        shader->use();
+        // In vectors, the same unit as calcVectorPosition(..)
+        shader->setInt("u_keyframe_a", (int) (current * slotSize() / 2));
+        shader->setInt("u_keyframe_b", (int) (next * slotSize() / 2));
+        shader->setFloat("u_keyframe_mix", t);
+    }
+
+private:
+
+    // In floats
+    size_t slotSize() const {
+        return vectorFieldSize(width, height);
+    }
+};
+
+#endif
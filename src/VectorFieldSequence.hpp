@@ -0,0 +1,288 @@
+#ifndef VECTOR_FIELD_SEQUENCE_H
+#define VECTOR_FIELD_SEQUENCE_H
+
+#include "../include/glad/glad.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
+#include "GLHelpers.hpp"
+#include "Shader.hpp"
+#include "VectorField.hpp"
+#include "VectorFieldCache.hpp"
+
+/**
+    CS-11 Asn 2: Play a sequence of vector fields from disk, one keyframe every N frames.
+    @file VectorFieldSequence.hpp
+    @author Frank Hampus Weslien
+
+    The keyframes are the .field files in a folder (see --export-field), played
+    in the order of their names and from the start again after the last one.
+    particle.comp mixes the current keyframe with the next one, so it needs two
+    of them in graphics memory while the one after that is loaded.
+
+    All three live in one persistently mapped ssbo, one slot each, keyframe k in
+    slot k % 3. A loader thread reads the files straight into the mapping. When
+    the sequence moves on, a fence is put after the last frame that read the
+    slot that is no longer needed and the slot is only handed to the loader once
+    the GPU has passed it. Nothing waits unless the disk can't keep up.
+
+    NOTE: The object can not be copied since it owns the loader thread and the
+    ssbo.
+*/
+
+#define FIELD_SEQUENCE_SLOTS 3
+
+class VectorFieldSequence : private boost::noncopyable
+{
+    std::vector<std::string> files;
+    int width = 0;
+    int height = 0;
+    unsigned int framesPerKeyframe;
+
+    GLuint ssbo = 0;
+    float * mapping = NULL;
+
+    // The keyframe that is in, or on its way to, every slot
+    unsigned int slotKeyframe[FIELD_SEQUENCE_SLOTS];
+    bool slotReady[FIELD_SEQUENCE_SLOTS];
+    // Set while the GPU may still be reading the old keyframe in the slot
+    GLsync slotFence[FIELD_SEQUENCE_SLOTS] = {};
+
+    unsigned int currentKeyframe = 0;
+
+    std::thread loader;
+    std::deque<unsigned int> loadQueue;
+    std::mutex mutex;
+    std::condition_variable loadRequested;
+    std::condition_variable loadFinished;
+    bool stopping = false;
+
+public:
+
+    /**
+        Find the keyframes and start loading the first ones.
+        @param directory the folder with the .field files
+        @param framesPerKeyframe the number of frames from one keyframe to the next
+    */
+    VectorFieldSequence(const std::string &directory, unsigned int framesPerKeyframe)
+        : framesPerKeyframe(std::max(1u, framesPerKeyframe))
+    {
+        if(!findKeyframes(directory))
+            return;
+
+        GLsizeiptr nbytes = FIELD_SEQUENCE_SLOTS * slotSize() * sizeof(float);
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        glGenBuffers(1, &ssbo);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, nbytes, NULL, flags);
+        mapping = (float *) glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, nbytes, flags);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glCheckError();
+
+        if(mapping == NULL){
+            std::cout << "ERROR::VECTOR_FIELD_SEQUENCE::COULD_NOT_MAP_BUFFER of size " << nbytes << std::endl;
+            return;
+        }
+
+        for(unsigned int slot = 0; slot < FIELD_SEQUENCE_SLOTS; slot++){
+            slotKeyframe[slot] = slot;
+            slotReady[slot] = false;
+            loadQueue.push_back(slot);
+        }
+
+        loader = std::thread([this]{ loaderLoop(); });
+    }
+
+    ~VectorFieldSequence()
+    {
+        if(loader.joinable()){
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            loadRequested.notify_all();
+            loader.join();
+        }
+
+        for(unsigned int slot = 0; slot < FIELD_SEQUENCE_SLOTS; slot++){
+            if(slotFence[slot] != NULL)
+                glDeleteSync(slotFence[slot]);
+        }
+
+        if(ssbo != 0){
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+            if(mapping != NULL)
+                glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            glDeleteBuffers(1, &ssbo);
+        }
+    }
+
+    /**
+        @return false if the keyframes could not be found or the ssbo not be mapped
+    */
+    bool good() const {
+        return mapping != NULL;
+    }
+
+    /**
+        @return the number of vectors along the x-axis of every keyframe
+    */
+    int gridWidth() const {
+        return width;
+    }
+
+    /**
+        @return the number of vectors along the y-axis of every keyframe
+    */
+    int gridHeight() const {
+        return height;
+    }
+
+    /**
+        @return the ssbo with the keyframes, to be bound to binding 2
+    */
+    GLuint buffer() const {
+        return ssbo;
+    }
+
+    /**
+        Move the sequence to the given frame and tell the shader which keyframes
+        to mix. Call it before the commands that read the field are issued.
+        @param shader particle.comp compiled with FIELD_SEQUENCE
+        @param frameNbr the frame about to be rendered, one more than the last time
+    */
+    void update(Shader *shader, unsigned int frameNbr){
+        unsigned int keyframe = frameNbr / framesPerKeyframe;
+
+        while(currentKeyframe < keyframe){
+            // Every frame so far that read this slot comes before the fence
+            unsigned int slot = currentKeyframe % FIELD_SEQUENCE_SLOTS;
+            slotFence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            std::unique_lock<std::mutex> lock(mutex);
+            slotKeyframe[slot] = currentKeyframe + FIELD_SEQUENCE_SLOTS;
+            slotReady[slot] = false;
+            currentKeyframe++;
+        }
+
+        // Hand the slots the GPU is done with to the loader
+        for(unsigned int slot = 0; slot < FIELD_SEQUENCE_SLOTS; slot++)
+            releaseSlot(slot, false);
+
+        unsigned int current = keyframe % FIELD_SEQUENCE_SLOTS;
+        unsigned int next = (keyframe + 1) % FIELD_SEQUENCE_SLOTS;
+        releaseSlot(current, true);
+        releaseSlot(next, true);
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            loadFinished.wait(lock, [this, current, next]{ return slotReady[current] && slotReady[next]; });
+        }
+
+        shader->use();
+        // In vectors, the same unit as calcVectorPosition(..)
+        shader->setInt("u_keyframe_a", (int) (current * slotSize() / 2));
+        shader->setInt("u_keyframe_b", (int) (next * slotSize() / 2));
+        shader->setFloat("u_keyframe_mix", (float) (frameNbr % framesPerKeyframe) / framesPerKeyframe);
+    }
+
+private:
+
+    // In floats
+    size_t slotSize() const {
+        return vectorFieldSize(width, height);
+    }
+
+    bool findKeyframes(const std::string &directory){
+        boost::system::error_code error;
+        for(boost::filesystem::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)){
+            if(it->path().extension() == VECTOR_FIELD_CACHE_EXTENSION)
+                files.push_back(it->path().string());
+        }
+        std::sort(files.begin(), files.end());
+
+        if(error || files.empty()){
+            std::cout << "ERROR::VECTOR_FIELD_SEQUENCE::NO_KEYFRAMES in '" << directory << "'" << std::endl;
+            return false;
+        }
+
+        for(const std::string &file : files){
+            VectorFieldCacheHeader header;
+            if(!readVectorFieldHeader(file, header)){
+                std::cout << "ERROR::VECTOR_FIELD_SEQUENCE::NOT_A_FIELD '" << file << "'" << std::endl;
+                return false;
+            }
+
+            if(file == files.front()){
+                width = header.key.width;
+                height = header.key.height;
+            } else if((int) header.key.width != width || (int) header.key.height != height){
+                std::cout << "ERROR::VECTOR_FIELD_SEQUENCE::SIZE_MISMATCH '" << file << "' is "
+                          << header.key.width << "x" << header.key.height << " but '" << files.front()
+                          << "' is " << width << "x" << height << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Give the slot to the loader if the GPU is done with the keyframe that was in it
+    void releaseSlot(unsigned int slot, bool wait){
+        if(slotFence[slot] == NULL)
+            return;
+
+        GLenum status = glClientWaitSync(slotFence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0);
+        if(status == GL_TIMEOUT_EXPIRED)
+            return;
+
+        glDeleteSync(slotFence[slot]);
+        slotFence[slot] = NULL;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            loadQueue.push_back(slot);
+        }
+        loadRequested.notify_one();
+    }
+
+    void loaderLoop(){
+        for(;;){
+            unsigned int slot;
+            unsigned int keyframe;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                loadRequested.wait(lock, [this]{ return stopping || !loadQueue.empty(); });
+                if(stopping)
+                    return;
+                slot = loadQueue.front();
+                loadQueue.pop_front();
+                keyframe = slotKeyframe[slot];
+            }
+
+            float * data = mapping + slot * slotSize();
+            const std::string &file = files[keyframe % files.size()];
+            if(!readVectorFieldFile(file, width, height, data)){
+                std::cout << "ERROR::VECTOR_FIELD_SEQUENCE::COULD_NOT_READ '" << file << "'" << std::endl;
+                std::memset(data, 0, slotSize() * sizeof(float));
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                slotReady[slot] = true;
+            }
+            loadFinished.notify_all();
+        }
+    }
+};
+
+#endif
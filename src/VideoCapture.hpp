@@ -8,6 +8,7 @@
 #include "../include/glad/glad.h" 
 #include "FiniteMathPatch.hpp"
 #include <stdexcept>
+#include <memory>
 #include "GPUPixelReader.hpp"
 
 extern "C" {
@@ -58,6 +59,10 @@ av_always_inline std::string av_ts2timestring(int ts, AVRational *tb) {
     CS-11 Asn 2: Encode video from OpenGL
     @file VideoCapture.hpp
     @author Frank Hampus Weslien
+
+    The frames are either read from OpenGL with recordFrame() or handed over
+    from memory with recordFrame(pixels), as the SoftwareRenderer does. The
+    latter needs no OpenGL context at all.
 */
 class VideoCapture
 {
@@ -71,7 +76,11 @@ public:
                 , unsigned int crf
                 , std::string preset
                 , std::string tune
-                ): gpuPixelReader(3, width, height, GL_BGRA, width * height * 4){
+                , bool fromGPU = true
+                ){
+        // Without it the frames come from recordFrame(pixels)
+        if(fromGPU)
+            gpuPixelReader.reset(new GPUPixelReader(3, width, height, GL_BGRA, width * height * 4));
 
         avformat_alloc_output_context2(&avFormatContext, NULL, NULL, filename);
         if (!avFormatContext) {
@@ -177,7 +186,7 @@ public:
 
         sws = sws_getContext( codec_ctx->width
                             , codec_ctx->height
-                            , AV_PIX_FMT_RGB32
+                            , fromGPU ? AV_PIX_FMT_RGB32 : AV_PIX_FMT_RGBA
                             , codec_ctx->width
                             , codec_ctx->height
                             , AV_PIX_FMT_YUV420P
@@ -214,50 +223,28 @@ public:
     void recordFrame(){
         fflush(stdout);
 
-        /* Make sure the frame data is writable.
-           On the first round, the frame is fresh from av_frame_get_buffer()
-           and therefore we know it is writable.
-           But on the next rounds, encode() will have called
-           avcodec_send_frame(), and the codec may have kept a reference to
-           the frame in its internal structures, that makes the frame
-           unwritable.
-           av_frame_make_writable() checks that and allocates a new buffer
-           for the frame only if necessary.
-         */
-        ret = av_frame_make_writable(frame);
-        if (ret < 0){
-            fprintf(stderr, "Could not make the frame writable\n");
-            exit(1); // Wait... you should throw error instead!
-        }
-
-        int frameNbr = gpuPixelReader.readPixels(pixels);
-
-        if(frameNbr >= 0) {
-            // CONVERT TO YUV AND ENCODE
-            ret =  av_image_alloc(frame->data, frame->linesize, codec_ctx->width, codec_ctx->height, AV_PIX_FMT_YUV420P, 32);
-            if (ret < 0){
-                fprintf(stderr, "Could not allocate the image\n");
-                exit(1); // Wait... you should throw error instead!
-            }
-
-            // Compensate for OpenGL y-axis pointing upwards and ffmpeg y-axis pointing downwards        
-            uint8_t *in_data[1] = {(uint8_t *) pixels + (codec_ctx->height-1)*codec_ctx->width*4}; // address of the last line
-            int in_linesize[1] = {- codec_ctx->width * 4}; // negative stride
-
-            sws_scale(sws, in_data, in_linesize, 0, codec_ctx->height, frame->data, frame->linesize);
+        int frameNbr = gpuPixelReader->readPixels(pixels);
 
-            frame->pts = frameNbr;
+        if(frameNbr >= 0)
+            encodeFrame(pixels, frameNbr);
+    }
 
-            /* encode the image */
-            write_frame(avFormatContext, codec_ctx, avStream, frame, pkt);
-        }
+    /**
+     * Write a frame from memory to the video stream, the object must have been
+     * created with fromGPU false.
+     *
+     * @param rgba 4 bytes RGBA per pixel with the bottom row first, like glReadPixels(..) gives them
+     */
+    void recordFrame(const uint8_t *rgba){
+        fflush(stdout);
+        encodeFrame(rgba, nextPts++);
     }
 
     void close()
     {
         // Since the gpuPixelReader is always a few frames behind we have to flush
         // make sure that we get all the frames
-        for(int i = 0; i < gpuPixelReader.getNbrPBOs(); i++){
+        for(int i = 0; gpuPixelReader && i < gpuPixelReader->getNbrPBOs(); i++){
             recordFrame();
         }
 
@@ -278,7 +265,9 @@ public:
 
 private:
 
-    GPUPixelReader gpuPixelReader;
+    std::unique_ptr<GPUPixelReader> gpuPixelReader;
+    // The pts of the next frame from recordFrame(pixels)
+    int64_t nextPts = 0;
 
     AVOutputFormat *avOutputFormat;
     AVFormatContext* avFormatContext = NULL;
@@ -298,6 +287,48 @@ private:
     int ret;
 
 
+    /**
+     * Convert the pixels to YUV and encode them
+     *
+     * @param rgba the pixels, in the format sws was made for, with the bottom row first
+     * @param pts the number of the frame in the video
+     */
+    void encodeFrame(const uint8_t *rgba, int64_t pts){
+        /* Make sure the frame data is writable.
+           On the first round, the frame is fresh from av_frame_get_buffer()
+           and therefore we know it is writable.
+           But on the next rounds, encode() will have called
+           avcodec_send_frame(), and the codec may have kept a reference to
+           the frame in its internal structures, that makes the frame
+           unwritable.
+           av_frame_make_writable() checks that and allocates a new buffer
+           for the frame only if necessary.
+         */
+        ret = av_frame_make_writable(frame);
+        if (ret < 0){
+            fprintf(stderr, "Could not make the frame writable\n");
+            exit(1); // Wait... you should throw error instead!
+        }
+
+        // CONVERT TO YUV AND ENCODE
+        ret =  av_image_alloc(frame->data, frame->linesize, codec_ctx->width, codec_ctx->height, AV_PIX_FMT_YUV420P, 32);
+        if (ret < 0){
+            fprintf(stderr, "Could not allocate the image\n");
+            exit(1); // Wait... you should throw error instead!
+        }
+
+        // Compensate for OpenGL y-axis pointing upwards and ffmpeg y-axis pointing downwards        
+        uint8_t *in_data[1] = {(uint8_t *) rgba + (codec_ctx->height-1)*codec_ctx->width*4}; // address of the last line
+        int in_linesize[1] = {- codec_ctx->width * 4}; // negative stride
+
+        sws_scale(sws, in_data, in_linesize, 0, codec_ctx->height, frame->data, frame->linesize);
+
+        frame->pts = pts;
+
+        /* encode the image */
+        write_frame(avFormatContext, codec_ctx, avStream, frame, pkt);
+    }
+
     int write_frame(AVFormatContext *fmt_ctx, AVCodecContext *c,
                         AVStream *st, AVFrame *frame, AVPacket *pkt)
     {
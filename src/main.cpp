@@ -1,7 +1,5 @@
 #include <iostream>
 #include <cmath>
-#include <functional>
-#include <tuple>
 
 #include "../include/glad/glad.h" 
 #include <GLFW/glfw3.h>
@@ -17,35 +15,84 @@
 #include "CmdOptions.hpp"
 #include "ScreenShooter.hpp"
 #include "VideoCapture.hpp"
-#include "VectorFieldFunctions.hpp"
+#include "VectorField.hpp"
+#include "FieldExpression.hpp"
+#include "FieldSdf.hpp"
+#include "FieldImage.hpp"
+#include "VectorFieldCache.hpp"
+#include "GPUFieldBuilder.hpp"
+#include "VectorFieldSequence.hpp"
+#include "VectorFieldMorph.hpp"
+#include "SparseVectorField.hpp"
+#include "AdaptiveVectorField.hpp"
+#include "FieldLayoutBenchmark.hpp"
+#include "FieldAnalysis.hpp"
+#include "FieldEdits.hpp"
+#include "CompactParticles.hpp"
+#include "CpuParticleSystem.hpp"
+#include "ParticleDispatch.hpp"
+#include "ParticleSeeder.hpp"
+#include "SoftwareRenderer.hpp"
+#include "ThreadPool.hpp"
 
 #include <boost/random.hpp>
+#include <memory>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
 
-struct VectorField {
-    std::vector<float> data;
-    int width;
-    int height;
+// Where the vector field lives
+enum FieldStorage {
+    FIELD_STORAGE_MAPPED,   // an ssbo the CPU writes to through a persistent mapping
+    FIELD_STORAGE_GPU,      // an ssbo, or texture, only the GPU writes to
+    FIELD_STORAGE_NONE,     // nowhere, particle.comp evaluates the field function itself
+    FIELD_STORAGE_SEQUENCE, // in the ring of keyframes owned by a VectorFieldSequence
+    FIELD_STORAGE_MORPH,    // in the slots of a VectorFieldMorph, one field per function
+    FIELD_STORAGE_SPARSE,   // in the tiles owned by a SparseVectorField, built when first read
+    FIELD_STORAGE_ADAPTIVE, // in the quadtrees owned by an AdaptiveVectorField
+    FIELD_STORAGE_PERIODIC, // one period of the field in an ssbo like FIELD_STORAGE_MAPPED, particle.comp repeats it
+    FIELD_STORAGE_HOST      // only in the CPU's memory, for the particles of a CpuParticleSystem
 };
 
 struct ParticleSystem { 
     Shader * shader;
-    VectorField * vectorField;
+    // Points into the persistently mapped ssbo, data is NULL for the other kinds of storage
+    VectorField vectorField;
     unsigned int ssbo;
+    FieldStorage storage;
+    // The field as read by particle.comp with --field-format rg16f or rg32f, 0 otherwise.
+    // The ssbo is then only where the CPU builds it, and is deleted after the upload.
+    GLuint texture;
 };
 
-std::function<std::tuple<float, float>(float, float, float, float)> createVectorFieldFn(unsigned int functionNbr);
-VectorField createVectorField(int vectorWidthGrid, int vectorHeightGrid, std::function<std::tuple<float, float>(float, float, float, float)> f);
-ParticleSystem initParticleSystem(Shader * particleComputeShader, VectorField *vectorField);
-void updateParticleSystem(ParticleSystem *particleSystem, VectorField *vectorField);
+// The texture unit particle.comp samples the vector field texture from
+#define FIELD_TEXTURE_UNIT 2
+
+std::string fieldImageDescription();
+VectorFieldCacheKey fieldCacheKey(int vectorWidthGrid, int vectorHeightGrid);
+void createVectorField(ThreadPool *threadPool, VectorFieldCache *fieldCache, VectorField *vectorField, const FieldKernel *kernel);
+bool fieldPeriod(const FieldKernel *kernel, int vectorWidthGrid, int vectorHeightGrid, int *periodWidth, int *periodHeight);
+bool allocateVectorFieldBuffer(GLuint ssbo, int vectorWidthGrid, int vectorHeightGrid, bool mapped, VectorField *vectorField);
+GLenum fieldTextureFormat();
+GLuint createVectorFieldTexture(int vectorWidthGrid, int vectorHeightGrid, GLenum textureFormat, bool repeat);
+void uploadVectorFieldTexture(ParticleSystem *particleSystem);
+ParticleSystem initParticleSystem(Shader * particleComputeShader, int vectorWidthGrid, int vectorHeightGrid, FieldStorage storage, GLenum textureFormat, int periodWidth, int periodHeight);
+void animateVectorField(ParticleSystem *particleSystem, ThreadPool *threadPool, GPUFieldBuilder *gpuFieldBuilder, VectorFieldSequence *fieldSequence, VectorFieldMorph *fieldMorph, SparseVectorField *sparseField, unsigned int frameNbr);
+void editVectorField(GLFWwindow *window, ThreadPool *threadPool, FieldEditor *fieldEditor, const std::vector<ScriptedFieldEdit> &scriptedEdits, size_t *nextEdit, unsigned int frameNbr);
+void createParticles(std::vector<float> *positions, std::vector<float> *colors);
+void createCompactParticles(CompactParticles *particles, int vectorWidthGrid, int vectorHeightGrid);
+VectorField createHostVectorField(ThreadPool *threadPool, VectorFieldCache *fieldCache, const FieldKernel *kernel, int vectorWidthGrid, int vectorHeightGrid, bool periodic, int periodWidth, int periodHeight, std::vector<float> *data);
+ParticleStepParams particleStepParams(const VectorField &hostField, int vectorWidthGrid, int vectorHeightGrid);
+int renderOnCpu(const FieldKernel *kernel, bool fieldPeriodic, int fieldPeriodWidth, int fieldPeriodHeight);
+bool checkParticleBackend(Shader *particleComputeShader, unsigned int particleLocalSize, ThreadPool *threadPool, const std::vector<float> &positions, const std::vector<float> &colors, const ParticleStepParams &params);
 
 void renderFrame( GLFWwindow*  window
                 , unsigned int frameNbr
                 , Shader *particleComputeShader
+                , unsigned int particleLocalSize
                 , GLuint PARTICLE_VAO
                 , GLuint PARTICLE_VBO // Necessary???
+                , GLuint PARTICLE_COLOR_VBO
                 , GLuint particleFBO
                 , Shader *particleShader
                 , GLuint particleTexture
@@ -56,6 +103,8 @@ void renderFrame( GLFWwindow*  window
                 , GLuint backgroundTextures[]
                 , Shader *postprocessingShader
                 , GLuint POST_PROCESSING_VAO
+                , CpuParticleSystem *cpuParticles
+                , ThreadPool *threadPool
                 );
 
 // timing
@@ -86,14 +135,157 @@ int main(int argc, char **argv)
         return EXIT_SUCCESS;
     }
 
+    if(cmdOptions.field_isa != "auto"){
+        FieldIsa isa = FIELD_ISA_SCALAR;
+        if(cmdOptions.field_isa == "sse4.1")
+            isa = FIELD_ISA_SSE41;
+        else if(cmdOptions.field_isa == "avx2")
+            isa = FIELD_ISA_AVX2;
+        else if(cmdOptions.field_isa == "avx512")
+            isa = FIELD_ISA_AVX512;
+
+        if(!setFieldIsa(isa)){
+            std::cout << "WARNING: '--field-isa " << cmdOptions.field_isa << "' is not supported by this CPU" << '\n';
+            return EXIT_FAILURE;
+        }
+    }
+
+    // The expressions are compiled once, up front, so that mistakes show up before the window
+    const FieldKernel * vectorFieldKernel = fieldKernel(cmdOptions.vector_field_function);
+    std::unique_ptr<FieldExpressionKernel> expressionKernel;
+    if(!cmdOptions.field_x.empty()){
+        std::string error;
+        expressionKernel.reset(new FieldExpressionKernel());
+        if(!expressionKernel->compile(cmdOptions.field_x, cmdOptions.field_y, error)){
+            std::cout << "ERROR::FIELD_EXPRESSION::COMPILATION_FAILED\n" << error << std::endl;
+            return EXIT_FAILURE;
+        }
+        vectorFieldKernel = expressionKernel.get();
+    }
+    if(!cmdOptions.field_sdf.empty()){
+        std::string error;
+        FieldSdfKernel * sdfKernel = new FieldSdfKernel();
+        expressionKernel.reset(sdfKernel);
+        if(!sdfKernel->compile(cmdOptions.field_sdf, error)){
+            std::cout << "ERROR::FIELD_SDF::COMPILATION_FAILED\n" << error << std::endl;
+            return EXIT_FAILURE;
+        }
+        vectorFieldKernel = expressionKernel.get();
+    }
+    std::unique_ptr<ImageFieldKernel> imageKernel;
+    if(!cmdOptions.field_image.empty()){
+        std::string error;
+        ThreadPool threadPool(cmdOptions.nbr_threads);
+        imageKernel.reset(new ImageFieldKernel());
+        if(!imageKernel->load( cmdOptions.field_image
+                             , threadPool
+                             , cmdOptions.field_image_blur
+                             , cmdOptions.field_image_mode == "along"
+                             , cmdOptions.field_image_strength
+                             , error)){
+            std::cout << "ERROR::FIELD_IMAGE::LOADING_FAILED " << error << std::endl;
+            return EXIT_FAILURE;
+        }
+        vectorFieldKernel = imageKernel.get();
+    }
+
+    std::vector<ScriptedFieldEdit> scriptedEdits;
+    if(!cmdOptions.field_edits.empty()){
+        std::string error;
+        if(!loadFieldEdits(cmdOptions.field_edits, cmdOptions.vectorGridWidth(), cmdOptions.vectorGridHeight(), scriptedEdits, error)){
+            std::cout << "ERROR::FIELD_EDITS::LOADING_FAILED " << error << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(cmdOptions.check_field_kernels && cmdOptions.field_backend == "cpu"){
+        bool passed = expressionKernel
+                    ? checkFieldKernel(*expressionKernel, cmdOptions.fieldSampleWidth(), cmdOptions.fieldSampleHeight())
+                    : checkFieldKernels(cmdOptions.fieldSampleWidth(), cmdOptions.fieldSampleHeight());
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if(cmdOptions.benchmark_field_layout){
+        ThreadPool threadPool(cmdOptions.nbr_threads);
+        benchmarkFieldLayouts( threadPool
+                             , *vectorFieldKernel
+                             , cmdOptions.vectorGridWidth()
+                             , cmdOptions.vectorGridHeight()
+                             , cmdOptions.nbr_particles
+                             , cmdOptions.speed * 30.0f / cmdOptions.fps
+                             );
+        return EXIT_SUCCESS;
+    }
+
+    // A field that repeats itself is stored one period at a time, at full resolution
+    int fieldPeriodWidth, fieldPeriodHeight;
+    bool fieldPeriodic = fieldPeriod(vectorFieldKernel, cmdOptions.fieldSampleWidth(), cmdOptions.fieldSampleHeight(), &fieldPeriodWidth, &fieldPeriodHeight);
+
+    if(cmdOptions.fieldResolutionCapped() && !fieldPeriodic){
+        size_t fullSize = vectorFieldSize(cmdOptions.fieldSampleWidth(), cmdOptions.fieldSampleHeight());
+        size_t cappedSize = vectorFieldSize(cmdOptions.vectorGridWidth(), cmdOptions.vectorGridHeight());
+        std::cout << "The vector field has " << (float) cmdOptions.vectors_per_ratio / cmdOptions.pixels_per_ratio
+                  << " vectors per pixel, more than the particles can resolve. It is built at "
+                  << cmdOptions.vectorGridWidth() << "x" << cmdOptions.vectorGridHeight() << " instead of "
+                  << cmdOptions.fieldSampleWidth() << "x" << cmdOptions.fieldSampleHeight() << ", which saves "
+                  << (fullSize - cappedSize) * sizeof(float) / (1024 * 1024) << " MB. Use '--full-field-resolution' to build all of it."
+                  << std::endl;
+    }
+
+    if(!cmdOptions.export_field.empty()){
+        int width = cmdOptions.vectorGridWidth();
+        int height = cmdOptions.vectorGridHeight();
+        VectorFieldCacheKey key = fieldCacheKey(width, height);
+        ThreadPool threadPool(cmdOptions.nbr_threads);
+        std::vector<float> data(vectorFieldSize(width, height));
+        VectorField vectorField = { data.data(), width, height };
+        buildVectorField(threadPool, vectorField, *vectorFieldKernel, key.sampleWidth, key.sampleHeight);
+
+        if(!writeVectorFieldFile(cmdOptions.export_field, key, data.data())){
+            std::cout << "ERROR::VECTOR_FIELD::COULD_NOT_WRITE '" << cmdOptions.export_field << "'" << std::endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    // The same field as the particles get, without a window
+    if(!cmdOptions.analyze_field.empty()){
+        int width = cmdOptions.vectorGridWidth();
+        int height = cmdOptions.vectorGridHeight();
+        VectorFieldCacheKey key = fieldCacheKey(width, height);
+        ThreadPool threadPool(cmdOptions.nbr_threads);
+        std::vector<float> data(vectorFieldSize(width, height));
+        VectorField vectorField = { data.data(), width, height };
+        buildVectorField(threadPool, vectorField, *vectorFieldKernel, key.sampleWidth, key.sampleHeight);
+
+        std::string name = !cmdOptions.field_image.empty() ? cmdOptions.field_image
+                         : !cmdOptions.field_sdf.empty() ? cmdOptions.field_sdf
+                         : expressionKernel ? cmdOptions.field_x + ", " + cmdOptions.field_y
+                         : std::to_string(cmdOptions.vector_field_function);
+        bool written = analyzeField( threadPool
+                                   , vectorField
+                                   , name
+                                   , cmdOptions.speed * 30.0f / cmdOptions.fps
+                                   , cmdOptions.fps * cmdOptions.lengthInSeconds
+                                   , cmdOptions.analyze_field
+                                   );
+        return written ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Everything on the CPU, without a window
+    if(cmdOptions.render_backend == "cpu")
+        return renderOnCpu(vectorFieldKernel, fieldPeriodic, fieldPeriodWidth, fieldPeriodHeight);
+
 
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4); // glBufferStorage
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_SAMPLES, 4);
+    // The GPU check only needs the context
+    glfwWindowHint(GLFW_VISIBLE, !cmdOptions.check_field_kernels && !cmdOptions.check_particle_backend);
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
@@ -118,6 +310,12 @@ int main(int argc, char **argv)
         return -1;
     }
 
+    if(cmdOptions.check_field_kernels){
+        bool passed = checkGPUField(cmdOptions.shaderPath, cmdOptions.vectorGridWidth(), cmdOptions.vectorGridHeight());
+        glfwTerminate();
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     // configure global OpenGL state
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
@@ -130,9 +328,28 @@ int main(int argc, char **argv)
 
     // Build and compile our shader programs
     // ------------------------------------
-    Shader particleComputeShader((cmdOptions.shaderPath + "/particle.comp").c_str());
+    // An analytic field is compiled into the particle shader
+    std::string particleDefines = fieldLayoutDefine();
+    if(cmdOptions.field_backend == "analytic")
+        particleDefines += "#define ANALYTIC_FIELD\n#define FIELD_FUNCTION " + std::to_string(cmdOptions.vector_field_function) + "\n";
+    else if(!cmdOptions.field_sequence.empty() || !cmdOptions.field_morph.empty())
+        particleDefines += "#define FIELD_SEQUENCE\n";
+    else if(cmdOptions.sparse_field)
+        particleDefines += SparseVectorField::shaderDefines();
+    else if(cmdOptions.adaptive_field)
+        particleDefines += AdaptiveVectorField::shaderDefines();
+    else if(fieldTextureFormat() != 0)
+        particleDefines += "#define FIELD_TEXTURE\n";
+    if(fieldPeriodic)
+        particleDefines += "#define FIELD_PERIODIC\n";
+    // Both shaders decode the packed particles
+    std::string particleFormatDefines = cmdOptions.particle_format == "compact" ? compactParticleShaderDefines() : "";
+    particleDefines += particleFormatDefines;
+    // 'auto' starts out with the default and is tuned once everything is set up
+    unsigned int particleLocalSize = cmdOptions.particle_local_size == "auto" ? PARTICLE_DEFAULT_LOCAL_SIZE : std::stoul(cmdOptions.particle_local_size);
+    Shader particleComputeShader((cmdOptions.shaderPath + "/particle.comp").c_str(), particleDefines + particleLocalSizeDefine(particleLocalSize));
     glCheckError(); 
-    Shader particleShader((cmdOptions.shaderPath +"/particle.vert").c_str(), (cmdOptions.shaderPath +"/particle.frag").c_str());
+    Shader particleShader((cmdOptions.shaderPath +"/particle.vert").c_str(), (cmdOptions.shaderPath +"/particle.frag").c_str(), particleFormatDefines);
     glCheckError(); 
     Shader postprocessingTrailShader( (cmdOptions.shaderPath +"/post-processing.vert").c_str(), (cmdOptions.shaderPath + "/post-processing-trail.frag").c_str() );
     glCheckError(); 
@@ -142,59 +359,249 @@ int main(int argc, char **argv)
     // Vector Field
     // ------------------------------------
 
-    std::function<std::tuple<float, float>(float, float, float, float)> vectorFieldFn = createVectorFieldFn(cmdOptions.vector_field_function); 
-
-    VectorField vectorField = createVectorField(cmdOptions.vectorGridWidth(), cmdOptions.vectorGridHeight(), vectorFieldFn);
-
-    // It probably copies the shader here...
-    ParticleSystem pSystem = initParticleSystem(&particleComputeShader, &vectorField);
+    ThreadPool threadPool(cmdOptions.nbr_threads);
+    VectorFieldCache fieldCache(cmdOptions.field_cache, (uint64_t) cmdOptions.field_cache_max_mb * 1024 * 1024);
+
+    std::unique_ptr<GPUFieldBuilder> gpuFieldBuilder;
+    if(cmdOptions.field_backend == "gpu"){
+        gpuFieldBuilder.reset(new GPUFieldBuilder( cmdOptions.shaderPath
+                                                 , cmdOptions.vector_field_function
+                                                 , cmdOptions.field_orbit_radius * cmdOptions.vectorGridHeight()
+                                                 , cmdOptions.field_orbit_period
+                                                 , fieldTextureFormat()
+                                                 ));
+    }
 
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    // Only the CPU writes to the ssbo through a mapping, the GPU gets memory it can read faster
+    FieldStorage fieldStorage = FIELD_STORAGE_MAPPED;
+    if(cmdOptions.particle_backend == "cpu")
+        fieldStorage = FIELD_STORAGE_HOST;
+    else if(cmdOptions.field_backend == "gpu")
+        fieldStorage = FIELD_STORAGE_GPU;
+    else if(cmdOptions.field_backend == "analytic")
+        fieldStorage = FIELD_STORAGE_NONE;
+    else if(!cmdOptions.field_sequence.empty())
+        fieldStorage = FIELD_STORAGE_SEQUENCE;
+    else if(!cmdOptions.field_morph.empty())
+        fieldStorage = FIELD_STORAGE_MORPH;
+    else if(cmdOptions.sparse_field)
+        fieldStorage = FIELD_STORAGE_SPARSE;
+    else if(cmdOptions.adaptive_field)
+        fieldStorage = FIELD_STORAGE_ADAPTIVE;
+    else if(fieldPeriodic)
+        fieldStorage = FIELD_STORAGE_PERIODIC;
+
+    // One period is small, so it is built at full resolution
+    int vectorWidthGrid = fieldPeriodic ? cmdOptions.fieldSampleWidth() : cmdOptions.vectorGridWidth();
+    int vectorHeightGrid = fieldPeriodic ? cmdOptions.fieldSampleHeight() : cmdOptions.vectorGridHeight();
+
+    std::unique_ptr<VectorFieldSequence> fieldSequence;
+    if(fieldStorage == FIELD_STORAGE_SEQUENCE){
+        fieldSequence.reset(new VectorFieldSequence(cmdOptions.field_sequence, cmdOptions.field_sequence_frames));
+        if(!fieldSequence->good()){
+            std::cout << "Failed to load the vector field sequence" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        // The keyframes decide the size of the grid
+        vectorWidthGrid = fieldSequence->gridWidth();
+        vectorHeightGrid = fieldSequence->gridHeight();
+    }
 
-    // Particles
-    // ------------------------------------
-    std::vector<float> particles;
+    // The fixed point positions of the packed particles only reach so far
+    if(cmdOptions.particle_format == "compact" && std::max(vectorWidthGrid, vectorHeightGrid) > COMPACT_PARTICLE_MAX_GRID){
+        std::cout << "ERROR::PARTICLES::GRID_TOO_LARGE_FOR_COMPACT_FORMAT the grid is " << vectorWidthGrid << "x" << vectorHeightGrid
+                  << " vectors, '--particle-format compact' holds up to " << COMPACT_PARTICLE_MAX_GRID << " per side, lower '--vectors-per-ratio'" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
 
-    // To be able to reproduce a video we make sure to use a known seed
-    // so that all particles get initalized to the exact same locations.
-    boost::mt19937 rng(1000);    
-    boost::uniform_real<> placeDistribution(-1.0f, 1.0f);
-    boost::variate_generator<boost::mt19937&, boost::uniform_real<> >
-           rngPlace(rng, placeDistribution); 
+    std::unique_ptr<VectorFieldMorph> fieldMorph;
+    if(fieldStorage == FIELD_STORAGE_MORPH){
+        fieldMorph.reset(new VectorFieldMorph( cmdOptions.field_morph
+                                             , vectorWidthGrid
+                                             , vectorHeightGrid
+                                             , cmdOptions.field_morph_hold
+                                             , cmdOptions.field_morph_frames
+                                             , cmdOptions.field_morph_curve == "smooth"
+                                             ));
+        VectorFieldCacheKey key = fieldCacheKey(vectorWidthGrid, vectorHeightGrid);
+        if(!fieldMorph->build(threadPool, fieldCache, key.sampleWidth, key.sampleHeight)){
+            glfwTerminate();
+            return -1;
+        }
+        std::cout << "The " << cmdOptions.field_morph.size() << " vector fields of '--field-morph' take "
+                  << fieldMorph->bufferBytes() / (1024 * 1024) << " MB of graphics memory" << std::endl;
+    }
 
-    float timeToLive = cmdOptions.fps * cmdOptions.lengthInSeconds;
+    std::unique_ptr<SparseVectorField> sparseField;
+    if(fieldStorage == FIELD_STORAGE_SPARSE){
+        sparseField.reset(new SparseVectorField( vectorFieldKernel
+                                               , vectorWidthGrid
+                                               , vectorHeightGrid
+                                               , (uint64_t) cmdOptions.sparse_field_gpu_mb * 1024 * 1024
+                                               , (uint64_t) cmdOptions.sparse_field_cache_mb * 1024 * 1024
+                                               ));
+        if(!sparseField->good()){
+            glfwTerminate();
+            return -1;
+        }
+        std::cout << "The vector field is " << sparseField->nbrTiles() << " tiles of " << SPARSE_FIELD_TILE_SIZE << "x"
+                  << SPARSE_FIELD_TILE_SIZE << " vectors, " << sparseField->nbrSlots() << " of them fit in graphics memory" << std::endl;
+    }
 
-    for(int i = 0; i < cmdOptions.nbr_particles; i++){
+    std::unique_ptr<AdaptiveVectorField> adaptiveField;
+    if(fieldStorage == FIELD_STORAGE_ADAPTIVE){
+        adaptiveField.reset(new AdaptiveVectorField(vectorFieldKernel, vectorWidthGrid, vectorHeightGrid, cmdOptions.adaptive_field_tolerance));
+        adaptiveField->build(threadPool);
+        if(!adaptiveField->good()){
+            glfwTerminate();
+            return -1;
+        }
+        std::cout << "The vector field is " << adaptiveField->nbrCornerLeaves() << " interpolated cells and "
+                  << adaptiveField->nbrBrickLeaves() << " bricks of " << ADAPTIVE_FIELD_BRICK_SIZE << "x" << ADAPTIVE_FIELD_BRICK_SIZE
+                  << " vectors, " << adaptiveField->bufferBytes() / 1024 << " KB instead of "
+                  << vectorFieldSize(vectorWidthGrid, vectorHeightGrid) * sizeof(float) / 1024 << " KB for the whole grid" << std::endl;
+    }
 
-        // Start position
-        particles.push_back(rngPlace());
-        particles.push_back(rngPlace());
+    // It probably copies the shader here...
+    ParticleSystem pSystem = initParticleSystem(&particleComputeShader, vectorWidthGrid, vectorHeightGrid, fieldStorage, fieldTextureFormat(), fieldPeriodWidth, fieldPeriodHeight);
+    if(fieldTextureFormat() != 0 && pSystem.texture == 0){
+        glfwTerminate();
+        return -1;
+    }
+    // The CPU writes the field through the mapping
+    if((fieldStorage == FIELD_STORAGE_MAPPED || fieldStorage == FIELD_STORAGE_PERIODIC) && pSystem.vectorField.data == NULL){
+        glfwTerminate();
+        return -1;
+    }
 
-        // Loop
-        particles.push_back(0.0f); // looping isn't used anymore...
-        particles.push_back(timeToLive);
+    if(fieldStorage == FIELD_STORAGE_GPU){
+        gpuFieldBuilder->build(pSystem.texture != 0 ? pSystem.texture : pSystem.ssbo, cmdOptions.vectorGridWidth(), cmdOptions.vectorGridHeight(), 0.0f);
+    } else if(fieldStorage == FIELD_STORAGE_MAPPED){
+        // The field is written straight into the mapped ssbo, there is no copy on the host
+        createVectorField(&threadPool, &fieldCache, &pSystem.vectorField, vectorFieldKernel);
+        if(pSystem.texture != 0)
+            uploadVectorFieldTexture(&pSystem);
+    } else if(fieldStorage == FIELD_STORAGE_SEQUENCE){
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, fieldSequence->buffer());
+    } else if(fieldStorage == FIELD_STORAGE_MORPH){
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, fieldMorph->buffer());
+    } else if(fieldStorage == FIELD_STORAGE_SPARSE){
+        sparseField->bind();
+    } else if(fieldStorage == FIELD_STORAGE_ADAPTIVE){
+        adaptiveField->bind();
+    } else if(fieldStorage == FIELD_STORAGE_PERIODIC){
+        buildPeriodicVectorField(threadPool, pSystem.vectorField, *vectorFieldKernel, vectorWidthGrid, vectorHeightGrid);
+        if(pSystem.texture != 0)
+            uploadVectorFieldTexture(&pSystem);
+        std::cout << "The vector field repeats itself every " << fieldPeriodWidth << "x" << fieldPeriodHeight
+                  << " vectors, only those are built, " << vectorFieldSize(fieldPeriodWidth, fieldPeriodHeight) * sizeof(float) / 1024
+                  << " KB instead of " << vectorFieldSize(vectorWidthGrid, vectorHeightGrid) * sizeof(float) / (1024 * 1024)
+                  << " MB for the whole grid" << std::endl;
+    }
 
-        // Color
-        particles.push_back(cmdOptions.particle_color.x);
-        particles.push_back(cmdOptions.particle_color.y);
-        particles.push_back(cmdOptions.particle_color.z);
-        particles.push_back(cmdOptions.particle_color.w);
+    // The CPU moves the particles, the field never has to go to the GPU
+    std::vector<float> hostFieldData;
+    VectorField hostField = { NULL, vectorWidthGrid, vectorHeightGrid };
+    if(fieldStorage == FIELD_STORAGE_HOST)
+        hostField = createHostVectorField(&threadPool, &fieldCache, vectorFieldKernel, vectorWidthGrid, vectorHeightGrid, fieldPeriodic, fieldPeriodWidth, fieldPeriodHeight, &hostFieldData);
+    // A sparse field isn't animated, but its tiles are brought in before every frame the same way
+    bool animateField = cmdOptions.field_orbit_radius != 0.0f || fieldSequence || fieldMorph || sparseField;
+
+    // Edits only rebuild the part of the field they change
+    std::unique_ptr<FieldEditor> fieldEditor;
+    size_t nextEdit = 0;
+    if(!cmdOptions.field_edits.empty() || cmdOptions.field_brush){
+        VectorFieldCacheKey key = fieldCacheKey(vectorWidthGrid, vectorHeightGrid);
+        fieldEditor.reset(new FieldEditor(vectorFieldKernel, pSystem.vectorField, pSystem.texture, key.sampleWidth, key.sampleHeight));
     }
 
-    unsigned int PARTICLE_VAO, PARTICLE_VBO;
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+
+    // Particles
+    // ------------------------------------
+    // With --particle-format compact they are packed straight away, there is no copy as floats.
+    // With --particle-init philox particle-init.comp writes them into the buffers instead,
+    // unless the CPU moves them.
+    const bool compactParticles = cmdOptions.particle_format == "compact";
+    const bool seedOnGpu = cmdOptions.particle_init == "philox" && fieldStorage != FIELD_STORAGE_HOST;
+    const GLsizeiptr nbrParticles = cmdOptions.nbr_particles;
+    std::vector<float> particlePositions, particleColors;
+    CompactParticles packedParticles;
+    if(compactParticles && !seedOnGpu)
+        createCompactParticles(&packedParticles, vectorWidthGrid, vectorHeightGrid);
+    else if(!seedOnGpu)
+        createParticles(&particlePositions, &particleColors);
+
+    // The positions and the colors are in buffers of their own, particle.comp reads and
+    // writes the positions every frame but only writes the colors in color modes 1-3.
+    // The packed loop is only read by particle.comp, so it is not drawn from.
+    unsigned int PARTICLE_VAO, PARTICLE_VBO, PARTICLE_COLOR_VBO = 0, PARTICLE_LIFETIME_SSBO = 0;
     
     glGenVertexArrays(1, &PARTICLE_VAO);
     glGenBuffers(1, &PARTICLE_VBO);
     glBindVertexArray(PARTICLE_VAO);
     glBindBuffer(GL_ARRAY_BUFFER, PARTICLE_VBO);
-    glBufferData(GL_ARRAY_BUFFER, particles.size() * 4, particles.data(), GL_DYNAMIC_DRAW);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*) (4 * sizeof(float)));
+    if(compactParticles){
+        glBufferData(GL_ARRAY_BUFFER, nbrParticles * 2 * sizeof(int32_t), seedOnGpu ? NULL : packedParticles.positions.data(), GL_DYNAMIC_DRAW);
+        glVertexAttribIPointer(0, 2, GL_INT, 2 * sizeof(int32_t), (void*)0);
+
+        glGenBuffers(1, &PARTICLE_LIFETIME_SSBO);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, PARTICLE_LIFETIME_SSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, nbrParticles * sizeof(uint32_t), seedOnGpu ? NULL : packedParticles.lifetimes.data(), GL_STATIC_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, PARTICLE_LIFETIME_SSBO);
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, nbrParticles * 4 * sizeof(float), seedOnGpu ? NULL : particlePositions.data(), GL_DYNAMIC_DRAW);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+    }
     // Allow particle.comp to update the particle positions
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, PARTICLE_VBO);
 
+    if(cmdOptions.colorMode != 0){
+        glGenBuffers(1, &PARTICLE_COLOR_VBO);
+        glBindBuffer(GL_ARRAY_BUFFER, PARTICLE_COLOR_VBO);
+        if(compactParticles){
+            glBufferData(GL_ARRAY_BUFFER, nbrParticles * sizeof(uint32_t), seedOnGpu ? NULL : packedParticles.colors.data(), GL_DYNAMIC_DRAW);
+            glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(uint32_t), (void*)0);
+        } else {
+            glBufferData(GL_ARRAY_BUFFER, nbrParticles * 4 * sizeof(float), seedOnGpu ? NULL : particleColors.data(), GL_DYNAMIC_DRAW);
+            glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+        }
+        glEnableVertexAttribArray(1);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, PARTICLE_COLOR_VBO);
+    } else {
+        // Every particle keeps the color it started with, the same for all of them
+        glDisableVertexAttribArray(1);
+        glVertexAttrib4f( 1
+                        , cmdOptions.particle_color.x
+                        , cmdOptions.particle_color.y
+                        , cmdOptions.particle_color.z
+                        , cmdOptions.particle_color.w
+                        );
+    }
+    if(seedOnGpu){
+        GPUParticleSeeder seeder(cmdOptions.shaderPath, compactParticles);
+        seeder.seed( PARTICLE_VBO
+                   , PARTICLE_COLOR_VBO
+                   , PARTICLE_LIFETIME_SSBO
+                   , cmdOptions.nbr_particles
+                   , cmdOptions.particle_seed
+                   , cmdOptions.fps * cmdOptions.lengthInSeconds
+                   , cmdOptions.particle_color
+                   , vectorWidthGrid
+                   , vectorHeightGrid
+                   );
+    }
+    // Only graphics memory holds them from here on
+    packedParticles = CompactParticles();
+    glCheckError();
+
+    std::unique_ptr<CpuParticleSystem> cpuParticles;
+    if(fieldStorage == FIELD_STORAGE_HOST)
+        cpuParticles.reset(new CpuParticleSystem(particlePositions, particleColors, particleStepParams(hostField, vectorWidthGrid, vectorHeightGrid)));
+
     // Particles FBO to be used for post-processing
     // -----------------------------------------------
     GLuint particleFBO;
@@ -305,12 +712,43 @@ int main(int argc, char **argv)
     particleComputeShader.setFloat("u_probability_to_die", cmdOptions.probability_to_die);
     particleComputeShader.setVec2f("u_angle_vector", cmdOptions.cosColorAnglePos);
     particleComputeShader.setFloat("u_speed", cmdOptions.speed);
+    particleComputeShader.setUint("u_nbr_particles", cmdOptions.nbr_particles);
+    if(fieldStorage == FIELD_STORAGE_NONE){
+        particleComputeShader.setFloat("u_field_time", 0.0f);
+        particleComputeShader.setFloat("u_orbit_radius", cmdOptions.field_orbit_radius * cmdOptions.vectorGridHeight());
+        particleComputeShader.setFloat("u_orbit_period", cmdOptions.field_orbit_period);
+    }
+
+    if(cmdOptions.check_particle_backend){
+        bool passed = checkParticleBackend(&particleComputeShader, particleLocalSize, &threadPool, particlePositions, particleColors, particleStepParams(hostField, vectorWidthGrid, vectorHeightGrid));
+        glfwTerminate();
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // The fastest local size of particle.comp on this GPU, timed on the particles
+    if(cmdOptions.particle_local_size == "auto" && cpuParticles == NULL){
+        std::string cachePath = cmdOptions.particle_local_size_cache;
+        if(cachePath.empty())
+            cachePath = ParticleLocalSizeCache::defaultPath();
+        else if(cachePath == "none")
+            cachePath = "";
+        ParticleLocalSizeCache localSizeCache(cachePath);
+        particleLocalSize = tuneParticleLocalSize( cmdOptions.shaderPath
+                                                 , particleDefines
+                                                 , &particleComputeShader
+                                                 , cmdOptions.nbr_particles
+                                                 , std::vector<GLuint> { PARTICLE_VBO, PARTICLE_COLOR_VBO }
+                                                 , localSizeCache
+                                                 );
+    }
 
     // Particle Shader
     // ------------------------------------
     particleShader.use();
     glm::mat4 model = glm::mat4(1.0f);
     particleShader.setMat4("model", model);
+    if(compactParticles)
+        particleShader.setVec2f("u_grid_size", vectorWidthGrid - 1.0f, vectorHeightGrid - 1.0f);
 
     // Post-processing Trail Shader
     // ------------------------------------
@@ -344,11 +782,18 @@ int main(int argc, char **argv)
             unsigned int inTexture = pingPongFBOIndex;
             unsigned int outTexture = (pingPongFBOIndex + 1) % 2;
 
+            if(animateField)
+                animateVectorField(&pSystem, &threadPool, gpuFieldBuilder.get(), fieldSequence.get(), fieldMorph.get(), sparseField.get(), frameNbr);
+            if(fieldEditor)
+                editVectorField(window, &threadPool, fieldEditor.get(), scriptedEdits, &nextEdit, frameNbr);
+
             renderFrame( window
                     , frameNbr 
                     , &particleComputeShader 
+                    , particleLocalSize
                     , PARTICLE_VAO 
                     , PARTICLE_VBO 
+                    , PARTICLE_COLOR_VBO
                     , particleFBO
                     , &particleShader
                     , particleTexture
@@ -359,6 +804,8 @@ int main(int argc, char **argv)
                     , backgroundTextures
                     , &postprocessingShader
                     , POST_PROCESSING_VAO
+                    , cpuParticles.get()
+                    , &threadPool
             );
 
             pingPongFBOIndex = outTexture;
@@ -387,11 +834,18 @@ int main(int argc, char **argv)
             unsigned int inTexture = pingPongFBOIndex;
             unsigned int outTexture = (pingPongFBOIndex + 1) % 2;
 
+            if(animateField)
+                animateVectorField(&pSystem, &threadPool, gpuFieldBuilder.get(), fieldSequence.get(), fieldMorph.get(), sparseField.get(), frameNbr);
+            if(fieldEditor)
+                editVectorField(window, &threadPool, fieldEditor.get(), scriptedEdits, &nextEdit, frameNbr);
+
             renderFrame( window
                     , frameNbr 
                     , &particleComputeShader 
+                    , particleLocalSize
                     , PARTICLE_VAO 
                     , PARTICLE_VBO 
+                    , PARTICLE_COLOR_VBO
                     , particleFBO
                     , &particleShader
                     , particleTexture
@@ -402,6 +856,8 @@ int main(int argc, char **argv)
                     , backgroundTextures
                     , &postprocessingShader
                     , POST_PROCESSING_VAO
+                    , cpuParticles.get()
+                    , &threadPool
             );
 
             pingPongFBOIndex = outTexture;
@@ -427,6 +883,10 @@ int main(int argc, char **argv)
     // ------------------------------------------------------------------------
     glDeleteVertexArrays(1, &PARTICLE_VAO);
     glDeleteBuffers(1, &PARTICLE_VBO);
+    if(PARTICLE_COLOR_VBO != 0)
+        glDeleteBuffers(1, &PARTICLE_COLOR_VBO);
+    if(PARTICLE_LIFETIME_SSBO != 0)
+        glDeleteBuffers(1, &PARTICLE_LIFETIME_SSBO);
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -437,8 +897,10 @@ int main(int argc, char **argv)
 void renderFrame( GLFWwindow*  window
                 , unsigned int frameNbr
                 , Shader * particleComputeShader
+                , unsigned int particleLocalSize
                 , GLuint PARTICLE_VAO
                 , GLuint PARTICLE_VBO // Necessary???
+                , GLuint PARTICLE_COLOR_VBO
                 , GLuint particleFBO
                 , Shader *particleShader
                 , GLuint particleTexture
@@ -449,6 +911,8 @@ void renderFrame( GLFWwindow*  window
                 , GLuint backgroundTextures[]
                 , Shader *postprocessingShader
                 , GLuint POST_PROCESSING_VAO
+                , CpuParticleSystem *cpuParticles
+                , ThreadPool *threadPool
                 ){
         // per-frame time logic
         // --------------------
@@ -462,17 +926,23 @@ void renderFrame( GLFWwindow*  window
 
         // Update Particle Positions
         // ------
-        particleComputeShader->use();
-        particleComputeShader->setFloat("u_time", currentFrame);
-        particleComputeShader->setInt("u_loop_iteration", frameNbr); // TODO: REMOVE THIS!
+        if(cpuParticles != NULL){
+            // The same step on the CPU, the particles are sent to the VBO afterwards
+            cpuParticles->step(*threadPool, currentFrame, frameNbr);
+            cpuParticles->upload(*threadPool, PARTICLE_VBO, PARTICLE_COLOR_VBO);
+        } else {
+            particleComputeShader->use();
+            particleComputeShader->setFloat("u_time", currentFrame);
+            particleComputeShader->setInt("u_loop_iteration", frameNbr); // TODO: REMOVE THIS!
 
 
-        glBindVertexArray(PARTICLE_VAO);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, PARTICLE_VBO);
-        glDispatchCompute(cmdOptions.nbr_particles / cmdOptions.nbr_compute_groups, 1, 1);
+            glBindVertexArray(PARTICLE_VAO);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, PARTICLE_VBO);
+            dispatchParticles(particleLocalSize, cmdOptions.nbr_particles);
 
 
-        glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+            glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+        }
 
         // Render Particles
         // ------
@@ -548,554 +1018,590 @@ void renderFrame( GLFWwindow*  window
 
 
 
-std::function<std::tuple<float, float>(float, float, float, float)> createVectorFieldFn(unsigned int functionNbr){ 
-    auto defaultFN = [](float x, float y, float width, float height) { 
-                        return std::make_tuple(0.01 * sin(x*M_PI/9.0f), 0.01 * cos(y*M_PI/9.0f)); 
-                        };
-
-   switch(functionNbr) {
-    case 0 : return defaultFN;
-             break;       // and exits the switch
-    case 1 : return [](float x, float y, float width, float height) { 
-                        return std::make_tuple(0.01 * sin(x*M_PI/9.0f) + 0.01, 0.0); 
-                        };
-             break;
-    case 2 : return [](float x, float y, float width, float height) { 
-                        float center_x = width / 2;
-                        float center_y = height / 2;
-                        float max_length = sqrt(width*width + height*height) / 2.0;
-                        return std::make_tuple(0.01 * (x - center_x) / max_length   , 0.01 * (y - center_y) / max_length ); 
-                        };
-            break;
-    case 3 : return [](float x, float y, float width, float height) { 
-                        float sign = -1.0f + 2.0f * ((int) y % 2);
-                        return std::make_tuple(sign * 0.01, 0);
-                        };
-            break;
-    case 4 : return [](float x, float y, float width, float height) { 
-                        float x_ = x / width * 0.01;
-                        float y_ = y / height * 0.01;
-                        return std::make_tuple(x_ + y_, y_ - x_);
-                        };
-            break;
-    case 5 : return [](float x, float y, float width, float height) { 
-                        return std::make_tuple(sin(x * M_PI / 4) * 0.01, cos(y * M_PI / 4) * 0.01);
-                        };
-            break;
-    case 6 : return [](float x, float y, float width, float height) { 
-                        return std::make_tuple(atan(x - width) * 0.01, atan(y - height) * 0.01);
-                        };
-            break;
-    case 7 : return [](float x, float y, float width, float height) { 
-                        int even_x = -1 + 2 * (int(x) % 2);
-                        int even_y = -1 + 2 * (int(y) % 2);
-                        return std::make_tuple( even_x * 0.01,  even_y * 0.01);
-                        };
-            break;
-    case 8 : return [](float x, float y, float width, float height) { 
-                        int even_x = -1 + 2 * (int(x) % 2);
-                        int even_y = -1 + 2 * (int(y) % 2);
-                        return std::make_tuple( even_x * 0.01,  even_y * 0.01);
-                        };
-            break;
-    case 9 : return [](float x, float y, float width, float height) { 
-                    return std::make_tuple(sin(5.0*y + x) * 0.01, cos(5.0*x - y) * 0.01);
-                    };
-        break;
-    case 10 : return [](float x, float y, float width, float height) { 
-                    float w = 2.0*M_PI/5.;
-                    float A = 2.0;
-                    int mid_x = x - width / 2;
-                    int mid_y = y - height / 2;
-
-                    float d = sqrt(mid_x*mid_x + mid_y*mid_y) + 0.01;
-                    return std::make_tuple(A*cos(w*100/d) * 0.001, A*sin(w*100/d) * 0.001);
-                    };
-        break;
-    case 11 : return [](float x, float y, float width, float height) { 
-                    float a = 0.1;
-                    int mid_x = x - width / 2;
-                    int mid_y = y - height / 2;
-                    float r2 = mid_x * mid_x + mid_y * mid_y;
-                    //v = vec2(p.y, -x) / r2 - a * p;
-                    return std::make_tuple(0.01 * y / r2, -0.01 * x / r2);
-                    };
-        break;
-    case 12 : return [](float x, float y, float width, float height) { 
-                    float a = 0.01;
-                    int mid_x = x - width / 2;
-                    int mid_y = y - height / 2;
-                    float r2 = mid_x * mid_x + mid_y * mid_y + 0.01;
-                    //v = vec2(p.y, -x) / r2 - a * p;
-                    return std::make_tuple(a * mid_y / r2 - a * mid_x, -1.0 * a * mid_x / r2 - a * mid_y);
-                    };
-        break;
-    case 13 : return [](float x, float y, float width, float height) { 
-                    float a = 0.001;
-                    int mid_x = x - width / 2;
-                    int mid_y = y - height / 2;
-                    float r2 = mid_x * mid_x + mid_y * mid_y + 0.001;
-                    //v = vec2(p.y, -x) / r2 - a * p;
-                    return std::make_tuple(a * mid_y / r2 - a * mid_x, -1.0 * a * mid_x / r2 - a * mid_y);
-                    };
-        break;
-    case 14 : return [](float x, float y, float width, float height) { 
-                    float a = 0.001;
-                    int mid_x = x - width / 2;
-                    int mid_y = y - height / 2;
-                    return std::make_tuple(a * mid_y, -1.0 * a * mid_x);
-                    };
-        break;
-    case 15 : return [](float x, float y, float width, float height) { 
-                    float a = 0.01;
-                    float x_v = -2.0 * (int(x) % 2) + 1.0;
-                    float y_v = -2.0 * (int(y) % 2) + 1.0;
-                    return std::make_tuple(a * x_v, a * y_v);
-                    };
-        break;
-    case 16 : return [](float x, float y, float width, float height) { 
-                    float a = 0.01;
-                    float x_v = -2.0 * (int(x) % 2) + 1.0;
-                    float y_v = -2.0 * (int(y) % 2) + 1.0;
-                    return std::make_tuple(a * x_v * cos(x * M_PI * 0.236123), a * y_v * cos(y * M_PI * 0.872766836123));
-                    };
-        break;
-    case 17 : return [](float x, float y, float width, float height) { 
-                    float a = 0.01;
-                    float x_v = -2.0 * (int(x) % 2) + 1.0;
-                    float y_v = -2.0 * (int(y) % 2) + 1.0;
-                    return std::make_tuple(a * x_v * y / height, a * y_v * x / width );
-                    };
-        break;
-    case 18 : return [](float x, float y, float width, float height) { 
-                    float a = 0.01;
-                    float clip_x = 2.0 * x / width - 1.0;
-                    float clip_y = 2.0 * y / height - 1.0;
-                    return std::make_tuple(a * clip_x * clip_x / ( 0.1 + clip_y) , a *  clip_y * clip_y / ( 0.1 + clip_x)  );
-                    };
-        break;
-    case 19 : return [](float x, float y, float width, float height) { 
-                    float a = 0.01;
-                    float twirl_size = 20.0;
-                    float clip_x = 2.0 * x / width - 1.0;
-                    float clip_y = 2.0 * y / height - 1.0;
-                    float radial_exponent = 1.5;
-                    float length = sqrt(clip_x*clip_x + clip_y*clip_y);
-                    float radial_coeff = pow(length, radial_exponent);
-                    float new_x = -clip_y/length + radial_coeff*sin(twirl_size*y);
-                    float new_y =  clip_x/length + radial_coeff*cos(twirl_size*x);
-                    return std::make_tuple(a * new_x , a *  new_y  );
-                    };
-        break;
-    case 20 : return [](float x, float y, float width, float height) { 
-                float a = 0.01;
-                float twirl_size = 20.0;
-                float clip_x = 2.0 * x / width - 1.0;
-                float clip_y = 2.0 * y / height - 1.0;
-                float radial_exponent = 1.5;
-                float length = sqrt(clip_x*clip_x + clip_y*clip_y);
-                float radial_coeff = pow(length, radial_exponent);
-                float new_x =  clip_x/length + radial_coeff*sin(twirl_size*y);
-                float new_y =  clip_y/length + radial_coeff*cos(twirl_size*x);
-                return std::make_tuple(a * new_x , a *  new_y  );
-                };
-        break;
-    case 21 : return [](float x, float y, float width, float height) { 
-                float a = 0.01;
-                float twirl_size = 20.0;
-                float clip_x = 2.0 * x / width - 1.0;
-                float clip_y = 2.0 * y / height - 1.0;
-                float radial_exponent = 1.5;
-                float length = sqrt(clip_x*clip_x + clip_y*clip_y);
-                float radial_coeff = pow(length, radial_exponent);
-                float new_x =  clip_y/(length + 0.01) + radial_coeff*sin(twirl_size*x);
-                float new_y =  clip_x/(length + 0.01) + radial_coeff*sin(twirl_size*y);
-                return std::make_tuple(a * new_x , a *  new_y  );
-                };
-        break;
-    case 22 : return [](float x, float y, float width, float height) { 
-                float a = 0.01;
-                float twirl_size = 20.0;
-                float clip_x = 2.0 * x / width - 1.0;
-                float clip_y = 2.0 * y / height - 1.0;
-                float radial_exponent = 1.5;
-                float length = sqrt(clip_x*clip_x + clip_y*clip_y);
-                float radial_coeff = pow(length, radial_exponent);
-                float new_x =  -clip_y/(length + 0.01) + radial_coeff*atan(twirl_size*x);
-                float new_y =  clip_x/(length + 0.01) + radial_coeff*atan(twirl_size*y);
-                return std::make_tuple(a * new_x , a *  new_y  );
-                };
-        break;
-    case 23 : return [](float x, float y, float width, float height) { 
-                float a = 0.01;
-                float twirl_size = 40.0;
-                float clip_x = 2.0 * x / width - 1.0;
-                float clip_y = 2.0 * y / height - 1.0;
-                float radial_exponent = 1.5;
-                float length = sqrt(clip_x*clip_x + clip_y*clip_y);
-                float radial_coeff = pow(length, radial_exponent);
-                float new_x =  clip_y/(length + 0.01) + radial_coeff*sin(twirl_size*y);
-                float new_y =  -clip_x/(length + 0.01) + radial_coeff*sin(twirl_size*y);
-                return std::make_tuple(a * new_x , a *  new_y  );
-                };
-        break;
-    case 24 : return [](float x, float y, float width, float height) { 
-                    float a = 0.01;
-                    float clip_x = 2.0 * x / width - 1.0;
-                    float clip_y = 2.0 * y / height - 1.0;
-                    float f1 = sin(clip_x);
-                    float f2 = sin(2.0*clip_x);
-                    float f3 = sin(3.0*clip_x);
-                    float f4 = sin(4.0*clip_x);
-                    float f5 = sin(5.0*clip_x);
-                    float new_x = a * (f1 + 
-                        f2*clip_y/4.0 + 
-                        f3*clip_x/6.0 +
-                        f4*clip_x/8.0 +
-                        f5*clip_y/10.0);
-                    f1 = sin(clip_y);
-                    f2 = sin(2.0*clip_y);
-                    f3 = sin(3.0*clip_y);
-                    f4 = sin(4.0*clip_y);
-                    f5 = sin(5.0*clip_y);
-                    float new_y = a * (f1 + 
-                        f2*clip_y/4.0 + 
-                        f3*clip_x/6.0 +
-                        f4*clip_x/8.0 +
-                        f5*clip_y/10.0);
-
-                    return std::make_tuple(new_x , new_y  );
-                    };
-        break;
-    case 25 : return [](float x, float y, float width, float height) { 
-                    auto f = [](float x, float y){
-                        float f1 = sin(x);
-                        float f2 = sin(2.0*x);
-                        float f3 = sin(3.0*x);
-                        float f4 = sin(4.0*x);
-                        float f5 = sin(5.0*x);
-                        return (f1 + 
-                            f2*x/4.0 + 
-                            f3*y/6.0 +
-                            f4*x/8.0 +
-                            f5*y/10.0);
-                    };
-
-                    auto df = [f](float x, float y) {
-                        float h = 0.001;
-                        return (f(x+h, y)-f(x-h, y))/(2.0*h);
-                        };
-
-                    float a = 0.01;
-                    float clip_x = 2.0 * x / width - 1.0;
-                    float clip_y = 2.0 * y / height - 1.0;
-                    return std::make_tuple(a * df(clip_x, clip_y) , a * df(clip_y, clip_x));
-                    };
-        break;
-    case 26 : return [](float x, float y, float width, float height) { 
-                auto f = [](float x, float y){
-                    float f1 = sin(x);
-                    float f2 = cos(2.0*x);
-                    float f3 = sin(3.0*x);
-                    float f4 = cos(4.0*x);
-                    float f5 = sin(5.0*x);
-                    return (f1 + 
-                        f2*y/4.0 + 
-                        f3*x/6.0 +
-                        f4*x/8.0 +
-                        f5*y/10.0);
-                };
-
-                auto df = [f](float x, float y) {
-                    float h = 0.001;
-                    return (f(x+h, y)-f(x-h, y))/(2.0*h);
-                    };
-
-                float a = 0.01;
-                float clip_x = 2.0 * x / width - 1.0;
-                float clip_y = 2.0 * y / height - 1.0;
-                float twirl_size = 20.0;
-                float radial_exponent = 1.5;
-                float length = sqrt(clip_x*clip_x + clip_y*clip_y);
-                float radial_coeff = pow(length, radial_exponent);
-                float new_x =  df(clip_y, clip_x)/(length + 0.01) + radial_coeff*sin(twirl_size*y);
-                float new_y =  -df(clip_x, clip_y)/(length + 0.01) + radial_coeff*sin(twirl_size*x);
-
-                return std::make_tuple(a * new_x , a * new_y);
-                };
-        break;
-    case 27 : return [](float x, float y, float width, float height) { 
-                auto f = [](float x, float y){
-                    float f1 = sin(x);
-                    float f2 = cos(2.0*x);
-                    float f3 = sin(3.0*x);
-                    float f4 = cos(4.0*x);
-                    float f5 = sin(5.0*x);
-                    return (f1 + 
-                        f2*y/4.0 + 
-                        f3*x/6.0 +
-                        f4*x/8.0 +
-                        f5*y/10.0);
-                };
-
-                auto df = [f](float x, float y) {
-                    float h = 0.001;
-                    return (f(x+h, y)-f(x-h, y))/(2.0*h);
-                    };
-
-                float a = 0.01;
-                float clip_x = 2.0 * x / width - 1.0;
-                float clip_y = 2.0 * y / height - 1.0;
-                float twirl_size = 20.0;
-                float radial_exponent = 1.5;
-                float length = sqrt(clip_x*clip_x + clip_y*clip_y);
-                float radial_coeff = pow(length, radial_exponent);
-                float new_x =  -df(clip_y, clip_x) + radial_coeff*sin(twirl_size*y);
-                float new_y =  -df(clip_x, clip_y) + radial_coeff*sin(twirl_size*x);
-
-                return std::make_tuple(a * new_x , a * new_y);
-                };
-        break;
-    case 28 : return [](float x, float y, float width, float height) { 
-
-                float a = 0.01;
-                float clip_x = 2.0 * x / width - 1.0;
-                float clip_y = 2.0 * y / height - 1.0;
-
-                float new_x = cos(clip_x) * sin(clip_y);
-                float new_y = tanh(clip_y);
-
-                return std::make_tuple(a * new_x , a * new_y);
-                };
-        break;
-    case 29 : return [](float x, float y, float width, float height) { 
-
-                float a = 0.01;
-                float clip_x = 2.0 * x / width - 1.0;
-                float clip_y = 2.0 * y / height - 1.0;
-
-                float new_x = tanh(clip_x) * tanh(clip_y);
-                float new_y = -tanh(clip_y);
-
-                return std::make_tuple(a * new_x , a * new_y);
-                };
-        break;
-    case 30 : return [](float x, float y, float width, float height) { 
-
-                float a = 0.01;
-                float clip_x = 2.0 * x / width - 1.0;
-                float clip_y = 2.0 * y / height - 1.0;
-                float new_x = sin(tan(clip_x * M_PI / 2.12937678))*cos(tan(clip_y * M_PI / 2.12937678));
-                float new_y = sin(tan(clip_y * M_PI / 2.12937678))*cos(tan(clip_x * M_PI / 2.12937678));
-
-                return std::make_tuple(a * new_x , a * new_y);
-                };
-        break;
-    case 31 : return [](float x, float y, float width, float height) { 
-
-                float a = 0.01;
-                float clip_x = 2.0 * x / width - 1.0;
-                float clip_y = 2.0 * y / height - 1.0;
-                float new_x = sin(tan(clip_y * M_PI / 3.1976123))*cos(tan(clip_x * M_PI / 0.82734));
-                float new_y = sin(tan(clip_y * M_PI / 4.123871))*cos(tan(clip_x * M_PI / 2.7236));
-
-                return std::make_tuple(a * new_x , a * new_y);
-                };
-        break;
-    case 32 : return [](float x, float y, float width, float height) { 
-
-                float a = 0.01;
-                float clip_x = 2.0 * x / width - 1.0;
-                float clip_y = 2.0 * y / height - 1.0;
-                float p1_x = clip_x - 0.5;
-                float p1_y = clip_y;
-
-                float p2_x = clip_x + 0.5;
-                float p2_y = clip_y;
-
-                float p1_length = p1_x*p1_x + p1_y*p1_y;
-                float p2_length = p2_x*p2_x + p2_y*p2_y;
-
-                float new_x = -1.0 * (p1_y / p1_length + p2_y / p2_length);
-                float new_y = (p1_x / p1_length + p2_x / p2_length);
-
-                return std::make_tuple(a * new_x , a * new_y);
-                };
-        break;
-    case 33 : return [](float x, float y, float width, float height) { 
-
-                float a = 0.01;
-                float clip_x = 2.0 * x / width - 1.0;
-                float clip_y = 2.0 * y / height - 1.0;
-                float p1_x = clip_x - 0.5;
-                float p1_y = clip_y + 0.2;
-
-                float p2_x = clip_x + 0.5;
-                float p2_y = clip_y - 0.2;
-
-                float p1_length = p1_x*p1_x + p1_y*p1_y;
-                float p2_length = p2_x*p2_x + p2_y*p2_y;
-
-                float new_x = (p1_y / p1_length + p2_y / p2_length);
-                float new_y = -1.0 * (p1_x / p1_length + p2_x / p2_length);
-
-                return std::make_tuple(a * new_x , a * new_y);
-                };
-        break;
-    case 34 : return [](float x, float y, float width, float height) { 
-
-                float a = 0.01;
-                float clip_x = 2.0 * x / width - 1.0;
-                float clip_y = 2.0 * y / height - 1.0;
-
-                return std::make_tuple(a * clip_y * clip_y , a * clip_x * clip_x);
-                };
-        break;
-    case 35 : return [](float x, float y, float width, float height) { 
-
-                float twirl_size = 20.0;
-                float radial_exponent = 1.5;
-                float a = 0.01;
-                float clip_x = 2.0 * x / width - 1.0;
-                float clip_y = 2.0 * y / height - 1.0;
-
-                float length = sqrt(clip_x*clip_x + clip_y*clip_y);
-                float radial_coeff = pow(length, radial_exponent);
-                float new_x = clip_y * clip_y + radial_coeff*sin(twirl_size*x);
-                float new_y = clip_x * clip_x + radial_coeff*sin(twirl_size*y);
-                return std::make_tuple(a * new_x, a * new_y);
-                };
-        break;
-    case 36 : return [](float x, float y, float width, float height) { 
-
-                float twirl_size = 20.0;
-                float radial_exponent = 1.5;
-                float a = 0.01;
-                float clip_x = 2.0 * x / width - 1.0;
-                float clip_y = 2.0 * y / height - 1.0;
-
-                float length = sqrt(clip_x*clip_x + clip_y*clip_y);
-                float radial_coeff = pow(length, radial_exponent);
-                float new_x = clip_y * clip_x + radial_coeff*sin(2.0 * twirl_size*x);
-                float new_y = clip_x * clip_y + radial_coeff*cos(2.0 * twirl_size*y);
-                return std::make_tuple(a * new_x, a * new_y);
-                };
-        break;
-    case 37 : return [](float x, float y, float width, float height) { 
-                float a = 0.01;
-                glm::vec3 df = sdgArc(toClipSpace(glm::vec2(x, y), width, height), glm::vec2(0.3, 0.3), 0.5, 0.5 );
-                glm::vec2 v = turnNinetyDegrees(glm::vec2(df.y, df.z));
-                if (df.x <= 0){
-                    v = glm::vec2(df.y, df.z);
-                }
-
-                return std::make_tuple(a * v.x, a * v.y);
-                };
-        break;
-    case 38 : return [](float x, float y, float width, float height) { 
-                float a = 0.01;
-                glm::vec3 df = sdgCross(toClipSpace(glm::vec2(x, y), width, height), glm::vec2(0.3, 0.3));
-                glm::vec2 v = turnNinetyDegrees(glm::vec2(df.y, df.z));
-                if (df.x <= 0){
-                    v = glm::vec2(df.y, df.z);
-                }
-
-                return std::make_tuple(a * v.x, a * v.y);
-                };
-        break;
-    case 39 : return [](float x, float y, float width, float height) { 
-                float a = 0.01;
-                glm::vec3 df = sdgCross(toClipSpace(glm::vec2(x, y), width, height), glm::vec2(0.8, 0.3));
-                glm::vec2 v = turnNinetyDegrees(glm::vec2(df.y, df.z));
-                if (df.x <= 0){
-                    v = glm::vec2(df.y, df.z);
-                }
-
-                return std::make_tuple(a * v.x, a * v.y);
-                };
-        break;
-    case 40 : return [](float x, float y, float width, float height) { 
-                float a = 0.01;
-                glm::vec3 df = sdgArc(toClipSpace(glm::vec2(x, y), width, height),  glm::vec2(0.7, 0.3), -0.8, 0.3);
-                glm::vec2 v = turnNinetyDegrees(glm::vec2(df.y, df.z));
-                if (df.x <= 0){
-                    v = glm::vec2(df.y, df.z);
-                }
-
-                return std::make_tuple(a * v.x, a * v.y);
-                };
-        break;
+// The image of --field-image and everything that is done to it, so that a changed
+// image or option gets a field of its own in the cache.
+// ------------------------------------------------------------------------------------
+std::string fieldImageDescription(){
+    boost::system::error_code error;
+    std::time_t modified = boost::filesystem::last_write_time(cmdOptions.field_image, error);
+    uint64_t size = boost::filesystem::file_size(cmdOptions.field_image, error);
+    return cmdOptions.field_image
+         + '\n' + std::to_string(modified) + ' ' + std::to_string(size)
+         + '\n' + std::to_string(cmdOptions.field_image_blur)
+         + ' ' + cmdOptions.field_image_mode
+         + ' ' + std::to_string(cmdOptions.field_image_strength);
+}
+
 
-    }
 
-    return defaultFN;
+// The key the vector field given by the options is cached and exported under.
+// ------------------------------------------------------------------------------------
+VectorFieldCacheKey fieldCacheKey(int vectorWidthGrid, int vectorHeightGrid){
+    VectorFieldCacheKey key = !cmdOptions.field_image.empty()
+                            ? vectorFieldCacheKey("field-image", fieldImageDescription(), vectorWidthGrid, vectorHeightGrid)
+                            : !cmdOptions.field_sdf.empty()
+                            ? vectorFieldCacheKey("field-sdf", cmdOptions.field_sdf, vectorWidthGrid, vectorHeightGrid)
+                            : cmdOptions.field_x.empty()
+                            ? vectorFieldCacheKey(cmdOptions.vector_field_function, vectorWidthGrid, vectorHeightGrid)
+                            : vectorFieldCacheKey(cmdOptions.field_x, cmdOptions.field_y, vectorWidthGrid, vectorHeightGrid);
+    // A capped grid stands in for the full one, the function is sampled on that
+    if(cmdOptions.fieldResolutionCapped()){
+        key.sampleWidth = cmdOptions.fieldSampleWidth();
+        key.sampleHeight = cmdOptions.fieldSampleHeight();
+    }
+    return key;
 }
 
-// Creates a vector field width a given resolution covering the the width and height.
-// Width - the width that the vector field has to cover in pixels 
-// Height - the hight that the vector field has to cover in pixels 
-// resolution - pixels between vectors
-// padding - number of extra layers of vectors to add on each side
+// Fills a vector field covering the the width and height.
+// vectorField - the grid to fill, its data must already be allocated
+// kernel - the function to evaluate at every point of the grid
 //
-// The padding is helpfull if you want the vector field to extend beyond the screen.
+// The work is split over all threads in the pool. When the resolution is capped
+// every vector is the average of the function around it, see CmdOptions.
 // ------------------------------------------------------------------------------------
-VectorField createVectorField(int vectorWidthGrid, int vectorHeightGrid, std::function<std::tuple<float, float>(float, float, float, float)> f)
+void createVectorField(ThreadPool *threadPool, VectorFieldCache *fieldCache, VectorField *vectorField, const FieldKernel *kernel)
 {
+    VectorFieldCacheKey key = fieldCacheKey(vectorField->width, vectorField->height);
 
-    std::vector<float> vectorFieldData;
-    for (int i = 0; i < vectorWidthGrid; i++) {
-            for (int j = 0; j < vectorHeightGrid; j++) {
-                auto res = f(i, j, vectorWidthGrid, vectorHeightGrid);
-                vectorFieldData.push_back(std::get<0>(res));
-                vectorFieldData.push_back(std::get<1>(res));
-            }
-    }
+    if(fieldCache->load(key, *threadPool, *vectorField))
+        return;
 
-    return VectorField { vectorFieldData, vectorWidthGrid, vectorHeightGrid };
+    if(fieldCache->buildAndStore(key, *threadPool, *kernel, *vectorField))
+        return;
+
+    buildVectorField(*threadPool, *vectorField, *kernel, key.sampleWidth, key.sampleHeight);
 }
 
-ParticleSystem initParticleSystem(Shader *particleComputeShader, VectorField *vectorField){
-    particleComputeShader->use();
-    glCheckError(); 
-    particleComputeShader->setInt("u_width", vectorField->width);
-    glCheckError(); 
-    particleComputeShader->setInt("u_height", vectorField->height);
-    glCheckError(); 
+// The part of the grid that is stored of a vector field that repeats itself, see
+// --field-period. The period is the whole grid along an axis it does not repeat
+// along. Returns true if one period is less than the whole grid.
+// ------------------------------------------------------------------------------------
+bool fieldPeriod(const FieldKernel *kernel, int vectorWidthGrid, int vectorHeightGrid, int *periodWidth, int *periodHeight){
+    int periodX = 0;
+    int periodY = 0;
+    if(cmdOptions.fieldPeriodUsable() && !kernel->period(periodX, periodY) && cmdOptions.field_period == "auto")
+        detectFieldPeriod(*kernel, vectorWidthGrid, vectorHeightGrid, periodX, periodY);
+
+    *periodWidth = periodX > 0 ? std::min(periodX, vectorWidthGrid) : vectorWidthGrid;
+    *periodHeight = periodY > 0 ? std::min(periodY, vectorHeightGrid) : vectorHeightGrid;
+    return *periodWidth < vectorWidthGrid || *periodHeight < vectorHeightGrid;
+}
+
+// Allocates an immutable ssbo large enough for the vector field and maps it 
+// persistently so that the field can be written to it directly.
+// When it is not mapped the data of the field is NULL and only the GPU
+// can write to the ssbo. Returns false if the ssbo could not be mapped, the
+// data is then NULL too.
+// ------------------------------------------------------------------------------------
+bool allocateVectorFieldBuffer(GLuint ssbo, int vectorWidthGrid, int vectorHeightGrid, bool mapped, VectorField *vectorField){
+    GLsizeiptr nbytes = vectorFieldSize(vectorWidthGrid, vectorHeightGrid) * sizeof(float);
+    GLbitfield flags = mapped ? GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT : 0;
 
-    GLuint ssbo;
-    glGenBuffers(1, &ssbo);
-    glCheckError(); 
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
     glCheckError(); 
-    glBufferData(GL_SHADER_STORAGE_BUFFER, vectorField->data.size() * 4, vectorField->data.data(), GL_STATIC_DRAW);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, nbytes, NULL, flags);
+    glCheckError(); 
+    float * data = NULL;
+    if(mapped)
+        data = (float *) glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, nbytes, flags);
     glCheckError(); 
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, ssbo);
     glCheckError(); 
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0); // unbind
     glCheckError(); 
 
-    return ParticleSystem { particleComputeShader, vectorField, ssbo };
+    *vectorField = VectorField { data, vectorWidthGrid, vectorHeightGrid };
+    if(mapped && data == NULL){
+        std::cout << "ERROR::VECTOR_FIELD::COULD_NOT_MAP_BUFFER of size " << nbytes << std::endl;
+        return false;
+    }
+    return true;
+}
 
+// The internal format of the vector field texture given by --field-format, 0 for the ssbo.
+// ------------------------------------------------------------------------------------
+GLenum fieldTextureFormat(){
+    if(cmdOptions.field_format == "rg16f")
+        return GL_RG16F;
+    if(cmdOptions.field_format == "rg32f")
+        return GL_RG32F;
+    return 0;
 }
 
-void updateParticleSystem(ParticleSystem *particleSystem, VectorField * vectorField){
-    particleSystem->shader->use();
+// Allocates an immutable texture for the vector field and binds it to
+// FIELD_TEXTURE_UNIT. It is transposed so that it has the same layout as the
+// ssbo, the vector at (x, y) is the texel at (y, x). The texture unit wraps
+// around when it repeats, for the periods of FIELD_STORAGE_PERIODIC.
+// Returns 0 if the grid is larger than the largest texture the driver allows.
+// ------------------------------------------------------------------------------------
+GLuint createVectorFieldTexture(int vectorWidthGrid, int vectorHeightGrid, GLenum textureFormat, bool repeat){
+    GLint maxSize;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    if(vectorWidthGrid > maxSize || vectorHeightGrid > maxSize){
+        std::cout << "ERROR::VECTOR_FIELD::TEXTURE_TOO_LARGE the grid is " << vectorWidthGrid << "x" << vectorHeightGrid
+                  << " but textures can be at most " << maxSize << "x" << maxSize << ", lower '--vectors-per-ratio' or use '--field-format ssbo'" << std::endl;
+        return 0;
+    }
+
+    // 'smooth' lets the texture unit interpolate, 'min' takes the closest vector
+    GLint filter = cmdOptions.interpolation_mode == 0 ? GL_LINEAR : GL_NEAREST;
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glActiveTexture(GL_TEXTURE0 + FIELD_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, textureFormat, vectorHeightGrid, vectorWidthGrid);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+    glActiveTexture(GL_TEXTURE0);
     glCheckError(); 
-    particleSystem->shader->setInt("u_width", vectorField->width);
+
+    return texture;
+}
+
+// Copies the field the CPU built in the ssbo into the texture and deletes the ssbo.
+// The copy happens on the GPU with the ssbo as the pixel source, which is also
+// where the floats are converted to halfs for rg16f.
+// ------------------------------------------------------------------------------------
+void uploadVectorFieldTexture(ParticleSystem *particleSystem){
+    int width = particleSystem->vectorField.width;
+    int height = particleSystem->vectorField.height;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, particleSystem->ssbo);
+    glBindTexture(GL_TEXTURE_2D, particleSystem->texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, height, width, GL_RG, GL_FLOAT, (void *) 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
     glCheckError(); 
-    particleSystem->shader->setInt("u_height", vectorField->height);
+
+    // The GL keeps the buffer alive until the copy is done, deleting also unmaps it
+    glDeleteBuffers(1, &particleSystem->ssbo);
     glCheckError(); 
+    particleSystem->ssbo = 0;
+    particleSystem->vectorField.data = NULL;
+
+    glActiveTexture(GL_TEXTURE0 + FIELD_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, particleSystem->texture);
+    glActiveTexture(GL_TEXTURE0);
+}
 
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, particleSystem->ssbo);
+// periodWidth and periodHeight are the part of the grid that is stored with
+// FIELD_STORAGE_PERIODIC, see fieldPeriod(..), and are not used otherwise.
+ParticleSystem initParticleSystem(Shader *particleComputeShader, int vectorWidthGrid, int vectorHeightGrid, FieldStorage storage, GLenum textureFormat, int periodWidth, int periodHeight){
+    particleComputeShader->use();
     glCheckError(); 
-    glBufferData(GL_SHADER_STORAGE_BUFFER, vectorField->data.size() * 4, vectorField->data.data(), GL_STATIC_DRAW);
+    particleComputeShader->setInt("u_width", vectorWidthGrid);
     glCheckError(); 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, particleSystem->ssbo);
+    particleComputeShader->setInt("u_height", vectorHeightGrid);
     glCheckError(); 
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0); // unbind
+
+    // Only the first period is stored, the buffer or texture is as large as that
+    bool periodic = storage == FIELD_STORAGE_PERIODIC;
+    if(periodic){
+        particleComputeShader->setVec2i("u_field_period", periodWidth, periodHeight);
+        glCheckError(); 
+    }
+    int fieldWidth = periodic ? periodWidth : vectorWidthGrid;
+    int fieldHeight = periodic ? periodHeight : vectorHeightGrid;
+
+    // The grid only exists in the shader, any size costs nothing.
+    // A sequence, a morph, a sparse, or an adaptive field brings its own buffers,
+    // and a field on the host has none.
+    if(storage == FIELD_STORAGE_NONE || storage == FIELD_STORAGE_SEQUENCE || storage == FIELD_STORAGE_MORPH
+       || storage == FIELD_STORAGE_SPARSE || storage == FIELD_STORAGE_ADAPTIVE || storage == FIELD_STORAGE_HOST)
+        return ParticleSystem { particleComputeShader, VectorField { NULL, vectorWidthGrid, vectorHeightGrid }, 0, storage, 0 };
+
+    GLuint texture = 0;
+    if(textureFormat != 0){
+        texture = createVectorFieldTexture(fieldWidth, fieldHeight, textureFormat, periodic);
+        // The GPU writes straight into the texture
+        if(storage == FIELD_STORAGE_GPU || texture == 0)
+            return ParticleSystem { particleComputeShader, VectorField { NULL, vectorWidthGrid, vectorHeightGrid }, 0, storage, texture };
+    }
+
+    GLuint ssbo;
+    glGenBuffers(1, &ssbo);
     glCheckError(); 
+    VectorField vectorField;
+    if(!allocateVectorFieldBuffer(ssbo, fieldWidth, fieldHeight, storage == FIELD_STORAGE_MAPPED || periodic, &vectorField)){
+        glDeleteBuffers(1, &ssbo);
+        ssbo = 0;
+    }
 
-    particleSystem->vectorField = vectorField;
+    return ParticleSystem { particleComputeShader, vectorField, ssbo, storage, texture };
+
+}
+
+// The particles as particle.comp has them, the positions and colors 4 floats each.
+// Drawn from mt19937 like the NFTs were, or from Philox like particle-init.comp.
+// ------------------------------------------------------------------------------------
+void createParticles(std::vector<float> *positions, std::vector<float> *colors){
+    positions->resize(4 * (size_t) cmdOptions.nbr_particles);
+    colors->resize(4 * (size_t) cmdOptions.nbr_particles);
+
+    // To be able to reproduce a video we make sure to use a known seed
+    // so that all particles get initalized to the exact same locations.
+    boost::mt19937 rng(cmdOptions.particle_seed);    
+    boost::uniform_real<> placeDistribution(-1.0f, 1.0f);
+    boost::variate_generator<boost::mt19937&, boost::uniform_real<> >
+           rngPlace(rng, placeDistribution); 
+    const bool philox = cmdOptions.particle_init == "philox";
+
+    float timeToLive = cmdOptions.fps * cmdOptions.lengthInSeconds;
+
+    for(unsigned int i = 0; i < cmdOptions.nbr_particles; i++){
+        float * position = positions->data() + 4 * (size_t) i;
+        float * color = colors->data() + 4 * (size_t) i;
+
+        // Start position
+        if(philox){
+            particlePhiloxPosition(cmdOptions.particle_seed, i, &position[0], &position[1]);
+        } else {
+            position[0] = rngPlace();
+            position[1] = rngPlace();
+        }
+
+        // Loop
+        position[2] = 0.0f; // looping isn't used anymore...
+        position[3] = timeToLive;
+
+        // Color
+        color[0] = cmdOptions.particle_color.x;
+        color[1] = cmdOptions.particle_color.y;
+        color[2] = cmdOptions.particle_color.z;
+        color[3] = cmdOptions.particle_color.w;
+    }
+}
+
+
+
+// The particles of createParticles(..) packed like particle.comp has them with
+// --particle-format compact, drawn from the same random numbers.
+// ------------------------------------------------------------------------------------
+void createCompactParticles(CompactParticles *particles, int vectorWidthGrid, int vectorHeightGrid){
+    particles->positions.clear();
+    particles->lifetimes.clear();
+    particles->colors.clear();
+
+    boost::mt19937 rng(cmdOptions.particle_seed);    
+    boost::uniform_real<> placeDistribution(-1.0f, 1.0f);
+    boost::variate_generator<boost::mt19937&, boost::uniform_real<> >
+           rngPlace(rng, placeDistribution); 
+
+    uint32_t lifetime = compactParticleLifetime(0.0f, cmdOptions.fps * cmdOptions.lengthInSeconds);
+    uint32_t color = compactParticleColor(cmdOptions.particle_color);
+
+    particles->positions.reserve(2 * (size_t) cmdOptions.nbr_particles);
+    particles->lifetimes.assign(cmdOptions.nbr_particles, lifetime);
+    // The color is a constant attribute when it never changes
+    if(cmdOptions.colorMode != 0)
+        particles->colors.assign(cmdOptions.nbr_particles, color);
+
+    for(unsigned int i = 0; i < cmdOptions.nbr_particles; i++){
+        // As floats first, so that they start where createParticles(..) puts them
+        float x = rngPlace();
+        float y = rngPlace();
+        particles->positions.push_back(compactParticlePosition(x, vectorWidthGrid));
+        particles->positions.push_back(compactParticlePosition(y, vectorHeightGrid));
+    }
+}
+
+
+
+// The field of --particle-backend cpu, built into data. Only one period of the grid
+// when the field repeats itself.
+// ------------------------------------------------------------------------------------
+VectorField createHostVectorField(ThreadPool *threadPool, VectorFieldCache *fieldCache, const FieldKernel *kernel, int vectorWidthGrid, int vectorHeightGrid, bool periodic, int periodWidth, int periodHeight, std::vector<float> *data){
+    VectorField hostField = { NULL, vectorWidthGrid, vectorHeightGrid };
+    if(periodic){
+        hostField.width = periodWidth;
+        hostField.height = periodHeight;
+    }
+    data->resize(vectorFieldSize(hostField.width, hostField.height));
+    hostField.data = data->data();
+    if(periodic)
+        buildPeriodicVectorField(*threadPool, hostField, *kernel, vectorWidthGrid, vectorHeightGrid);
+    else
+        createVectorField(threadPool, fieldCache, &hostField, kernel);
+    return hostField;
+}
+
+
+
+// The uniforms of particle.comp for the particles of --particle-backend cpu, which
+// read the field from hostField. It is one period of the grid when it is smaller.
+// ------------------------------------------------------------------------------------
+ParticleStepParams particleStepParams(const VectorField &hostField, int vectorWidthGrid, int vectorHeightGrid){
+    ParticleStepParams params;
+    params.field = hostField.data;
+    params.fieldWidth = hostField.width;
+    params.fieldHeight = hostField.height;
+    params.gridWidth = vectorWidthGrid;
+    params.gridHeight = vectorHeightGrid;
+    params.speedFactor = cmdOptions.speed * 30.0f / cmdOptions.fps;
+    params.time = 0.0f;
+    params.probabilityToDie = cmdOptions.probability_to_die;
+    params.loop = false;
+    params.loopIteration = 0.0f;
+    params.interpolationMode = cmdOptions.interpolation_mode;
+    params.colorMode = cmdOptions.colorMode;
+    for(int c = 0; c < 3; c++){
+        params.aa[c] = cmdOptions.cosColorBase[c];
+        params.bb[c] = cmdOptions.cosColorAmplitude[c];
+        params.cc[c] = cmdOptions.cosColorSpeed[c];
+        params.dd[c] = cmdOptions.cosColorOffset[c];
+    }
+    params.angleVector[0] = cmdOptions.cosColorAnglePos.x;
+    params.angleVector[1] = cmdOptions.cosColorAnglePos.y;
+    return params;
+}
+
+// Compares the particles of --particle-backend cpu with particle.comp, for
+// --check-particle-backend. Every frame both move the particles on from where
+// particle.comp left them, a step apart can't be compared with the steps after it:
+// the random deaths are seeded by the positions, so the last bit of a position sends
+// a particle somewhere else. The frame passes when at least 99% of the particles
+// are within the tolerances, the rest are the deaths decided by that last bit.
+// With --particle-init philox particle-init.comp must also start every particle on
+// exactly the same bits as the CPU.
+// ------------------------------------------------------------------------------------
+bool checkParticleBackend(Shader *particleComputeShader, unsigned int particleLocalSize, ThreadPool *threadPool, const std::vector<float> &positions, const std::vector<float> &colors, const ParticleStepParams &params){
+    const unsigned int nbrFrames = 30;
+    const float positionTolerance = 1e-5f;
+    const float colorTolerance = 1e-3f;
+    const size_t nbrChecked = positions.size() / 4;
+
+    std::cout << "Checking the CPU particles against particle.comp on " << glGetString(GL_RENDERER)
+              << " (" << nbrChecked << " particles, " << fieldIsaName(activeFieldIsa()) << ")" << std::endl;
+
+    // The field the CPU reads, for particle.comp
+    GLuint buffers[3];
+    glGenBuffers(3, buffers);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[0]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, vectorFieldSize(params.fieldWidth, params.fieldHeight) * sizeof(float), params.field, GL_STATIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, buffers[0]);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[1]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, positions.size() * sizeof(float), positions.data(), GL_DYNAMIC_COPY);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffers[1]);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[2]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, colors.size() * sizeof(float), colors.data(), GL_DYNAMIC_COPY);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, buffers[2]);
+    glCheckError();
+
+    std::vector<float> gpuPositions(positions), gpuColors(colors);
+    bool seedsAgree = true;
+    if(cmdOptions.particle_init == "philox"){
+        GPUParticleSeeder seeder(cmdOptions.shaderPath, false);
+        seeder.seed( buffers[1]
+                   , buffers[2]
+                   , 0
+                   , positions.size() / 4
+                   , cmdOptions.particle_seed
+                   , cmdOptions.fps * cmdOptions.lengthInSeconds
+                   , cmdOptions.particle_color
+                   , params.gridWidth
+                   , params.gridHeight
+                   );
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[1]);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, gpuPositions.size() * sizeof(float), gpuPositions.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[2]);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, gpuColors.size() * sizeof(float), gpuColors.data());
+        glCheckError();
+
+        size_t nbrDifferent = 0;
+        for(size_t i = 0; i < positions.size(); i++)
+            nbrDifferent += gpuPositions[i] != positions[i] || gpuColors[i] != colors[i];
+        seedsAgree = nbrDifferent == 0;
+        if(seedsAgree)
+            std::cout << "    particle-init.comp starts every particle where the CPU does" << std::endl;
+        else
+            std::cout << "    particle-init.comp starts " << nbrDifferent << " values of the particles somewhere else than the CPU  FAILED" << std::endl;
+    }
+
+    particleComputeShader->use();
+    if(params.fieldWidth < params.gridWidth || params.fieldHeight < params.gridHeight)
+        particleComputeShader->setVec2i("u_field_period", params.fieldWidth, params.fieldHeight);
+
+    std::vector<float> cpuPositions(positions.size()), cpuColors(colors.size());
+    float worstShare = 1.0f;
+    float maxPositionDiff = 0.0f;
+    float maxColorDiff = 0.0f;
+    for(unsigned int frame = 0; frame < nbrFrames; frame++){
+        float time = (float) frame / cmdOptions.fps;
+
+        CpuParticleSystem cpuParticles(gpuPositions, gpuColors, params);
+        cpuParticles.step(*threadPool, time, frame);
+        cpuParticles.interleave(*threadPool, cpuPositions.data(), cpuColors.data());
+
+        particleComputeShader->setFloat("u_time", time);
+        particleComputeShader->setInt("u_loop_iteration", frame);
+        dispatchParticles(particleLocalSize, nbrChecked);
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        // The binding base above also changed the generic binding
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[1]);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, gpuPositions.size() * sizeof(float), gpuPositions.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[2]);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, gpuColors.size() * sizeof(float), gpuColors.data());
+        glCheckError();
+
+        size_t nbrClose = 0;
+        for(size_t i = 0; i < nbrChecked; i++){
+            float positionDiff = std::max(std::abs(gpuPositions[4 * i] - cpuPositions[4 * i]), std::abs(gpuPositions[4 * i + 1] - cpuPositions[4 * i + 1]));
+            float colorDiff = 0.0f;
+            for(int c = 0; c < 4; c++)
+                colorDiff = std::max(colorDiff, std::abs(gpuColors[4 * i + c] - cpuColors[4 * i + c]));
+            bool close = positionDiff <= positionTolerance && colorDiff <= colorTolerance;
+            nbrClose += close;
+            if(close){
+                maxPositionDiff = std::max(maxPositionDiff, positionDiff);
+                maxColorDiff = std::max(maxColorDiff, colorDiff);
+            }
+        }
+        worstShare = std::min(worstShare, nbrChecked > 0 ? (float) nbrClose / nbrChecked : 1.0f);
+    }
+    glDeleteBuffers(3, buffers);
+
+    bool passed = worstShare >= 0.99f;
+    std::cout << "    " << worstShare * 100.0f << "% of the particles agree in the worst of " << nbrFrames << " frames"
+              << ", those are at most " << maxPositionDiff << " apart and their colors " << maxColorDiff
+              << (passed ? "" : "  FAILED") << std::endl;
+    return passed && seedsAgree;
+}
+
+// --render-backend cpu: moves and draws the particles on every core, without a window
+// or OpenGL, and records and screenshots the frames like the render loop in main(..).
+// The particles die by the time of the frame rather than the clock, so the same
+// options always give the same video.
+// ------------------------------------------------------------------------------------
+int renderOnCpu(const FieldKernel *kernel, bool fieldPeriodic, int fieldPeriodWidth, int fieldPeriodHeight){
+    ThreadPool threadPool(cmdOptions.nbr_threads);
+    VectorFieldCache fieldCache(cmdOptions.field_cache, (uint64_t) cmdOptions.field_cache_max_mb * 1024 * 1024);
+
+    int vectorWidthGrid = fieldPeriodic ? cmdOptions.fieldSampleWidth() : cmdOptions.vectorGridWidth();
+    int vectorHeightGrid = fieldPeriodic ? cmdOptions.fieldSampleHeight() : cmdOptions.vectorGridHeight();
+    std::vector<float> hostFieldData;
+    VectorField hostField = createHostVectorField(&threadPool, &fieldCache, kernel, vectorWidthGrid, vectorHeightGrid, fieldPeriodic, fieldPeriodWidth, fieldPeriodHeight, &hostFieldData);
+
+    std::vector<float> particlePositions, particleColors;
+    createParticles(&particlePositions, &particleColors);
+    CpuParticleSystem particles(particlePositions, particleColors, particleStepParams(hostField, vectorWidthGrid, vectorHeightGrid));
+    SoftwareRenderer renderer( cmdOptions.width()
+                             , cmdOptions.height()
+                             , cmdOptions.point_size
+                             , cmdOptions.background_color
+                             , cmdOptions.trail_mix_rate
+                             );
+
+    unsigned int numberOfFramesToRecord = cmdOptions.fps * cmdOptions.lengthInSeconds;
+    unsigned int numberOfFramesToDelay =  cmdOptions.fps * cmdOptions.delayInSeconds;
+    unsigned int numberOfFrames = cmdOptions.record ? numberOfFramesToRecord + numberOfFramesToDelay : numberOfFramesToRecord;
+
+    ScreenShooter screenShooter;
+    unsigned int frameToScreenShot = cmdOptions.fps * cmdOptions.screenshotDelay;
+
+    std::unique_ptr<VideoCapture> videoCapture;
+    if(cmdOptions.record){
+        videoCapture.reset(new VideoCapture( cmdOptions.outFileName.c_str()
+                                           , cmdOptions.width()
+                                           , cmdOptions.height()
+                                           , cmdOptions.fps
+                                           , 8000000
+                                           , cmdOptions.crf
+                                           , cmdOptions.preset
+                                           , cmdOptions.tune
+                                           , false
+                                           ));
+    }
+
+    unsigned int frameNbr = 0;
+    while(frameNbr != numberOfFrames){
+        particles.step(threadPool, (float) frameNbr / cmdOptions.fps, frameNbr);
+        renderer.render(threadPool, particles, frameNbr);
+
+        frameNbr += 1;
+
+        if(videoCapture && numberOfFramesToDelay < frameNbr)
+            videoCapture->recordFrame(renderer.pixels());
+
+        if(frameToScreenShot == frameNbr && cmdOptions.screenshot)
+            screenShooter.screenshot(cmdOptions.screenshotFileName.c_str(), cmdOptions.width(), cmdOptions.height(), renderer.pixels());
+    }
+
+    if(videoCapture)
+        videoCapture->close();
+    return EXIT_SUCCESS;
+}
+
+// Makes the edits of --field-edits that are due before this frame, and with
+// --field-brush pulls the field along with the mouse while the left button is
+// held. Only the rectangle under an edit is rebuilt and written to the field.
+// ------------------------------------------------------------------------------------
+void editVectorField(GLFWwindow *window, ThreadPool *threadPool, FieldEditor *fieldEditor, const std::vector<ScriptedFieldEdit> &scriptedEdits, size_t *nextEdit, unsigned int frameNbr){
+    for(; *nextEdit < scriptedEdits.size() && scriptedEdits[*nextEdit].frame <= frameNbr; (*nextEdit)++)
+        fieldEditor->apply(*threadPool, scriptedEdits[*nextEdit].edit);
+
+    if(!cmdOptions.field_brush)
+        return;
+
+    // Where the mouse was the last frame, in vectors, if the button was held
+    static bool dragging = false;
+    static float lastX = 0.0f;
+    static float lastY = 0.0f;
+
+    // The simulation is drawn in the bottom left corner of the window, see framebuffer_size_callback(..)
+    double cursorX, cursorY;
+    int windowWidth, windowHeight, framebufferWidth, framebufferHeight;
+    glfwGetCursorPos(window, &cursorX, &cursorY);
+    glfwGetWindowSize(window, &windowWidth, &windowHeight);
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    float pixelX = cursorX * framebufferWidth / std::max(windowWidth, 1);
+    float pixelY = framebufferHeight - cursorY * framebufferHeight / std::max(windowHeight, 1);
+    float x = pixelX / cmdOptions.width() * (cmdOptions.vectorGridWidth() - 1);
+    float y = pixelY / cmdOptions.height() * (cmdOptions.vectorGridHeight() - 1);
+
+    bool pressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    float dx = x - lastX;
+    float dy = y - lastY;
+    float length = std::sqrt(dx * dx + dy * dy);
+    if(pressed && dragging && length > 0.0f){
+        FieldEdit edit;
+        edit.x = x;
+        edit.y = y;
+        edit.radius = cmdOptions.field_brush_radius * cmdOptions.vectorGridHeight();
+        edit.strength = 0.5f;
+        edit.kernel = NULL;
+        edit.targetX = cmdOptions.field_brush_strength * dx / length;
+        edit.targetY = cmdOptions.field_brush_strength * dy / length;
+        fieldEditor->apply(*threadPool, edit);
+    }
+
+    dragging = pressed;
+    lastX = x;
+    lastY = y;
+}
+
+// Moves an animated vector field to where it is at the given frame. Frames
+// rather than the clock are used so that recordings come out the same.
+// ------------------------------------------------------------------------------------
+void animateVectorField(ParticleSystem *particleSystem, ThreadPool *threadPool, GPUFieldBuilder *gpuFieldBuilder, VectorFieldSequence *fieldSequence, VectorFieldMorph *fieldMorph, SparseVectorField *sparseField, unsigned int frameNbr){
+    float fieldTime = (float) frameNbr / cmdOptions.fps;
+
+    if(particleSystem->storage == FIELD_STORAGE_SEQUENCE){
+        fieldSequence->update(particleSystem->shader, frameNbr);
+    } else if(particleSystem->storage == FIELD_STORAGE_MORPH){
+        fieldMorph->update(particleSystem->shader, frameNbr);
+    } else if(particleSystem->storage == FIELD_STORAGE_SPARSE){
+        sparseField->update(*threadPool, frameNbr);
+    } else if(particleSystem->storage == FIELD_STORAGE_NONE){
+        particleSystem->shader->use();
+        particleSystem->shader->setFloat("u_field_time", fieldTime);
+    } else if(particleSystem->storage == FIELD_STORAGE_GPU){
+        GLuint field = particleSystem->texture != 0 ? particleSystem->texture : particleSystem->ssbo;
+        gpuFieldBuilder->build(field, particleSystem->vectorField.width, particleSystem->vectorField.height, fieldTime);
+    }
 }
 
 glm::vec4 fromHexColor(std::string hexColor){